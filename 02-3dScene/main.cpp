@@ -4,14 +4,31 @@
  */
 
 #include <cstdio>
+#include <cstring>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/transform.hpp>
 
+#include "Benchmark.h"
+#include "BlockCompression.h"
 #include "Camera.h"
+#include "CameraPath.h"
+#include "CpuProfiler.h"
+#include "DynamicResolution.h"
+#include "FrameStats.h"
+#include "Frustum.h"
 #include "Geometry.h"
+#include "MaterialLibrary.h"
+#include "MeshletCuller.h"
+#include "GLStateCache.h"
+#include "GpuProfiler.h"
+#include "PersistentRing.h"
+#include "RenderQueue.h"
+#include "RenderTargetPool.h"
+#include "TextureLoader.h"
 #include "Textures.h"
+#include "ThreadPool.h"
 
 #include "shaders.h"
 
@@ -32,6 +49,9 @@ enum class WindowParams : int
 
 // ----------------------------------------------------------------------------
 
+// Shadow of the GL state, filters out redundant state changes
+GLStateCache glState;
+
 // Near clip plane settings
 float nearClipPlane = 0.01f;
 // Far clip plane settings
@@ -55,47 +75,132 @@ struct MouseStatus
   }
 } mouseStatus = {0.0};
 
-struct FrameBuffer
-{
-    GLuint handle;
-    GLuint color;
-    GLuint depth_stencil;
-};
-
 // ----------------------------------------------------------------------------
 
-// Max buffer length
-static const unsigned int MAX_BUFFER_LENGTH = 256;
 // Main window handle
 GLFWwindow *mainWindow = nullptr;
+// Current size of the window framebuffer
+int windowWidth = (int)WindowParams::Width;
+int windowHeight = (int)WindowParams::Height;
 
 // Camera instance
 Camera camera;
 
+// Number of frames rendered so far
+int renderedFrames = 0;
+
 // Meshes
-Mesh<Vertex_Pos_Tex>* quad = nullptr;
-Mesh<Vertex_Pos_Tex>* pool = nullptr;
-Mesh<Vertex_Pos_Tex>* cube = nullptr;
-Mesh<Vertex_Pos_Tex>* skyBox = nullptr;
+Mesh<Vertex_Pos_Tex_Packed>* quad = nullptr;
+Mesh<Vertex_Pos_Tex_Packed>* pool = nullptr;
+Mesh<Vertex_Pos_Tex_Packed>* cube = nullptr;
+Mesh<Vertex_Pos_Tex_Packed>* skyBox = nullptr;
 
 // Textures helper instance
 Textures& textures(Textures::GetInstance());
+// Decodes the textures on the worker threads, they hold a placeholder until uploaded
+TextureLoader textureLoader;
 
 // Texture we'll be using
 GLuint waterNormal = 0;
 GLuint waterDuDv = 0;
+// Block format of the two channel water maps, the shader rebuilds z of BC5 normals
+BlockFormat waterMapFormat = BlockFormat::None;
 GLuint testTex = 0;
 GLuint checkerTex = 0;
 GLuint terracotaTex = 0;
 GLuint skyTex = 0;
 
+// Materials of the scene geometry, the shaders look the textures up by the material index
+MaterialLibrary materials;
+int checkerMaterial = 0;
+int testMaterial = 0;
+int terracotaMaterial = 0;
+int skyMaterial = 0;
+// First texture unit and the storage buffer binding of the materials
+constexpr GLuint materials_unit = 5;
+constexpr GLuint materials_binding = 1;
+
 // Texture sampler to use
 Sampler activeSampler = Sampler::Nearest;
 
-// Framebuffers
+// Offscreen render targets, (re)allocated to match the window size
+RenderTargetPool renderTargets;
+
+// Framebuffers acquired from the pool for the current frame
 FrameBuffer reflection = {0};
 FrameBuffer refraction = {0};
 
+// Resolution of the offscreen targets relative to the window, the water shader
+// distorts them anyway so they don't need the full resolution
+float reflectionScale = 1.0f;
+float refractionScale = 1.0f;
+
+// Scales the resolution of all passes at runtime to fit the GPU frame budget. The
+// targets are allocated for the unscaled resolution and the passes render into a
+// part of them, so the scales can change every frame without reallocations
+DynamicResolution dynamicResolution;
+// Budget used when dynamic resolution is toggled on
+float gpuBudget = 16.6f;
+// Window sized target for the main view while the dynamic resolution is on
+FrameBuffer mainView = {0};
+// Vertex array of the fullscreen triangle stretching the main view to the window, the
+// vertices are generated by the shader
+GLuint compositeVao = 0;
+
+// Render the refraction and reflection views in a single layered pass, it's used when
+// both have the same resolution scale so that they fit into one texture array
+bool layeredViews = true;
+// Layered target holding the refraction (layer 0) and reflection (layer 1) view
+FrameBuffer offscreenViews = {0};
+// The render helpers draw into all views of the layered pass at once
+bool renderingLayered = false;
+
+// Per-view shader data, layout of the View uniform block (std140)
+struct ViewData
+{
+  glm::mat4 worldToView;
+  glm::mat4 projection;
+  glm::mat4 worldToClip;
+  glm::vec4 cameraPosWorld;
+  glm::vec4 clippingPlane;
+  glm::vec2 nearFar;
+  glm::vec2 padding;
+};
+
+// Maximum number of views and draws per frame
+constexpr int max_frame_views = 16;
+constexpr int max_frame_draws = 1024;
+
+// Per-view data of the frame, bound as a uniform buffer range once per pass
+PersistentRing viewData;
+// Instance data of the frame, bound as a storage buffer once per frame and indexed by
+// the base instance and instance ID of each draw
+PersistentRing instanceData;
+// Multi draw indirect commands of the frame, bound as the draw indirect buffer
+PersistentRing drawCommands;
+
+// Stages of the scene draws, the render queue issues them in this order
+enum RenderStage : unsigned int
+{
+  // the pool writing the stencil mask of the ground
+  StageMask,
+  // the ground around the pool
+  StageGround,
+  // opaque geometry sorted front to back
+  StageOpaque,
+  // the sky fills whatever is left, early depth test rejects everything hidden
+  StageSky,
+};
+
+// Draws of the current pass
+RenderQueue renderQueue;
+// Culls the meshlets of the draws of the current pass before they reach the queue
+MeshletCuller meshletCuller;
+// Worker threads the meshlets are culled by
+ThreadPool threadPool;
+// Viewer position the draws of the current pass are sorted by
+glm::vec3 queueOrigin = glm::vec3(0.0f);
+
 // Control variables
 constexpr float water_height = 0.8f;
 constexpr float ground_height = 1.0f;
@@ -104,14 +209,72 @@ constexpr float pool_width = 4.0f;
 constexpr float pool_length = 8.0f;
 constexpr float pool_depth = 2.0f; // this has to be a whole number for some reason or the pool gets placed wrong
 constexpr float wave_speed = 0.02f;
+constexpr float distortion_strength = 0.01f; // in texture coordinates
 float wave_offset = 0.0f;
-glm::vec4 clipping_plane(0.0f, -1.0f, 0.0f, 0.0f);
 
 // Vsync on?
 bool vsync = true;
+// Backface culling on? Set up by the main pass stages, the mask stage draws both sides
+bool backFaceCulling = true;
+
+// Occlusion query of the water surface, the offscreen passes of the next frame are
+// rendered conditionally on its result
+GLuint waterQuery = 0;
+// The query has been issued since the water last entered the view frustum
+bool waterQueryIssued = false;
+// Skip the offscreen passes when the water was hidden in the previous frame?
+bool occlusionCulling = true;
+
+// Benchmark run settings
+BenchmarkSettings benchmark;
+// Camera path being recorded or replayed
+CameraPath cameraPath;
+
+// Per-pass GPU timings
+GpuProfiler gpuProfiler;
+
+// Frame time statistics of the interactive run
+FrameStats frameStats;
 
 // ----------------------------------------------------------------------------
-FrameBuffer createFramebuffer(int width, int height, bool depth_texture);
+
+// Returns the size of an offscreen target scaled relative to the window
+int scaledSize(int size, float scale)
+{
+  const int scaled = (int)(size * scale + 0.5f);
+  return scaled > 0 ? scaled : 1;
+}
+
+// Cycles the resolution scale through full, half and quarter resolution
+float nextScale(float scale)
+{
+  if (scale > 0.75f)
+    return 0.5f;
+  if (scale > 0.375f)
+    return 0.25f;
+  return 1.0f;
+}
+
+// Prints the video memory taken by the materials and the water maps against the budget,
+// returns false when it's over the budget
+bool printTextureMemory()
+{
+  materials.PrintMemoryUsage();
+  Textures::PrintMemoryUsage("waterNormal", waterNormal);
+  Textures::PrintMemoryUsage("waterDuDv", waterDuDv);
+
+  const size_t total = materials.GetMemoryUsage() + Textures::GetMemoryUsage(waterNormal) + Textures::GetMemoryUsage(waterDuDv);
+  const double totalMB = total / (1024.0 * 1024.0);
+  if (benchmark.textureBudget <= 0.0f)
+  {
+    printf("Textures total: %.2f MB\n", totalMB);
+    return true;
+  }
+
+  const bool withinBudget = totalMB <= benchmark.textureBudget;
+  printf("Textures total: %.2f MB of %.2f MB budget%s\n", totalMB, benchmark.textureBudget, withinBudget ? "" : ", over budget!");
+  return withinBudget;
+}
 
 // Callback for handling GLFW errors
 void errorCallback(int error, const char* description)
@@ -122,6 +285,14 @@ void errorCallback(int error, const char* description)
 // Callback for handling window resize events
 void resizeCallback(GLFWwindow* window, int width, int height)
 {
+  // Minimized window, keep the last usable size
+  if (width <= 0 || height <= 0)
+    return;
+
+  // Offscreen targets follow on the next frame, the pool reallocates them lazily
+  windowWidth = width;
+  windowHeight = height;
+
   glViewport(0, 0, width, height);
   camera.SetProjection(45.0f, (float)width / (float)height, nearClipPlane, farClipPlane);
 }
@@ -144,10 +315,10 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
   // Enable/disable MSAA - note that it still uses the MSAA buffer
   if (key == GLFW_KEY_F1 && action == GLFW_PRESS)
   {
-    if (glIsEnabled(GL_MULTISAMPLE))
-      glDisable(GL_MULTISAMPLE);
+    if (glState.IsEnabled(GL_MULTISAMPLE))
+      glState.Disable(GL_MULTISAMPLE);
     else
-      glEnable(GL_MULTISAMPLE);
+      glState.Enable(GL_MULTISAMPLE);
   }
 
   // Enable/disable wireframe rendering
@@ -164,19 +335,20 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
   // Enable/disable backface culling
   if (key == GLFW_KEY_F3 && action == GLFW_PRESS)
   {
-    if (glIsEnabled(GL_CULL_FACE))
-      glDisable(GL_CULL_FACE);
+    backFaceCulling = !backFaceCulling;
+    if (backFaceCulling)
+      glState.Enable(GL_CULL_FACE);
     else
-      glEnable(GL_CULL_FACE);
+      glState.Disable(GL_CULL_FACE);
   }
 
   // Enable/disable depth test
   if (key == GLFW_KEY_F4 && action == GLFW_PRESS)
   {
-    if (glIsEnabled(GL_DEPTH_TEST))
-      glDisable(GL_DEPTH_TEST);
+    if (glState.IsEnabled(GL_DEPTH_TEST))
+      glState.Disable(GL_DEPTH_TEST);
     else
-      glEnable(GL_DEPTH_TEST);
+      glState.Enable(GL_DEPTH_TEST);
   }
 
   // Enable/disable vsync
@@ -188,26 +360,168 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
     else
       glfwSwapInterval(0);
   }
+
+  // Print GPU pass timings and GL state call counts, dump the last frames for chrome://tracing
+  if (key == GLFW_KEY_F6 && action == GLFW_PRESS)
+  {
+    gpuProfiler.PrintStats();
+    gpuProfiler.WriteChromeTrace("gpu_trace.json");
+    glState.PrintCounters(renderedFrames);
+    renderQueue.PrintCounters(renderedFrames);
+    meshletCuller.PrintCounters(renderedFrames);
+  }
+
+  // Print video memory taken by the offscreen render targets, materials and meshes, with
+  // shift the mesh arenas are defragmented first
+  if (key == GLFW_KEY_F7 && action == GLFW_PRESS)
+  {
+    if (mods & GLFW_MOD_SHIFT)
+      MeshArenaBase::DefragmentAll();
+    renderTargets.PrintMemoryUsage();
+    printTextureMemory();
+    MeshArenaBase::PrintAllOccupancy();
+  }
+
+  // Cycle the reflection resolution
+  if (key == GLFW_KEY_F8 && action == GLFW_PRESS)
+  {
+    reflectionScale = nextScale(reflectionScale);
+    printf("Reflection scale: %.2f\n", reflectionScale);
+  }
+
+  // Cycle the refraction resolution
+  if (key == GLFW_KEY_F9 && action == GLFW_PRESS)
+  {
+    refractionScale = nextScale(refractionScale);
+    printf("Refraction scale: %.2f\n", refractionScale);
+  }
+
+  // Enable/disable dynamic resolution
+  if (key == GLFW_KEY_F10 && action == GLFW_PRESS)
+  {
+    dynamicResolution.SetBudget(dynamicResolution.IsEnabled() ? 0.0f : gpuBudget);
+    printf("Dynamic resolution: %s\n", dynamicResolution.IsEnabled() ? "on" : "off");
+  }
+
+  // Enable/disable skipping the offscreen passes when the water is occluded
+  if (key == GLFW_KEY_F11 && action == GLFW_PRESS)
+  {
+    occlusionCulling = !occlusionCulling;
+    waterQueryIssued = false;
+    printf("Occlusion culling: %s\n", occlusionCulling ? "on" : "off");
+  }
+
+  // Switch between the layered and separate refraction/reflection passes
+  if (key == GLFW_KEY_F12 && action == GLFW_PRESS)
+  {
+    layeredViews = !layeredViews;
+    printf("Layered views: %s\n", layeredViews ? "on" : "off");
+  }
 }
 
-// Helper method for creating scene geometry
-void createGeometry()
+// Returns the world space bounds of the water surface
+AABB waterBounds()
 {
+  return {glm::vec3(-pool_width / 2.0f, water_height, -pool_length / 2.0f),
+          glm::vec3(pool_width / 2.0f, water_height, pool_length / 2.0f)};
+}
+
+// Returns the scissor box (x, y, width, height) covering the part of a width x height
+// viewport the water shader samples, i.e., the screen rectangle of the water grown by
+// the distortion, mirrored vertically for the reflection
+glm::ivec4 waterScissor(const glm::vec4& waterRect, int width, int height, bool mirror)
+{
+  glm::vec4 rect = waterRect + glm::vec4(-distortion_strength, -distortion_strength, distortion_strength, distortion_strength);
+  if (mirror)
+    rect = glm::vec4(rect.x, 1.0f - rect.w, rect.z, 1.0f - rect.y);
+
+  // a texel more for the bilinear filter and the depth aware upsampling
+  const int x0 = glm::clamp((int)floorf(rect.x * width) - 1, 0, width);
+  const int y0 = glm::clamp((int)floorf(rect.y * height) - 1, 0, height);
+  const int x1 = glm::clamp((int)ceilf(rect.z * width) + 1, x0, width);
+  const int y1 = glm::clamp((int)ceilf(rect.w * height) + 1, y0, height);
+
+  return glm::ivec4(x0, y0, x1 - x0, y1 - y0);
+}
+
+// Helper method for creating scene geometry, fails when the materials can't be built
+bool createGeometry()
+{
+    // Start decoding the textures, everything else is prepared meanwhile. The water maps
+    // start flat: the normal points up and the distortion is zero
+    waterNormal = textureLoader.Load("waterNormal.jpg", false, glm::vec3(0.5f, 0.5f, 1.0f), waterMapFormat, true);
+    waterDuDv = textureLoader.Load("waterDisplacement.png", false, glm::vec3(0.5f, 0.5f, 0.0f), waterMapFormat);
+    testTex = textureLoader.Load("debugUV.png", false);
+    terracotaTex = textureLoader.Load("brickWall.jpg", false);
+    skyTex = textureLoader.Load("sky_seamless_texture_5893.jpg", false);
+
     // Prepare meshes
-    quad = Geometry::CreateQuadTex();
-    pool = Geometry::CreatePoolTex();
-    cube = Geometry::CreateCubeTex();
-    skyBox = Geometry::CreateCubeTexInsideOut();
+    quad = Geometry::CreateQuadTex<Vertex_Pos_Tex_Packed>();
+    pool = Geometry::CreatePoolTex<Vertex_Pos_Tex_Packed>();
+    cube = Geometry::CreateCubeTex<Vertex_Pos_Tex_Packed>();
+    skyBox = Geometry::CreateCubeTexInsideOut<Vertex_Pos_Tex_Packed>();
     
     // Prepare textures
-    waterNormal = Textures::LoadTexture("waterNormal.jpg", false);
-    waterDuDv = Textures::LoadTexture("waterDisplacement.png", false);
-    checkerTex = Textures::CreateCheckerBoardTexture(256, 16);
-    testTex = Textures::LoadTexture("debugUV.png", false);
-    terracotaTex = Textures::LoadTexture("brickWall.jpg", false);
-    skyTex = Textures::LoadTexture("sky_seamless_texture_5893.jpg", false);
+    checkerTex = Textures::CreateCheckerBoardTexture(256, 16, Textures::CHECKER_ODD_COLOR, Textures::CHECKER_EVEN_COLOR, true,
+                                                     benchmark.mipFilter, &threadPool);
+
+    // the materials copy their textures, those have to be loaded by now, the water
+    // maps are uploaded whenever they're ready
+    textureLoader.Wait(testTex);
+    textureLoader.Wait(terracotaTex);
+    textureLoader.Wait(skyTex);
+
+    checkerMaterial = materials.Add(checkerTex);
+    testMaterial = materials.Add(testTex);
+    terracotaMaterial = materials.Add(terracotaTex);
+    skyMaterial = materials.Add(skyTex);
+    if (!materials.Build(glState, 1024))
+        return false;
+
+    // the materials hold their own copies
+    glDeleteTextures(1, &checkerTex);
+    glDeleteTextures(1, &testTex);
+    glDeleteTextures(1, &terracotaTex);
+    glDeleteTextures(1, &skyTex);
+    checkerTex = testTex = terracotaTex = skyTex = 0;
     
     textures.CreateSamplers();
+    return true;
+}
+
+// Builds the tessellated water grids of a few sizes, the builder prints how the
+// optimization changed their vertex cache statistics. Every other grid is freed then,
+// the holes left in the mesh arena are closed by defragmenting it
+bool benchmarkMeshes()
+{
+  const int sizes[] = {16, 64, 128, 256};
+  const int count = (int)(sizeof(sizes) / sizeof(sizes[0]));
+  Mesh<Vertex_Pos_Tex_Packed>* grids[count] = {};
+  bool result = true;
+  for (int i = 0; i < count && result; ++i)
+  {
+    printf("Water grid of %dx%d patches:\n", sizes[i], sizes[i]);
+    const double start = glfwGetTime();
+    grids[i] = Geometry::CreateQuadGrid<Vertex_Pos_Tex_Packed>(sizes[i]);
+    result = grids[i] != nullptr;
+    printf("Built in %.2f ms\n", (glfwGetTime() - start) * 1000.0);
+  }
+
+  for (int i = 0; i < count; i += 2)
+  {
+    delete grids[i];
+    grids[i] = nullptr;
+  }
+  MeshArenaBase::PrintAllOccupancy();
+  const double start = glfwGetTime();
+  MeshArenaBase::DefragmentAll();
+  glFinish();
+  printf("Defragmented in %.2f ms\n", (glfwGetTime() - start) * 1000.0);
+  MeshArenaBase::PrintAllOccupancy();
+
+  for (Mesh<Vertex_Pos_Tex_Packed>* grid : grids)
+    delete grid;
+  return result;
 }
 
 // Helper method for OpenGL initialization
@@ -225,6 +539,18 @@ bool initOpenGL()
   glfwWindowHint(GLFW_SAMPLES, 4);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
+  // Headless mode: no visible window, render into an offscreen OSMesa context
+  // which works on machines without a display (e.g. Mesa llvmpipe)
+  if (benchmark.headless)
+  {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+  }
+
+  // Benchmark runs must not be throttled by the display
+  if (benchmark.frames > 0)
+    vsync = false;
+
   // Create the window
   mainWindow = glfwCreateWindow((int)WindowParams::Width, (int)WindowParams::Height, "", nullptr, nullptr);
   if (mainWindow == nullptr)
@@ -249,17 +575,18 @@ bool initOpenGL()
     glfwSwapInterval(0);
 
   // Enable backface culling
-  glEnable(GL_CULL_FACE);
+  if (backFaceCulling)
+    glState.Enable(GL_CULL_FACE);
   glCullFace(GL_BACK);
 
   // Enable depth test
-  glEnable(GL_DEPTH_TEST);
+  glState.Enable(GL_DEPTH_TEST);
   glDepthFunc(GL_LEQUAL);
 
   glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
 
   // Enable clipping plane 0
-  glEnable(GL_CLIP_DISTANCE0);
+  glState.Enable(GL_CLIP_DISTANCE0);
 
   // Register a window resize callback
   glfwSetFramebufferSizeCallback(mainWindow, resizeCallback);
@@ -276,9 +603,19 @@ bool initOpenGL()
   // Set the initial camera position and orientation
   camera.SetTransformation(glm::vec3(0.0f, 2.5f, -5.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
-  reflection = createFramebuffer((int)WindowParams::Width, (int)WindowParams::Height, false);
-  // need to sample depth buffer for fogginess
-  refraction = createFramebuffer((int)WindowParams::Width, (int)WindowParams::Height, true);
+  // Create the GPU profiler queries
+  gpuProfiler.Init();
+
+  // Create the water visibility query
+  glGenQueries(1, &waterQuery);
+
+  // Create the vertex array of the composite pass
+  glCreateVertexArrays(1, &compositeVao);
+
+  // Create the buffers of the per-view and per-draw shader data and of the draw commands
+  if (!viewData.Init(max_frame_views * 256) || !instanceData.Init(max_frame_draws * sizeof(InstanceData)) ||
+      !drawCommands.Init(max_frame_draws * sizeof(DrawElementsIndirectCommand)))
+    return false;
 
   return true;
 }
@@ -298,6 +635,9 @@ void shutDown()
     pool = nullptr;
     delete cube;
     cube = nullptr;
+    delete skyBox;
+    skyBox = nullptr;
+    MeshArenaBase::ReleaseAll();
 
     // Release textures
     if (glIsTexture(checkerTex))
@@ -306,18 +646,24 @@ void shutDown()
         glDeleteTextures(1, &terracotaTex);
     if (glIsTexture(testTex))
         glDeleteTextures(1, &testTex);
-    if (glIsTexture(reflection.color))
-        glDeleteTextures(1, &reflection.color);
-    if (glIsTexture(refraction.color))
-        glDeleteTextures(1, &refraction.color);
-    if (glIsTexture(refraction.depth_stencil))
-        glDeleteTextures(1, &refraction.depth_stencil);
-    if (glIsTexture(reflection.depth_stencil))
-        glDeleteTextures(1, &reflection.depth_stencil);
-
-    // Release buffers
-    glDeleteFramebuffers(1, &reflection.handle);
-    glDeleteFramebuffers(1, &refraction.handle);
+    if (glIsTexture(skyTex))
+        glDeleteTextures(1, &skyTex);
+    materials.Release();
+
+    // Stop the texture loads and the worker threads
+    textureLoader.Release();
+    threadPool.Release();
+
+    // Release framebuffers
+    renderTargets.Clear();
+    viewData.Release();
+    instanceData.Release();
+    drawCommands.Release();
+
+    // Release queries
+    gpuProfiler.Release();
+    glDeleteQueries(1, &waterQuery);
+    glDeleteVertexArrays(1, &compositeVao);
 
     // Release the window
     glfwDestroyWindow(mainWindow);
@@ -369,196 +715,181 @@ void processInput(float dt)
     camera.SetTransformation(glm::vec3(0.0f, 0.0f, -5.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 }
 
-FrameBuffer createFramebuffer(int width, int height, bool depth_texture)
+void setupFramebuffer(GLuint fbo, int width, int height, bool useStencil = false)
 {
-    // Bind the default framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    GLuint handle = 0;
-    glGenFramebuffers(1, &handle);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, handle);
-
-    // --------------------------------------------------------------------------
-    // Render target texture:
-    // --------------------------------------------------------------------------
+    glState.BindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
 
-    
-    GLuint renderTarget = 0;
+    glState.Enable(GL_CLIP_DISTANCE0);
+    glState.Enable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_TRUE);
 
-    glGenTextures(1, &renderTarget);
+    glClearColor(0.1f, 0.2f, 0.4f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (useStencil) 
+    {
+        glState.Enable(GL_STENCIL_TEST);
+        glStencilMask(0xFF);
+        glClearStencil(0);
+        glClear(GL_STENCIL_BUFFER_BIT);
+        glState.Disable(GL_STENCIL_TEST);
+    }
+}
 
-    glBindTexture(GL_TEXTURE_2D, renderTarget);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderTarget, 0);
+// Fills in the shader data of a view
+void fillView(ViewData& view, const Camera& cam, const glm::vec4& clippingPlane)
+{
+    view.worldToView = cam.GetWorldToView();
+    view.projection = cam.GetProjection();
+    view.worldToClip = view.projection * view.worldToView;
+    view.cameraPosWorld = cam.GetViewToWorld()[3];
+    view.clippingPlane = clippingPlane;
+    view.nearFar = glm::vec2(nearClipPlane, farClipPlane);
+}
 
-    GLuint depthStencil = 0;
+// Binds the views of the following pass, the layered pass takes one view per layer
+void bindViews(const Camera* cams, const glm::vec4* clippingPlanes, int count)
+{
+    static GLint alignment = 0;
+    if (!alignment)
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
 
-    if (depth_texture)
+    GLintptr offset = 0;
+    ViewData* views = static_cast<ViewData*>(viewData.Allocate(count * sizeof(ViewData), alignment, offset));
+    if (!views)
     {
-        // we intend to sample the depth buffer -> it has to be a texture
-        glGenTextures(1, &depthStencil);
-        glBindTexture(GL_TEXTURE_2D, depthStencil);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, 0);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthStencil, 0);
-    } 
-    else {
-        glGenRenderbuffers(1, &depthStencil);
-        glBindRenderbuffer(GL_RENDERBUFFER, depthStencil);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencil);
+        printf("Too many views in a frame!\n");
+        return;
     }
 
-    // Set the list of draw buffers.
-    GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0 };
-    glDrawBuffers(1, drawBuffers);
+    for (int i = 0; i < count; ++i)
+        fillView(views[i], cams[i], clippingPlanes[i]);
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, viewData.GetBuffer(), offset, count * sizeof(ViewData));
+}
 
-    // Check for completeness
-    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-    if (status != GL_FRAMEBUFFER_COMPLETE) {
-        printf("Failed to create framebuffer: 0x%04X\n", status);
-    }
+// Binds the view of the following pass
+void bindView(const Camera& cam, const glm::vec4& clippingPlane)
+{
+    bindViews(&cam, &clippingPlane, 1);
+}
 
-    // Bind back the window system provided framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// Draws the mesh, its transformation is written to the frame data and the shaders pick
+// it by the base instance of the draw
+void drawMesh(Mesh<Vertex_Pos_Tex_Packed>* mesh, const glm::mat4& modelToWorld)
+{
+    GLintptr offset = 0;
+    InstanceData* instance = static_cast<InstanceData*>(instanceData.Allocate(sizeof(InstanceData), sizeof(InstanceData), offset));
+    if (!instance)
+    {
+        printf("Too many draws in a frame!\n");
+        return;
+    }
 
-    return { handle, renderTarget, depthStencil };
+    instance->modelToWorld = modelToWorld * mesh->GetDequantization();
+    instance->material = glm::ivec4(-1);
+    const GLuint baseInstance = (GLuint)((offset - instanceData.GetFrameOffset()) / sizeof(InstanceData));
+    const size_t indexOffset = mesh->GetFirstIndex() * MeshArenaBase::GetIndexSize(mesh->GetIndexType());
+    glState.BindVertexArray(mesh->GetVAO());
+    glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, mesh->GetIBOSize(), mesh->GetIndexType(),
+                                                  reinterpret_cast<void*>(indexOffset), 1, mesh->GetBaseVertex(), baseInstance);
 }
 
-void setupFramebuffer(GLuint fbo, bool useStencil = false)
+// Records a draw of the scene geometry into the render queue, no textures are bound for
+// it as the shaders look them up by the material. Only the meshlets of the mesh visible
+// in the views of the pass get to the queue
+void queueMesh(unsigned int stage, Mesh<Vertex_Pos_Tex_Packed>* mesh, int material, const glm::mat4& modelToWorld)
 {
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    const int program = renderingLayered ? ShaderProgram::Layered : ShaderProgram::Default;
+    const float depth = glm::length(glm::vec3(modelToWorld[3]) - queueOrigin);
+
+    DrawPacket packet;
+    packet.key = RenderQueue::MakeKey(stage, program, materials.GetArray(material), depth);
+    packet.program = shaderProgram[program];
+    packet.vao = mesh->GetVAO();
+    packet.indexType = mesh->GetIndexType();
+    packet.indexCount = mesh->GetIBOSize();
+    packet.firstIndex = mesh->GetFirstIndex();
+    packet.baseVertex = mesh->GetBaseVertex();
+    packet.texture = 0;
+    packet.sampler = 0;
+    packet.instance.modelToWorld = modelToWorld * mesh->GetDequantization();
+    packet.instance.material = glm::ivec4(material, 0, 0, 0);
+
+    // back facing meshlets can only go when the stage culls the back faces, the stencil
+    // masking draws both sides of the pool, the ground always culls them
+    const bool coneCulling = stage == StageGround || (stage != StageMask && backFaceCulling);
+    meshletCuller.Add(packet, mesh->GetMeshlets(), modelToWorld, coneCulling);
+}
 
-    glEnable(GL_CLIP_DISTANCE0);
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LEQUAL);
-    glDepthMask(GL_TRUE);
+// Starts recording the draws of a pass, the layered pass takes one camera per layer and
+// the draws are sorted by the distance from the first one
+void beginQueue(const Camera* cams, const glm::vec4* clippingPlanes, int count)
+{
+    renderQueue.Clear();
+    meshletCuller.SetViews(cams, clippingPlanes, count);
+    queueOrigin = glm::vec3(cams[0].GetViewToWorld()[3]);
+}
 
-    glClearColor(0.1f, 0.2f, 0.4f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    if (useStencil) 
-    {
-        glEnable(GL_STENCIL_TEST);
-        glStencilMask(0xFF);
-        glClearStencil(0);
-        glClear(GL_STENCIL_BUFFER_BIT);
-        glDisable(GL_STENCIL_TEST);
-    }
+// Starts recording the draws of a pass viewed by the camera
+void beginQueue(const Camera& cam, const glm::vec4& clippingPlane)
+{
+    beginQueue(&cam, &clippingPlane, 1);
 }
 
-void renderGround(const Camera& cam)
+// Culls, sorts and issues the draws of the pass
+void flushQueue(RenderQueue::StageCallback onStage = nullptr)
 {
-    glUseProgram(shaderProgram[ShaderProgram::Default]);
+    meshletCuller.Flush(threadPool, renderQueue);
+    renderQueue.Sort();
+    renderQueue.Submit(glState, instanceData, drawCommands, onStage);
+    renderQueue.Clear();
+}
 
+void renderGround()
+{
     glm::mat4 modelToWorld = glm::scale(glm::vec3(20.0, 1.0, 20.0));
     modelToWorld = glm::translate(modelToWorld, glm::vec3(0.0, ground_height, 0.0));
 
-    //set uniforms
-    glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(modelToWorld));
-    glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(cam.GetWorldToView()));
-    glUniformMatrix4fv(2, 1, GL_FALSE, glm::value_ptr(cam.GetProjection()));
-    glUniform4fv(3, 1, glm::value_ptr(clipping_plane));
-
-    //set textures
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, checkerTex);
-    glBindSampler(0, textures.GetSampler(activeSampler));
-
-    // draw
-    glBindVertexArray(quad->GetVAO());
-    glDrawElements(GL_TRIANGLES, quad->GetIBOSize(), GL_UNSIGNED_INT, reinterpret_cast<void*>(0));
-    
-    // release resources
-    glUseProgram(0);
-    glBindVertexArray(0);
+    queueMesh(StageGround, quad, checkerMaterial, modelToWorld);
 }
 
-void renderPool(const Camera& cam)
+void renderPool(unsigned int stage = StageOpaque)
 {
-    glUseProgram(shaderProgram[ShaderProgram::Default]);
-    
     glm::mat4 modelToWorld = glm::scale(glm::vec3(pool_width, pool_depth, pool_length));
     
     float offset = pool_depth / 2.0f;
     modelToWorld = glm::translate(modelToWorld, glm::vec3(0.0, ground_height - offset, 0.0));
 
-    //set uniforms
-    glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(modelToWorld));
-    glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(cam.GetWorldToView()));
-    glUniformMatrix4fv(2, 1, GL_FALSE, glm::value_ptr(cam.GetProjection()));
-    glUniform4fv(3, 1, glm::value_ptr(clipping_plane));
-
-    //set textures
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, checkerTex);
-    glBindSampler(0, textures.GetSampler(activeSampler));
-
-    // draw
-    glBindVertexArray(pool->GetVAO());
-    glDrawElements(GL_TRIANGLES, pool->GetIBOSize(), GL_UNSIGNED_INT, reinterpret_cast<void*>(0));
-
-    // release resources
-    glUseProgram(0);
-    glBindVertexArray(0);
+    queueMesh(stage, pool, checkerMaterial, modelToWorld);
 }
 
-void renderExtras(const Camera& cam)
+void renderExtras()
 {
-    glUseProgram(shaderProgram[ShaderProgram::Default]);
-
-    glm::mat4 modelToWorld = glm::translate(glm::vec3(0.0f, ground_height + 0.5f, pool_length / 2.0f + 0.5f));
-    //set uniforms
-    glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(modelToWorld));
-    glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(cam.GetWorldToView()));
-    glUniformMatrix4fv(2, 1, GL_FALSE, glm::value_ptr(cam.GetProjection()));
-    glUniform4fv(3, 1, glm::value_ptr(clipping_plane));
-
-    //set textures
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, testTex);
-    glBindSampler(0, textures.GetSampler(activeSampler));
+    // the cubes share the mesh, the queue draws them as instances
 
     //cube 1
-    glBindVertexArray(cube->GetVAO());
-    glDrawElements(GL_TRIANGLES, cube->GetIBOSize(), GL_UNSIGNED_INT, reinterpret_cast<void*>(0));
-
-    modelToWorld = glm::translate(glm::vec3(pool_width / 2.0f + 0.5f + 0.2f, ground_height + 0.5f, 0.2f));
-
-    glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(modelToWorld));
-
-    glBindTexture(GL_TEXTURE_2D, checkerTex);
+    glm::mat4 modelToWorld = glm::translate(glm::vec3(0.0f, ground_height + 0.5f, pool_length / 2.0f + 0.5f));
+    queueMesh(StageOpaque, cube, testMaterial, modelToWorld);
 
     //cube 2
-    glDrawElements(GL_TRIANGLES, cube->GetIBOSize(), GL_UNSIGNED_INT, reinterpret_cast<void*>(0));
+    modelToWorld = glm::translate(glm::vec3(pool_width / 2.0f + 0.5f + 0.2f, ground_height + 0.5f, 0.2f));
+    queueMesh(StageOpaque, cube, checkerMaterial, modelToWorld);
 
+    //cube 3
     modelToWorld = glm::translate(glm::vec3(pool_width / 2.0f + 0.5f, ground_height + 0.5f + 1.0f, 0.2f));
     modelToWorld = glm::rotate(modelToWorld, glm::pi<float>() / 3.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-
-    glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(modelToWorld));
-    glBindTexture(GL_TEXTURE_2D, terracotaTex);
-
-    //cube 3
-    glDrawElements(GL_TRIANGLES, cube->GetIBOSize(), GL_UNSIGNED_INT, reinterpret_cast<void*>(0));
-
-
-    // release resources
-    glUseProgram(0);
-    glBindVertexArray(0);
+    queueMesh(StageOpaque, cube, terracotaMaterial, modelToWorld);
 }
 
-
-void renderWater(const Camera& cam, float dt)
+void renderWater(float dt)
 {
-    glUseProgram(shaderProgram[ShaderProgram::Water]);
+    GpuProfilerZone zone(gpuProfiler, "renderWater");
+
+    glState.UseProgram(shaderProgram[ShaderProgram::Water]);
 
     glm::mat4 modelToWorld = glm::scale(glm::vec3(pool_width, 1.0, pool_length));
     modelToWorld = glm::translate(modelToWorld, glm::vec3(0.0f, water_height, 0.0f));
-    const glm::vec3 cameraPos = cam.GetViewToWorld()[3];
-    glm::vec2 nearFar(nearClipPlane, farClipPlane);
     
     wave_offset += wave_speed * dt;
     wave_offset = fmodf(wave_offset, 1.0);
@@ -574,81 +905,87 @@ void renderWater(const Camera& cam, float dt)
     glm::vec2 tiling(tileX, tileY);
 
     // set uniforms
-    glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(modelToWorld));
-    glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(cam.GetWorldToView()));
-    glUniformMatrix4fv(2, 1, GL_FALSE, glm::value_ptr(cam.GetProjection()));
-    glUniform3fv(3, 1, glm::value_ptr(cameraPos));
     glUniform1f(4, wave_offset);
-    glUniform2fv(5, 1, glm::value_ptr(nearFar));
     glUniform2fv(6, 1, glm::value_ptr(tiling));
+    // upsample the low resolution refraction with respect to its depth
+    const float refractionDynamic = dynamicResolution.GetScale(DynamicResolution::Refraction);
+    const float reflectionDynamic = dynamicResolution.GetScale(DynamicResolution::Reflection);
+    glUniform1i(7, refractionScale * refractionDynamic < 1.0f);
+    glUniform2f(8, refractionDynamic, reflectionDynamic);
+    glUniform1f(9, distortion_strength);
+    glUniform1i(10, waterMapFormat == BlockFormat::BC5);
     
     // set textures
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, refraction.color);
-    glBindSampler(0, textures.GetSampler(activeSampler));
+    glState.BindTexture(0, refraction.color);
+    glState.BindSampler(0, textures.GetSampler(activeSampler));
     
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, reflection.color);
-    glBindSampler(1, textures.GetSampler(activeSampler));
+    // low resolution reflection is at least bilinearly filtered, there's no depth to guide the upsampling
+    glState.BindTexture(1, reflection.color);
+    glState.BindSampler(1, textures.GetSampler(reflectionScale * reflectionDynamic < 1.0f ? Sampler::Bilinear : activeSampler));
 
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, waterNormal);
-    glBindSampler(2, textures.GetSampler(activeSampler));
+    glState.BindTexture(2, waterNormal);
+    glState.BindSampler(2, textures.GetSampler(activeSampler));
 
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, waterDuDv);
-    glBindSampler(3, textures.GetSampler(activeSampler));
+    glState.BindTexture(3, waterDuDv);
+    glState.BindSampler(3, textures.GetSampler(activeSampler));
 
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_2D, refraction.depth_stencil);
-    glBindSampler(4, textures.GetSampler(activeSampler));
+    glState.BindTexture(4, refraction.depth_stencil);
+    glState.BindSampler(4, textures.GetSampler(activeSampler));
 
     // draw
-    glBindVertexArray(quad->GetVAO());
-    glDrawElements(GL_TRIANGLES, quad->GetIBOSize(), GL_UNSIGNED_INT, reinterpret_cast<void*>(0));
-
-    // release resources
-    glUseProgram(0);
-    glBindVertexArray(0);
+    drawMesh(quad, modelToWorld);
 }
 
-void renderSky(const Camera& cam)
+void renderSky()
 {
-    glUseProgram(shaderProgram[ShaderProgram::Default]);
-
     glm::mat4 modelToWorld = glm::scale(glm::vec3(50.0f, 50.0f, 50.0f));
 
-    glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(modelToWorld));
-    glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(cam.GetWorldToView()));
-    glUniformMatrix4fv(2, 1, GL_FALSE, glm::value_ptr(cam.GetProjection()));
-    glUniform4fv(3, 1, glm::value_ptr(clipping_plane));
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, skyTex);
-    glBindSampler(0, textures.GetSampler(activeSampler));
-
-    glBindVertexArray(skyBox->GetVAO());
-    glDrawElements(GL_TRIANGLES, skyBox->GetIBOSize(), GL_UNSIGNED_INT, reinterpret_cast<void*>(0));
-
-    // release resources
-    glUseProgram(0);
-    glBindVertexArray(0);
+    queueMesh(StageSky, skyBox, skyMaterial, modelToWorld);
 }
 
-void renderScene(float dt)
+// Sets up the stencil masking of the main pass stages
+void setupMainStage(unsigned int stage)
 {
-    // first render everything under the water for refractions
-    setupFramebuffer(refraction.handle, false);
-
-    clipping_plane.w = water_height;
-    // draw ...
-    renderPool(camera);
-    //renderGround(camera, clipping_plane); // TODO: stencil buffer needed here too for arbitrary ground planes
-    renderSky(camera);
+    switch (stage)
+    {
+    case StageMask:
+        glState.Enable(GL_STENCIL_TEST);
+        // need to draw back faces of the pool for proper masking
+        glState.Disable(GL_CULL_FACE);
+
+        // use stencil buffer to mask out the ground around where the pool should be
+        glStencilFuncSeparate(GL_FRONT, GL_ALWAYS, 1, 0xFF);
+        glStencilFuncSeparate(GL_BACK, GL_ALWAYS, 0, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+        glStencilMask(0xFF);
+        break;
+
+    case StageGround:
+        glState.Enable(GL_STENCIL_TEST);
+        glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
+        glStencilMask(0x00);
+        // the ground covers the pool walls under it regardless of depth, it still writes
+        // its depth so that the sky drawn later doesn't cover it
+        glDepthFunc(GL_ALWAYS);
+        glState.Enable(GL_CULL_FACE);
+        glCullFace(GL_BACK);
+        break;
+
+    default:
+        glState.Disable(GL_STENCIL_TEST);
+        glDepthFunc(GL_LEQUAL);
+        // back to the culling the user asked for
+        if (backFaceCulling)
+            glState.Enable(GL_CULL_FACE);
+        else
+            glState.Disable(GL_CULL_FACE);
+        break;
+    }
+}
 
-    // now render everything above the water for reflections
-    setupFramebuffer(reflection.handle, false);
-    
+// Returns the camera mirrored by the water plane that renders the reflection
+Camera getReflectionCamera(const Camera& camera)
+{
     // we need to move the camera down by 2 time the distance from the water to the camera
     // and invert the pitch
     Camera cam;
@@ -666,55 +1003,309 @@ void renderScene(float dt)
 
     const glm::vec3 lookAt(dir + camera_pos);
     cam.SetTransformation(camera_pos, lookAt, up);
-    // TODO: maybe make the framebuffers respond to window resize
-    cam.SetProjection(45.0f, (float)WindowParams::Width / (float)WindowParams::Height, nearClipPlane, farClipPlane);
+    cam.SetProjection(45.0f, (float)windowWidth / (float)windowHeight, nearClipPlane, farClipPlane);
+    return cam;
+}
 
-    // now cull everything under water
-    clipping_plane.y *= -1;
+void renderScene(float dt)
+{
+    gpuProfiler.BeginFrame();
+    renderTargets.BeginFrame();
+
+    // instances and draw commands of the whole frame are written to one region of the rings
+    viewData.BeginFrame();
+    instanceData.BeginFrame();
+    drawCommands.BeginFrame();
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, instanceData.GetBuffer(), instanceData.GetFrameOffset(),
+                      instanceData.GetFrameSize());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommands.GetBuffer());
+
+    // textures still loading in the background replace their placeholders
+    if (textureLoader.GetPendingCount() > 0 && textureLoader.Update() > 0)
+        glState.Invalidate();
 
-    // draw ...
-    renderPool(cam);
-    //renderGround(cam, clipping_plane);
-    renderExtras(cam);
-    renderSky(cam);
+    materials.Bind(glState, materials_unit, textures.GetSampler(activeSampler), materials_binding);
+
+    // adjust the resolution according to the latest GPU timings
+    if (dynamicResolution.IsEnabled())
+    {
+        float passMs[DynamicResolution::NumPasses] = {
+            gpuProfiler.GetLastTime("Refraction"), gpuProfiler.GetLastTime("Reflection"), gpuProfiler.GetLastTime("Main")};
+        // the layered pass can't tell the views apart, split its time evenly
+        if (offscreenViews.handle)
+            passMs[DynamicResolution::Refraction] = passMs[DynamicResolution::Reflection] = 0.5f * gpuProfiler.GetLastTime("Offscreen");
+        dynamicResolution.Update(passMs);
+    }
+
+    // the offscreen targets cover the whole window, the water shader samples them in screen space
+    RenderTargetDesc reflectionDesc = {scaledSize(windowWidth, reflectionScale), scaledSize(windowHeight, reflectionScale),
+                                       GL_RGB16F, GL_DEPTH24_STENCIL8, false, 0};
+    // need to sample depth buffer for fogginess
+    RenderTargetDesc refractionDesc = {scaledSize(windowWidth, refractionScale), scaledSize(windowHeight, refractionScale),
+                                       GL_RGB16F, GL_DEPTH_COMPONENT24, true, 0};
+
+    // the offscreen targets are only sampled by the water, skip them when it can't be seen:
+    // outside of the frustum we know it right away, occluded water is detected by the
+    // query from the previous frame and the passes are skipped by the GPU itself
+    const glm::mat4x4 worldToClip = camera.GetProjection() * camera.GetWorldToView();
+    glm::vec4 waterRect;
+    const bool waterInFrustum = Frustum(worldToClip).Intersects(waterBounds()) &&
+                                GetScreenRect(worldToClip, waterBounds(), waterRect);
+    if (!waterInFrustum)
+        waterQueryIssued = false;
+    const bool conditionalRender = waterInFrustum && occlusionCulling && waterQueryIssued;
+    if (conditionalRender)
+        glBeginConditionalRender(waterQuery, GL_QUERY_NO_WAIT);
+
+    // the reflection is rendered by a camera mirrored by the water plane
+    const Camera mirroredCamera = getReflectionCamera(camera);
+    // refraction culls everything above the water, reflection everything under it
+    const glm::vec4 refractionPlane(0.0f, -1.0f, 0.0f, water_height);
+    const glm::vec4 reflectionPlane(0.0f, 1.0f, 0.0f, water_height);
+    const float refractionDynamic = dynamicResolution.GetScale(DynamicResolution::Refraction);
+    const float reflectionDynamic = dynamicResolution.GetScale(DynamicResolution::Reflection);
+
+    if (layeredViews && reflectionScale == refractionScale)
+    {
+        // render both views at once, each triangle is sent to both layers by the geometry shader
+        gpuProfiler.PushZone("Offscreen");
+        RenderTargetDesc viewsDesc = refractionDesc;
+        viewsDesc.layers = 2;
+        offscreenViews = renderTargets.Acquire(viewsDesc);
+        refraction = renderTargets.GetLayer(offscreenViews, 0);
+        reflection = renderTargets.GetLayer(offscreenViews, 1);
+        if (waterInFrustum)
+        {
+            const int refractionWidth = scaledSize(viewsDesc.width, refractionDynamic);
+            const int refractionHeight = scaledSize(viewsDesc.height, refractionDynamic);
+            const int reflectionWidth = scaledSize(viewsDesc.width, reflectionDynamic);
+            const int reflectionHeight = scaledSize(viewsDesc.height, reflectionDynamic);
+
+            const Camera cams[2] = {camera, mirroredCamera};
+            const glm::vec4 clippingPlanes[2] = {refractionPlane, reflectionPlane};
+            bindViews(cams, clippingPlanes, 2);
+
+            // clears only use the first scissor box, clear the union of both
+            const glm::ivec4 refractionScissor = waterScissor(waterRect, refractionWidth, refractionHeight, false);
+            const glm::ivec4 reflectionScissor = waterScissor(waterRect, reflectionWidth, reflectionHeight, true);
+            const glm::ivec2 clearMin = glm::min(glm::ivec2(refractionScissor), glm::ivec2(reflectionScissor));
+            const glm::ivec2 clearMax = glm::max(glm::ivec2(refractionScissor) + glm::ivec2(refractionScissor.z, refractionScissor.w),
+                                                 glm::ivec2(reflectionScissor) + glm::ivec2(reflectionScissor.z, reflectionScissor.w));
+            glState.Enable(GL_SCISSOR_TEST);
+            glScissor(clearMin.x, clearMin.y, clearMax.x - clearMin.x, clearMax.y - clearMin.y);
+            setupFramebuffer(offscreenViews.handle, viewsDesc.width, viewsDesc.height, false);
+
+            glViewportIndexedf(0, 0.0f, 0.0f, (float)refractionWidth, (float)refractionHeight);
+            glViewportIndexedf(1, 0.0f, 0.0f, (float)reflectionWidth, (float)reflectionHeight);
+            glScissorIndexedv(0, glm::value_ptr(refractionScissor));
+            glScissorIndexedv(1, glm::value_ptr(reflectionScissor));
+
+            // draw ... the extras are all above the water, the refraction clips them away
+            renderingLayered = true;
+            beginQueue(cams, clippingPlanes, 2);
+            renderPool();
+            renderExtras();
+            renderSky();
+            flushQueue();
+            renderingLayered = false;
+            glState.Disable(GL_SCISSOR_TEST);
+        }
+        gpuProfiler.PopZone();
+    }
+    else
+    {
+        offscreenViews = {0};
+
+        // first render everything under the water for refractions
+        gpuProfiler.PushZone("Refraction");
+        refraction = renderTargets.Acquire(refractionDesc);
+        if (waterInFrustum)
+        {
+            // the water only samples the targets around itself, the clear is scissored as well
+            const int width = scaledSize(refractionDesc.width, refractionDynamic);
+            const int height = scaledSize(refractionDesc.height, refractionDynamic);
+            const glm::ivec4 scissor = waterScissor(waterRect, width, height, false);
+            glState.Enable(GL_SCISSOR_TEST);
+            glScissor(scissor.x, scissor.y, scissor.z, scissor.w);
+            setupFramebuffer(refraction.handle, width, height, false);
+            bindView(camera, refractionPlane);
+
+            // draw ...
+            beginQueue(camera, refractionPlane);
+            renderPool();
+            //renderGround(); // TODO: stencil buffer needed here too for arbitrary ground planes
+            renderSky();
+            flushQueue();
+            glState.Disable(GL_SCISSOR_TEST);
+        }
+        gpuProfiler.PopZone();
+
+        // now render everything above the water for reflections
+        gpuProfiler.PushZone("Reflection");
+        reflection = renderTargets.Acquire(reflectionDesc);
+
+        if (waterInFrustum)
+        {
+            const int width = scaledSize(reflectionDesc.width, reflectionDynamic);
+            const int height = scaledSize(reflectionDesc.height, reflectionDynamic);
+            const glm::ivec4 scissor = waterScissor(waterRect, width, height, true);
+            glState.Enable(GL_SCISSOR_TEST);
+            glScissor(scissor.x, scissor.y, scissor.z, scissor.w);
+            setupFramebuffer(reflection.handle, width, height, false);
+            bindView(mirroredCamera, reflectionPlane);
+
+            // draw ...
+            beginQueue(mirroredCamera, reflectionPlane);
+            renderPool();
+            //renderGround();
+            renderExtras();
+            renderSky();
+            flushQueue();
+            glState.Disable(GL_SCISSOR_TEST);
+        }
+        gpuProfiler.PopZone();
+    }
+
+    if (conditionalRender)
+        glEndConditionalRender();
 
     // now draw everything in the scene
     // plus water with reflection and refraction
-    setupFramebuffer(0, true);
+    gpuProfiler.PushZone("Main");
+    const float mainDynamic = dynamicResolution.GetScale(DynamicResolution::Main);
+    const int mainWidth = scaledSize(windowWidth, mainDynamic);
+    const int mainHeight = scaledSize(windowHeight, mainDynamic);
+    if (dynamicResolution.IsEnabled())
+    {
+        // render into a window sized target first and stretch it to the window afterwards
+        mainView = renderTargets.Acquire({windowWidth, windowHeight, GL_RGBA8, GL_DEPTH24_STENCIL8, false, 0});
+        setupFramebuffer(mainView.handle, mainWidth, mainHeight, true);
+    }
+    else
+        setupFramebuffer(0, windowWidth, windowHeight, true);
 
-    clipping_plane = glm::vec4(0, -1, 0, infinity);
+    const glm::vec4 mainPlane(0, -1, 0, infinity);
+    bindView(camera, mainPlane);
 
-    renderSky(camera);
-    // draw ...
-    glEnable(GL_STENCIL_TEST);
-    // need to draw back faces of the pool for proper masking
-    glDisable(GL_CULL_FACE);
+    // draw ... the pool populates the stencil buffer masking the ground, the sky goes last
+    beginQueue(camera, mainPlane);
+    renderPool(StageMask);
+    renderGround();
+    renderExtras();
+    renderSky();
+    flushQueue(setupMainStage);
 
-    // use stencil buffer to mask out the ground around where the pool should be
-    glStencilFuncSeparate(GL_FRONT, GL_ALWAYS, 1, 0xFF);
-    glStencilFuncSeparate(GL_BACK, GL_ALWAYS, 0, 0xFF);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-    glStencilMask(0xFF);
+    if (waterInFrustum)
+    {
+        // the water is drawn last, any of its samples passing the depth test means it's visible
+        if (occlusionCulling)
+            glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, waterQuery);
+        renderWater(dt);
+        if (occlusionCulling)
+        {
+            glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+            waterQueryIssued = true;
+        }
+    }
 
-    // populate the stencil buffer
-    renderPool(camera);
+    if (dynamicResolution.IsEnabled())
+    {
+        // stretch the rendered part to the window, the window is multisampled so it can't
+        // be the destination of a scaling blit. The triangle is front facing, the culling
+        // can stay as it is
+        glState.BindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, windowWidth, windowHeight);
+        glState.Disable(GL_DEPTH_TEST);
+        glState.Disable(GL_STENCIL_TEST);
+
+        glState.UseProgram(shaderProgram[ShaderProgram::Composite]);
+        glUniform2f(0, (float)mainWidth / (float)windowWidth, (float)mainHeight / (float)windowHeight);
+        glState.BindTexture(0, mainView.color);
+        glState.BindSampler(0, textures.GetSampler(Sampler::Bilinear));
+        glState.BindVertexArray(compositeVao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        glState.Enable(GL_DEPTH_TEST);
+        renderTargets.Release(mainView);
+    }
+    gpuProfiler.PopZone();
 
-    glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-    glStencilMask(0x00);
-    glDisable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
+    // done with the offscreen targets for this frame
+    if (offscreenViews.handle)
+        renderTargets.Release(offscreenViews);
+    else
+    {
+        renderTargets.Release(reflection);
+        renderTargets.Release(refraction);
+    }
+
+    viewData.EndFrame();
+    instanceData.EndFrame();
+    drawCommands.EndFrame();
+    gpuProfiler.EndFrame();
+    ++renderedFrames;
+}
+
+// Helper method for running a fixed number of frames with a fixed time step and
+// no input, so that consecutive runs render the exact same images. Returns false when
+// the textures are over the budget
+bool benchmarkLoop()
+{
+  // Every run has to render the same images, no texture may arrive in the middle of it
+  textureLoader.Finish();
+  glState.Invalidate();
+
+  GpuFrameTimer gpuTimer;
+  gpuTimer.Init();
+
+  FrameReport report;
+  report.Reserve(benchmark.frames);
+
+  int resolvedFrame;
+  double gpuMs;
+  for (int frame = 0; frame < benchmark.frames && !glfwWindowShouldClose(mainWindow); ++frame)
+  {
+    double start = glfwGetTime();
+
+    glfwPollEvents();
+
+    // Input is ignored, the camera either stays put or follows the recorded path
+    if (benchmark.replayPath)
+      cameraPath.Apply(frame, camera);
 
-    renderGround(camera);
+    // Render the scene
+    gpuTimer.Begin(frame);
+    renderScene(benchmark.dt);
+    gpuTimer.End();
+
+    // Swapping only makes sense when there is a window to present to
+    if (!benchmark.headless)
+      glfwSwapBuffers(mainWindow);
 
-    glDisable(GL_STENCIL_TEST);
-    glEnable(GL_DEPTH_TEST);
+    report.AddFrame(frame, (glfwGetTime() - start) * 1000.0);
 
-    renderExtras(camera);
-    renderWater(camera, dt);
+    // Collect the GPU timings of already finished frames without stalling
+    while (gpuTimer.Resolve(resolvedFrame, gpuMs, false))
+      report.SetGpuTime(resolvedFrame, gpuMs);
+  }
 
-    glBindVertexArray(0);
-    glUseProgram(0);
+  // Wait for the remaining frames
+  while (gpuTimer.Resolve(resolvedFrame, gpuMs, true))
+    report.SetGpuTime(resolvedFrame, gpuMs);
+
+  report.PrintSummary();
+  gpuProfiler.PrintStats();
+  glState.PrintCounters(renderedFrames);
+  renderQueue.PrintCounters(renderedFrames);
+  meshletCuller.PrintCounters(renderedFrames);
+  renderTargets.PrintMemoryUsage();
+  const bool withinBudget = printTextureMemory();
+  MeshArenaBase::PrintAllOccupancy();
+  if (benchmark.reportPath)
+    report.Write(benchmark.reportPath);
+  if (benchmark.tracePath)
+    gpuProfiler.WriteChromeTrace(benchmark.tracePath);
+  return withinBudget;
 }
 
 // Helper method for implementing the application main loop
@@ -728,27 +1319,60 @@ void mainLoop()
     float dt = (float)(time - prevTime);
     prevTime = time;
 
-    // Print it to the title bar
-    static char title[MAX_BUFFER_LENGTH];
-    snprintf(title, MAX_BUFFER_LENGTH, "dt = %.2fms, FPS = %.1f", dt * 1000.0f, 1.0f / dt);
-    glfwSetWindowTitle(mainWindow, title);
+    // Report the statistics once in a while, setting the title may be a synchronous
+    // round-trip to the window manager so it's not done every frame
+    const char* report = frameStats.AddFrame(time, dt);
+    if (report && frameStats.GetOutput() == StatsOutput::Title)
+      glfwSetWindowTitle(mainWindow, report);
 
-    // Poll the events like keyboard, mouse, etc.
-    glfwPollEvents();
+    {
+      CpuZone zone("input");
 
-    // Process keyboard input
-    processInput(dt);
+      // Poll the events like keyboard, mouse, etc.
+      glfwPollEvents();
 
-    // Render the scene
-    renderScene(dt);
+      // Process keyboard input
+      processInput(dt);
+
+      // Capture the camera for later replay
+      if (benchmark.recordPath)
+        cameraPath.Record(camera);
+    }
+
+    {
+      CpuZone zone("render");
+
+      // Render the scene
+      renderScene(dt);
+    }
 
-    // Swap actual buffers on the GPU
-    glfwSwapBuffers(mainWindow);
+    {
+      CpuZone zone("swap");
+
+      // Swap actual buffers on the GPU
+      glfwSwapBuffers(mainWindow);
+    }
   }
 }
 
-int main()
+int main(int argc, char* argv[])
 {
+  // Read the benchmark settings
+  if (!benchmark.ParseArguments(argc, argv))
+  {
+    BenchmarkSettings::PrintUsage(argv[0]);
+    return -1;
+  }
+
+  // Replayed path determines the length of the run unless set explicitly
+  if (benchmark.replayPath)
+  {
+    if (!cameraPath.Load(benchmark.replayPath) || cameraPath.GetFrameCount() == 0)
+      return -1;
+    if (benchmark.frames == 0)
+      benchmark.frames = cameraPath.GetFrameCount();
+  }
+
   // Initialize the OpenGL context and create a window
   if (!initOpenGL())
   {
@@ -765,13 +1389,99 @@ int main()
     return -1;
   }
 
+  // Start the worker threads, the calling thread takes part as well
+  threadPool.Init();
+  textureLoader.Init(threadPool, glState);
+  textureLoader.SetCacheEnabled(benchmark.textureCache);
+  materials.SetCacheEnabled(benchmark.textureCache);
+
+  // Block compressed textures, the color ones in the material arrays
+  BlockFormat colorFormat = benchmark.textureCompression;
+  if (!BlockEncoder::IsSupported(colorFormat))
+  {
+    printf("%s textures aren't supported, falling back to uncompressed ones\n", BlockEncoder::GetName(colorFormat));
+    colorFormat = BlockFormat::None;
+  }
+  if (colorFormat != BlockFormat::None && BlockEncoder::IsSupported(BlockFormat::BC5))
+    waterMapFormat = BlockFormat::BC5;
+  materials.SetCompression(colorFormat, benchmark.compressionQuality, &threadPool);
+  textureLoader.SetCompressionQuality(benchmark.compressionQuality);
+  textureLoader.SetMipFilter(benchmark.mipFilter);
+  materials.SetMipFilter(benchmark.mipFilter, &threadPool);
+
+  // Compare the mip generation of the scene images and exit
+  if (benchmark.mipBenchmark)
+  {
+    const bool result = Textures::BenchmarkMipmaps("waterNormal.jpg", MipContent::Normal, threadPool) &&
+                        Textures::BenchmarkMipmaps("waterDisplacement.png", MipContent::Linear, threadPool) &&
+                        Textures::BenchmarkMipmaps("debugUV.png", MipContent::Linear, threadPool) &&
+                        Textures::BenchmarkMipmaps("brickWall.jpg", MipContent::Linear, threadPool) &&
+                        Textures::BenchmarkMipmaps("sky_seamless_texture_5893.jpg", MipContent::Linear, threadPool);
+    shutDown();
+    return result ? 0 : -1;
+  }
+
+  // Print the optimization statistics of the water grids and exit
+  if (benchmark.meshBenchmark)
+  {
+    const bool result = benchmarkMeshes();
+    shutDown();
+    return result ? 0 : -1;
+  }
+
   // Create the scene geometry
-  createGeometry();
+  if (!createGeometry())
+  {
+    printf("Failed to create the scene geometry!\n");
+    shutDown();
+    return -1;
+  }
+
+  // The loader bakes every texture missing in the cache as it's uploaded
+  if (benchmark.bakeTextures)
+  {
+    textureLoader.Finish();
+    shutDown();
+    return 0;
+  }
+
+  // Loading bound buffers and textures directly, the cache can't rely on its shadow
+  glState.Invalidate();
+
+  // Set up the frame statistics reporting
+  if (strcmp(benchmark.statsOutput, "title") == 0)
+    frameStats.SetOutput(StatsOutput::Title);
+  else if (strcmp(benchmark.statsOutput, "stdout") == 0)
+    frameStats.SetOutput(StatsOutput::Stdout);
+  else
+    frameStats.SetOutput(StatsOutput::File, benchmark.statsOutput);
+  frameStats.SetInterval(benchmark.statsInterval);
+  frameStats.SetHitchThreshold(benchmark.hitchMs);
+
+  // Offscreen target resolution
+  reflectionScale = benchmark.reflectionScale;
+  refractionScale = benchmark.refractionScale;
+  layeredViews = benchmark.layeredViews;
+
+  // Dynamic resolution
+  if (benchmark.gpuBudget > 0.0f)
+  {
+    gpuBudget = benchmark.gpuBudget;
+    dynamicResolution.SetBudget(gpuBudget);
+  }
+
+  // Enter the application main loop, benchmarks fail when the textures don't fit the budget
+  int result = 0;
+  if (benchmark.frames > 0)
+    result = benchmarkLoop() ? 0 : -1;
+  else
+    mainLoop();
 
-  // Enter the application main loop
-  mainLoop();
+  // Store the recorded camera path
+  if (benchmark.recordPath)
+    cameraPath.Save(benchmark.recordPath);
 
   // Release used resources and exit
   shutDown();
-  return 0;
+  return result;
 }
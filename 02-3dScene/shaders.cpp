@@ -10,10 +10,11 @@ GLuint shaderProgram[ShaderProgram::NumShaderPrograms] = {0};
 bool compileShaders()
 {
   GLuint vertexShader[VertexShader::NumVertexShaders] = {0};
+  GLuint geometryShader[GeometryShader::NumGeometryShaders] = {0};
   GLuint fragmentShader[FragmentShader::NumFragmentShaders] = {0};
 
   // Cleanup lambda
-  auto cleanUp = [&vertexShader, &fragmentShader]()
+  auto cleanUp = [&vertexShader, &geometryShader, &fragmentShader]()
   {
     for (int i = 0; i < VertexShader::NumVertexShaders; ++i)
     {
@@ -21,6 +22,12 @@ bool compileShaders()
         glDeleteShader(vertexShader[i]);
     }
 
+    for (int i = 0; i < GeometryShader::NumGeometryShaders; ++i)
+    {
+      if (glIsShader(geometryShader[i]))
+        glDeleteShader(geometryShader[i]);
+    }
+
     for (int i = 0; i < FragmentShader::NumFragmentShaders; ++i)
     {
       if (glIsShader(fragmentShader[i]))
@@ -39,6 +46,17 @@ bool compileShaders()
     }
   }
 
+  // Compile all geometry shaders
+  for (int i = 0; i < GeometryShader::NumGeometryShaders; ++i)
+  {
+    geometryShader[i] = ShaderCompiler::CompileShader(gsSource, i, GL_GEOMETRY_SHADER);
+    if (!geometryShader[i])
+    {
+      cleanUp();
+      return false;
+    }
+  }
+
   // Compile all fragment shaders
   for (int i = 0; i < FragmentShader::NumFragmentShaders; ++i)
   {
@@ -67,6 +85,23 @@ bool compileShaders()
       return false;
   }
 
+  shaderProgram[ShaderProgram::Layered] = glCreateProgram();
+  glAttachShader(shaderProgram[ShaderProgram::Layered], vertexShader[VertexShader::Layered]);
+  glAttachShader(shaderProgram[ShaderProgram::Layered], geometryShader[GeometryShader::Layered]);
+  glAttachShader(shaderProgram[ShaderProgram::Layered], fragmentShader[FragmentShader::Default]);
+  if (!ShaderCompiler::LinkProgram(shaderProgram[ShaderProgram::Layered])) {
+      cleanUp();
+      return false;
+  }
+
+  shaderProgram[ShaderProgram::Composite] = glCreateProgram();
+  glAttachShader(shaderProgram[ShaderProgram::Composite], vertexShader[VertexShader::Composite]);
+  glAttachShader(shaderProgram[ShaderProgram::Composite], fragmentShader[FragmentShader::Composite]);
+  if (!ShaderCompiler::LinkProgram(shaderProgram[ShaderProgram::Composite])) {
+      cleanUp();
+      return false;
+  }
+
 
   cleanUp();
   return true;
@@ -12,7 +12,7 @@ namespace ShaderProgram
 {
   enum
   {
-    Default, Water, NumShaderPrograms
+    Default, Water, Layered, Composite, NumShaderPrograms
   };
 }
 
@@ -29,32 +29,52 @@ namespace VertexShader
 {
   enum
   {
-    Default, Water, NumVertexShaders
+    Default, Water, Layered, Composite, NumVertexShaders
   };
 }
 
 // Vertex shader sources
 static const char* vsSource[] = {
-// default vertex shader
+// default vertex shader, the per-view data come from a uniform buffer bound once per pass and
+// the model transformation from a storage buffer indexed by the base instance of the draw
 R"(
 #version 460 core
 
-layout (location = 0) uniform mat4 modelToWorld;
-layout (location = 1) uniform mat4 worldToView;
-layout (location = 2) uniform mat4 projection;
-layout (location = 3) uniform vec4 clippingPlane;
+layout (std140, binding = 0) uniform View
+{
+    mat4 worldToView;
+    mat4 projection;
+    mat4 worldToClip;
+    vec4 cameraPosWorld;
+    vec4 clippingPlane;
+    vec2 nearFar;
+};
+
+struct Instance
+{
+    mat4 modelToWorld;
+    ivec4 material; // x: index of the material
+};
+
+layout (std430, binding = 0) readonly buffer Instances
+{
+    Instance instances[];
+};
 
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec2 texCoords;
 
 out vec2 vTexCoord;
+flat out int vMaterial;
 
 void main()
 {
-    vec4 positionWorld = modelToWorld * vec4(position, 1.0);
+    Instance instance = instances[gl_BaseInstance + gl_InstanceID];
+    vec4 positionWorld = instance.modelToWorld * vec4(position, 1.0);
     gl_ClipDistance[0] = dot(clippingPlane, positionWorld);
     
     vTexCoord = texCoords;
+    vMaterial = instance.material.x;
     gl_Position = projection * worldToView * positionWorld;
 }
 )",
@@ -62,12 +82,28 @@ void main()
 R"(
 #version 460 core
 
-layout (location = 0) uniform mat4 modelToWorld;
-layout (location = 1) uniform mat4 worldToView;
-layout (location = 2) uniform mat4 projection;
-layout (location = 3) uniform vec3 cameraPosWorld;
+layout (std140, binding = 0) uniform View
+{
+    mat4 worldToView;
+    mat4 projection;
+    mat4 worldToClip;
+    vec4 cameraPosWorld;
+    vec4 clippingPlane;
+    vec2 nearFar;
+};
+
+struct Instance
+{
+    mat4 modelToWorld;
+    ivec4 material; // x: index of the material
+};
+
+layout (std430, binding = 0) readonly buffer Instances
+{
+    Instance instances[];
+};
+
 layout (location = 4) uniform float movement;
-layout (location = 5) uniform vec2 nearFar;
 layout (location = 6) uniform vec2 tiling;
 
 layout (location = 0) in vec3 position;
@@ -82,12 +118,116 @@ void main()
     // if the pool is now a square, scale one direction appropriately to tile the texture
     vTexCoord = vec2(texCoords.x * tiling.x, texCoords.y * tiling.y);
 
-    vec4 positionWorld = modelToWorld * vec4(position, 1.0);
-    pixelToCam = cameraPosWorld - positionWorld.xyz;
+    vec4 positionWorld = instances[gl_BaseInstance + gl_InstanceID].modelToWorld * vec4(position, 1.0);
+    pixelToCam = cameraPosWorld.xyz - positionWorld.xyz;
     posClipSpace = projection * worldToView * positionWorld;
 
     gl_Position = posClipSpace;
 }
+)",
+// Layered vertex shader, the geometry shader projects the vertices to each of the views
+R"(
+#version 460 core
+
+struct Instance
+{
+    mat4 modelToWorld;
+    ivec4 material; // x: index of the material
+};
+
+layout (std430, binding = 0) readonly buffer Instances
+{
+    Instance instances[];
+};
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec2 texCoords;
+
+out vec2 layeredTexCoord;
+flat out int layeredMaterial;
+
+void main()
+{
+    Instance instance = instances[gl_BaseInstance + gl_InstanceID];
+    layeredTexCoord = texCoords;
+    layeredMaterial = instance.material.x;
+    gl_Position = instance.modelToWorld * vec4(position, 1.0);
+}
+)",
+// ----------------------------------------------------------------------------
+// Composite vertex shader, a single triangle covering the screen made from the vertex IDs
+// ----------------------------------------------------------------------------
+R"(
+#version 460 core
+
+out vec2 vTexCoord;
+
+void main()
+{
+    // (0, 0), (2, 0) and (0, 2), the screen is the lower left quarter of the triangle
+    vTexCoord = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(vTexCoord * 2.0 - 1.0, 0.0, 1.0);
+}
+)"
+};
+
+// ============================================================================
+
+// Geometry shader types
+namespace GeometryShader
+{
+  enum
+  {
+    Layered, NumGeometryShaders
+  };
+}
+
+// Geometry shader sources
+static const char* gsSource[] = {
+// Layered geometry shader, one invocation per view renders the triangle into its layer
+R"(
+#version 460 core
+
+layout (triangles, invocations = 2) in;
+layout (triangle_strip, max_vertices = 3) out;
+
+struct View
+{
+    mat4 worldToView;
+    mat4 projection;
+    mat4 worldToClip;
+    vec4 cameraPosWorld;
+    vec4 clippingPlane;
+    vec2 nearFar;
+};
+
+layout (std140, binding = 0) uniform LayeredViews
+{
+    View views[2];
+};
+
+in vec2 layeredTexCoord[];
+flat in int layeredMaterial[];
+
+out vec2 vTexCoord;
+flat out int vMaterial;
+
+void main()
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        vec4 positionWorld = gl_in[i].gl_Position;
+        gl_ClipDistance[0] = dot(views[gl_InvocationID].clippingPlane, positionWorld);
+        gl_Position = views[gl_InvocationID].worldToClip * positionWorld;
+        // each view has its own viewport and scissor as their resolution may differ
+        gl_Layer = gl_InvocationID;
+        gl_ViewportIndex = gl_InvocationID;
+        vTexCoord = layeredTexCoord[i];
+        vMaterial = layeredMaterial[i];
+        EmitVertex();
+    }
+    EndPrimitive();
+}
 )"
 };
 
@@ -98,7 +238,7 @@ namespace FragmentShader
 {
   enum
   {
-    Default, Water, NumFragmentShaders
+    Default, Water, Composite, NumFragmentShaders
   };
 }
 
@@ -110,15 +250,61 @@ static const char* fsSource[] = {
 R"(
 #version 460 core
 
-layout (binding = 0) uniform sampler2D diffuse;
+struct Material
+{
+    vec4 uvRect;  // offset (xy) and scale (zw) of the material in its layer
+    vec4 uvClamp; // limits of the texture coordinates in the layer
+    ivec4 texture; // x: texture array, y: layer, z: coarsest level sampled
+};
+
+layout (std430, binding = 1) readonly buffer Materials
+{
+    Material materials[];
+};
+
+// textures of all materials, see MaterialLibrary
+layout (binding = 5) uniform sampler2DArray materialArrays[4];
 
 in vec2 vTexCoord;
+flat in int vMaterial;
 
 layout (location = 0) out vec4 color;
 
+// samples the texture with the gradients shortened so that no level past maxLevel is
+// used, the coarser levels of atlas rectangles are blended with their neighbours
+vec3 sample_material(sampler2DArray tex, vec3 uvw, vec2 dx, vec2 dy, int maxLevel)
+{
+  vec2 size = vec2(textureSize(tex, 0).xy);
+  float footprint = max(length(dx * size), length(dy * size));
+  float limit = exp2(float(maxLevel));
+  if (footprint > limit)
+  {
+    dx *= limit / footprint;
+    dy *= limit / footprint;
+  }
+  return textureGrad(tex, uvw, dx, dy).rgb;
+}
+
 void main()
 {
-  vec3 texSample = texture(diffuse, vTexCoord).rgb;
+  Material material = materials[vMaterial];
+  vec2 uv = material.uvRect.xy + vTexCoord * material.uvRect.zw;
+
+  // explicit gradients, the clamp would break the implicit ones at the atlas rectangle
+  // edges and they are undefined in the switch anyway
+  vec2 dx = dFdx(uv);
+  vec2 dy = dFdy(uv);
+  vec3 uvw = vec3(clamp(uv, material.uvClamp.xy, material.uvClamp.zw), material.texture.y);
+
+  // samplers can't be indexed by a value that isn't uniform for the whole draw
+  vec3 texSample;
+  switch (material.texture.x)
+  {
+  case 0: texSample = sample_material(materialArrays[0], uvw, dx, dy, material.texture.z); break;
+  case 1: texSample = sample_material(materialArrays[1], uvw, dx, dy, material.texture.z); break;
+  case 2: texSample = sample_material(materialArrays[2], uvw, dx, dy, material.texture.z); break;
+  default: texSample = sample_material(materialArrays[3], uvw, dx, dy, material.texture.z); break;
+  }
   color = vec4(texSample, 1.0f);
 }
 )",
@@ -126,8 +312,21 @@ void main()
 R"(
 #version 460 core
 
+layout (std140, binding = 0) uniform View
+{
+    mat4 worldToView;
+    mat4 projection;
+    mat4 worldToClip;
+    vec4 cameraPosWorld;
+    vec4 clippingPlane;
+    vec2 nearFar;
+};
+
 layout (location = 4) uniform float movement;
-layout (location = 5) uniform vec2 nearFar;
+layout (location = 7) uniform bool bilateralUpsample;
+layout (location = 8) uniform vec2 targetScales; // part of the refraction (x) and reflection (y) target rendered to
+layout (location = 9) uniform float distortionStrenght; // largest offset of the sampled coords, the passes render this much around the water
+layout (location = 10) uniform bool normalMapXY; // the normal map stores just x and y (BC5), z is rebuilt
 
 layout (binding = 0) uniform sampler2D refraction;
 layout (binding = 1) uniform sampler2D reflection;
@@ -139,10 +338,10 @@ in vec2 vTexCoord;
 in vec4 posClipSpace;
 in vec3 pixelToCam;
 
-const float distortionStrenght = 0.01;
 const float offsetFactor = 0.1;
 const float depthScale = 0.91; // how soon will the deep water color appear, it's pretty sensitive
 const float fogDensity = 1.1;
+const float upsampleDepthEpsilon = 0.05; // relative depth difference still considered the same surface
 
 const float n1 = 1.0;  // air
 const float n2 = 1.33; // water
@@ -162,6 +361,46 @@ float linearize_depth(float depthVal)
     return 2 * nearFar.x * nearFar.y / (nearFar.y + nearFar.x - (nearFar.y - nearFar.x) * (2 * depthVal - 1));
 }
 
+// samples the refraction texture rendered at a lower resolution than the screen,
+// the four nearest texels are weighted bilinearly and by how close their depth is to
+// the depth of the nearest texel so that colors don't bleed over the pool edges
+vec3 sample_refraction(vec2 coord)
+{
+  if (!bilateralUpsample)
+  {
+    // keep the bilinear footprint within the rendered part
+    vec2 halfTexel = 0.5 / vec2(textureSize(refraction, 0));
+    return texture(refraction, clamp(coord * targetScales.x, halfTexel, targetScales.x - halfTexel)).rgb;
+  }
+
+  vec2 size = vec2(textureSize(refraction, 0)) * targetScales.x;
+  ivec2 maxTexel = ivec2(size) - 1;
+  vec2 texelPos = coord * size - 0.5;
+  ivec2 base = ivec2(floor(texelPos));
+  vec2 f = fract(texelPos);
+
+  float refDepth = linearize_depth(texelFetch(depthBuffer, clamp(ivec2(round(texelPos)), ivec2(0), maxTexel), 0).x);
+
+  vec3 sum = vec3(0.0);
+  float weightSum = 0.0;
+  for (int y = 0; y < 2; ++y)
+  {
+    for (int x = 0; x < 2; ++x)
+    {
+      ivec2 texel = clamp(base + ivec2(x, y), ivec2(0), maxTexel);
+      float depth = linearize_depth(texelFetch(depthBuffer, texel, 0).x);
+
+      float weight = (x == 0 ? 1.0 - f.x : f.x) * (y == 0 ? 1.0 - f.y : f.y);
+      weight /= upsampleDepthEpsilon + abs(depth - refDepth) / refDepth;
+
+      sum += texelFetch(refraction, texel, 0).rgb * weight;
+      weightSum += weight;
+    }
+  }
+
+  return sum / max(weightSum, 1e-5);
+}
+
 void main()
 {
   // convert fragment position from clip space to normalized device space
@@ -186,12 +425,20 @@ void main()
   reflectCoord.x = clamp(reflectCoord.x, 0.001, 0.999);
   reflectCoord.y = clamp(reflectCoord.y, -0.999, -0.001);
 
-  vec4 refractCol = vec4(texture(refraction, refractCoord).rgb, 1.0);
+  // the passes may have rendered into just a part of the targets, move the coords
+  // there, the reflection wraps around explicitly as the repeat can't be relied on
+  reflectCoord = vec2(reflectCoord.x, 1.0 + reflectCoord.y) * targetScales.y;
+  // keep the bilinear footprint within the rendered part at low resolutions
+  vec2 reflectHalfTexel = 0.5 / vec2(textureSize(reflection, 0));
+  reflectCoord = clamp(reflectCoord, reflectHalfTexel, targetScales.y - reflectHalfTexel);
+
+  vec4 refractCol = vec4(sample_refraction(refractCoord), 1.0);
   vec4 reflectCol = vec4(texture(reflection, reflectCoord).rgb, 1.0);
 
   // sample the depth buffer to get distance from surface of water to floor
   // and use it to create fogginess in deeper parts
-  float distToFloor = texture(depthBuffer, ndsCoord).x;
+  vec2 depthHalfTexel = 0.5 / vec2(textureSize(depthBuffer, 0));
+  float distToFloor = texture(depthBuffer, clamp(ndsCoord * targetScales.x, depthHalfTexel, targetScales.x - depthHalfTexel)).x;
   distToFloor = linearize_depth(distToFloor);
 
   float distToWater = gl_FragCoord.z;
@@ -209,6 +456,12 @@ void main()
   refractCol = mix(fog1, fog2, 0.5);
 
   vec3 normalRaw = texture(normalMap, offsetCoord).rgb;
+  if (normalMapXY)
+  {
+    // z is what's left of the unit vector, stored biased like the other two
+    vec2 xy = normalRaw.rg * 2.0 - 1.0;
+    normalRaw.b = sqrt(max(1.0 - dot(xy, xy), 0.0)) * 0.5 + 0.5;
+  }
   
   // convert rgb normal data to the actual vector it represents
   // also scale it a bit in the y direction so the water is not too bumpy
@@ -225,5 +478,26 @@ void main()
 
   color = mix(refractCol, reflectCol, R);
 }
+)",
+// ----------------------------------------------------------------------------
+// Composite fragment shader, stretches the rendered part of the source to the screen
+// ----------------------------------------------------------------------------
+R"(
+#version 460 core
+
+layout (location = 0) uniform vec2 sourceScale; // part of the source rendered to
+
+layout (binding = 0) uniform sampler2D source;
+
+in vec2 vTexCoord;
+
+layout (location = 0) out vec4 color;
+
+void main()
+{
+  // keep the bilinear footprint within the rendered part
+  vec2 halfTexel = 0.5 / vec2(textureSize(source, 0));
+  color = vec4(texture(source, clamp(vTexCoord * sourceScale, halfTexel, sourceScale - halfTexel)).rgb, 1.0);
+}
 )"
 };
@@ -0,0 +1,131 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <glad/glad.h>
+#include <vector>
+
+#include "BlockCompression.h"
+#include "MipGenerator.h"
+
+// Settings of a deterministic benchmark run, filled in from the command line
+struct BenchmarkSettings
+{
+  // Create an offscreen context without a visible window
+  bool headless = false;
+  // Number of frames to render, 0 means run interactively until the window is closed
+  int frames = 0;
+  // Fixed time step used for every frame of the run [s]
+  float dt = 1.0f / 60.0f;
+  // Where to write the per-frame report, .json extension selects JSON, anything else CSV
+  const char* reportPath = nullptr;
+  // Where to write the Chrome trace of the last profiled frames
+  const char* tracePath = nullptr;
+  // Resolution of the reflection and refraction targets relative to the window
+  float reflectionScale = 1.0f;
+  float refractionScale = 1.0f;
+  // Render the reflection and refraction in a single layered pass when their scales match
+  bool layeredViews = true;
+  // GPU frame budget of the dynamic resolution [ms], 0 keeps the resolution fixed
+  float gpuBudget = 0.0f;
+  // Where to report frame statistics of an interactive run: "title", "stdout" or a file name
+  const char* statsOutput = "title";
+  // How often to report frame statistics [s]
+  double statsInterval = 0.5;
+  // Frames longer than this count as hitches [ms]
+  float hitchMs = 33.3f;
+  // Camera path recorded during an interactive run
+  const char* recordPath = nullptr;
+  // Camera path driving the camera of a benchmark run instead of the input
+  const char* replayPath = nullptr;
+  // Load textures baked by an earlier run and bake the missing ones
+  bool textureCache = true;
+  // Bake all textures into the cache and exit without rendering
+  bool bakeTextures = false;
+  // Block format of the color textures, the two channel water maps get BC5 unless it's None
+  BlockFormat textureCompression = BlockFormat::BC7;
+  // Encoder preset of the compressed textures
+  BlockQuality compressionQuality = BlockQuality::Normal;
+  // Filter of the texture mips
+  MipFilter mipFilter = MipGenerator::DEFAULT_FILTER;
+  // Compare the mip generation of the scene images on the GPU and the CPU and exit
+  bool mipBenchmark = false;
+  // Build the water grids of a few sizes, print their vertex cache statistics and exit
+  bool meshBenchmark = false;
+  // Video memory budget of the textures, a benchmark run exceeding it fails [MB], 0 means no budget
+  float textureBudget = 0.0f;
+
+  // Parses the command line, returns false on unknown or malformed options
+  bool ParseArguments(int argc, char* argv[]);
+  // Prints command line usage
+  static void PrintUsage(const char* program);
+};
+
+// Measures GPU time of a frame using a ring of GL_TIME_ELAPSED queries so that
+// reading the results back never waits for the GPU to finish the current frame
+class GpuFrameTimer
+{
+public:
+  // Number of frames the query results may lag behind
+  static const int LATENCY = 4;
+
+  GpuFrameTimer() : _queries{0}, _frames{0}, _current(0) {}
+  ~GpuFrameTimer();
+
+  // Create the query objects
+  void Init();
+  // Starts measuring the given frame
+  void Begin(int frame);
+  // Stops measuring the current frame
+  void End();
+  // Reads back the oldest finished frame, returns false if no result is available yet.
+  // When wait is set the call blocks until the result arrives
+  bool Resolve(int& frame, double& ms, bool wait);
+
+private:
+  // Query objects
+  GLuint _queries[LATENCY];
+  // Frame index measured by each query, -1 when the query holds no pending result
+  int _frames[LATENCY];
+  // Query used by the next Begin()
+  int _current;
+
+  // No copies allowed
+  GpuFrameTimer(const GpuFrameTimer &);
+  GpuFrameTimer & operator = (const GpuFrameTimer &);
+};
+
+// Collects per-frame CPU and GPU timings and writes them into a report file
+class FrameReport
+{
+public:
+  // Timings of a single frame
+  struct Sample
+  {
+    int frame;
+    double cpuMs;
+    double gpuMs;
+  };
+
+  // Reserve space for the given number of frames
+  void Reserve(int frames) { _samples.reserve(frames); }
+  // Records CPU time of a frame, frames are expected to be numbered from 0 in order.
+  // The GPU time arrives later
+  void AddFrame(int frame, double cpuMs);
+  // Fills in the GPU time of an already recorded frame
+  void SetGpuTime(int frame, double gpuMs);
+  // Writes the report as CSV or JSON according to the file extension
+  bool Write(const char* path) const;
+  // Prints min/avg/max summary to stdout
+  void PrintSummary() const;
+
+private:
+  std::vector<Sample> _samples;
+
+  bool WriteCSV(FILE* file) const;
+  bool WriteJSON(FILE* file) const;
+};
@@ -0,0 +1,102 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+
+class ThreadPool;
+
+// S3TC formats come from an extension the GL loader doesn't include
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// Block compressed formats produced by the encoder, all of them made of 4x4 pixel blocks
+enum class BlockFormat
+{
+  // Uncompressed
+  None,
+  // Opaque color, 4 bits per pixel
+  BC1,
+  // Color with alpha, 8 bits per pixel
+  BC3,
+  // Single channel, 4 bits per pixel
+  BC4,
+  // Two channels, 8 bits per pixel
+  BC5,
+  // Color with alpha in BC7 mode 6, 8 bits per pixel
+  BC7
+};
+
+// Quality presets trading the encoding time for the precision of the endpoints
+enum class BlockQuality
+{
+  // Bounding box endpoints
+  Fast,
+  // Principal axis endpoints refined once by least squares
+  Normal,
+  // Principal axis endpoints refined repeatedly, all BC7 p-bit combinations and a local
+  // search around the BC4/BC5 endpoints
+  High
+};
+
+// Squared error of an encoded image against its source
+struct BlockStats
+{
+  double squaredError;
+  // Number of compared channel values
+  uint64_t samples;
+
+  BlockStats() : squaredError(0.0), samples(0) {}
+
+  void Add(const BlockStats &stats) { squaredError += stats.squaredError; samples += stats.samples; }
+  // Peak signal to noise ratio [dB], 100 for a lossless encoding
+  double GetPSNR() const;
+};
+
+// Encodes RGBA8 images into block compressed formats on the CPU. Blocks are independent,
+// block rows are encoded in parallel on the thread pool and the pixels of a block are
+// matched against the palette four at a time with SSE2 where it's available.
+class BlockEncoder
+{
+public:
+  // Returns the GL internal format of the block format, the sRGB one of the color formats
+  // if asked for. BC4 and BC5 have no sRGB formats
+  static GLenum GetInternalFormat(BlockFormat format, bool sRGB = false);
+  // Returns whether the block format holds color, the other ones keep separate channels
+  static bool IsColor(BlockFormat format);
+  // Returns the size of a 4x4 block [bytes]
+  static size_t GetBlockSize(BlockFormat format);
+  // Returns the size of an encoded image [bytes]
+  static size_t GetImageSize(BlockFormat format, int width, int height);
+  // Returns whether the GL implementation can sample the format
+  static bool IsSupported(BlockFormat format);
+  // Returns printable names of the format and the preset
+  static const char *GetName(BlockFormat format);
+  static const char *GetName(BlockQuality quality);
+
+  // Encodes the image of tightly packed RGBA8 pixels into blocks written in rows,
+  // partial blocks at the right and bottom edge repeat the edge pixels. BC4 takes the red
+  // channel, BC5 the red and green ones. Compares the encoded channels to the source,
+  // per block into blockStats if given (a stats for each block of the image)
+  static BlockStats Encode(BlockFormat format, BlockQuality quality, const unsigned char *pixels, int width, int height,
+                           unsigned char *blocks, ThreadPool *threadPool, BlockStats *blockStats = nullptr);
+
+private:
+  BlockEncoder();
+  ~BlockEncoder();
+};
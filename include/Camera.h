@@ -35,6 +35,8 @@ public:
   const glm::mat4x4& GetWorldToView() const { return _worldToView; }
   // Returns const reference to the internal camera transformation inverse
   const glm::mat4x4& GetViewToWorld() const { return _viewToWorld; }
+  // Sets transformation directly from the view to world matrix (rotation and translation only)
+  void SetViewToWorld(const glm::mat4x4& viewToWorld);
   // Sets camera projection using field of view and aspect ratio
   void SetProjection(float fov, float aspect, float near, float far);
   // Returns the camera projection matrix
@@ -0,0 +1,40 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "Camera.h"
+
+// Camera transformations captured once per frame, stored in a compact binary file:
+// header (magic, version, frame count) followed by 12 floats per frame, the rotation
+// and translation columns of the camera view to world transformation
+class CameraPath
+{
+public:
+  // Removes all recorded frames
+  void Clear() { _frames.clear(); }
+  // Appends the current camera transformation
+  void Record(const Camera& camera);
+  // Sets the camera transformation recorded in the given frame, wraps around at the end
+  void Apply(int frame, Camera& camera) const;
+  // Returns the number of recorded frames
+  int GetFrameCount() const { return (int)_frames.size(); }
+
+  // Writes the recorded path to a file
+  bool Save(const char* path) const;
+  // Replaces the recorded path with the one stored in a file
+  bool Load(const char* path);
+
+private:
+  // Affine part of the view to world transformation, column by column
+  struct Frame
+  {
+    float m[4][3];
+  };
+
+  std::vector<Frame> _frames;
+};
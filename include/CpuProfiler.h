@@ -0,0 +1,97 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Lightweight CPU instrumentation. Each thread records finished zones into its own
+// single producer/single consumer ring buffer without taking any locks, the rings
+// are drained from the main thread by Collect() which accumulates time per zone.
+class CpuProfiler
+{
+public:
+  // Number of zones a thread may record between two Collect() calls, must be a power of two
+  static const uint32_t RING_SIZE = 4096;
+
+  // Accumulated time of a zone since the last Collect()
+  struct ZoneTotal
+  {
+    // Zone name
+    const char* name;
+    // Total time spent in the zone [ms]
+    double ms;
+    // Number of times the zone was entered
+    int count;
+  };
+
+  // Get and create instance for this singleton
+  static CpuProfiler& GetInstance();
+  // Current time in nanoseconds
+  static uint64_t Now();
+
+  // Records a finished zone of the calling thread, name must be a string literal
+  void Record(const char* name, uint64_t start, uint64_t end);
+  // Drains the rings of all threads and replaces the zone totals with their content
+  void Collect();
+  // Zone totals gathered by the last Collect() in order of first appearance
+  const std::vector<ZoneTotal>& GetZoneTotals() const { return _totals; }
+  // Number of zones dropped because a ring was full
+  uint32_t GetDroppedCount() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+  // Single recorded zone
+  struct Event
+  {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+  };
+
+  // Per-thread ring, written only by its thread and read only by Collect()
+  struct ThreadRing
+  {
+    Event events[RING_SIZE];
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+  };
+
+  // All is private, instance is created in GetInstance()
+  CpuProfiler() : _dropped(0) {}
+  ~CpuProfiler();
+  // No copies allowed
+  CpuProfiler(const CpuProfiler &);
+  CpuProfiler & operator = (const CpuProfiler &);
+
+  // Returns the ring of the calling thread, creates it on the first call
+  ThreadRing* GetThreadRing();
+
+  // Rings of all threads that recorded something, guarded by the mutex
+  std::vector<ThreadRing*> _rings;
+  std::mutex _ringsMutex;
+  // Result of the last Collect()
+  std::vector<ZoneTotal> _totals;
+  // Number of dropped zones
+  std::atomic<uint32_t> _dropped;
+};
+
+// Scoped CPU zone, the zone lasts until the end of the enclosing block
+class CpuZone
+{
+public:
+  CpuZone(const char* name) : _name(name), _start(CpuProfiler::Now()) {}
+  ~CpuZone() { CpuProfiler::GetInstance().Record(_name, _start, CpuProfiler::Now()); }
+
+private:
+  const char* _name;
+  uint64_t _start;
+
+  // No copies allowed
+  CpuZone(const CpuZone &);
+  CpuZone & operator = (const CpuZone &);
+};
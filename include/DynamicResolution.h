@@ -0,0 +1,48 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+// Feedback controller for the render resolution. It watches the GPU time of the
+// refraction, reflection and main pass and scales their resolution to fit the frame
+// budget. The offscreen passes are scaled down first and up last as the water
+// distortion hides their resolution, the main view only when that isn't enough.
+class DynamicResolution
+{
+public:
+  // Pass scaled by the controller
+  enum Pass
+  {
+    Refraction, Reflection, Main, NumPasses
+  };
+
+  DynamicResolution();
+
+  // Sets the GPU frame budget [ms], 0 disables the controller and resets the scales
+  void SetBudget(float ms);
+  // Returns the GPU frame budget [ms]
+  float GetBudget() const { return _budgetMs; }
+  // Returns whether the controller is active
+  bool IsEnabled() const { return _budgetMs > 0.0f; }
+  // Sets the lowest scale the given pass may go to
+  void SetMinScale(Pass pass, float scale) { _minScale[pass] = scale; }
+
+  // Feeds the GPU times of the last measured frame [ms] and updates the scales
+  void Update(const float passMs[NumPasses]);
+  // Returns the current resolution scale of a pass
+  float GetScale(Pass pass) const { return _scale[pass]; }
+
+private:
+  // Scales of all passes
+  float _scale[NumPasses];
+  // Lower limits of the scales
+  float _minScale[NumPasses];
+  // Target GPU frame time
+  float _budgetMs;
+  // Smoothed GPU frame time
+  float _smoothedMs;
+  // Frames to wait before the next change so that the measurements catch up
+  int _cooldown;
+};
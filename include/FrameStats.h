@@ -0,0 +1,80 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <cstdio>
+
+// Where frame statistics get reported
+enum class StatsOutput : int
+{
+  Title, Stdout, File
+};
+
+// Histogram of frame times collected over a reporting interval
+class FrameHistogram
+{
+public:
+  // Bucket width [ms]
+  static constexpr float BUCKET_MS = 0.1f;
+  // Number of buckets, the last one holds everything above
+  static const int NUM_BUCKETS = 1000;
+
+  FrameHistogram() { Clear(); }
+
+  // Removes all samples
+  void Clear();
+  // Adds a frame time [ms]
+  void Add(float ms);
+  // Returns the frame time below which the given fraction of frames lies [ms]
+  float Percentile(float fraction) const;
+  // Number of frames in the histogram
+  int GetCount() const { return _count; }
+  // Sum of all frame times [ms]
+  double GetSum() const { return _sum; }
+
+private:
+  int _buckets[NUM_BUCKETS];
+  int _count;
+  double _sum;
+};
+
+// Collects frame times and zone timings and periodically reports percentiles,
+// hitches and per-zone averages instead of printing every single frame
+class FrameStats
+{
+public:
+  static const unsigned int MAX_REPORT_LENGTH = 1024;
+
+  FrameStats();
+  ~FrameStats();
+
+  // Selects the report output, path is needed only for StatsOutput::File
+  bool SetOutput(StatsOutput output, const char* path = nullptr);
+  // Sets how often a report is produced [s]
+  void SetInterval(double seconds) { _interval = seconds; }
+  // Frames longer than this are counted as hitches [ms]
+  void SetHitchThreshold(float ms) { _hitchMs = ms; }
+  // Returns the selected output
+  StatsOutput GetOutput() const { return _output; }
+
+  // Adds a frame ending at the given time, returns the report when the interval
+  // has elapsed (already written to stdout/file), nullptr otherwise
+  const char* AddFrame(double time, float dt);
+
+private:
+  FrameHistogram _histogram;
+  StatsOutput _output;
+  FILE* _file;
+  double _interval;
+  double _intervalStart;
+  float _hitchMs;
+  int _hitches;
+  char _report[MAX_REPORT_LENGTH];
+
+  // No copies allowed
+  FrameStats(const FrameStats &);
+  FrameStats & operator = (const FrameStats &);
+};
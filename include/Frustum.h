@@ -0,0 +1,39 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Axis aligned bounding box in world space
+struct AABB
+{
+  glm::vec3 min;
+  glm::vec3 max;
+};
+
+// View frustum given by its six planes, used for culling on the CPU
+class Frustum
+{
+public:
+  Frustum() {}
+  explicit Frustum(const glm::mat4x4& worldToClip) { Update(worldToClip); }
+
+  // Extracts the planes from the combined projection and view matrix
+  void Update(const glm::mat4x4& worldToClip);
+  // Returns false if the box is certainly outside, true if it may be visible
+  bool Intersects(const AABB& box) const;
+  // Returns false if the sphere is certainly outside, true if it may be visible
+  bool Intersects(const glm::vec3& center, float radius) const;
+
+private:
+  // Left, right, bottom, top, near, far, unit normals point inside
+  glm::vec4 _planes[6];
+};
+
+// Projects the box to the screen and returns the rectangle it covers as (min x, min y,
+// max x, max y) in [0, 1] texture coordinates, parts behind the camera are clipped away.
+// Returns false if nothing of the box is in front of the camera.
+bool GetScreenRect(const glm::mat4x4& worldToClip, const AABB& box, glm::vec4& rect);
@@ -0,0 +1,77 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <glad/glad.h>
+
+// Shadows the bound program, VAO, textures, samplers, framebuffers and enabled
+// capabilities and drops calls that wouldn't change anything, so that consecutive draws
+// don't make the driver validate the same state over and over. Only state changed
+// through the cache is tracked, call Invalidate() after touching it directly.
+class GLStateCache
+{
+public:
+  // Number of texture units tracked
+  static const int MAX_TEXTURE_UNITS = 16;
+  // Number of capabilities tracked
+  static const int MAX_CAPABILITIES = 16;
+
+  GLStateCache();
+
+  // Forgets all shadowed state, the next change of each is issued
+  void Invalidate();
+
+  void UseProgram(GLuint program);
+  void BindVertexArray(GLuint vao);
+  // Binds the texture to the unit whatever its target is (glBindTextureUnit)
+  void BindTexture(GLuint unit, GLuint texture);
+  void BindSampler(GLuint unit, GLuint sampler);
+  // GL_FRAMEBUFFER binds both the draw and the read framebuffer
+  void BindFramebuffer(GLenum target, GLuint framebuffer);
+  void Enable(GLenum capability);
+  void Disable(GLenum capability);
+  // Answered from the shadow copy when known, no round trip to the driver
+  bool IsEnabled(GLenum capability);
+
+  // Returns the number of calls passed to the driver
+  unsigned long long GetIssuedCount() const { return _issued; }
+  // Returns the number of redundant calls dropped
+  unsigned long long GetFilteredCount() const { return _filtered; }
+  // Prints the counters averaged over the given number of frames
+  void PrintCounters(int frames) const;
+
+private:
+  // Value of state not known to the cache
+  static const GLuint UNKNOWN = ~0u;
+
+  struct Capability
+  {
+    GLenum capability;
+    // 0 disabled, 1 enabled, UNKNOWN otherwise
+    GLuint state;
+  };
+
+  // Returns the shadow of the capability, nullptr when there is no room to track it
+  Capability* FindCapability(GLenum capability);
+  // Records the state as set, returns whether the call has to be issued
+  bool Update(GLuint& shadow, GLuint value);
+
+  GLuint _program;
+  GLuint _vao;
+  GLuint _textures[MAX_TEXTURE_UNITS];
+  GLuint _samplers[MAX_TEXTURE_UNITS];
+  GLuint _drawFramebuffer;
+  GLuint _readFramebuffer;
+  Capability _capabilities[MAX_CAPABILITIES];
+  int _capabilityCount;
+
+  unsigned long long _issued;
+  unsigned long long _filtered;
+
+  // No copies allowed
+  GLStateCache(const GLStateCache &);
+  GLStateCache & operator = (const GLStateCache &);
+};
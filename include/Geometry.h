@@ -14,23 +14,31 @@ class Geometry
 public:
   // Creates simple quad with uniform color
   static Mesh<Vertex_Pos_Col> *CreateQuadColor();
-  // Create simple quad with texture coordinates
-  static Mesh<Vertex_Pos_Tex> *CreateQuadTex();
+  // Create simple quad with texture coordinates, the texture coordinate meshes are
+  // created as Vertex_Pos_Tex or Vertex_Pos_Tex_Packed, the triangle ones are split into
+  // meshlets for culling
+  template <class VertexType = Vertex_Pos_Tex>
+  static Mesh<VertexType> *CreateQuadTex();
   // Create simple quad with normals, tangents and texture coordinates
   static Mesh<Vertex_Pos_Nrm_Tgt_Tex> *CreateQuadNormalTangentTex();
   // Creates simple cube with colors
   static Mesh<Vertex_Pos_Col> *CreateCubeColor();
 
-  static Mesh<Vertex_Pos_Tex>* CreateQuadTex2D();
-  static Mesh<Vertex_Pos_Tex>* CreateQuadGrid(int size);
+  template <class VertexType = Vertex_Pos_Tex>
+  static Mesh<VertexType>* CreateQuadTex2D();
+  template <class VertexType = Vertex_Pos_Tex>
+  static Mesh<VertexType>* CreateQuadGrid(int size);
   static Mesh<Vertex_Pos_Col> *CreatePool();
-  static Mesh<Vertex_Pos_Tex>* CreatePoolTex();
-  static Mesh<Vertex_Pos_Tex>* CreateCubeTexInsideOut();
+  template <class VertexType = Vertex_Pos_Tex>
+  static Mesh<VertexType>* CreatePoolTex();
+  template <class VertexType = Vertex_Pos_Tex>
+  static Mesh<VertexType>* CreateCubeTexInsideOut();
 
   // Creates simple cube with colors and shared vertices
   static Mesh<Vertex_Pos_Col> *CreateCubeColorShared();
   // Creates simple cube with texture coordinates
-  static Mesh<Vertex_Pos_Tex> *CreateCubeTex();
+  template <class VertexType = Vertex_Pos_Tex>
+  static Mesh<VertexType> *CreateCubeTex();
   // Create simple cube with normals, tangents and texture coordinates
   static Mesh<Vertex_Pos_Nrm_Tgt_Tex> *CreateCubeNormalTangentTex(bool createAdjacencyInfo = false);
   // Create tethrahedron composed from vertices
@@ -0,0 +1,141 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <glad/glad.h>
+#include <vector>
+
+// Hierarchical GPU profiler. Every zone is bracketed by a pair of GL_TIMESTAMP
+// queries (unlike GL_TIME_ELAPSED these can nest), query objects are kept in a ring
+// of several frames and read back only once available, so the profiler never stalls
+// the pipeline. A frame is simply not profiled when the ring is full.
+class GpuProfiler
+{
+public:
+  // Number of frames the results may lag behind
+  static const int LATENCY = 4;
+  // Maximum number of zones measured within a frame
+  static const int MAX_ZONES = 64;
+  // Number of samples per zone used for the rolling statistics
+  static const int HISTORY = 256;
+  // Number of frames kept for the Chrome trace
+  static const int TRACE_FRAMES = 32;
+
+  // Rolling statistics of a single zone
+  struct ZoneStats
+  {
+    // Zone name
+    const char* name;
+    // Nesting level, 0 for top level zones
+    int depth;
+    // Times over the last HISTORY samples [ms]
+    float minMs, avgMs, p99Ms;
+    // Number of samples the statistics are computed from
+    int samples;
+  };
+
+  GpuProfiler();
+  ~GpuProfiler();
+
+  // Create the query objects
+  void Init();
+  // Release the query objects, must be called while the context still exists
+  void Release();
+  // Starts a new frame and reads back results of the finished ones
+  void BeginFrame();
+  // Ends the current frame
+  void EndFrame();
+  // Opens a zone nested in the currently open one, name must be a string literal
+  void PushZone(const char* name);
+  // Closes the innermost open zone
+  void PopZone();
+
+  // Returns the most recent time of the top level zone with the given name [ms], 0 if unknown
+  float GetLastTime(const char* name) const;
+  // Fills in statistics of all zones seen so far in hierarchical order
+  void GetStats(std::vector<ZoneStats>& stats) const;
+  // Prints statistics of all zones to stdout
+  void PrintStats() const;
+  // Writes the last TRACE_FRAMES frames in the Chrome trace event format (chrome://tracing)
+  bool WriteChromeTrace(const char* path) const;
+
+private:
+  // Zone identified by its name and parent, i.e., the same render call in two passes
+  // makes two zones
+  struct Zone
+  {
+    const char* name;
+    int parent;
+    int depth;
+    // Ring of last measured times [ms]
+    float history[HISTORY];
+    int historyCount;
+    int historyNext;
+  };
+
+  // Queries issued within a single frame
+  struct FrameQueries
+  {
+    // Start and end timestamp query of each zone instance
+    GLuint queries[MAX_ZONES * 2];
+    // Zone of each instance
+    int zones[MAX_ZONES];
+    // Number of zone instances in the frame
+    int count;
+    // Query issued last, with nested zones it's the end of an outer zone rather than the
+    // end of the last opened one
+    int last;
+    // Waiting for the results
+    bool pending;
+  };
+
+  // Single measured zone instance kept for the trace
+  struct TraceEvent
+  {
+    int zone;
+    GLuint64 start;
+    GLuint64 end;
+  };
+
+  // Returns the index of the zone with given name under given parent, creates it if needed
+  int FindZone(const char* name, int parent);
+  // Reads back results of a finished frame, returns false when they are not available yet
+  bool Resolve(FrameQueries& frame);
+
+  // All zones seen so far
+  std::vector<Zone> _zones;
+  // Query ring
+  FrameQueries _frames[LATENCY];
+  // Frame being recorded, -1 when the current frame is not profiled
+  int _current;
+  // Next ring slot to use
+  int _next;
+  // Stack of open zone instances
+  int _stack[MAX_ZONES];
+  int _stackSize;
+  // Last resolved frames for the trace, TRACE_FRAMES rings of events
+  std::vector<TraceEvent> _trace[TRACE_FRAMES];
+  int _traceNext;
+
+  // No copies allowed
+  GpuProfiler(const GpuProfiler &);
+  GpuProfiler & operator = (const GpuProfiler &);
+};
+
+// Scoped profiler zone, the zone lasts until the end of the enclosing block
+class GpuProfilerZone
+{
+public:
+  GpuProfilerZone(GpuProfiler& profiler, const char* name) : _profiler(profiler) { _profiler.PushZone(name); }
+  ~GpuProfilerZone() { _profiler.PopZone(); }
+
+private:
+  GpuProfiler& _profiler;
+
+  // No copies allowed
+  GpuProfilerZone(const GpuProfilerZone &);
+  GpuProfilerZone & operator = (const GpuProfilerZone &);
+};
@@ -0,0 +1,121 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "BlockCompression.h"
+#include "MipGenerator.h"
+
+class GLStateCache;
+class ThreadPool;
+
+// Texture look up of a material, layout of the Material struct (std430)
+struct MaterialData
+{
+  // Offset (xy) and scale (zw) of the rectangle of the material in its layer
+  glm::vec4 uvRect;
+  // Limits (min xy, max zw) of the texture coordinates in the layer, atlas rectangles
+  // don't repeat and stay half a texel inside so that their neighbours don't bleed in
+  glm::vec4 uvClamp;
+  // x: texture array, y: layer, z: coarsest level sampled, the atlas rectangles stop
+  // before the levels blending them with their neighbours
+  glm::ivec4 texture;
+};
+
+// Packs the textures of all materials into a few texture arrays so that the shaders can
+// look the textures up by a small material index and draws with different materials
+// don't need any texture binds in between. Power of two textures of the same size take
+// whole layers of an array of their size, all other textures are packed into atlas
+// layers and address their rectangle in it. The arrays are sRGB so that sRGB textures
+// keep their precision, every texture is copied in as the values it's sampled as. The
+// arrays may be block compressed once they're complete, the encoding runs on the worker
+// threads. With the cache enabled the complete arrays are baked, keyed by the hash of
+// their level 0 and the settings, and later runs upload them with no mip generation and
+// no encoding.
+class MaterialLibrary
+{
+public:
+  // Maximum number of texture arrays, bound to consecutive texture units
+  static const int MAX_ARRAYS = 4;
+  // Gap around the atlas rectangles filled with their edge texels [texels]
+  static const int ATLAS_PADDING = 8;
+
+  MaterialLibrary();
+  ~MaterialLibrary();
+
+  // Block compresses the arrays created by Build() afterwards, the thread pool may be null
+  void SetCompression(BlockFormat format, BlockQuality quality, ThreadPool *threadPool);
+  // Sets the filter of the mips of the arrays, the thread pool may be null
+  void SetMipFilter(MipFilter filter, ThreadPool *threadPool);
+  // Loads the arrays baked by an earlier run and bakes the missing ones
+  void SetCacheEnabled(bool enabled) { _useCache = enabled; }
+
+  // Adds a material textured by the texture and returns its index. The texture is only
+  // read by Build() and may be deleted afterwards
+  int Add(GLuint texture);
+  // Creates the texture arrays and the material table, the atlas layers are
+  // atlasSize x atlasSize
+  bool Build(GLStateCache& state, int atlasSize);
+  // Frees the arrays and the table, must be called while the context still exists
+  void Release();
+
+  // Binds the arrays to texture units starting at firstUnit and the material table to
+  // the storage buffer binding
+  void Bind(GLStateCache& state, GLuint firstUnit, GLuint sampler, GLuint binding) const;
+
+  // Returns the number of materials
+  int GetCount() const { return (int)_materials.size(); }
+  // Returns the texture array of the material, draws sorted by it stay close in memory
+  int GetArray(int material) const { return _materials[material].texture.x; }
+  // Returns the video memory taken by the arrays [bytes]
+  size_t GetMemoryUsage() const;
+  // Prints the arrays with their memory usage to stdout
+  void PrintMemoryUsage() const;
+
+private:
+  struct TextureArray
+  {
+    GLuint texture;
+    int width, height, layers, levels;
+    // Array of atlas layers
+    bool atlas;
+    BlockFormat format;
+  };
+
+  // Returns the video memory taken by the array [bytes]
+  static size_t GetMemoryUsage(const TextureArray& array);
+  // Places the textures not fitting any array into atlas layers, returns the number of layers
+  int PackAtlas(int atlasSize, std::vector<glm::ivec4>& rects, std::vector<int>& layers) const;
+  // Replaces the array with a block compressed one and prints the error of each of its materials
+  void Compress(size_t index, const std::vector<glm::ivec4>& rects, const std::vector<int>& arrays, const std::vector<int>& layers);
+  // Replaces the array with the one baked from the same level 0 with the same settings,
+  // returns false when there's none. hash is set to the key of the array either way
+  bool LoadBaked(size_t index, uint64_t& hash);
+
+  // Textures of the materials, only until Build()
+  std::vector<GLuint> _sources;
+  std::vector<MaterialData> _materials;
+  std::vector<TextureArray> _arrays;
+  // Storage buffer with the material table
+  GLuint _table;
+  // Compression of the arrays
+  BlockFormat _format;
+  BlockQuality _quality;
+  ThreadPool *_threadPool;
+  // Filter of the mips of the arrays
+  MipFilter _mipFilter;
+  // Load and bake the complete arrays
+  bool _useCache;
+
+  // No copies allowed
+  MaterialLibrary(const MaterialLibrary &);
+  MaterialLibrary & operator = (const MaterialLibrary &);
+};
@@ -8,34 +8,58 @@
 #include <glad/glad.h>
 #include <vector>
 
-// Class for mesh representation
+#include "MeshArena.h"
+#include "Meshlet.h"
+#include "Vertex.h"
+
+// Class for mesh representation, the vertices and indices live in the arena of the
+// vertex format shared with all other meshes of that format
 template <class VertexType>
 class Mesh
 {
 public:
-  Mesh() : _vao(0), _vbo(0), _vboSize(0), _ibo(0), _iboSize(0) {}
+  Mesh() : _handle(-1), _vboSize(0), _iboSize(0) {}
   ~Mesh();
 
   // Initialize the mesh with data
   void Init(const std::vector<VertexType> &vb, const std::vector<GLuint> &ib);
-  // Return the associated VAO for rendering
-  GLuint GetVAO() { return _vao; }
+  // Initialize the mesh in place: reserves exactly the given counts and returns write only
+  // pointers to the staging memory the data is to be written to, indices of the returned
+  // type, Commit() uploads it. Packed positions are dequantized by the given quantization
+  bool Begin(GLsizei vertexCount, GLsizei indexCount, VertexType *&vertices, void *&indices, GLenum &indexType,
+             const PositionQuantization &quantization = PositionQuantization());
+  void Commit() { MeshArena<VertexType>::GetInstance().Commit(_handle); }
+  // Return the associated VAO for rendering, it's shared by all meshes of the format and index type
+  GLuint GetVAO() { return MeshArena<VertexType>::GetInstance().GetVAO(GetIndexType()); }
+  // Get the type of the indices, 16 bit unless there are too many vertices
+  GLenum GetIndexType() { return _handle >= 0 ? MeshArena<VertexType>::GetInstance().GetRange(_handle).indexType : GL_UNSIGNED_INT; }
   // Get the size of the vertex buffer
   GLsizei GetVBOSize() { return _vboSize; }
   // Get the size of the index buffer
   GLsizei GetIBOSize() { return _iboSize; }
+  // Get the offset of the vertices in the shared vertex buffer, the indices are relative to it
+  GLint GetBaseVertex() { return _handle >= 0 ? MeshArena<VertexType>::GetInstance().GetRange(_handle).baseVertex : 0; }
+  // Get the offset of the indices in the shared index buffer [indices]
+  GLuint GetFirstIndex() { return _handle >= 0 ? MeshArena<VertexType>::GetInstance().GetRange(_handle).firstIndex : 0; }
+  // Get the transformation of the stored positions to the model space, it's to be applied
+  // before the model to world transformation
+  glm::mat4 GetDequantization() const;
+  // Get the meshlets the mesh is split into for culling, empty unless they were built
+  const std::vector<Meshlet> &GetMeshlets() const { return _meshlets; }
+  // Takes over the meshlets of the mesh, their bounds are in the model space
+  void SetMeshlets(std::vector<Meshlet> &meshlets) { _meshlets.swap(meshlets); }
 
 protected:
-  // Vertex array object used to draw this mesh
-  GLuint _vao;
-  // Vertex buffer
-  GLuint _vbo;
+  // Handle of the range of the mesh in the arena
+  int _handle;
   // Vertex buffer size in # of vertices
   GLsizei _vboSize;
-  // Index buffer
-  GLuint _ibo;
   // Index buffer size
   GLsizei _iboSize;
+  // Quantization of the positions of packed vertex formats
+  PositionQuantization _quantization;
+  // Meshlets covering the index buffer
+  std::vector<Meshlet> _meshlets;
 
 private:
   // No copies allowed
@@ -46,39 +70,48 @@ private:
 template <class VertexType>
 Mesh<VertexType>::~Mesh()
 {
-  // Release resources used by the driver
-  glDeleteVertexArrays(1, &_vao);
-  glDeleteBuffers(1, &_vbo);
-  glDeleteBuffers(1, &_ibo);
+  // Return the range to the arena
+  MeshArena<VertexType>::GetInstance().Free(_handle);
 }
 
 template<class VertexType>
 void Mesh<VertexType>::Init(const std::vector<VertexType> &vb, const std::vector<GLuint> &ib)
 {
   // Do nothing if we're already initialized
-  if (_vao)
+  if (_handle >= 0)
     return;
 
   _vboSize = (GLsizei)vb.size();
   _iboSize = (GLsizei)ib.size();
 
-  // Create and bind the Vertex Array Object
-  glGenVertexArrays(1, &_vao);
-  glBindVertexArray(_vao);
+  // Copy the data to the arena
+  _handle = MeshArena<VertexType>::GetInstance().Allocate(vb.data(), _vboSize, ib.data(), _iboSize);
+}
 
-  // Generate the vertex buffer fill it with data
-  glGenBuffers(1, &_vbo);
-  glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(VertexType) * _vboSize, static_cast<const void *>(&*vb.begin()), GL_STATIC_DRAW);
+template<class VertexType>
+bool Mesh<VertexType>::Begin(GLsizei vertexCount, GLsizei indexCount, VertexType *&vertices, void *&indices, GLenum &indexType,
+                             const PositionQuantization &quantization)
+{
+  if (_handle >= 0)
+    return false;
 
-  // Describe and enable vertex attributes
-  VertexType::BindVertexAttributes();
+  void *data = nullptr;
+  _handle = MeshArena<VertexType>::GetInstance().Reserve(vertexCount, indexCount, data, indices, indexType);
+  if (_handle < 0)
+    return false;
 
-  // Generate the index buffer and fill it with data
-  glGenBuffers(1, &_ibo);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ibo);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * _iboSize, static_cast<const void *>(&*ib.begin()), GL_STATIC_DRAW);
+  _vboSize = vertexCount;
+  _iboSize = indexCount;
+  _quantization = quantization;
+  vertices = static_cast<VertexType*>(data);
+  return true;
+}
 
-  // Unbind the VAO
-  glBindVertexArray(0);
+template<class VertexType>
+glm::mat4 Mesh<VertexType>::GetDequantization() const
+{
+  return glm::mat4(glm::vec4(_quantization.scale.x, 0.0f, 0.0f, 0.0f),
+                   glm::vec4(0.0f, _quantization.scale.y, 0.0f, 0.0f),
+                   glm::vec4(0.0f, 0.0f, _quantization.scale.z, 0.0f),
+                   glm::vec4(_quantization.bias, 1.0f));
 }
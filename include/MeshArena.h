@@ -0,0 +1,179 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <glad/glad.h>
+#include <vector>
+
+#include "Vertex.h"
+
+// Suballocates the vertices and indices of all meshes of one vertex format out of a
+// single immutable vertex buffer and a single immutable index buffer, drawn through one
+// VAO with base vertex and first index offsets. Mesh creation or removal then costs no
+// GL objects and switching between meshes of the same format doesn't touch the VAO.
+// When an allocation doesn't fit the arena is compacted, and grown if that's not
+// enough, the ranges of live meshes may move so they are looked up by their handle.
+// New meshes are written by the CPU straight into a persistently mapped staging ring and
+// copied to their range on the GPU, so creating a mesh costs one copy and no allocation
+// once the ring is large enough. The uploads are suballocated from regions of the ring
+// fenced one by one, they only wait for the GPU when they wrap around to a region it's
+// still copying from.
+// Meshes of up to 65536 vertices take 16 bit indices, the larger ones 32 bit, each index
+// type has its own index buffer and VAO.
+class MeshArenaBase
+{
+public:
+  // Range of a mesh in the buffers
+  struct Range
+  {
+    // Offset of the first vertex [vertices]
+    GLint baseVertex;
+    // Offset of the first index [indices]
+    GLuint firstIndex;
+    GLsizei vertexCount;
+    GLsizei indexCount;
+    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    GLenum indexType;
+  };
+
+  // Returns the handle of a new mesh range with the data uploaded, -1 on failure
+  int Allocate(const void* vertices, GLsizei vertexCount, const GLuint* indices, GLsizei indexCount);
+  // Returns the handle of a new mesh range, -1 on failure. Its vertices and indices of
+  // the returned type are to be written to the returned write only pointers and uploaded
+  // by Commit(), only one range of the arena may be reserved at a time
+  int Reserve(GLsizei vertexCount, GLsizei indexCount, void*& vertices, void*& indices, GLenum& indexType);
+  // Uploads the data written to the reserved range
+  void Commit(int handle);
+  // Returns the range back to the arena
+  void Free(int handle);
+  // Returns the current range of the mesh, valid until the next allocation or defragmentation
+  const Range& GetRange(int handle) const { return _ranges[handle]; }
+  // Returns the VAO drawing all meshes of the arena with the index type
+  GLuint GetVAO(GLenum indexType) const { return _indexBuffers[GetIndexBuffer(indexType)].vao; }
+
+  // Returns the smallest index type able to address the vertices
+  static GLenum SelectIndexType(GLsizei vertexCount) { return vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+  // Returns the size of an index of the type [bytes]
+  static size_t GetIndexSize(GLenum indexType) { return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+
+  // Moves all live ranges to the start of the buffers so that the free space is in one piece
+  void Defragment();
+  // Releases the buffers and the VAO, must be called while the context still exists
+  void Release();
+  // Prints the occupancy of the arena to stdout
+  void PrintOccupancy() const;
+
+  // Calls Defragment(), Release() or PrintOccupancy() of all arenas
+  static void DefragmentAll();
+  static void ReleaseAll();
+  static void PrintAllOccupancy();
+
+protected:
+  MeshArenaBase(size_t vertexSize, void (*bindAttributes)());
+  ~MeshArenaBase();
+
+private:
+  // Contiguous run of free vertices or indices
+  struct FreeBlock
+  {
+    GLuint offset;
+    GLuint size;
+  };
+
+  // Index buffer of one index type together with the VAO drawing from it
+  struct IndexBuffer
+  {
+    GLuint vao;
+    GLuint ibo;
+    // Size of the buffer [indices]
+    GLuint capacity;
+    // Free runs of the buffer ordered by offset
+    std::vector<FreeBlock> freeList;
+  };
+  static const int INDEX_TYPES = 2;
+  // Regions of the staging ring
+  static const int STAGING_REGIONS = 4;
+
+  // Returns the index of the index buffer of the type
+  static int GetIndexBuffer(GLenum indexType) { return indexType == GL_UNSIGNED_SHORT ? 0 : 1; }
+
+  // Returns the offset of a free run of count elements taken from the list, -1 if there's none
+  static GLint TakeBlock(std::vector<FreeBlock>& freeList, GLuint count);
+  // Returns the run back to the list, merges it with its neighbours
+  static void ReturnBlock(std::vector<FreeBlock>& freeList, GLuint offset, GLuint count);
+  // Returns the number of free elements of the list
+  static GLuint GetFreeCount(const std::vector<FreeBlock>& freeList);
+
+  // Returns the handle of a new range, compacts or grows the buffers when it doesn't fit
+  int AllocateRange(GLsizei vertexCount, GLsizei indexCount, GLenum indexType);
+  // Moves the live ranges to the start of new buffers of the given capacities, index
+  // buffers of no capacity aren't created
+  void Reallocate(GLuint vertexCapacity, const GLuint indexCapacities[INDEX_TYPES]);
+  // Finds size bytes of the staging ring for an upload and returns their offset, grows the
+  // ring when a region is too small and waits for the GPU only when it still copies out
+  // of the region the upload moves to
+  bool PrepareStaging(size_t size, size_t& offset);
+  // Deletes the staging ring and its fences
+  void ReleaseStaging();
+
+  // Size of a vertex [bytes]
+  size_t _vertexSize;
+  // Describes the vertex attributes of the bound vertex buffer
+  void (*_bindAttributes)();
+
+  GLuint _vbo;
+  // Size of the vertex buffer [vertices]
+  GLuint _vertexCapacity;
+  // Free runs of the vertex buffer ordered by offset
+  std::vector<FreeBlock> _freeVertices;
+  // 16 and 32 bit index buffers
+  IndexBuffer _indexBuffers[INDEX_TYPES];
+  // Ranges of the meshes indexed by their handles, unused ones have no vertices
+  std::vector<Range> _ranges;
+  // Handles available for reuse
+  std::vector<int> _freeHandles;
+  // Number of meshes and times the buffers were reallocated (compacted or grown)
+  int _meshCount;
+  int _reallocations;
+
+  // Persistently mapped staging ring for the uploads and the size of its regions [bytes]
+  GLuint _staging;
+  unsigned char* _stagingData;
+  size_t _stagingRegionSize;
+  // Region the uploads are taken from and the bytes already used in it
+  int _stagingRegion;
+  size_t _stagingUsed;
+  // Signaled when the copies out of the regions left behind are done
+  GLsync _stagingFences[STAGING_REGIONS];
+  // Handle of the reserved range waiting for Commit(), -1 if there's none
+  int _pending;
+  // Offset of the data of the reserved range in the staging ring [bytes]
+  size_t _pendingOffset;
+
+  // All arenas, for the global operations
+  static std::vector<MeshArenaBase*>& GetArenas();
+
+  // No copies allowed
+  MeshArenaBase(const MeshArenaBase &);
+  MeshArenaBase & operator = (const MeshArenaBase &);
+};
+
+// Arena of the meshes of a vertex format
+template <class VertexType>
+class MeshArena : public MeshArenaBase
+{
+public:
+  // Get and create instance for this singleton
+  static MeshArena& GetInstance()
+  {
+    static MeshArena instance;
+    return instance;
+  }
+
+private:
+  MeshArena() : MeshArenaBase(sizeof(VertexType), &BindVertexAttributes<VertexType>) {}
+};
@@ -0,0 +1,236 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+
+// Builds a mesh of exactly known size without any intermediate buffers: the vertices and
+// indices are written straight into the staging memory of the mesh arena and Finish()
+// uploads them with a single copy. The counts given to the constructor must match what's
+// added, only one builder per vertex format may be alive at a time. The vertices are
+// added in full precision and packed on the way, packed formats quantize the positions
+// within the bounds given to the constructor. Triangle meshes may be split into meshlets
+// and any mesh optimized for the vertex cache, overdraw and vertex fetch as well, the
+// indices and positions, and the vertices of the optimized meshes, are then kept aside
+// until Finish() reorders them.
+template <class VertexType>
+class MeshBuilder
+{
+public:
+  typedef typename VertexPacking<VertexType>::Source SourceVertex;
+
+  MeshBuilder(GLsizei vertexCount, GLsizei indexCount,
+              const glm::vec3 &boundsMin = glm::vec3(-1.0f), const glm::vec3 &boundsMax = glm::vec3(1.0f));
+  ~MeshBuilder();
+
+  // Splits the mesh into meshlets when it's finished, must be called before adding anything
+  void BuildMeshlets(GLuint maxVertices = MeshletBuilder::MAX_VERTICES, GLuint maxTriangles = MeshletBuilder::MAX_TRIANGLES)
+  {
+    if (_vertexCount > 0 || _indexCount > 0)
+      return;
+
+    _meshletVertices = maxVertices;
+    _meshletTriangles = maxTriangles;
+    KeepIndices();
+  }
+
+  // Reorders the primitives for the vertex cache and overdraw and the vertices in the order
+  // they're fetched when the mesh is finished, prints the statistics when given a name.
+  // Must be called before adding anything
+  void OptimizePrimitives(GLuint primitiveSize = 3, const char *name = nullptr)
+  {
+    if (_vertexCount > 0 || _indexCount > 0)
+      return;
+
+    _optimizedPrimitive = primitiveSize;
+    _optimizedName = name;
+    _keptVertices.reserve(_vertexCapacity);
+    KeepIndices();
+  }
+
+  // Adds a vertex and returns its index
+  GLuint AddVertex(const SourceVertex &vertex)
+  {
+    // The staging memory is write only, the vertex is written once as a whole. Optimized
+    // vertices are reordered, they go to the staging memory at the end
+    if (_vertexCount < _vertexCapacity)
+    {
+      if (_optimizedPrimitive > 0)
+        _keptVertices.push_back(vertex);
+      else
+        _vertices[_vertexCount] = VertexPacking<VertexType>::Pack(vertex, _quantization);
+      if (_keepIndices)
+        _positions.push_back(glm::vec3(vertex.x, vertex.y, vertex.z));
+    }
+    return (GLuint)_vertexCount++;
+  }
+  void AddIndex(GLuint index)
+  {
+    if (_indexCount < _indexCapacity)
+    {
+      // Meshlets and the optimization reorder the primitives, the indices go to the staging
+      // memory at the end
+      if (_keepIndices)
+        _keptIndices.push_back(index);
+      else if (_indexType == GL_UNSIGNED_SHORT)
+        static_cast<GLushort*>(_indices)[_indexCount] = (GLushort)index;
+      else
+        static_cast<GLuint*>(_indices)[_indexCount] = index;
+    }
+    ++_indexCount;
+  }
+  void AddTriangle(GLuint a, GLuint b, GLuint c)
+  {
+    AddIndex(a);
+    AddIndex(b);
+    AddIndex(c);
+  }
+
+  // Uploads the data and returns the mesh, nullptr when the counts don't match the reservation
+  Mesh<VertexType> *Finish();
+
+private:
+  // Keeps the indices and positions aside for reordering
+  void KeepIndices()
+  {
+    _keepIndices = true;
+    _positions.reserve(_vertexCapacity);
+    _keptIndices.reserve(_indexCapacity);
+  }
+
+  // Mesh being built, owned by the builder until Finish()
+  Mesh<VertexType> *_mesh;
+  // Staging memory of the mesh
+  VertexType *_vertices;
+  void *_indices;
+  GLenum _indexType;
+  // Quantization of the positions of packed vertex formats
+  PositionQuantization _quantization;
+  // Reserved and added counts
+  GLsizei _vertexCapacity, _vertexCount;
+  GLsizei _indexCapacity, _indexCount;
+  // Meshlet limits, zero when no meshlets are built
+  GLuint _meshletVertices, _meshletTriangles;
+  // Vertices of the primitives reordered for the cache, zero when not optimized
+  GLuint _optimizedPrimitive;
+  const char *_optimizedName;
+  // Positions and indices kept for the meshlets and the optimization
+  bool _keepIndices;
+  std::vector<glm::vec3> _positions;
+  std::vector<GLuint> _keptIndices;
+  // Vertices kept for the vertex fetch reordering
+  std::vector<SourceVertex> _keptVertices;
+
+  // No copies allowed
+  MeshBuilder(const MeshBuilder &);
+  MeshBuilder & operator = (const MeshBuilder &);
+};
+
+template <class VertexType>
+MeshBuilder<VertexType>::MeshBuilder(GLsizei vertexCount, GLsizei indexCount, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) :
+  _mesh(new Mesh<VertexType>()),
+  _vertices(nullptr),
+  _indices(nullptr),
+  _indexType(GL_UNSIGNED_INT),
+  _quantization(VertexPacking<VertexType>::GetQuantization(boundsMin, boundsMax)),
+  _vertexCapacity(0),
+  _vertexCount(0),
+  _indexCapacity(0),
+  _indexCount(0),
+  _meshletVertices(0),
+  _meshletTriangles(0),
+  _optimizedPrimitive(0),
+  _optimizedName(nullptr),
+  _keepIndices(false)
+{
+  if (_mesh->Begin(vertexCount, indexCount, _vertices, _indices, _indexType, _quantization))
+  {
+    _vertexCapacity = vertexCount;
+    _indexCapacity = indexCount;
+  }
+}
+
+template <class VertexType>
+MeshBuilder<VertexType>::~MeshBuilder()
+{
+  // Not finished, the range goes back to the arena uncommitted
+  delete _mesh;
+}
+
+template <class VertexType>
+Mesh<VertexType> *MeshBuilder<VertexType>::Finish()
+{
+  if (!_mesh)
+    return nullptr;
+
+  if (_vertexCapacity == 0 || _vertexCount != _vertexCapacity || _indexCount != _indexCapacity)
+  {
+    printf("Mesh built with %d vertices and %d indices instead of the %d and %d reserved!\n",
+           _vertexCount, _indexCount, _vertexCapacity, _indexCapacity);
+    delete _mesh;
+    _mesh = nullptr;
+    return nullptr;
+  }
+
+  if (_optimizedPrimitive > 0)
+  {
+    const MeshOptimizer::CacheStatistics before =
+      MeshOptimizer::AnalyzeVertexCache(_keptIndices.data(), _keptIndices.size(), _positions.size(), _optimizedPrimitive);
+    MeshOptimizer::OptimizeVertexCache(_keptIndices.data(), _keptIndices.size(), _positions.size(), _optimizedPrimitive);
+    MeshOptimizer::OptimizeOverdraw(_keptIndices.data(), _keptIndices.size(), _positions, _optimizedPrimitive);
+
+    // Lay the vertices out in the order they're fetched, the unused ones go last so that
+    // the reserved count still matches
+    std::vector<GLuint> remap;
+    GLuint next = (GLuint)MeshOptimizer::OptimizeVertexFetch(_keptIndices.data(), _keptIndices.size(), _keptVertices.size(), remap);
+    std::vector<glm::vec3> positions(_positions.size());
+    for (size_t i = 0; i < _keptVertices.size(); ++i)
+    {
+      if (remap[i] == ~0u)
+        remap[i] = next++;
+      _vertices[remap[i]] = VertexPacking<VertexType>::Pack(_keptVertices[i], _quantization);
+      positions[remap[i]] = _positions[i];
+    }
+    _positions.swap(positions);
+
+    if (_optimizedName)
+    {
+      const MeshOptimizer::CacheStatistics after =
+        MeshOptimizer::AnalyzeVertexCache(_keptIndices.data(), _keptIndices.size(), _positions.size(), _optimizedPrimitive);
+      printf("Mesh optimization of %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", _optimizedName, before.acmr, after.acmr,
+             before.atvr, after.atvr);
+    }
+  }
+
+  if (_meshletVertices > 0)
+  {
+    std::vector<Meshlet> meshlets;
+    MeshletBuilder::Build(_keptIndices.data(), _keptIndices.size(), _positions, meshlets, _meshletVertices, _meshletTriangles);
+    _mesh->SetMeshlets(meshlets);
+  }
+
+  if (_keepIndices)
+  {
+    for (GLsizei i = 0; i < _indexCount; ++i)
+    {
+      if (_indexType == GL_UNSIGNED_SHORT)
+        static_cast<GLushort*>(_indices)[i] = (GLushort)_keptIndices[i];
+      else
+        static_cast<GLuint*>(_indices)[i] = _keptIndices[i];
+    }
+  }
+
+  _mesh->Commit();
+  Mesh<VertexType> *mesh = _mesh;
+  _mesh = nullptr;
+  return mesh;
+}
@@ -0,0 +1,82 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Reorders the primitives and vertices of meshes at load time for the GPU: primitives
+// are ordered so that the post-transform vertex cache hits as often as possible
+// (Forsyth's linear-speed vertex cache optimization), then clusters of them are sorted
+// so that the outer, occluding ones go first and cause less overdraw, and finally the
+// vertices are laid out in the order the indices fetch them. Primitives are triangles
+// or, e.g., quad patches for tessellation, given by the number of their vertices.
+class MeshOptimizer
+{
+public:
+  // Vertex cache behaviour of an index buffer
+  struct CacheStatistics
+  {
+    // Average cache miss ratio, transformed vertices per primitive
+    float acmr;
+    // Average transformed to vertex ratio, transformed vertices per vertex, 1 is ideal
+    float atvr;
+  };
+
+  // Simulates a FIFO post-transform cache of the size over the indices
+  static CacheStatistics AnalyzeVertexCache(const GLuint *indices, size_t indexCount, size_t vertexCount,
+                                            GLuint primitiveSize = 3, size_t cacheSize = 16);
+
+  // Reorders the primitives for the post-transform vertex cache
+  static void OptimizeVertexCache(GLuint *indices, size_t indexCount, size_t vertexCount, GLuint primitiveSize = 3);
+  // Reorders clusters of the cache optimized primitives so that the ones facing outwards go
+  // first, clusters are only split where the cache miss ratio grows at most by threshold
+  static void OptimizeOverdraw(GLuint *indices, size_t indexCount, const std::vector<glm::vec3> &positions,
+                               GLuint primitiveSize = 3, float threshold = 1.05f);
+  // Renumbers the vertices in the order of their first use and rewrites the indices,
+  // returns the number of used vertices. remap[old] is the new index, unused vertices get ~0u
+  static size_t OptimizeVertexFetch(GLuint *indices, size_t indexCount, size_t vertexCount, std::vector<GLuint> &remap);
+
+  // Runs all the stages on a mesh with float x, y, z positions, prints the statistics
+  // before and after when it's given a name
+  template <class VertexType>
+  static void Optimize(std::vector<VertexType> &vb, std::vector<GLuint> &ib, GLuint primitiveSize = 3, const char *name = nullptr);
+
+private:
+  MeshOptimizer();
+  ~MeshOptimizer();
+};
+
+template <class VertexType>
+void MeshOptimizer::Optimize(std::vector<VertexType> &vb, std::vector<GLuint> &ib, GLuint primitiveSize, const char *name)
+{
+  const CacheStatistics before = AnalyzeVertexCache(ib.data(), ib.size(), vb.size(), primitiveSize);
+
+  std::vector<glm::vec3> positions(vb.size());
+  for (size_t i = 0; i < vb.size(); ++i)
+    positions[i] = glm::vec3(vb[i].x, vb[i].y, vb[i].z);
+
+  OptimizeVertexCache(ib.data(), ib.size(), vb.size(), primitiveSize);
+  OptimizeOverdraw(ib.data(), ib.size(), positions, primitiveSize);
+
+  std::vector<GLuint> remap;
+  std::vector<VertexType> vertices(OptimizeVertexFetch(ib.data(), ib.size(), vb.size(), remap));
+  for (size_t i = 0; i < vb.size(); ++i)
+  {
+    if (remap[i] != ~0u)
+      vertices[remap[i]] = vb[i];
+  }
+  vb.swap(vertices);
+
+  if (name)
+  {
+    const CacheStatistics after = AnalyzeVertexCache(ib.data(), ib.size(), vb.size(), primitiveSize);
+    printf("Mesh optimization of %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", name, before.acmr, after.acmr, before.atvr, after.atvr);
+  }
+}
@@ -0,0 +1,59 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Small cluster of neighbouring triangles of a mesh with bounds to cull it by. The
+// triangles of a meshlet are a contiguous range of the index buffer of the mesh, so any
+// run of neighbouring visible meshlets is drawn as a single range.
+struct Meshlet
+{
+  // Bounding sphere in the model space
+  glm::vec3 center;
+  float radius;
+  // Normal cone: a viewer at position p sees only the back faces of the meshlet if
+  // dot(normalize(coneApex - p), coneAxis) > coneCutoff. Meshlets facing too many
+  // directions get a zero axis and are never culled by the cone
+  glm::vec3 coneApex;
+  float coneCutoff;
+  glm::vec3 coneAxis;
+  // Range of the triangles relative to the first index of the mesh [indices]
+  GLuint firstIndex;
+  GLuint indexCount;
+};
+
+// Splits triangle meshes into meshlets at load time
+class MeshletBuilder
+{
+public:
+  // Default limits of a meshlet, the sizes mesh shading hardware prefers
+  static const GLuint MAX_VERTICES = 64;
+  static const GLuint MAX_TRIANGLES = 124;
+
+  // Groups the triangles into meshlets of at most the given number of vertices and
+  // triangles and reorders them in place so that each meshlet is a contiguous range.
+  // Meshlets are grown by the triangles adding the fewest new vertices, the ones facing
+  // the same way as the meshlet go first to keep the normal cones narrow
+  static void Build(GLuint *indices, size_t indexCount, const std::vector<glm::vec3> &positions, std::vector<Meshlet> &meshlets,
+                    GLuint maxVertices = MAX_VERTICES, GLuint maxTriangles = MAX_TRIANGLES);
+
+  // Returns false if the viewer at the model space position certainly sees only the back
+  // faces of the meshlet
+  static bool IsFrontFacing(const Meshlet &meshlet, const glm::vec3 &viewer)
+  {
+    // No normalization, a viewer right at the apex is never culled
+    const glm::vec3 toApex = meshlet.coneApex - viewer;
+    return glm::dot(toApex, meshlet.coneAxis) <= meshlet.coneCutoff * glm::length(toApex);
+  }
+
+private:
+  MeshletBuilder();
+  ~MeshletBuilder();
+};
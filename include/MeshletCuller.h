@@ -0,0 +1,88 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Camera.h"
+#include "Frustum.h"
+#include "Meshlet.h"
+#include "RenderQueue.h"
+
+class ThreadPool;
+
+// Culls the meshlets of the draws of a pass on the CPU before they go to the render
+// queue. A meshlet is kept when any view of the pass may see it: it has to intersect
+// the view frustum, be on the visible side of the clipping plane and, unless the draw
+// renders back faces too, face the viewer according to its normal cone. The visible
+// meshlets following each other in the index buffer are merged into a single draw,
+// the multi draw indirect calls of the queue then issue just the visible ranges.
+class MeshletCuller
+{
+public:
+  // Maximum number of views of a pass, the layered pass renders two
+  static const int MAX_VIEWS = 2;
+  // Number of meshlets a thread culls at least, smaller work isn't worth the handover
+  static const size_t GRAIN = 256;
+
+  MeshletCuller();
+
+  // Sets the views of the following draws, the planes clip away what's on their negative side
+  void SetViews(const Camera *cams, const glm::vec4 *clippingPlanes, int count);
+  // Records the draw of a mesh, the packet covers the whole index range of the mesh and
+  // the meshlet bounds are transformed by modelToWorld. Draws without meshlets always pass
+  void Add(const DrawPacket &packet, const std::vector<Meshlet> &meshlets, const glm::mat4 &modelToWorld, bool coneCulling);
+
+  // Culls the recorded draws in parallel, adds the visible ranges to the queue and
+  // removes the draws
+  void Flush(ThreadPool &threadPool, RenderQueue &queue);
+
+  // Prints the number of tested and visible meshlets averaged over the given number of frames
+  void PrintCounters(int frames) const;
+
+private:
+  // View in the world space
+  struct View
+  {
+    Frustum frustum;
+    glm::vec4 clippingPlane;
+  };
+
+  // Recorded draw
+  struct Draw
+  {
+    DrawPacket packet;
+    const std::vector<Meshlet> *meshlets;
+    glm::mat4 modelToWorld;
+    // Largest scale of the transformation, the bounding spheres grow by it
+    float scale;
+    // Viewer positions in the model space, the cones are tested there as the back faces
+    // stay back faces under any transformation that doesn't mirror
+    glm::vec3 viewers[MAX_VIEWS];
+    bool coneCulling;
+    // Index of the first meshlet in the visibility flags
+    size_t firstMeshlet;
+  };
+
+  // Tests the meshlets [begin, end) of all draws
+  void CullRange(size_t begin, size_t end);
+
+  View _views[MAX_VIEWS];
+  glm::vec3 _viewerPositions[MAX_VIEWS];
+  int _viewCount;
+  std::vector<Draw> _draws;
+  // Visibility of the meshlets of all recorded draws
+  std::vector<uint8_t> _visible;
+  // Number of meshlets tested and found visible
+  unsigned long long _tested;
+  unsigned long long _passed;
+
+  // No copies allowed
+  MeshletCuller(const MeshletCuller &);
+  MeshletCuller & operator = (const MeshletCuller &);
+};
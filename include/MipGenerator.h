@@ -0,0 +1,65 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+class ThreadPool;
+
+// Filters reducing one mip level into the next
+enum class MipFilter
+{
+  // glGenerateMipmap, left to the driver
+  Driver,
+  // Average of the texels covered by the destination texel
+  Box,
+  // Windowed sinc of radius 3 with a Kaiser window (alpha 4), sharp without much ringing
+  Kaiser,
+  // Lanczos windowed sinc of radius 3, the sharpest one
+  Lanczos
+};
+
+// What the channels of an image hold, decides the space they're filtered in
+enum class MipContent
+{
+  // Values filtered as they are
+  Linear,
+  // sRGB encoded color converted to linear values for the filtering, alpha stays linear
+  SRGB,
+  // Unit vectors biased into [0, 1] in the first three channels, renormalized on every level
+  Normal
+};
+
+// Generates mip chains of 8 bit images on the CPU. Levels are filtered separably in 32 bit
+// floats, the rows of a level in parallel on the thread pool with SSE2 kernels, the
+// vertical pass with AVX ones on CPUs supporting it. Every level is reduced from the
+// previous one, the edges are mirrored and odd sizes are resampled by the exact ratio of
+// the level sizes.
+class MipGenerator
+{
+public:
+  // Filter used unless another one is asked for
+  static const MipFilter DEFAULT_FILTER = MipFilter::Kaiser;
+
+  // Returns the size of the levels below level 0 [bytes]
+  static size_t GetChainSize(int width, int height, int numChannels);
+  // Returns a printable name of the filter
+  static const char *GetName(MipFilter filter);
+  // Returns the radius of the filter kernel in texels of the reduced level, the driver
+  // filter is taken for a box filter
+  static float GetRadius(MipFilter filter);
+
+  // Generates the levels below level 0 of the image of tightly packed pixels with 1 to 4
+  // channels, down to 1x1. The levels are written one after another into levels, which
+  // needs GetChainSize() bytes. Returns false for the driver filter, which is up to the
+  // caller
+  static bool Generate(MipFilter filter, MipContent content, const unsigned char *pixels, int width, int height,
+                       int numChannels, unsigned char *levels, ThreadPool *threadPool);
+
+private:
+  MipGenerator();
+  ~MipGenerator();
+};
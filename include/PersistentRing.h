@@ -0,0 +1,64 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <glad/glad.h>
+
+// Buffer persistently mapped for writing and split into FRAMES regions used round robin.
+// The CPU fills the region of the current frame while the GPU may still be reading the
+// older ones, a fence placed at the end of each frame keeps a region from being
+// overwritten before the GPU is done with it. There are no per-update driver calls,
+// the data written through the mapping is visible to commands issued afterwards.
+class PersistentRing
+{
+public:
+  // Number of frames in flight
+  static const int FRAMES = 3;
+
+  PersistentRing();
+  ~PersistentRing();
+
+  // Creates and maps the buffer with frameSize bytes available per frame
+  bool Init(size_t frameSize);
+  // Unmaps and deletes the buffer, must be called while the context still exists
+  void Release();
+
+  // Moves to the next region, waits for the GPU if it still uses it
+  void BeginFrame();
+  // Marks the end of the commands using the current region
+  void EndFrame();
+
+  // Allocates size bytes aligned to alignment in the region of the current frame and
+  // returns where to write them, nullptr when the region is full. offset is set to the
+  // position of the data in the buffer
+  void* Allocate(size_t size, size_t alignment, GLintptr& offset);
+
+  // Returns the buffer handle
+  GLuint GetBuffer() const { return _buffer; }
+  // Returns the offset of the current frame region in the buffer
+  GLintptr GetFrameOffset() const { return (GLintptr)(_current * _frameSize); }
+  // Returns the size of a frame region
+  size_t GetFrameSize() const { return _frameSize; }
+
+private:
+  // Buffer object
+  GLuint _buffer;
+  // Persistent mapping of the whole buffer
+  unsigned char* _data;
+  // Size of one region, a multiple of the buffer offset alignments
+  size_t _frameSize;
+  // Region of the current frame
+  int _current;
+  // Bytes used in the current region
+  size_t _used;
+  // Fences of the frames in flight
+  GLsync _fences[FRAMES];
+
+  // No copies allowed
+  PersistentRing(const PersistentRing &);
+  PersistentRing & operator = (const PersistentRing &);
+};
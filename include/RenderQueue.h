@@ -0,0 +1,114 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+class GLStateCache;
+class PersistentRing;
+
+// Per instance data read by the shaders, layout of the Instance struct (std430)
+struct InstanceData
+{
+  glm::mat4 modelToWorld;
+  // x: index of the material
+  glm::ivec4 material;
+};
+
+// Command of an indirect draw, layout given by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLint baseVertex;
+  GLuint baseInstance;
+};
+
+// Single draw recorded into a render queue with all the state it needs
+struct DrawPacket
+{
+  // Sort key, see RenderQueue::MakeKey()
+  uint64_t key;
+  GLuint program;
+  GLuint vao;
+  // Index range of the mesh in the index buffer of the VAO, of GL_UNSIGNED_SHORT or
+  // GL_UNSIGNED_INT indices
+  GLenum indexType;
+  GLsizei indexCount;
+  GLuint firstIndex;
+  GLint baseVertex;
+  // Texture and sampler bound to unit 0, no texture leaves the unit as it is
+  GLuint texture;
+  GLuint sampler;
+  // Data of the instance, the shaders pick it by the base instance and instance ID
+  InstanceData instance;
+};
+
+// Collects the draws of a pass and issues them sorted by a 64 bit key so that the
+// draws sharing a program and textures go one after another and only the state that
+// differs between neighbours has to be changed. The key is, from the most significant
+// bits: stage (8 bits), program (8 bits), texture set (16 bits) and depth (32 bits).
+// Stages are issued strictly in order, they separate draws that depend on each other,
+// e.g., the stencil masking, and let the far away draws like the sky go last.
+// Sorted draws sharing all the state are merged into a single multi draw indirect call,
+// neighbouring draws of the same mesh into a single instanced command of it.
+class RenderQueue
+{
+public:
+  // Called whenever the stage changes during Submit() to set up its fixed function state
+  typedef void (*StageCallback)(unsigned int stage);
+
+  RenderQueue() : _draws(0), _drawCalls(0) {}
+
+  // Builds the sort key, depth is the distance from the viewer. Front to back ordering
+  // lets the early depth test reject hidden fragments, back to front is for blending
+  static uint64_t MakeKey(unsigned int stage, unsigned int program, unsigned int textureSet, float depth, bool backToFront = false);
+
+  // Removes all draws
+  void Clear() { _packets.clear(); _order.clear(); }
+  // Records a draw
+  void Add(const DrawPacket& packet) { _packets.push_back(packet); }
+  // Returns the number of recorded draws
+  size_t GetSize() const { return _packets.size(); }
+
+  // Sorts the draws by their keys, draws with equal keys keep their order
+  void Sort();
+  // Issues the sorted draws through the state cache, the callback is called before the
+  // first draw of each stage. The instance data are written to the instances ring bound
+  // as the storage buffer of the frame, the commands to the commands ring bound as the
+  // draw indirect buffer
+  void Submit(GLStateCache& state, PersistentRing& instances, PersistentRing& commands, StageCallback onStage = nullptr);
+
+  // Prints the number of draws and of the draw calls they were merged into averaged over
+  // the given number of frames
+  void PrintCounters(int frames) const;
+
+private:
+  // Sorts the key and index pairs, least significant byte first
+  static void RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& order,
+                        std::vector<uint64_t>& scratchKeys, std::vector<uint32_t>& scratchOrder);
+  // Returns whether the draws can go into the same multi draw call
+  static bool SameState(const DrawPacket& a, const DrawPacket& b);
+
+  std::vector<DrawPacket> _packets;
+  // Sorted order of the packets
+  std::vector<uint32_t> _order;
+  // Sorting buffers kept between frames
+  std::vector<uint64_t> _keys, _scratchKeys;
+  std::vector<uint32_t> _scratchOrder;
+  // Number of draws submitted and of draw calls issued for them
+  unsigned long long _draws;
+  unsigned long long _drawCalls;
+
+  // No copies allowed
+  RenderQueue(const RenderQueue &);
+  RenderQueue & operator = (const RenderQueue &);
+};
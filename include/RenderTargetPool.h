@@ -0,0 +1,105 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <glad/glad.h>
+#include <vector>
+
+// Description of an offscreen render target, the key the pool looks targets up by
+struct RenderTargetDesc
+{
+  // Size in pixels
+  int width, height;
+  // Sized internal format of the color attachment
+  GLenum colorFormat;
+  // Sized internal format of the depth (stencil) attachment
+  GLenum depthFormat;
+  // The depth attachment is going to be sampled -> texture, renderbuffer otherwise
+  bool sampledDepth;
+  // Number of layers of a layered target (2D array textures), 0 for a plain 2D target.
+  // Layered targets always use a depth texture as renderbuffers can't be layered
+  int layers;
+
+  bool operator == (const RenderTargetDesc& other) const
+  {
+    return width == other.width && height == other.height && colorFormat == other.colorFormat &&
+           depthFormat == other.depthFormat && sampledDepth == other.sampledDepth && layers == other.layers;
+  }
+};
+
+// Framebuffer with its color and depth (stencil) attachment
+struct FrameBuffer
+{
+  GLuint handle;
+  GLuint color;
+  GLuint depth_stencil;
+};
+
+// Maximum number of layers of a layered target
+static const int MAX_RENDER_TARGET_LAYERS = 4;
+
+// Pool of offscreen render targets. Targets are acquired for the duration of a pass
+// and released when no longer needed, a later Acquire() with the same description
+// reuses (aliases) a released target instead of allocating a new one. Targets that
+// stay unused for a few frames, e.g. after a window resize, are freed lazily.
+class RenderTargetPool
+{
+public:
+  // Number of frames an unused target survives before it is freed
+  static const int MAX_UNUSED_FRAMES = 3;
+
+  RenderTargetPool() : _frame(0) {}
+  ~RenderTargetPool();
+
+  // Starts a new frame, frees targets that haven't been used for a while
+  void BeginFrame();
+  // Returns a target matching the description, allocates a new one if none is free
+  FrameBuffer Acquire(const RenderTargetDesc& desc);
+  // Returns the target back to the pool, it can be handed out again in this frame
+  void Release(const FrameBuffer& target);
+  // Returns a single layer of a layered target: a framebuffer rendering into just that
+  // layer and 2D views of its color and depth, so it can be used as a plain 2D target
+  FrameBuffer GetLayer(const FrameBuffer& target, int layer) const;
+  // Frees all targets, must be called while the context still exists
+  void Clear();
+
+  // Returns the number of bytes of video memory allocated by all targets
+  size_t GetMemoryUsage() const;
+  // Prints all targets with their memory usage to stdout
+  void PrintMemoryUsage() const;
+
+private:
+  struct Entry
+  {
+    RenderTargetDesc desc;
+    FrameBuffer target;
+    // Single layer framebuffers and views of a layered target
+    FrameBuffer layers[MAX_RENDER_TARGET_LAYERS];
+    // Video memory taken by the attachments
+    size_t bytes;
+    // Last frame the target was acquired in
+    unsigned int lastUsed;
+    // Currently handed out
+    bool inUse;
+  };
+
+  // Creates the framebuffer and its attachments
+  static FrameBuffer Allocate(const RenderTargetDesc& desc);
+  // Creates the framebuffers and views of the individual layers of a layered target
+  static void AllocateLayers(Entry& entry);
+  // Releases the framebuffer and its attachments
+  static void Free(const Entry& entry);
+  // Returns the number of bytes per pixel of a sized internal format
+  static size_t GetPixelSize(GLenum format);
+
+  std::vector<Entry> _entries;
+  unsigned int _frame;
+
+  // No copies allowed
+  RenderTargetPool(const RenderTargetPool &);
+  RenderTargetPool & operator = (const RenderTargetPool &);
+};
@@ -0,0 +1,100 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+#include <string>
+
+// Read only memory mapping of a whole file
+class MappedFile
+{
+public:
+  MappedFile() : _data(nullptr), _size(0) {}
+  ~MappedFile() { Close(); }
+
+  // Maps the file, returns false if it doesn't exist or can't be mapped
+  bool Open(const char path[]);
+  // Unmaps the file
+  void Close();
+
+  bool IsOpen() const { return _data != nullptr; }
+  const unsigned char *GetData() const { return _data; }
+  size_t GetSize() const { return _size; }
+
+private:
+  const unsigned char *_data;
+  size_t _size;
+
+  // No copies allowed
+  MappedFile(const MappedFile &);
+  MappedFile & operator = (const MappedFile &);
+};
+
+// Header of a baked texture file, followed by the table of the levels and their data.
+// The levels are stored in the final GPU format, tightly packed, so that they can be
+// uploaded straight from the file
+struct BakedTextureHeader
+{
+  // "NPGT"
+  char magic[4];
+  uint32_t version;
+  // Hash of the source image file and the encoding settings, the texture is rebaked
+  // whenever either changes
+  uint64_t sourceHash;
+  uint32_t width, height;
+  uint32_t levels;
+  // Layers of a texture array, 0 for a 2D texture
+  uint32_t layers;
+  // Sized internal format, pixel format and type of the level data, compressed formats
+  // have GL_NONE format and type
+  uint32_t internalFormat;
+  uint32_t format;
+  uint32_t type;
+};
+
+// Level of a baked texture
+struct BakedTextureLevel
+{
+  // Position and size of the data of all layers in the file [bytes]
+  uint64_t offset;
+  uint64_t size;
+  uint32_t width, height;
+};
+
+// Cache of textures baked from image files: all mip levels in the GPU format, so that
+// loading them takes no decoding and no mip generation. The baked file lives next to its
+// source and is keyed by the hash of the source file contents. Texture arrays built at
+// runtime are baked the same way, keyed by the hash of their contents.
+class TextureCache
+{
+public:
+  static const uint32_t VERSION = 3;
+
+  // Returns the 64 bit FNV-1a hash of the data, continues from the given hash
+  static uint64_t Hash(const unsigned char *data, size_t size, uint64_t hash = 14695981039346656037ull);
+  // Returns the path of the baked file of the source image
+  static std::string GetBakedPath(const char source[]) { return std::string(source) + ".baked"; }
+
+  // Maps the baked file if it's valid and was baked from the source with the hash
+  static bool Open(const char path[], uint64_t sourceHash, MappedFile &file);
+  // Allocates immutable storage of the texture and uploads all levels straight from the
+  // mapped baked file, the texture may be a mutable texture holding a placeholder. Baked
+  // texture arrays need a texture created as one
+  static bool Upload(const MappedFile &file, GLuint texture);
+  // Reads all levels of the mip complete texture back and writes them to the baked file,
+  // the uncompressed levels are read in the given format and type
+  static bool Bake(GLuint texture, GLenum internalFormat, GLenum format, GLenum type, uint64_t sourceHash, const char path[]);
+
+private:
+  // Returns the size of a level of the given dimensions in the format of the header, 0
+  // for formats a baked file can't hold [bytes]
+  static uint64_t GetLevelSize(const BakedTextureHeader &header, uint32_t width, uint32_t height);
+
+  TextureCache();
+  ~TextureCache();
+};
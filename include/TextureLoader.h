@@ -0,0 +1,126 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "BlockCompression.h"
+#include "MipGenerator.h"
+#include "TextureCache.h"
+
+class GLStateCache;
+class ThreadPool;
+
+// Loads textures in the background: the images are decoded and their mips filtered by the
+// workers of a thread pool in parallel while the GL thread keeps going, and Update()
+// uploads the decoded ones through a persistently mapped pixel unpack buffer. Load()
+// returns the texture right away, it holds a single color placeholder until its image is
+// uploaded. The placeholders are mutable so that the real image gets immutable storage in
+// the same object. With the cache enabled, images baked by an earlier run skip the
+// decoding and the mip generation: their levels are uploaded straight from the mapped
+// baked file. Missing or stale baked files are written after the upload. Textures may be
+// block compressed after their mips are generated, the baked files keep the blocks.
+class TextureLoader
+{
+public:
+  // Initial size of the staging buffer, it grows to fit the largest image
+  static const size_t MIN_STAGING = 16 * 1024 * 1024;
+
+  TextureLoader();
+  ~TextureLoader();
+
+  // Sets the thread pool decoding the images and the state cache the placeholders are
+  // created through
+  void Init(ThreadPool &threadPool, GLStateCache &state) { _threadPool = &threadPool; _state = &state; }
+  // Enables the baked texture cache for the following loads, it's on by default
+  void SetCacheEnabled(bool enabled) { _useCache = enabled; }
+  // Sets the encoder preset of the compressed textures
+  void SetCompressionQuality(BlockQuality quality) { _quality = quality; }
+  // Sets the filter of the mips of the following loads, the driver one generates them on
+  // the GL thread after the upload
+  void SetMipFilter(MipFilter filter) { _mipFilter = filter; }
+  // Waits for the images being decoded and frees the staging buffer, must be called while
+  // the context still exists. The textures stay, they're owned by the caller
+  void Release();
+
+  // Starts loading the texture from the file stored on the disk, the placeholder color is
+  // used until the image is uploaded. Linear textures can be block compressed, the mips of
+  // normal maps are renormalized
+  GLuint Load(const char name[], bool sRGB, const glm::vec3 &placeholder = glm::vec3(0.5f),
+              BlockFormat compression = BlockFormat::None, bool normalMap = false);
+
+  // Uploads the images decoded so far and returns their number. The staging buffer is
+  // bound directly, state caches need to be invalidated when it's non-zero
+  int Update();
+  // Waits until the texture is uploaded, the calling thread decodes queued images meanwhile
+  void Wait(GLuint texture);
+  // Waits until all textures are uploaded
+  void Finish();
+
+  // Returns the number of textures not uploaded yet
+  size_t GetPendingCount() const { return _pending.size(); }
+
+private:
+  // Texture being loaded
+  struct Request
+  {
+    GLuint texture;
+    std::string name;
+    bool sRGB;
+    // Use the baked texture cache
+    bool useCache;
+    BlockFormat compression;
+    BlockQuality quality;
+    MipFilter mipFilter;
+    MipContent mipContent;
+    // Decoded image, filled in by the worker, nullptr when the decoding failed
+    unsigned char *data;
+    int width, height, numChannels;
+    // Levels below level 0 filtered by the worker, one after another, empty when the
+    // driver generates them
+    std::vector<unsigned char> mips;
+    // Hash of the source file and the settings and the baked file, mapped by the worker
+    // when up to date
+    uint64_t sourceHash;
+    MappedFile baked;
+  };
+
+  // Decodes the image of the request on a worker
+  void Decode(Request *request);
+  // Uploads the decoded image and frees the request
+  void Upload(Request *request);
+  // Makes sure size bytes are available in the staging buffer, returns their offset
+  bool PrepareStaging(size_t size, size_t &offset);
+  // Returns whether the texture is still being loaded
+  bool IsPending(GLuint texture) const;
+
+  ThreadPool *_threadPool;
+  GLStateCache *_state;
+  bool _useCache;
+  BlockQuality _quality;
+  MipFilter _mipFilter;
+  // Requests not uploaded yet, only touched by the GL thread
+  std::vector<Request*> _pending;
+  // Requests decoded by the workers and waiting for the upload
+  std::vector<Request*> _decoded;
+  std::mutex _decodedMutex;
+
+  // Persistently mapped pixel unpack buffer the images are uploaded from
+  GLuint _staging;
+  unsigned char *_stagingData;
+  size_t _stagingSize;
+  // Bytes of the staging buffer used since the GPU was last waited for
+  size_t _stagingUsed;
+
+  // No copies allowed
+  TextureLoader(const TextureLoader &);
+  TextureLoader & operator = (const TextureLoader &);
+};
@@ -5,8 +5,15 @@
 
 #pragma once
 
+#include <cstddef>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <vector>
+
+#include "BlockCompression.h"
+#include "MipGenerator.h"
+
+class GLStateCache;
 
 enum class Sampler : int
 {
@@ -19,12 +26,49 @@ class Textures
 public:
   // Get and create instance for this singleton
   static Textures& GetInstance();
-  // Create checkerboard pattern texture
-  static GLuint CreateCheckerBoardTexture(unsigned int textureSize, unsigned int checkerSize, glm::vec3 oddColor = glm::vec3(0.15f, 0.15f, 0.6f), glm::vec3 evenColor = glm::vec3(0.85f, 0.75f, 0.3f), bool sRGB = true);
-  // Create single color texture for default usage
-  static GLuint CreateSingleColorTexture(unsigned char r, unsigned char g, unsigned char b);
-  // Load texture from file stored on the disk
-  static GLuint LoadTexture(const char name[], bool sRGB);
+  // Colors of the default checkerboard
+  static const glm::vec3 CHECKER_ODD_COLOR;
+  static const glm::vec3 CHECKER_EVEN_COLOR;
+
+  // Create checkerboard pattern texture, its mips are filtered on the thread pool if given
+  static GLuint CreateCheckerBoardTexture(unsigned int textureSize, unsigned int checkerSize, glm::vec3 oddColor = CHECKER_ODD_COLOR, glm::vec3 evenColor = CHECKER_EVEN_COLOR, bool sRGB = true,
+                                          MipFilter mipFilter = MipGenerator::DEFAULT_FILTER, ThreadPool *threadPool = nullptr);
+  // Create single color texture for default usage, the texture is left bound to unit 0
+  static GLuint CreateSingleColorTexture(GLStateCache &state, unsigned char r, unsigned char g, unsigned char b);
+  // Load texture from file stored on the disk, its mips are filtered on the thread pool if given
+  static GLuint LoadTexture(const char name[], bool sRGB, MipFilter mipFilter = MipGenerator::DEFAULT_FILTER, ThreadPool *threadPool = nullptr);
+  // Sized internal format of 8 bit images with the number of channels, sRGB ones need at
+  // least three channels
+  static GLenum GetInternalFormat(int numChannels, bool sRGB);
+  // Pixel format of 8 bit images with the number of channels
+  static GLenum GetPixelFormat(int numChannels);
+  // Number of channels to decode an image with, sRGB grey images are expanded to RGB(A)
+  // as there are no single and two channel sRGB formats, 0 keeps the channels of the file
+  static int GetDecodedChannels(int fileChannels, bool sRGB);
+  // Makes single and two channel textures (R8, RG8) read as grey and grey with alpha
+  static void SetGreySwizzle(GLuint texture, GLenum internalFormat);
+  // Number of levels of a full mip chain
+  static int GetLevelCount(int width, int height);
+  // Video memory taken by all levels of the texture [bytes]
+  static size_t GetMemoryUsage(GLuint texture);
+  // Prints the size, format, levels and memory of the texture
+  static void PrintMemoryUsage(const char name[], GLuint texture);
+  // Fill the levels below level 0 of a 2D or 2D array texture with storage for its whole mip
+  // chain. The CPU filters start from the tightly packed pixels of level 0 if given,
+  // otherwise level 0 of all layers is read back. The driver filter calls glGenerateMipmap
+  static void GenerateMipmaps(GLuint texture, MipFilter filter, MipContent content, ThreadPool *threadPool,
+                              const unsigned char *pixels = nullptr, int numChannels = 4);
+  // Generate the mips of the image on the GPU and by all CPU filters, prints the times
+  static bool BenchmarkMipmaps(const char name[], MipContent content, ThreadPool &threadPool);
+  // Copy the texture into the rectangle of a texture array layer, rescales it to fit
+  static void CopyToLayer(GLStateCache &state, GLuint texture, GLuint array, int layer, int x, int y, int width, int height);
+  // Encode all levels of a 2D or 2D array texture into blocks and upload them to
+  // immutable storage of the destination, which may be the source itself if it's mutable.
+  // sRGB sources get the sRGB block format, grey ones are expanded to the color they're
+  // swizzled to for the color formats. Returns the error of all levels, blockStats gets
+  // the errors of the level 0 blocks
+  static BlockStats Compress(GLuint source, GLuint destination, BlockFormat format, BlockQuality quality,
+                             ThreadPool *threadPool, std::vector<BlockStats> *blockStats = nullptr);
   // Create all samplers
   void CreateSamplers();
   // Get sampler
@@ -0,0 +1,63 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running tasks from a shared queue. The thread waiting
+// for a parallel loop runs the ranges of the loop nobody has taken yet instead of just
+// blocking, so the loops may be nested and a pool without workers still gets them done.
+class ThreadPool
+{
+public:
+  // Range of a parallel loop given to one task, [begin, end)
+  typedef std::function<void(size_t begin, size_t end)> RangeTask;
+
+  ThreadPool();
+  ~ThreadPool();
+
+  // Starts the workers, 0 takes one less than the number of hardware threads as the
+  // calling thread takes part in the loops
+  void Init(unsigned int workers = 0);
+  // Finishes the queued tasks and joins the workers
+  void Release();
+
+  // Queues the task to run on any worker
+  void Enqueue(std::function<void()> task);
+  // Splits [0, count) into ranges of at least grain items, runs them in parallel and
+  // returns when all of them are done
+  void ParallelFor(size_t count, size_t grain, const RangeTask &task);
+
+  // Runs one queued task on the calling thread if there is any, returns false when the
+  // queue is empty. Threads waiting for the results of queued tasks help with it
+  bool RunPending();
+
+  // Returns the number of worker threads
+  unsigned int GetWorkerCount() const { return (unsigned int)_workers.size(); }
+
+private:
+  // Runs queued tasks until the pool is released
+  void WorkerLoop();
+
+  std::vector<std::thread> _workers;
+  // Tasks waiting for a thread
+  std::deque<std::function<void()>> _tasks;
+  std::mutex _mutex;
+  // Signaled when a task is queued or the pool is released
+  std::condition_variable _wake;
+  // Set when the workers are to exit
+  bool _stop;
+
+  // No copies allowed
+  ThreadPool(const ThreadPool &);
+  ThreadPool & operator = (const ThreadPool &);
+};
@@ -5,7 +5,42 @@
 
 #pragma once
 
+#include <cmath>
+#include <cstddef>
 #include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Attribute of a vertex format: shader location, number and type of the components,
+// whether integer components are normalized to [0, 1] ([-1, 1] if signed) and the offset
+// of the attribute in the vertex [bytes]
+template <GLuint Location, GLint Size, GLenum Type, GLboolean Normalized, size_t Offset>
+struct VertexAttribute
+{
+  static void Bind(GLsizei stride)
+  {
+    glVertexAttribPointer(Location, Size, Type, Normalized, stride, reinterpret_cast<void*>(Offset));
+    glEnableVertexAttribArray(Location);
+  }
+};
+
+// Compile time list of the attributes of a vertex format
+template <class... Attributes>
+struct VertexLayout
+{
+  static void Bind(GLsizei stride)
+  {
+    // Expands to one Bind() per attribute, in order
+    const int expand[] = {0, (Attributes::Bind(stride), 0)...};
+    (void)expand;
+  }
+};
+
+// Describes the attributes of the vertex format to the bound vertex buffer
+template <class VertexType>
+void BindVertexAttributes()
+{
+  VertexType::Layout::Bind((GLsizei)sizeof(VertexType));
+}
 
 // Vertex containing vec3 position
 struct Vertex_Pos
@@ -13,12 +48,8 @@ struct Vertex_Pos
   // Position
   float x, y, z;
 
-  static void BindVertexAttributes()
-  {
-    // Positions: 3 floats, stride = 3 * sizeof(float), offset = 0
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex_Pos), reinterpret_cast<void*>(0));
-    glEnableVertexAttribArray(0);
-  }
+  // Positions: 3 floats, offset = 0
+  typedef VertexLayout<VertexAttribute<0, 3, GL_FLOAT, GL_FALSE, 0>> Layout;
 };
 
 // Vertex containing vec3 position, vec3 color
@@ -29,15 +60,10 @@ struct Vertex_Pos_Col
   // Vertex color
   float r, g, b;
 
-  static void BindVertexAttributes()
-  {
-    // Positions: 3 floats, stride = 6 * sizeof(float), offset = 0
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex_Pos_Col), reinterpret_cast<void*>(0));
-    glEnableVertexAttribArray(0);
-    // Texture coordinates: 3 floats, stride = 6 * sizeof(float), offset = 3
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex_Pos_Col), reinterpret_cast<void*>(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-  }
+  // Positions: 3 floats, offset = 0
+  // Colors: 3 floats, offset = 3
+  typedef VertexLayout<VertexAttribute<0, 3, GL_FLOAT, GL_FALSE, 0>,
+                       VertexAttribute<1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float)>> Layout;
 };
 
 // Vertex containing vec3 position, vec2 UV coords
@@ -48,15 +74,10 @@ struct Vertex_Pos_Tex
   // Texture coordinates
   float u, v;
 
-  static void BindVertexAttributes()
-  {
-    // Positions: 3 floats, stride = 5 * sizeof(float), offset = 0
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex_Pos_Tex), reinterpret_cast<void*>(0));
-    glEnableVertexAttribArray(0);
-    // Texture coordinates: 2 floats, stride = 5 * sizeof(float), offset = 3
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex_Pos_Tex), reinterpret_cast<void*>(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-  }
+  // Positions: 3 floats, offset = 0
+  // Texture coordinates: 2 floats, offset = 3
+  typedef VertexLayout<VertexAttribute<0, 3, GL_FLOAT, GL_FALSE, 0>,
+                       VertexAttribute<1, 2, GL_FLOAT, GL_FALSE, 3 * sizeof(float)>> Layout;
 };
 
 // Vertex containing vec3 position, vec3 normal
@@ -67,15 +88,10 @@ struct Vertex_Pos_Nrm
   // Normal
   float nx, ny, nz;
 
-  static void BindVertexAttributes()
-  {
-    // Positions: 3 floats, stride = 6 * sizeof(float), offset = 0
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex_Pos_Nrm), reinterpret_cast<void*>(0));
-    glEnableVertexAttribArray(0);
-    // Normals: 3 floats, stride = 6 * sizeof(float), offset = 3
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex_Pos_Nrm), reinterpret_cast<void*>(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-  }
+  // Positions: 3 floats, offset = 0
+  // Normals: 3 floats, offset = 3
+  typedef VertexLayout<VertexAttribute<0, 3, GL_FLOAT, GL_FALSE, 0>,
+                       VertexAttribute<1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float)>> Layout;
 };
 
 // Vertex containing vec3 position, vec3 normal, vec3 tangent, vec2 UV coords
@@ -90,19 +106,150 @@ struct Vertex_Pos_Nrm_Tgt_Tex
   // Texture coordinates
   float u, v;
 
-  static void BindVertexAttributes()
+  // Positions: 3 floats, offset = 0
+  // Normals: 3 floats, offset = 3
+  // Tangents: 3 floats, offset = 6
+  // Texture coordinates: 2 floats, offset = 9
+  typedef VertexLayout<VertexAttribute<0, 3, GL_FLOAT, GL_FALSE, 0>,
+                       VertexAttribute<1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float)>,
+                       VertexAttribute<2, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float)>,
+                       VertexAttribute<3, 2, GL_FLOAT, GL_FALSE, 9 * sizeof(float)>> Layout;
+};
+
+// Vertex_Pos_Tex packed to 12 bytes: snorm16 position within the bounds of the mesh and
+// unorm16 UV coords, so the texture coordinates must stay in [0, 1]. The mesh provides
+// the dequantization transformation of the positions, see Mesh::GetDequantization()
+struct Vertex_Pos_Tex_Packed
+{
+  // Position, w pads it to 8 bytes
+  GLshort x, y, z, w;
+  // Texture coordinates
+  GLushort u, v;
+
+  // Positions: 3 normalized shorts, offset = 0
+  // Texture coordinates: 2 normalized unsigned shorts, offset = 4
+  typedef VertexLayout<VertexAttribute<0, 3, GL_SHORT, GL_TRUE, 0>,
+                       VertexAttribute<1, 2, GL_UNSIGNED_SHORT, GL_TRUE, 4 * sizeof(GLshort)>> Layout;
+};
+
+// Vertex_Pos_Nrm_Tgt_Tex packed to 20 bytes: snorm16 position within the bounds of the
+// mesh, octahedral snorm16 normal and tangent and unorm16 UV coords in [0, 1]. The
+// shaders get the normal and tangent as vec2 and decode them by the inverse of
+// encodeOctahedral()
+struct Vertex_Pos_Nrm_Tgt_Tex_Packed
+{
+  // Position, w pads it to 8 bytes
+  GLshort x, y, z, w;
+  // Octahedral normal
+  GLshort nx, ny;
+  // Octahedral tangent
+  GLshort tx, ty;
+  // Texture coordinates
+  GLushort u, v;
+
+  // Positions: 3 normalized shorts, offset = 0
+  // Normals: 2 normalized shorts, offset = 4
+  // Tangents: 2 normalized shorts, offset = 6
+  // Texture coordinates: 2 normalized unsigned shorts, offset = 8
+  typedef VertexLayout<VertexAttribute<0, 3, GL_SHORT, GL_TRUE, 0>,
+                       VertexAttribute<1, 2, GL_SHORT, GL_TRUE, 4 * sizeof(GLshort)>,
+                       VertexAttribute<2, 2, GL_SHORT, GL_TRUE, 6 * sizeof(GLshort)>,
+                       VertexAttribute<3, 2, GL_UNSIGNED_SHORT, GL_TRUE, 8 * sizeof(GLshort)>> Layout;
+};
+
+// Mapping of the positions of a mesh to [-1, 1]: position = quantized * scale + bias
+struct PositionQuantization
+{
+  glm::vec3 scale;
+  glm::vec3 bias;
+
+  // No quantization
+  PositionQuantization() : scale(1.0f), bias(0.0f) {}
+  // Maps the bounding box to [-1, 1], flat dimensions keep scale 1 so that they're exact
+  PositionQuantization(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) :
+    scale(glm::max(boundsMax - boundsMin, 0.0f) * 0.5f),
+    bias((boundsMin + boundsMax) * 0.5f)
+  {
+    for (int i = 0; i < 3; ++i)
+    {
+      if (scale[i] <= 0.0f)
+        scale[i] = 1.0f;
+    }
+  }
+
+  glm::vec3 Quantize(const glm::vec3 &position) const { return (position - bias) / scale; }
+};
+
+// Converts the value from [-1, 1] to a normalized short
+inline GLshort packSnorm16(float value)
+{
+  return (GLshort)std::lround(glm::clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+// Converts the value from [0, 1] to a normalized unsigned short
+inline GLushort packUnorm16(float value)
+{
+  return (GLushort)std::lround(glm::clamp(value, 0.0f, 1.0f) * 65535.0f);
+}
+
+// Projects the unit vector onto the octahedron unfolded to the [-1, 1] square
+inline glm::vec2 encodeOctahedral(const glm::vec3 &n)
+{
+  glm::vec2 p = glm::vec2(n.x, n.y) / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+  if (n.z < 0.0f)
+  {
+    // Fold the lower hemisphere over the diagonals
+    p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * glm::vec2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+  }
+  return p;
+}
+
+// Converts the full precision vertices the geometry is generated in to the vertex format,
+// the formats are stored as they are unless they specialize it
+template <class VertexType>
+struct VertexPacking
+{
+  // Vertex the format is made from
+  typedef VertexType Source;
+
+  // Returns the quantization of the mesh positions within the bounds
+  static PositionQuantization GetQuantization(const glm::vec3 &, const glm::vec3 &) { return PositionQuantization(); }
+  static VertexType Pack(const Source &vertex, const PositionQuantization &) { return vertex; }
+};
+
+template <>
+struct VertexPacking<Vertex_Pos_Tex_Packed>
+{
+  typedef Vertex_Pos_Tex Source;
+
+  static PositionQuantization GetQuantization(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax)
+  {
+    return PositionQuantization(boundsMin, boundsMax);
+  }
+  static Vertex_Pos_Tex_Packed Pack(const Source &vertex, const PositionQuantization &quantization)
+  {
+    const glm::vec3 position = quantization.Quantize(glm::vec3(vertex.x, vertex.y, vertex.z));
+    return {packSnorm16(position.x), packSnorm16(position.y), packSnorm16(position.z), 0,
+            packUnorm16(vertex.u), packUnorm16(vertex.v)};
+  }
+};
+
+template <>
+struct VertexPacking<Vertex_Pos_Nrm_Tgt_Tex_Packed>
+{
+  typedef Vertex_Pos_Nrm_Tgt_Tex Source;
+
+  static PositionQuantization GetQuantization(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax)
+  {
+    return PositionQuantization(boundsMin, boundsMax);
+  }
+  static Vertex_Pos_Nrm_Tgt_Tex_Packed Pack(const Source &vertex, const PositionQuantization &quantization)
   {
-    // Positions: 3 floats, stride = 11 * sizeof(float), offset = 0
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex_Pos_Nrm_Tgt_Tex), reinterpret_cast<void*>(0));
-    glEnableVertexAttribArray(0);
-    // Normals: 3 floats, stride = 11 * sizeof(float), offset = 3
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex_Pos_Nrm_Tgt_Tex), reinterpret_cast<void*>(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    // Tangents: 3 floats, stride = 11 * sizeof(float), offset = 6
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex_Pos_Nrm_Tgt_Tex), reinterpret_cast<void*>(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    // Texture coordinates: 2 floats, stride = 11 * sizeof(float), offset = 9
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex_Pos_Nrm_Tgt_Tex), reinterpret_cast<void*>(9 * sizeof(float)));
-    glEnableVertexAttribArray(3);
+    const glm::vec3 position = quantization.Quantize(glm::vec3(vertex.x, vertex.y, vertex.z));
+    const glm::vec2 normal = encodeOctahedral(glm::vec3(vertex.nx, vertex.ny, vertex.nz));
+    const glm::vec2 tangent = encodeOctahedral(glm::vec3(vertex.tx, vertex.ty, vertex.tz));
+    return {packSnorm16(position.x), packSnorm16(position.y), packSnorm16(position.z), 0,
+            packSnorm16(normal.x), packSnorm16(normal.y), packSnorm16(tangent.x), packSnorm16(tangent.y),
+            packUnorm16(vertex.u), packUnorm16(vertex.v)};
   }
 };
@@ -0,0 +1,358 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <Benchmark.h>
+
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+
+bool BenchmarkSettings::ParseArguments(int argc, char* argv[])
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const char* arg = argv[i];
+    // All options but --headless, --bake, --mip-benchmark and --mesh-benchmark take a value
+    const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+    if (strcmp(arg, "--headless") == 0)
+    {
+      headless = true;
+      continue;
+    }
+    if (strcmp(arg, "--bake") == 0)
+    {
+      bakeTextures = true;
+      continue;
+    }
+    if (strcmp(arg, "--mip-benchmark") == 0)
+    {
+      mipBenchmark = true;
+      continue;
+    }
+    if (strcmp(arg, "--mesh-benchmark") == 0)
+    {
+      meshBenchmark = true;
+      continue;
+    }
+
+    if (!value)
+    {
+      printf("Missing value for option: %s\n", arg);
+      return false;
+    }
+
+    if (strcmp(arg, "--frames") == 0)
+      frames = atoi(value);
+    else if (strcmp(arg, "--dt") == 0)
+      dt = (float)atof(value);
+    else if (strcmp(arg, "--report") == 0)
+      reportPath = value;
+    else if (strcmp(arg, "--trace") == 0)
+      tracePath = value;
+    else if (strcmp(arg, "--reflection-scale") == 0)
+      reflectionScale = (float)atof(value);
+    else if (strcmp(arg, "--refraction-scale") == 0)
+      refractionScale = (float)atof(value);
+    else if (strcmp(arg, "--layered") == 0)
+      layeredViews = atoi(value) != 0;
+    else if (strcmp(arg, "--gpu-budget") == 0)
+      gpuBudget = (float)atof(value);
+    else if (strcmp(arg, "--stats") == 0)
+      statsOutput = value;
+    else if (strcmp(arg, "--stats-interval") == 0)
+      statsInterval = atof(value);
+    else if (strcmp(arg, "--hitch") == 0)
+      hitchMs = (float)atof(value);
+    else if (strcmp(arg, "--record") == 0)
+      recordPath = value;
+    else if (strcmp(arg, "--replay") == 0)
+      replayPath = value;
+    else if (strcmp(arg, "--texture-cache") == 0)
+      textureCache = atoi(value) != 0;
+    else if (strcmp(arg, "--texture-budget") == 0)
+      textureBudget = (float)atof(value);
+    else if (strcmp(arg, "--texture-compression") == 0)
+    {
+      if (strcmp(value, "none") == 0)
+        textureCompression = BlockFormat::None;
+      else if (strcmp(value, "bc1") == 0)
+        textureCompression = BlockFormat::BC1;
+      else if (strcmp(value, "bc3") == 0)
+        textureCompression = BlockFormat::BC3;
+      else if (strcmp(value, "bc7") == 0)
+        textureCompression = BlockFormat::BC7;
+      else
+      {
+        printf("Unknown texture compression: %s\n", value);
+        return false;
+      }
+    }
+    else if (strcmp(arg, "--mip-filter") == 0)
+    {
+      if (strcmp(value, "driver") == 0)
+        mipFilter = MipFilter::Driver;
+      else if (strcmp(value, "box") == 0)
+        mipFilter = MipFilter::Box;
+      else if (strcmp(value, "kaiser") == 0)
+        mipFilter = MipFilter::Kaiser;
+      else if (strcmp(value, "lanczos") == 0)
+        mipFilter = MipFilter::Lanczos;
+      else
+      {
+        printf("Unknown mip filter: %s\n", value);
+        return false;
+      }
+    }
+    else if (strcmp(arg, "--compression-quality") == 0)
+    {
+      if (strcmp(value, "fast") == 0)
+        compressionQuality = BlockQuality::Fast;
+      else if (strcmp(value, "normal") == 0)
+        compressionQuality = BlockQuality::Normal;
+      else if (strcmp(value, "high") == 0)
+        compressionQuality = BlockQuality::High;
+      else
+      {
+        printf("Unknown compression quality: %s\n", value);
+        return false;
+      }
+    }
+    else
+    {
+      printf("Unknown option: %s\n", arg);
+      return false;
+    }
+    ++i;
+  }
+
+  if (frames < 0 || dt <= 0.0f)
+  {
+    printf("Invalid benchmark settings: frames = %d, dt = %f\n", frames, dt);
+    return false;
+  }
+
+  if (reflectionScale <= 0.0f || reflectionScale > 1.0f || refractionScale <= 0.0f || refractionScale > 1.0f)
+  {
+    printf("Resolution scales must be in (0, 1]: reflection = %f, refraction = %f\n", reflectionScale, refractionScale);
+    return false;
+  }
+
+  if (gpuBudget < 0.0f)
+  {
+    printf("Invalid GPU budget: %f\n", gpuBudget);
+    return false;
+  }
+
+  if (textureBudget < 0.0f)
+  {
+    printf("Invalid texture budget: %f\n", textureBudget);
+    return false;
+  }
+
+  if (statsInterval <= 0.0 || hitchMs <= 0.0f)
+  {
+    printf("Invalid stats settings: interval = %f, hitch = %f\n", statsInterval, hitchMs);
+    return false;
+  }
+
+  // Without a window there is nobody to close it, run a fixed number of frames
+  if (headless && frames == 0 && !replayPath && !bakeTextures && !mipBenchmark && !meshBenchmark)
+  {
+    printf("Headless mode requires --frames or --replay\n");
+    return false;
+  }
+
+  // Recording needs the interactive input
+  if (recordPath && (frames > 0 || replayPath))
+  {
+    printf("--record can't be combined with --frames or --replay\n");
+    return false;
+  }
+
+  // Baking writes into the cache
+  if (bakeTextures && !textureCache)
+  {
+    printf("--bake can't be combined with --texture-cache 0\n");
+    return false;
+  }
+
+  return true;
+}
+
+void BenchmarkSettings::PrintUsage(const char* program)
+{
+  printf("Usage: %s [options]\n"
+         "  --frames N                   render N frames with a fixed time step and exit\n"
+         "  --dt seconds                 time step of the benchmark frames\n"
+         "  --headless                   no window, render into an offscreen context\n"
+         "  --report file.csv|file.json  write per-frame CPU and GPU times\n"
+         "  --trace file.json            write the GPU profiler Chrome trace\n"
+         "  --record path.bin            record the camera of an interactive run\n"
+         "  --replay path.bin            replay a recorded camera path as a benchmark\n"
+         "  --reflection-scale 0..1      reflection resolution relative to the window\n"
+         "  --refraction-scale 0..1      refraction resolution relative to the window\n"
+         "  --layered 0|1                render reflection and refraction in one layered pass\n"
+         "  --gpu-budget ms              scale the resolution dynamically to fit the GPU budget\n"
+         "  --stats title|stdout|file    where to report frame statistics\n"
+         "  --stats-interval seconds     how often to report frame statistics\n"
+         "  --hitch ms                   frames longer than this count as hitches\n"
+         "  --texture-cache 0|1          load textures baked into .baked files next to the images\n"
+         "  --bake                       bake all textures into the cache and exit\n"
+         "  --texture-compression none|bc1|bc3|bc7\n"
+         "                               block format of the color textures, water maps get BC5\n"
+         "  --compression-quality fast|normal|high\n"
+         "                               block encoder preset\n"
+         "  --texture-budget MB          fail the benchmark when the textures take more video memory\n"
+         "  --mip-filter driver|box|kaiser|lanczos\n"
+         "                               filter of the texture mips, driver is glGenerateMipmap\n"
+         "  --mip-benchmark              time the mip generation on the GPU and the CPU and exit\n"
+         "  --mesh-benchmark             optimize the water grids of a few sizes, print the statistics and exit\n", program);
+}
+
+// ----------------------------------------------------------------------------
+
+GpuFrameTimer::~GpuFrameTimer()
+{
+  // Release resources used by the driver
+  if (_queries[0])
+    glDeleteQueries(LATENCY, _queries);
+}
+
+void GpuFrameTimer::Init()
+{
+  // Do nothing if we're already initialized
+  if (_queries[0])
+    return;
+
+  glGenQueries(LATENCY, _queries);
+  for (int i = 0; i < LATENCY; ++i)
+    _frames[i] = -1;
+  _current = 0;
+}
+
+void GpuFrameTimer::Begin(int frame)
+{
+  // A result that was not read back in time gets dropped in favor of not stalling
+  _frames[_current] = frame;
+  glBeginQuery(GL_TIME_ELAPSED, _queries[_current]);
+}
+
+void GpuFrameTimer::End()
+{
+  glEndQuery(GL_TIME_ELAPSED);
+  _current = (_current + 1) % LATENCY;
+}
+
+bool GpuFrameTimer::Resolve(int& frame, double& ms, bool wait)
+{
+  // Find the oldest pending query, it is the one right after the current slot
+  for (int i = 0; i < LATENCY; ++i)
+  {
+    const int slot = (_current + i) % LATENCY;
+    if (_frames[slot] < 0)
+      continue;
+
+    if (!wait)
+    {
+      GLint available = GL_FALSE;
+      glGetQueryObjectiv(_queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (available == GL_FALSE)
+        return false;
+    }
+
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(_queries[slot], GL_QUERY_RESULT, &elapsed);
+
+    frame = _frames[slot];
+    ms = (double)elapsed * 1e-6;
+    _frames[slot] = -1;
+    return true;
+  }
+
+  return false;
+}
+
+// ----------------------------------------------------------------------------
+
+void FrameReport::AddFrame(int frame, double cpuMs)
+{
+  _samples.push_back({frame, cpuMs, -1.0});
+}
+
+void FrameReport::SetGpuTime(int frame, double gpuMs)
+{
+  if (frame >= 0 && frame < (int)_samples.size())
+    _samples[frame].gpuMs = gpuMs;
+}
+
+bool FrameReport::Write(const char* path) const
+{
+  FILE* file = fopen(path, "w");
+  if (!file)
+  {
+    printf("Failed to open report file: %s\n", path);
+    return false;
+  }
+
+  const size_t length = strlen(path);
+  const bool json = length >= 5 && strcmp(path + length - 5, ".json") == 0;
+  const bool result = json ? WriteJSON(file) : WriteCSV(file);
+
+  fclose(file);
+  return result;
+}
+
+bool FrameReport::WriteCSV(FILE* file) const
+{
+  fprintf(file, "frame,cpu_ms,gpu_ms\n");
+  for (const Sample& s : _samples)
+    fprintf(file, "%d,%.4f,%.4f\n", s.frame, s.cpuMs, s.gpuMs);
+
+  return ferror(file) == 0;
+}
+
+bool FrameReport::WriteJSON(FILE* file) const
+{
+  fprintf(file, "{\n  \"frames\": [\n");
+  for (size_t i = 0; i < _samples.size(); ++i)
+  {
+    const Sample& s = _samples[i];
+    fprintf(file, "    {\"frame\": %d, \"cpu_ms\": %.4f, \"gpu_ms\": %.4f}%s\n",
+            s.frame, s.cpuMs, s.gpuMs, (i + 1 < _samples.size()) ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+
+  return ferror(file) == 0;
+}
+
+void FrameReport::PrintSummary() const
+{
+  if (_samples.empty())
+    return;
+
+  double cpuMin = DBL_MAX, cpuMax = 0.0, cpuSum = 0.0;
+  double gpuMin = DBL_MAX, gpuMax = 0.0, gpuSum = 0.0;
+  int gpuCount = 0;
+  for (const Sample& s : _samples)
+  {
+    cpuMin = s.cpuMs < cpuMin ? s.cpuMs : cpuMin;
+    cpuMax = s.cpuMs > cpuMax ? s.cpuMs : cpuMax;
+    cpuSum += s.cpuMs;
+
+    // Frames without a GPU result are skipped
+    if (s.gpuMs < 0.0)
+      continue;
+    gpuMin = s.gpuMs < gpuMin ? s.gpuMs : gpuMin;
+    gpuMax = s.gpuMs > gpuMax ? s.gpuMs : gpuMax;
+    gpuSum += s.gpuMs;
+    ++gpuCount;
+  }
+
+  printf("Frames: %d\n", (int)_samples.size());
+  printf("CPU: min %.3fms, avg %.3fms, max %.3fms\n", cpuMin, cpuSum / _samples.size(), cpuMax);
+  if (gpuCount > 0)
+    printf("GPU: min %.3fms, avg %.3fms, max %.3fms\n", gpuMin, gpuSum / gpuCount, gpuMax);
+}
@@ -0,0 +1,726 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <BlockCompression.h>
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLOCK_ENCODER_SSE2
+#include <emmintrin.h>
+#endif
+
+// Pixels of a 4x4 block, every channel stored separately so that four pixels of it fill
+// a SIMD register
+struct Block
+{
+  alignas(16) float channels[4][16];
+  // Pixels inside the image, the repeated edge pixels don't count into the error
+  bool valid[16];
+};
+
+// Values the block decodes to, indexed by the per pixel indices
+struct Palette
+{
+  alignas(16) float colors[16][4];
+  int size;
+};
+
+// Writes values into a block from the least significant bit on
+struct BitWriter
+{
+  unsigned char *data;
+  int position;
+
+  void Write(uint32_t value, int bits)
+  {
+    for (int i = 0; i < bits; ++i, ++position)
+    {
+      if ((value >> i) & 1)
+        data[position >> 3] |= (unsigned char)(1 << (position & 7));
+    }
+  }
+};
+
+// Interpolation weights of BC7 4 bit indices [1/64]
+static const int BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+// Interpolation weights of the BC1 indices
+static const float BC1_WEIGHTS[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+
+static glm::vec4 getPixel(const Block &block, int i)
+{
+  return glm::vec4(block.channels[0][i], block.channels[1][i], block.channels[2][i], block.channels[3][i]);
+}
+
+// Copies the block at x, y out of the image, pixels past the edges repeat the last ones
+static void loadBlock(const unsigned char *pixels, int width, int height, int x, int y, Block &block)
+{
+  for (int i = 0; i < 16; ++i)
+  {
+    const int px = x + (i & 3), py = y + (i >> 2);
+    const unsigned char *pixel = pixels + ((size_t)std::min(py, height - 1) * width + std::min(px, width - 1)) * 4;
+    for (int c = 0; c < 4; ++c)
+      block.channels[c][i] = pixel[c];
+    block.valid[i] = px < width && py < height;
+  }
+}
+
+// Picks the closest palette entry for every pixel of the block, returns the squared error
+// of the channels [firstChannel, firstChannel + channelCount)
+static float fitIndices(const Block &block, const Palette &palette, int firstChannel, int channelCount, uint8_t indices[16])
+{
+  float error = 0.0f;
+#ifdef BLOCK_ENCODER_SSE2
+  for (int i = 0; i < 16; i += 4)
+  {
+    __m128 best = _mm_set1_ps(FLT_MAX);
+    __m128 bestIndex = _mm_setzero_ps();
+    for (int p = 0; p < palette.size; ++p)
+    {
+      __m128 distance = _mm_setzero_ps();
+      for (int c = firstChannel; c < firstChannel + channelCount; ++c)
+      {
+        const __m128 d = _mm_sub_ps(_mm_load_ps(&block.channels[c][i]), _mm_set1_ps(palette.colors[p][c]));
+        distance = _mm_add_ps(distance, _mm_mul_ps(d, d));
+      }
+      const __m128 closer = _mm_cmplt_ps(distance, best);
+      best = _mm_min_ps(distance, best);
+      bestIndex = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps((float)p)), _mm_andnot_ps(closer, bestIndex));
+    }
+
+    alignas(16) float bestErrors[4], bestIndices[4];
+    _mm_store_ps(bestErrors, best);
+    _mm_store_ps(bestIndices, bestIndex);
+    for (int j = 0; j < 4; ++j)
+    {
+      indices[i + j] = (uint8_t)bestIndices[j];
+      error += bestErrors[j];
+    }
+  }
+#else
+  for (int i = 0; i < 16; ++i)
+  {
+    float best = FLT_MAX;
+    for (int p = 0; p < palette.size; ++p)
+    {
+      float distance = 0.0f;
+      for (int c = firstChannel; c < firstChannel + channelCount; ++c)
+      {
+        const float d = block.channels[c][i] - palette.colors[p][c];
+        distance += d * d;
+      }
+      if (distance < best)
+      {
+        best = distance;
+        indices[i] = (uint8_t)p;
+      }
+    }
+    error += best;
+  }
+#endif
+  return error;
+}
+
+// Compares the valid pixels decoded from the palette to the source
+static BlockStats measure(const Block &block, const Palette &palette, const uint8_t indices[16], int firstChannel, int channelCount)
+{
+  BlockStats stats;
+  for (int i = 0; i < 16; ++i)
+  {
+    if (!block.valid[i])
+      continue;
+    for (int c = firstChannel; c < firstChannel + channelCount; ++c)
+    {
+      const double d = block.channels[c][i] - palette.colors[indices[i]][c];
+      stats.squaredError += d * d;
+    }
+    stats.samples += channelCount;
+  }
+  return stats;
+}
+
+// Finds the mean of the block and the direction its pixels spread along: the principal
+// axis, or just the diagonal of the bounding box turned by the signs of the covariances
+static void computeAxis(const Block &block, int firstChannel, int channelCount, bool principal, glm::vec4 &mean, glm::vec4 &axis)
+{
+  glm::vec4 lo(FLT_MAX), hi(-FLT_MAX);
+  mean = glm::vec4(0.0f);
+  for (int i = 0; i < 16; ++i)
+  {
+    const glm::vec4 pixel = getPixel(block, i);
+    lo = glm::min(lo, pixel);
+    hi = glm::max(hi, pixel);
+    mean += pixel;
+  }
+  mean /= 16.0f;
+
+  // Covariance matrix, only the used channels
+  glm::mat4 covariance(0.0f);
+  for (int i = 0; i < 16; ++i)
+  {
+    const glm::vec4 d = getPixel(block, i) - mean;
+    for (int r = firstChannel; r < firstChannel + channelCount; ++r)
+    {
+      for (int c = firstChannel; c < firstChannel + channelCount; ++c)
+        covariance[c][r] += d[r] * d[c];
+    }
+  }
+
+  axis = glm::vec4(0.0f);
+  int dominant = firstChannel;
+  for (int c = firstChannel; c < firstChannel + channelCount; ++c)
+  {
+    axis[c] = hi[c] - lo[c];
+    if (axis[c] > axis[dominant])
+      dominant = c;
+  }
+  for (int c = firstChannel; c < firstChannel + channelCount; ++c)
+  {
+    if (covariance[dominant][c] < 0.0f)
+      axis[c] = -axis[c];
+  }
+  if (!principal || glm::dot(axis, axis) == 0.0f)
+    return;
+
+  // Power iteration converges to the eigenvector of the largest eigenvalue, starting
+  // close to it already
+  glm::vec4 v = axis;
+  for (int i = 0; i < 8; ++i)
+  {
+    const glm::vec4 next = covariance * v;
+    const float length = glm::length(next);
+    if (length < 1e-6f)
+      return;
+    v = next / length;
+  }
+  axis = v;
+}
+
+// Puts the endpoints at the extremes of the block projected onto the axis
+static void projectEndpoints(const Block &block, const glm::vec4 &mean, const glm::vec4 &axis, glm::vec4 &e0, glm::vec4 &e1)
+{
+  const float axisLength = glm::dot(axis, axis);
+  if (axisLength == 0.0f)
+  {
+    e0 = e1 = mean;
+    return;
+  }
+
+  float lo = FLT_MAX, hi = -FLT_MAX;
+  for (int i = 0; i < 16; ++i)
+  {
+    const float t = glm::dot(getPixel(block, i) - mean, axis) / axisLength;
+    lo = std::min(lo, t);
+    hi = std::max(hi, t);
+  }
+  e0 = glm::clamp(mean + axis * lo, 0.0f, 255.0f);
+  e1 = glm::clamp(mean + axis * hi, 0.0f, 255.0f);
+}
+
+// Pulls the endpoints in a bit, the extremes are usually outliers
+static void insetEndpoints(glm::vec4 &e0, glm::vec4 &e1)
+{
+  const glm::vec4 inset = (e1 - e0) / 16.0f;
+  e0 += inset;
+  e1 -= inset;
+}
+
+// Finds the endpoints minimizing the squared error of the pixels interpolated between
+// them with the given weights, returns false when the weights don't determine them
+static bool fitEndpoints(const Block &block, const float weights[16], glm::vec4 &e0, glm::vec4 &e1)
+{
+  float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+  glm::vec4 ax(0.0f), bx(0.0f);
+  for (int i = 0; i < 16; ++i)
+  {
+    const float t = weights[i], s = 1.0f - t;
+    const glm::vec4 pixel = getPixel(block, i);
+    aa += s * s;
+    ab += s * t;
+    bb += t * t;
+    ax += s * pixel;
+    bx += t * pixel;
+  }
+
+  const float determinant = aa * bb - ab * ab;
+  if (std::abs(determinant) < 1e-6f)
+    return false;
+  e0 = glm::clamp((bb * ax - ab * bx) / determinant, 0.0f, 255.0f);
+  e1 = glm::clamp((aa * bx - ab * ax) / determinant, 0.0f, 255.0f);
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+
+static uint16_t packRGB565(const glm::vec4 &color)
+{
+  const int r = (int)(color.x * 31.0f / 255.0f + 0.5f);
+  const int g = (int)(color.y * 63.0f / 255.0f + 0.5f);
+  const int b = (int)(color.z * 31.0f / 255.0f + 0.5f);
+  return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static glm::vec4 unpackRGB565(uint16_t color)
+{
+  const int r = color >> 11, g = (color >> 5) & 63, b = color & 31;
+  return glm::vec4((float)((r << 3) | (r >> 2)), (float)((g << 2) | (g >> 4)), (float)((b << 3) | (b >> 2)), 255.0f);
+}
+
+// Four color palette, the encoder never uses the three color mode
+static void bc1Palette(uint16_t c0, uint16_t c1, Palette &palette)
+{
+  const glm::vec4 color0 = unpackRGB565(c0), color1 = unpackRGB565(c1);
+  palette.size = 4;
+  for (int i = 0; i < 4; ++i)
+  {
+    const glm::vec4 color = glm::mix(color0, color1, BC1_WEIGHTS[i]);
+    for (int c = 0; c < 4; ++c)
+      palette.colors[i][c] = color[c];
+  }
+}
+
+static BlockStats encodeBC1(const Block &block, BlockQuality quality, unsigned char *out)
+{
+  glm::vec4 mean, axis, e0, e1;
+  computeAxis(block, 0, 3, quality != BlockQuality::Fast, mean, axis);
+  projectEndpoints(block, mean, axis, e0, e1);
+  if (quality == BlockQuality::Fast)
+    insetEndpoints(e0, e1);
+
+  uint16_t c0 = packRGB565(e0), c1 = packRGB565(e1);
+  Palette palette;
+  bc1Palette(c0, c1, palette);
+  uint8_t indices[16];
+  float error = fitIndices(block, palette, 0, 3, indices);
+
+  // Endpoints fitted to the chosen indices, as long as they get better
+  const int iterations = quality == BlockQuality::Fast ? 0 : quality == BlockQuality::Normal ? 1 : 4;
+  for (int iteration = 0; iteration < iterations; ++iteration)
+  {
+    float weights[16];
+    for (int i = 0; i < 16; ++i)
+      weights[i] = BC1_WEIGHTS[indices[i]];
+    if (!fitEndpoints(block, weights, e0, e1))
+      break;
+
+    const uint16_t fitted0 = packRGB565(e0), fitted1 = packRGB565(e1);
+    if (fitted0 == c0 && fitted1 == c1)
+      break;
+    Palette fittedPalette;
+    bc1Palette(fitted0, fitted1, fittedPalette);
+    uint8_t fittedIndices[16];
+    const float fittedError = fitIndices(block, fittedPalette, 0, 3, fittedIndices);
+    if (fittedError >= error)
+      break;
+
+    c0 = fitted0;
+    c1 = fitted1;
+    palette = fittedPalette;
+    memcpy(indices, fittedIndices, sizeof(indices));
+    error = fittedError;
+  }
+  const BlockStats stats = measure(block, palette, indices, 0, 3);
+
+  // The four color mode needs c0 > c1, swapping the endpoints swaps indices 0-1 and 2-3
+  if (c0 < c1)
+  {
+    std::swap(c0, c1);
+    for (uint8_t &index : indices)
+      index ^= 1;
+  }
+  else if (c0 == c1)
+    memset(indices, 0, sizeof(indices));
+
+  uint32_t bits = 0;
+  for (int i = 0; i < 16; ++i)
+    bits |= (uint32_t)indices[i] << (2 * i);
+  out[0] = (unsigned char)(c0 & 0xff);
+  out[1] = (unsigned char)(c0 >> 8);
+  out[2] = (unsigned char)(c1 & 0xff);
+  out[3] = (unsigned char)(c1 >> 8);
+  for (int i = 0; i < 4; ++i)
+    out[4 + i] = (unsigned char)(bits >> (8 * i));
+  return stats;
+}
+
+// ----------------------------------------------------------------------------
+
+// Eight interpolated values when e0 > e1, six and the extremes 0 and 255 otherwise
+static void bc4Palette(int e0, int e1, int channel, Palette &palette)
+{
+  float values[8];
+  values[0] = (float)e0;
+  values[1] = (float)e1;
+  if (e0 > e1)
+  {
+    for (int i = 1; i < 7; ++i)
+      values[i + 1] = ((7 - i) * e0 + i * e1) / 7.0f;
+  }
+  else
+  {
+    for (int i = 1; i < 5; ++i)
+      values[i + 1] = ((5 - i) * e0 + i * e1) / 5.0f;
+    values[6] = 0.0f;
+    values[7] = 255.0f;
+  }
+
+  palette.size = 8;
+  for (int i = 0; i < 8; ++i)
+    palette.colors[i][channel] = values[i];
+}
+
+static BlockStats encodeBC4(const Block &block, int channel, BlockQuality quality, unsigned char *out)
+{
+  int best0 = 0, best1 = 0;
+  float bestError = FLT_MAX;
+  uint8_t bestIndices[16];
+  Palette palette;
+  const auto tryEndpoints = [&](int e0, int e1)
+  {
+    bc4Palette(e0, e1, channel, palette);
+    uint8_t indices[16];
+    const float error = fitIndices(block, palette, channel, 1, indices);
+    if (error >= bestError)
+      return false;
+    best0 = e0;
+    best1 = e1;
+    bestError = error;
+    memcpy(bestIndices, indices, sizeof(bestIndices));
+    return true;
+  };
+
+  // Eight values between the extremes
+  float lo = 255.0f, hi = 0.0f;
+  for (int i = 0; i < 16; ++i)
+  {
+    lo = std::min(lo, block.channels[channel][i]);
+    hi = std::max(hi, block.channels[channel][i]);
+  }
+  tryEndpoints((int)(hi + 0.5f), (int)(lo + 0.5f));
+
+  if (quality != BlockQuality::Fast && bestError > 0.0f)
+  {
+    // Six values between the extremes of the rest, 0 and 255 are in the palette anyway
+    float lo6 = 255.0f, hi6 = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+      const float value = block.channels[channel][i];
+      if (value > 0.5f && value < 254.5f)
+      {
+        lo6 = std::min(lo6, value);
+        hi6 = std::max(hi6, value);
+      }
+    }
+    if (lo6 <= hi6)
+      tryEndpoints((int)(lo6 + 0.5f), (int)(hi6 + 0.5f));
+
+    // Eight values fitted to the indices
+    const int iterations = quality == BlockQuality::Normal ? 1 : 2;
+    for (int iteration = 0; iteration < iterations && best0 > best1; ++iteration)
+    {
+      float weights[16];
+      for (int i = 0; i < 16; ++i)
+        weights[i] = bestIndices[i] == 0 ? 0.0f : bestIndices[i] == 1 ? 1.0f : (bestIndices[i] - 1) / 7.0f;
+      glm::vec4 e0, e1;
+      if (!fitEndpoints(block, weights, e0, e1))
+        break;
+      const int fitted0 = (int)(e0[channel] + 0.5f), fitted1 = (int)(e1[channel] + 0.5f);
+      if (fitted0 <= fitted1 || !tryEndpoints(fitted0, fitted1))
+        break;
+    }
+  }
+
+  if (quality == BlockQuality::High && bestError > 0.0f)
+  {
+    // Small steps around the best endpoints catch what the rounding missed
+    const int center0 = best0, center1 = best1;
+    for (int d0 = -2; d0 <= 2; ++d0)
+    {
+      for (int d1 = -2; d1 <= 2; ++d1)
+      {
+        const int e0 = center0 + d0, e1 = center1 + d1;
+        if (e0 >= 0 && e0 <= 255 && e1 >= 0 && e1 <= 255 && (e0 > e1) == (center0 > center1))
+          tryEndpoints(e0, e1);
+      }
+    }
+  }
+
+  bc4Palette(best0, best1, channel, palette);
+  out[0] = (unsigned char)best0;
+  out[1] = (unsigned char)best1;
+  uint64_t bits = 0;
+  for (int i = 0; i < 16; ++i)
+    bits |= (uint64_t)bestIndices[i] << (3 * i);
+  for (int i = 0; i < 6; ++i)
+    out[2 + i] = (unsigned char)(bits >> (8 * i));
+  return measure(block, palette, bestIndices, channel, 1);
+}
+
+// ----------------------------------------------------------------------------
+
+// Endpoints of BC7 mode 6: 7 bits per channel extended by a p-bit shared by the channels
+struct BC7Endpoints
+{
+  int q0[4], q1[4];
+  int p0, p1;
+};
+
+static void quantizeBC7(const glm::vec4 &color, int pbit, int q[4])
+{
+  for (int c = 0; c < 4; ++c)
+    q[c] = glm::clamp((int)std::floor((color[c] - pbit) * 0.5f + 0.5f), 0, 127);
+}
+
+// Returns the squared error of the color stored with the p-bit
+static float quantizationErrorBC7(const glm::vec4 &color, int pbit)
+{
+  int q[4];
+  quantizeBC7(color, pbit, q);
+  float error = 0.0f;
+  for (int c = 0; c < 4; ++c)
+  {
+    const float d = color[c] - (float)((q[c] << 1) | pbit);
+    error += d * d;
+  }
+  return error;
+}
+
+static void bc7Palette(const BC7Endpoints &endpoints, Palette &palette)
+{
+  palette.size = 16;
+  for (int c = 0; c < 4; ++c)
+  {
+    const int v0 = (endpoints.q0[c] << 1) | endpoints.p0, v1 = (endpoints.q1[c] << 1) | endpoints.p1;
+    for (int i = 0; i < 16; ++i)
+      palette.colors[i][c] = (float)(((64 - BC7_WEIGHTS[i]) * v0 + BC7_WEIGHTS[i] * v1 + 32) >> 6);
+  }
+}
+
+static BlockStats encodeBC7(const Block &block, BlockQuality quality, unsigned char *out)
+{
+  BC7Endpoints best;
+  float bestError = FLT_MAX;
+  uint8_t bestIndices[16];
+  const auto tryEndpoints = [&](const glm::vec4 &e0, const glm::vec4 &e1)
+  {
+    bool improved = false;
+    for (int pbits = 0; pbits < 4; ++pbits)
+    {
+      BC7Endpoints endpoints;
+      endpoints.p0 = pbits & 1;
+      endpoints.p1 = pbits >> 1;
+      // Only the high preset tries all of the p-bits, the others take the closest ones
+      if (quality != BlockQuality::High &&
+          (endpoints.p0 != (quantizationErrorBC7(e0, 1) < quantizationErrorBC7(e0, 0) ? 1 : 0) ||
+           endpoints.p1 != (quantizationErrorBC7(e1, 1) < quantizationErrorBC7(e1, 0) ? 1 : 0)))
+        continue;
+
+      quantizeBC7(e0, endpoints.p0, endpoints.q0);
+      quantizeBC7(e1, endpoints.p1, endpoints.q1);
+      Palette palette;
+      bc7Palette(endpoints, palette);
+      uint8_t indices[16];
+      const float error = fitIndices(block, palette, 0, 4, indices);
+      if (error < bestError)
+      {
+        best = endpoints;
+        bestError = error;
+        memcpy(bestIndices, indices, sizeof(bestIndices));
+        improved = true;
+      }
+    }
+    return improved;
+  };
+
+  glm::vec4 mean, axis, e0, e1;
+  computeAxis(block, 0, 4, quality != BlockQuality::Fast, mean, axis);
+  projectEndpoints(block, mean, axis, e0, e1);
+  if (quality == BlockQuality::Fast)
+    insetEndpoints(e0, e1);
+  tryEndpoints(e0, e1);
+
+  const int iterations = quality == BlockQuality::Fast ? 0 : quality == BlockQuality::Normal ? 1 : 3;
+  for (int iteration = 0; iteration < iterations && bestError > 0.0f; ++iteration)
+  {
+    float weights[16];
+    for (int i = 0; i < 16; ++i)
+      weights[i] = BC7_WEIGHTS[bestIndices[i]] / 64.0f;
+    if (!fitEndpoints(block, weights, e0, e1) || !tryEndpoints(e0, e1))
+      break;
+  }
+
+  Palette palette;
+  bc7Palette(best, palette);
+  const BlockStats stats = measure(block, palette, bestIndices, 0, 3);
+
+  // The most significant bit of the first index is implied zero, swapping the endpoints
+  // inverts the indices
+  if (bestIndices[0] >= 8)
+  {
+    std::swap(best.q0, best.q1);
+    std::swap(best.p0, best.p1);
+    for (uint8_t &index : bestIndices)
+      index = (uint8_t)(15 - index);
+  }
+
+  // Mode 6: mode bits, RGBA endpoints interleaved by channel, p-bits, indices
+  memset(out, 0, 16);
+  BitWriter writer = {out, 0};
+  writer.Write(1 << 6, 7);
+  for (int c = 0; c < 4; ++c)
+  {
+    writer.Write((uint32_t)best.q0[c], 7);
+    writer.Write((uint32_t)best.q1[c], 7);
+  }
+  writer.Write((uint32_t)best.p0, 1);
+  writer.Write((uint32_t)best.p1, 1);
+  writer.Write(bestIndices[0], 3);
+  for (int i = 1; i < 16; ++i)
+    writer.Write(bestIndices[i], 4);
+  return stats;
+}
+
+// ----------------------------------------------------------------------------
+
+// Encodes the block and returns its error, color formats are measured on RGB
+static BlockStats encodeBlock(BlockFormat format, BlockQuality quality, const Block &block, unsigned char *out)
+{
+  switch (format) {
+      case BlockFormat::BC1:
+          return encodeBC1(block, quality, out);
+      case BlockFormat::BC3:
+          encodeBC4(block, 3, quality, out);
+          return encodeBC1(block, quality, out + 8);
+      case BlockFormat::BC4:
+          return encodeBC4(block, 0, quality, out);
+      case BlockFormat::BC5:
+      {
+          BlockStats stats = encodeBC4(block, 0, quality, out);
+          stats.Add(encodeBC4(block, 1, quality, out + 8));
+          return stats;
+      }
+      case BlockFormat::BC7:
+          return encodeBC7(block, quality, out);
+      default:
+          return BlockStats();
+  }
+}
+
+double BlockStats::GetPSNR() const
+{
+  const double mse = samples > 0 ? squaredError / samples : 0.0;
+  if (mse <= 0.0)
+    return 100.0;
+  return std::min(10.0 * std::log10(255.0 * 255.0 / mse), 100.0);
+}
+
+GLenum BlockEncoder::GetInternalFormat(BlockFormat format, bool sRGB)
+{
+  switch (format) {
+      case BlockFormat::BC1:
+          return sRGB ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+      case BlockFormat::BC3:
+          return sRGB ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+      case BlockFormat::BC4:
+          return GL_COMPRESSED_RED_RGTC1;
+      case BlockFormat::BC5:
+          return GL_COMPRESSED_RG_RGTC2;
+      case BlockFormat::BC7:
+          return sRGB ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+      default:
+          return sRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+  }
+}
+
+bool BlockEncoder::IsColor(BlockFormat format)
+{
+  return format == BlockFormat::BC1 || format == BlockFormat::BC3 || format == BlockFormat::BC7;
+}
+
+size_t BlockEncoder::GetBlockSize(BlockFormat format)
+{
+  switch (format) {
+      case BlockFormat::BC1:
+      case BlockFormat::BC4:
+          return 8;
+      case BlockFormat::BC3:
+      case BlockFormat::BC5:
+      case BlockFormat::BC7:
+          return 16;
+      default:
+          // 4x4 RGBA8 pixels
+          return 64;
+  }
+}
+
+size_t BlockEncoder::GetImageSize(BlockFormat format, int width, int height)
+{
+  return (size_t)((width + 3) / 4) * ((height + 3) / 4) * GetBlockSize(format);
+}
+
+bool BlockEncoder::IsSupported(BlockFormat format)
+{
+  if (format == BlockFormat::None)
+    return true;
+
+  GLint supported = GL_FALSE;
+  glGetInternalformativ(GL_TEXTURE_2D_ARRAY, GetInternalFormat(format), GL_INTERNALFORMAT_SUPPORTED, 1, &supported);
+  return supported == GL_TRUE;
+}
+
+const char *BlockEncoder::GetName(BlockFormat format)
+{
+  static const char *names[] = {"none", "BC1", "BC3", "BC4", "BC5", "BC7"};
+  return names[(int)format];
+}
+
+const char *BlockEncoder::GetName(BlockQuality quality)
+{
+  static const char *names[] = {"fast", "normal", "high"};
+  return names[(int)quality];
+}
+
+BlockStats BlockEncoder::Encode(BlockFormat format, BlockQuality quality, const unsigned char *pixels, int width, int height,
+                                unsigned char *blocks, ThreadPool *threadPool, BlockStats *blockStats)
+{
+  const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+  const size_t blockSize = GetBlockSize(format);
+
+  // Errors summed per row in a fixed order, so the total doesn't depend on the threads
+  std::vector<BlockStats> rowStats(blocksY);
+  const ThreadPool::RangeTask encodeRows = [&](size_t begin, size_t end)
+  {
+    Block block;
+    for (size_t y = begin; y < end; ++y)
+    {
+      for (int x = 0; x < blocksX; ++x)
+      {
+        loadBlock(pixels, width, height, x * 4, (int)y * 4, block);
+        const size_t index = y * blocksX + x;
+        const BlockStats stats = encodeBlock(format, quality, block, blocks + index * blockSize);
+        if (blockStats)
+          blockStats[index] = stats;
+        rowStats[y].Add(stats);
+      }
+    }
+  };
+
+  if (threadPool)
+    threadPool->ParallelFor((size_t)blocksY, 2, encodeRows);
+  else
+    encodeRows(0, (size_t)blocksY);
+
+  BlockStats total;
+  for (const BlockStats &stats : rowStats)
+    total.Add(stats);
+  return total;
+}
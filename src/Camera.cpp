@@ -20,6 +20,12 @@ void Camera::SetTransformation(const glm::vec3& eye, const glm::vec3& lookAt, co
   _viewToWorld = fastMatrixInverse(_worldToView);
 }
 
+void Camera::SetViewToWorld(const glm::mat4x4& viewToWorld)
+{
+  _viewToWorld = viewToWorld;
+  _worldToView = fastMatrixInverse(_viewToWorld);
+}
+
 void Camera::SetProjection(float fov, float aspect, float near, float far)
 {
   // Make sure you convert from degrees to radians as glm uses radians from 0.9.6 version
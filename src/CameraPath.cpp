@@ -0,0 +1,111 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <CameraPath.h>
+
+#include <cstdint>
+#include <cstdio>
+
+// File identification, "CPTH" in little endian
+static const uint32_t CAMERA_PATH_MAGIC = 0x48545043;
+// Bumped whenever the frame layout changes
+static const uint32_t CAMERA_PATH_VERSION = 1;
+
+struct CameraPathHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t frameCount;
+};
+
+void CameraPath::Record(const Camera& camera)
+{
+  const glm::mat4x4& viewToWorld = camera.GetViewToWorld();
+
+  Frame frame;
+  for (int c = 0; c < 4; ++c)
+  {
+    for (int r = 0; r < 3; ++r)
+      frame.m[c][r] = viewToWorld[c][r];
+  }
+  _frames.push_back(frame);
+}
+
+void CameraPath::Apply(int frame, Camera& camera) const
+{
+  if (_frames.empty())
+    return;
+
+  const Frame& f = _frames[frame % _frames.size()];
+  glm::mat4x4 viewToWorld(glm::vec4(f.m[0][0], f.m[0][1], f.m[0][2], 0.0f),
+                          glm::vec4(f.m[1][0], f.m[1][1], f.m[1][2], 0.0f),
+                          glm::vec4(f.m[2][0], f.m[2][1], f.m[2][2], 0.0f),
+                          glm::vec4(f.m[3][0], f.m[3][1], f.m[3][2], 1.0f));
+  camera.SetViewToWorld(viewToWorld);
+}
+
+bool CameraPath::Save(const char* path) const
+{
+  FILE* file = fopen(path, "wb");
+  if (!file)
+  {
+    printf("Failed to open camera path for writing: %s\n", path);
+    return false;
+  }
+
+  const CameraPathHeader header = {CAMERA_PATH_MAGIC, CAMERA_PATH_VERSION, (uint32_t)_frames.size()};
+  bool result = fwrite(&header, sizeof(header), 1, file) == 1;
+  if (result && !_frames.empty())
+    result = fwrite(_frames.data(), sizeof(Frame), _frames.size(), file) == _frames.size();
+
+  fclose(file);
+  if (!result)
+    printf("Failed to write camera path: %s\n", path);
+  return result;
+}
+
+bool CameraPath::Load(const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if (!file)
+  {
+    printf("Failed to open camera path: %s\n", path);
+    return false;
+  }
+
+  CameraPathHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != CAMERA_PATH_MAGIC || header.version != CAMERA_PATH_VERSION)
+  {
+    printf("Not a camera path file: %s\n", path);
+    fclose(file);
+    return false;
+  }
+
+  // The frames have to be in the file before the count is trusted with an allocation
+  const long dataStart = ftell(file);
+  fseek(file, 0, SEEK_END);
+  const long dataSize = ftell(file) - dataStart;
+  fseek(file, dataStart, SEEK_SET);
+  if (dataStart < 0 || dataSize < 0 || (uint64_t)header.frameCount * sizeof(Frame) > (uint64_t)dataSize)
+  {
+    printf("Truncated camera path: %s\n", path);
+    fclose(file);
+    _frames.clear();
+    return false;
+  }
+
+  _frames.resize(header.frameCount);
+  const bool result = header.frameCount == 0 ||
+                      fread(_frames.data(), sizeof(Frame), _frames.size(), file) == _frames.size();
+  fclose(file);
+
+  if (!result)
+  {
+    printf("Truncated camera path: %s\n", path);
+    _frames.clear();
+  }
+  return result;
+}
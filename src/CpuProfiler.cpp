@@ -0,0 +1,95 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <CpuProfiler.h>
+
+#include <chrono>
+
+CpuProfiler::~CpuProfiler()
+{
+  for (ThreadRing* ring : _rings)
+    delete ring;
+}
+
+CpuProfiler& CpuProfiler::GetInstance()
+{
+  static CpuProfiler instance;
+  return instance;
+}
+
+uint64_t CpuProfiler::Now()
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CpuProfiler::ThreadRing* CpuProfiler::GetThreadRing()
+{
+  // The lock is taken only once per thread, rings live as long as the profiler
+  thread_local ThreadRing* ring = nullptr;
+  if (!ring)
+  {
+    ring = new ThreadRing();
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->tail.store(0, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(_ringsMutex);
+    _rings.push_back(ring);
+  }
+  return ring;
+}
+
+void CpuProfiler::Record(const char* name, uint64_t start, uint64_t end)
+{
+  ThreadRing* ring = GetThreadRing();
+
+  const uint32_t head = ring->head.load(std::memory_order_relaxed);
+  const uint32_t tail = ring->tail.load(std::memory_order_acquire);
+  if (head - tail >= RING_SIZE)
+  {
+    // Nobody collected for too long, rather lose the sample than block
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  ring->events[head & (RING_SIZE - 1)] = {name, start, end};
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+void CpuProfiler::Collect()
+{
+  _totals.clear();
+
+  std::lock_guard<std::mutex> lock(_ringsMutex);
+  for (ThreadRing* ring : _rings)
+  {
+    const uint32_t head = ring->head.load(std::memory_order_acquire);
+    uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+    for (; tail != head; ++tail)
+    {
+      const Event& e = ring->events[tail & (RING_SIZE - 1)];
+
+      // Only a handful of distinct zones exist, linear search is fine
+      ZoneTotal* total = nullptr;
+      for (ZoneTotal& t : _totals)
+      {
+        if (t.name == e.name)
+        {
+          total = &t;
+          break;
+        }
+      }
+      if (!total)
+      {
+        _totals.push_back({e.name, 0.0, 0});
+        total = &_totals.back();
+      }
+
+      total->ms += (double)(e.end - e.start) * 1e-6;
+      ++total->count;
+    }
+    ring->tail.store(tail, std::memory_order_release);
+  }
+}
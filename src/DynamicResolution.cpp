@@ -0,0 +1,91 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <DynamicResolution.h>
+
+#include <algorithm>
+#include <cmath>
+
+// Nothing changes while the frame time stays within [LOW, HIGH] * budget
+static const float HYSTERESIS_LOW = 0.85f;
+static const float HYSTERESIS_HIGH = 1.0f;
+// Largest relative change of a scale in a single step
+static const float MAX_STEP = 0.2f;
+// GPU timings lag a few frames behind, wait for the change to show up in them
+static const int COOLDOWN_FRAMES = 8;
+// Weight of the newest sample in the smoothed frame time
+static const float SMOOTHING = 0.2f;
+
+DynamicResolution::DynamicResolution() :
+  _budgetMs(0.0f),
+  _smoothedMs(0.0f),
+  _cooldown(0)
+{
+  for (int i = 0; i < NumPasses; ++i)
+  {
+    _scale[i] = 1.0f;
+    _minScale[i] = 0.25f;
+  }
+  _minScale[Main] = 0.5f;
+}
+
+void DynamicResolution::SetBudget(float ms)
+{
+  _budgetMs = ms > 0.0f ? ms : 0.0f;
+  _smoothedMs = 0.0f;
+  _cooldown = 0;
+  for (int i = 0; i < NumPasses; ++i)
+    _scale[i] = 1.0f;
+}
+
+void DynamicResolution::Update(const float passMs[NumPasses])
+{
+  if (!IsEnabled())
+    return;
+
+  float frameMs = 0.0f;
+  for (int i = 0; i < NumPasses; ++i)
+    frameMs += passMs[i];
+
+  _smoothedMs = _smoothedMs > 0.0f ? _smoothedMs + SMOOTHING * (frameMs - _smoothedMs) : frameMs;
+  if (_cooldown > 0)
+  {
+    --_cooldown;
+    return;
+  }
+
+  const bool overBudget = _smoothedMs > _budgetMs * HYSTERESIS_HIGH;
+  const bool underBudget = _smoothedMs < _budgetMs * HYSTERESIS_LOW;
+  if (!overBudget && !underBudget)
+    return;
+
+  // Cost is proportional to the number of pixels, i.e., to the square of the scale.
+  // Aim for the middle of the hysteresis band
+  const float target = _budgetMs * 0.5f * (HYSTERESIS_LOW + HYSTERESIS_HIGH);
+  const float factor = std::min(std::max(std::sqrt(target / _smoothedMs), 1.0f - MAX_STEP), 1.0f + MAX_STEP);
+
+  // Going down the offscreen passes give up resolution first, going up the main view gets it back first
+  for (int group = 0; group < 2; ++group)
+  {
+    const bool scaleMain = (group == 0) != overBudget;
+
+    bool changed = false;
+    for (int i = 0; i < NumPasses; ++i)
+    {
+      if ((i == Main) != scaleMain)
+        continue;
+
+      const float scale = std::min(std::max(_scale[i] * factor, _minScale[i]), 1.0f);
+      changed |= scale != _scale[i];
+      _scale[i] = scale;
+    }
+
+    if (changed)
+    {
+      _cooldown = COOLDOWN_FRAMES;
+      return;
+    }
+  }
+}
@@ -0,0 +1,137 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <FrameStats.h>
+#include <CpuProfiler.h>
+
+#include <cstring>
+
+void FrameHistogram::Clear()
+{
+  memset(_buckets, 0, sizeof(_buckets));
+  _count = 0;
+  _sum = 0.0;
+}
+
+void FrameHistogram::Add(float ms)
+{
+  int bucket = (int)(ms / BUCKET_MS);
+  if (bucket < 0)
+    bucket = 0;
+  if (bucket >= NUM_BUCKETS)
+    bucket = NUM_BUCKETS - 1;
+
+  ++_buckets[bucket];
+  ++_count;
+  _sum += ms;
+}
+
+float FrameHistogram::Percentile(float fraction) const
+{
+  if (_count == 0)
+    return 0.0f;
+
+  // Walk the buckets until enough frames are below, report the bucket upper bound
+  const int target = (int)(fraction * (_count - 1)) + 1;
+  int accumulated = 0;
+  for (int i = 0; i < NUM_BUCKETS; ++i)
+  {
+    accumulated += _buckets[i];
+    if (accumulated >= target)
+      return (i + 1) * BUCKET_MS;
+  }
+  return NUM_BUCKETS * BUCKET_MS;
+}
+
+// ----------------------------------------------------------------------------
+
+FrameStats::FrameStats() :
+  _output(StatsOutput::Title),
+  _file(nullptr),
+  _interval(0.5),
+  _intervalStart(-1.0),
+  _hitchMs(33.3f),
+  _hitches(0),
+  _report{0}
+{}
+
+FrameStats::~FrameStats()
+{
+  if (_file)
+    fclose(_file);
+}
+
+bool FrameStats::SetOutput(StatsOutput output, const char* path)
+{
+  if (_file)
+  {
+    fclose(_file);
+    _file = nullptr;
+  }
+
+  if (output == StatsOutput::File)
+  {
+    _file = path ? fopen(path, "w") : nullptr;
+    if (!_file)
+    {
+      printf("Failed to open stats file: %s\n", path ? path : "(null)");
+      _output = StatsOutput::Stdout;
+      return false;
+    }
+  }
+
+  _output = output;
+  return true;
+}
+
+const char* FrameStats::AddFrame(double time, float dt)
+{
+  // The very first frame has no meaningful duration
+  if (_intervalStart < 0.0)
+  {
+    _intervalStart = time;
+    return nullptr;
+  }
+
+  const float ms = dt * 1000.0f;
+  _histogram.Add(ms);
+  if (ms > _hitchMs)
+    ++_hitches;
+
+  if (time - _intervalStart < _interval)
+    return nullptr;
+
+  const int frames = _histogram.GetCount();
+  int length = snprintf(_report, MAX_REPORT_LENGTH, "%.1f FPS, p50 %.1fms, p95 %.1fms, p99 %.1fms, hitches %d",
+                        frames / (time - _intervalStart), _histogram.Percentile(0.5f),
+                        _histogram.Percentile(0.95f), _histogram.Percentile(0.99f), _hitches);
+
+  // The title bar gets just the summary, the rest also the average time of every zone. Zones
+  // don't run every frame (worker tasks, skipped passes), they're averaged over their own samples
+  CpuProfiler& profiler = CpuProfiler::GetInstance();
+  profiler.Collect();
+  if (_output != StatsOutput::Title)
+  {
+    for (const CpuProfiler::ZoneTotal& zone : profiler.GetZoneTotals())
+    {
+      if (length <= 0 || length >= (int)MAX_REPORT_LENGTH)
+        break;
+      length += snprintf(_report + length, MAX_REPORT_LENGTH - length, ", %s %.3fms", zone.name, zone.ms / zone.count);
+    }
+  }
+
+  if (_output == StatsOutput::Stdout)
+    printf("%s\n", _report);
+  else if (_output == StatsOutput::File)
+  {
+    fprintf(_file, "%.3f: %s\n", time, _report);
+    fflush(_file);
+  }
+
+  _histogram.Clear();
+  _hitches = 0;
+  _intervalStart = time;
+  return _report;
+}
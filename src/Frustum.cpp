@@ -0,0 +1,99 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <Frustum.h>
+
+void Frustum::Update(const glm::mat4x4& worldToClip)
+{
+  // Gribb-Hartmann: the planes are sums and differences of the matrix rows,
+  // glm is column major so the rows have to be assembled by hand
+  glm::vec4 row[4];
+  for (int i = 0; i < 4; ++i)
+    row[i] = glm::vec4(worldToClip[0][i], worldToClip[1][i], worldToClip[2][i], worldToClip[3][i]);
+
+  _planes[0] = row[3] + row[0];
+  _planes[1] = row[3] - row[0];
+  _planes[2] = row[3] + row[1];
+  _planes[3] = row[3] - row[1];
+  // -w <= z is conservative for the [0, 1] depth range as well
+  _planes[4] = row[3] + row[2];
+  _planes[5] = row[3] - row[2];
+
+  // Unit normals make the plane equations distances, the spheres need them
+  for (glm::vec4& plane : _planes)
+    plane /= glm::length(glm::vec3(plane));
+}
+
+bool Frustum::Intersects(const AABB& box) const
+{
+  for (const glm::vec4& plane : _planes)
+  {
+    // Test the corner furthest along the plane normal, if even that one is
+    // behind the plane the whole box is
+    const glm::vec3 corner(plane.x > 0.0f ? box.max.x : box.min.x,
+                           plane.y > 0.0f ? box.max.y : box.min.y,
+                           plane.z > 0.0f ? box.max.z : box.min.z);
+    if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+      return false;
+  }
+  return true;
+}
+
+bool Frustum::Intersects(const glm::vec3& center, float radius) const
+{
+  for (const glm::vec4& plane : _planes)
+  {
+    if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+      return false;
+  }
+  return true;
+}
+
+bool GetScreenRect(const glm::mat4x4& worldToClip, const AABB& box, glm::vec4& rect)
+{
+  // Points closer to the camera plane than this are considered behind the camera
+  const float minW = 1e-4f;
+
+  glm::vec4 corners[8];
+  for (int i = 0; i < 8; ++i)
+  {
+    const glm::vec3 corner(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z);
+    corners[i] = worldToClip * glm::vec4(corner, 1.0f);
+  }
+
+  glm::vec2 rectMin(1.0f), rectMax(0.0f);
+  bool any = false;
+  auto addPoint = [&](const glm::vec4& p)
+  {
+    const glm::vec2 uv = glm::vec2(p) / p.w * 0.5f + 0.5f;
+    rectMin = glm::min(rectMin, uv);
+    rectMax = glm::max(rectMax, uv);
+    any = true;
+  };
+
+  // Corners in front of the camera plus the points where the box edges cross it
+  for (int i = 0; i < 8; ++i)
+  {
+    if (corners[i].w > minW)
+      addPoint(corners[i]);
+
+    // Edges go from a corner to the corners differing in exactly one coordinate
+    for (int axis = 1; axis < 8; axis <<= 1)
+    {
+      const int j = i | axis;
+      if (j == i || (corners[i].w > minW) == (corners[j].w > minW))
+        continue;
+
+      const float t = (minW - corners[i].w) / (corners[j].w - corners[i].w);
+      addPoint(corners[i] + t * (corners[j] - corners[i]));
+    }
+  }
+
+  if (!any)
+    return false;
+
+  rect = glm::vec4(glm::clamp(rectMin, 0.0f, 1.0f), glm::clamp(rectMax, 0.0f, 1.0f));
+  return true;
+}
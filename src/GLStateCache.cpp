@@ -0,0 +1,157 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <GLStateCache.h>
+
+#include <cstdio>
+
+GLStateCache::GLStateCache() :
+  _capabilityCount(0),
+  _issued(0),
+  _filtered(0)
+{
+  Invalidate();
+}
+
+void GLStateCache::Invalidate()
+{
+  _program = UNKNOWN;
+  _vao = UNKNOWN;
+  for (int i = 0; i < MAX_TEXTURE_UNITS; ++i)
+  {
+    _textures[i] = UNKNOWN;
+    _samplers[i] = UNKNOWN;
+  }
+  _drawFramebuffer = UNKNOWN;
+  _readFramebuffer = UNKNOWN;
+  for (int i = 0; i < _capabilityCount; ++i)
+    _capabilities[i].state = UNKNOWN;
+}
+
+bool GLStateCache::Update(GLuint& shadow, GLuint value)
+{
+  if (shadow == value)
+  {
+    ++_filtered;
+    return false;
+  }
+
+  shadow = value;
+  ++_issued;
+  return true;
+}
+
+void GLStateCache::UseProgram(GLuint program)
+{
+  if (Update(_program, program))
+    glUseProgram(program);
+}
+
+void GLStateCache::BindVertexArray(GLuint vao)
+{
+  if (Update(_vao, vao))
+    glBindVertexArray(vao);
+}
+
+void GLStateCache::BindTexture(GLuint unit, GLuint texture)
+{
+  if (unit >= MAX_TEXTURE_UNITS)
+  {
+    ++_issued;
+    glBindTextureUnit(unit, texture);
+  }
+  else if (Update(_textures[unit], texture))
+    glBindTextureUnit(unit, texture);
+}
+
+void GLStateCache::BindSampler(GLuint unit, GLuint sampler)
+{
+  if (unit >= MAX_TEXTURE_UNITS)
+  {
+    ++_issued;
+    glBindSampler(unit, sampler);
+  }
+  else if (Update(_samplers[unit], sampler))
+    glBindSampler(unit, sampler);
+}
+
+void GLStateCache::BindFramebuffer(GLenum target, GLuint framebuffer)
+{
+  if (target == GL_FRAMEBUFFER)
+  {
+    // Both have to match to skip the call
+    if (_drawFramebuffer == framebuffer && _readFramebuffer == framebuffer)
+    {
+      ++_filtered;
+      return;
+    }
+    _drawFramebuffer = _readFramebuffer = framebuffer;
+    ++_issued;
+    glBindFramebuffer(target, framebuffer);
+  }
+  else if (Update(target == GL_READ_FRAMEBUFFER ? _readFramebuffer : _drawFramebuffer, framebuffer))
+    glBindFramebuffer(target, framebuffer);
+}
+
+void GLStateCache::Enable(GLenum capability)
+{
+  Capability* shadow = FindCapability(capability);
+  if (!shadow)
+  {
+    ++_issued;
+    glEnable(capability);
+  }
+  else if (Update(shadow->state, 1))
+    glEnable(capability);
+}
+
+void GLStateCache::Disable(GLenum capability)
+{
+  Capability* shadow = FindCapability(capability);
+  if (!shadow)
+  {
+    ++_issued;
+    glDisable(capability);
+  }
+  else if (Update(shadow->state, 0))
+    glDisable(capability);
+}
+
+bool GLStateCache::IsEnabled(GLenum capability)
+{
+  Capability* shadow = FindCapability(capability);
+  if (shadow && shadow->state != UNKNOWN)
+    return shadow->state == 1;
+
+  const bool enabled = glIsEnabled(capability) == GL_TRUE;
+  if (shadow)
+    shadow->state = enabled ? 1 : 0;
+  return enabled;
+}
+
+void GLStateCache::PrintCounters(int frames) const
+{
+  if (frames <= 0)
+    frames = 1;
+
+  const unsigned long long total = _issued + _filtered;
+  printf("GL state calls per frame: %.1f issued, %.1f filtered (%.1f%% redundant)\n", (double)_issued / frames,
+         (double)_filtered / frames, total > 0 ? 100.0 * _filtered / total : 0.0);
+}
+
+GLStateCache::Capability* GLStateCache::FindCapability(GLenum capability)
+{
+  for (int i = 0; i < _capabilityCount; ++i)
+  {
+    if (_capabilities[i].capability == capability)
+      return &_capabilities[i];
+  }
+
+  if (_capabilityCount == MAX_CAPABILITIES)
+    return nullptr;
+
+  _capabilities[_capabilityCount] = {capability, UNKNOWN};
+  return &_capabilities[_capabilityCount++];
+}
@@ -4,74 +4,65 @@
  */
 
 #include "Geometry.h"
+#include "MeshBuilder.h"
 
 #include <glm/glm.hpp>
 
 Mesh<Vertex_Pos_Col> *Geometry::CreateQuadColor()
 {
   // Create the vertex buffer for a quad
-  std::vector<Vertex_Pos_Col> vb;
-  vb.reserve(4);
+  MeshBuilder<Vertex_Pos_Col> builder(4, 6);
 
   // Create vertices
-  vb.push_back({-0.5f, 0.0f, -0.5f, 0.5f, 0.5f, 0.5f});
-  vb.push_back({ 0.5f, 0.0f, -0.5f, 0.5f, 0.5f, 0.5f});
-  vb.push_back({ 0.5f, 0.0f,  0.5f, 0.5f, 0.5f, 0.5f});
-  vb.push_back({-0.5f, 0.0f,  0.5f, 0.5f, 0.5f, 0.5f});
-
-  // Fill in the index buffer
-  std::vector<GLuint> ib;
-  ib.reserve(6);
+  builder.AddVertex({-0.5f, 0.0f, -0.5f, 0.5f, 0.5f, 0.5f});
+  builder.AddVertex({ 0.5f, 0.0f, -0.5f, 0.5f, 0.5f, 0.5f});
+  builder.AddVertex({ 0.5f, 0.0f,  0.5f, 0.5f, 0.5f, 0.5f});
+  builder.AddVertex({-0.5f, 0.0f,  0.5f, 0.5f, 0.5f, 0.5f});
 
   // One triangle
-  ib.push_back(0);
-  ib.push_back(1);
-  ib.push_back(2);
+  builder.AddIndex(0);
+  builder.AddIndex(1);
+  builder.AddIndex(2);
 
   // Other triangle
-  ib.push_back(2);
-  ib.push_back(3);
-  ib.push_back(0);
-
-  // Create, initialize and return the mesh
-  Mesh<Vertex_Pos_Col> *mesh = new Mesh<Vertex_Pos_Col>();
-  mesh->Init(vb, ib);
-  return mesh;
+  builder.AddIndex(2);
+  builder.AddIndex(3);
+  builder.AddIndex(0);
+
+  // Upload and return the mesh
+  return builder.Finish();
 }
 
-Mesh<Vertex_Pos_Tex>* Geometry::CreateQuadTex2D()
+template <class VertexType>
+Mesh<VertexType>* Geometry::CreateQuadTex2D()
 {
     // Create the vertex buffer for a quad
-    std::vector<Vertex_Pos_Tex> vb;
-    vb.reserve(4);
+    MeshBuilder<VertexType> builder(4, 6, glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    builder.OptimizePrimitives(3, "2D quad");
+    builder.BuildMeshlets();
 
     // Create vertices
-    vb.push_back({ -1.0f, 0.0f, 0.0f, 0.0f, 0.0f });
-    vb.push_back({ -0.0f, 0.0f, 0.0f, 1.0f, 0.0f });
-    vb.push_back({ -0.0f, 1.0f, 0.0f, 1.0f, 1.0f });
-    vb.push_back({ -1.0f, 1.0f, 0.0f, 0.0f, 1.0f });
-
-    // Fill in the index buffer
-    std::vector<GLuint> ib;
-    ib.reserve(6);
+    builder.AddVertex({ -1.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+    builder.AddVertex({ -0.0f, 0.0f, 0.0f, 1.0f, 0.0f });
+    builder.AddVertex({ -0.0f, 1.0f, 0.0f, 1.0f, 1.0f });
+    builder.AddVertex({ -1.0f, 1.0f, 0.0f, 0.0f, 1.0f });
 
     // One triangle
-    ib.push_back(0);
-    ib.push_back(1);
-    ib.push_back(2);
+    builder.AddIndex(0);
+    builder.AddIndex(1);
+    builder.AddIndex(2);
 
     // Other triangle
-    ib.push_back(2);
-    ib.push_back(3);
-    ib.push_back(0);
-
-    // Create, initialize and return the mesh
-    Mesh<Vertex_Pos_Tex>* mesh = new Mesh<Vertex_Pos_Tex>();
-    mesh->Init(vb, ib);
-    return mesh;
+    builder.AddIndex(2);
+    builder.AddIndex(3);
+    builder.AddIndex(0);
+
+    // Upload and return the mesh
+    return builder.Finish();
 }
 
-Mesh<Vertex_Pos_Tex>* Geometry::CreateQuadGrid(int size)
+template <class VertexType>
+Mesh<VertexType>* Geometry::CreateQuadGrid(int size)
 {
     const glm::mat4x3 vertCoords(-0.5f, 0.0f, -0.5f, 
                                   0.5f, 0.0f, -0.5f, 
@@ -83,8 +74,11 @@ Mesh<Vertex_Pos_Tex>* Geometry::CreateQuadGrid(int size)
     int halfSize = size / 2;
     float offset = halfSize + 0.5f * (size % 2);
     
-    std::vector<Vertex_Pos_Tex> vb;
-    vb.reserve((size + 1) * (size + 1));
+    // The patches are reordered for the cache when the builder finishes, the vertices go
+    // straight to the staging memory
+    MeshBuilder<VertexType> builder((size + 1) * (size + 1), 4 * numPatches,
+                                    glm::vec3(-offset, 0.0f, -offset), glm::vec3(size - offset, 0.0f, size - offset));
+    builder.OptimizePrimitives(4, "quad grid");
 
     for (int z = 0; z != size + 1; ++z)
     {
@@ -92,13 +86,11 @@ Mesh<Vertex_Pos_Tex>* Geometry::CreateQuadGrid(int size)
         {
             float u = x / (float)size;
             float v = z / (float)size;
-            vb.push_back({ x - offset, 0.0f, z - offset, u, v });
+            builder.AddVertex({ x - offset, 0.0f, z - offset, u, v });
         }
     }
 
     //index the patches
-    std::vector<GLuint> ib;
-
     for (int y = 0; y != size; ++y)
     {
         for (int x = 0; x != size; ++x)
@@ -106,662 +98,620 @@ Mesh<Vertex_Pos_Tex>* Geometry::CreateQuadGrid(int size)
             int botleft = x + (size + 1) * y;
             int topleft = x + (size + 1) * (y + 1);
             //4 vertex patches
-            ib.push_back(botleft);
-            ib.push_back(botleft + 1);
-            ib.push_back(topleft + 1);
-            ib.push_back(topleft);
+            builder.AddIndex(botleft);
+            builder.AddIndex(botleft + 1);
+            builder.AddIndex(topleft + 1);
+            builder.AddIndex(topleft);
         }
     }
 
-    // Create, initialize and return the mesh
-    Mesh<Vertex_Pos_Tex>* mesh = new Mesh<Vertex_Pos_Tex>();
-    mesh->Init(vb, ib);
-    return mesh;
+    // Upload and return the mesh
+    return builder.Finish();
 }
 
-Mesh<Vertex_Pos_Tex> *Geometry::CreateQuadTex()
+template <class VertexType>
+Mesh<VertexType> *Geometry::CreateQuadTex()
 {
   // Create the vertex buffer for a quad
-  std::vector<Vertex_Pos_Tex> vb;
-  vb.reserve(4);
+  MeshBuilder<VertexType> builder(4, 6, glm::vec3(-0.5f, 0.0f, -0.5f), glm::vec3(0.5f, 0.0f, 0.5f));
+  builder.OptimizePrimitives(3, "quad");
+  builder.BuildMeshlets();
 
   // Create vertices
-  vb.push_back({-0.5f, 0.0f, -0.5f, 0.0f, 0.0f});//botleft
-  vb.push_back({ 0.5f, 0.0f, -0.5f, 1.0f, 0.0f});//botright
-  vb.push_back({ 0.5f, 0.0f,  0.5f, 1.0f, 1.0f});//topright
-  vb.push_back({-0.5f, 0.0f,  0.5f, 0.0f, 1.0f});//topleft
-
-  // Fill in the index buffer
-  std::vector<GLuint> ib;
-  ib.reserve(6);
+  builder.AddVertex({-0.5f, 0.0f, -0.5f, 0.0f, 0.0f});//botleft
+  builder.AddVertex({ 0.5f, 0.0f, -0.5f, 1.0f, 0.0f});//botright
+  builder.AddVertex({ 0.5f, 0.0f,  0.5f, 1.0f, 1.0f});//topright
+  builder.AddVertex({-0.5f, 0.0f,  0.5f, 0.0f, 1.0f});//topleft
 
   // One triangle
-  ib.push_back(0);
-  ib.push_back(1);
-  ib.push_back(2);
+  builder.AddIndex(0);
+  builder.AddIndex(1);
+  builder.AddIndex(2);
 
   // Other triangle
-  ib.push_back(2);
-  ib.push_back(3);
-  ib.push_back(0);
-
-  // Create, initialize and return the mesh
-  Mesh<Vertex_Pos_Tex> *mesh = new Mesh<Vertex_Pos_Tex>();
-  mesh->Init(vb, ib);
-  return mesh;
+  builder.AddIndex(2);
+  builder.AddIndex(3);
+  builder.AddIndex(0);
+
+  // Upload and return the mesh
+  return builder.Finish();
 }
 
 Mesh<Vertex_Pos_Nrm_Tgt_Tex> *Geometry::CreateQuadNormalTangentTex()
 {
   // Create the vertex buffer for a quad
-  std::vector<Vertex_Pos_Nrm_Tgt_Tex> vb;
-  vb.reserve(4);
+  MeshBuilder<Vertex_Pos_Nrm_Tgt_Tex> builder(4, 6);
 
   // Create vertices
-  vb.push_back({-0.5f, 0.0f, -0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f});
-  vb.push_back({ 0.5f, 0.0f, -0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f});
-  vb.push_back({ 0.5f, 0.0f,  0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f});
-  vb.push_back({-0.5f, 0.0f,  0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f});
-
-  // Fill in the index buffer
-  std::vector<GLuint> ib;
-  ib.reserve(6);
+  builder.AddVertex({-0.5f, 0.0f, -0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f});
+  builder.AddVertex({ 0.5f, 0.0f, -0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f});
+  builder.AddVertex({ 0.5f, 0.0f,  0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f});
+  builder.AddVertex({-0.5f, 0.0f,  0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f});
 
   // One triangle
-  ib.push_back(0);
-  ib.push_back(1);
-  ib.push_back(2);
+  builder.AddIndex(0);
+  builder.AddIndex(1);
+  builder.AddIndex(2);
 
   // Other triangle
-  ib.push_back(2);
-  ib.push_back(3);
-  ib.push_back(0);
-
-  // Create, initialize and return the mesh
-  Mesh<Vertex_Pos_Nrm_Tgt_Tex> *mesh = new Mesh<Vertex_Pos_Nrm_Tgt_Tex>();
-  mesh->Init(vb, ib);
-  return mesh;
+  builder.AddIndex(2);
+  builder.AddIndex(3);
+  builder.AddIndex(0);
+
+  // Upload and return the mesh
+  return builder.Finish();
 }
 
 Mesh<Vertex_Pos_Col>* Geometry::CreatePool()
 {
     // Create the vertex buffer for a unit cube
-    std::vector<Vertex_Pos_Col> vb;
-    vb.reserve(20);
+    MeshBuilder<Vertex_Pos_Col> builder(20, 30);
 
     // Top face
-    //vb.push_back({ -0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.0f });
-    //vb.push_back({ 0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.0f });
-    //vb.push_back({ 0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f });
-    //vb.push_back({ -0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f });
+    //builder.AddVertex({ -0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.0f });
+    //builder.AddVertex({ 0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.0f });
+    //builder.AddVertex({ 0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f });
+    //builder.AddVertex({ -0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f });
 
     // Bottom face
-    vb.push_back({ 0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 1.0f });
-    vb.push_back({ -0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 1.0f });
-    vb.push_back({ -0.5f, -0.5f, 0.5f, 0.0f, 1.0f, 1.0f });
-    vb.push_back({ 0.5f, -0.5f, 0.5f, 0.0f, 1.0f, 1.0f });
+    builder.AddVertex({ 0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 1.0f });
+    builder.AddVertex({ -0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 1.0f });
+    builder.AddVertex({ -0.5f, -0.5f, 0.5f, 0.0f, 1.0f, 1.0f });
+    builder.AddVertex({ 0.5f, -0.5f, 0.5f, 0.0f, 1.0f, 1.0f });
 
     // Front face
-    vb.push_back({ -0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 1.0f });
-    vb.push_back({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 1.0f });
-    vb.push_back({ 0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 1.0f });
-    vb.push_back({ -0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 1.0f });
+    builder.AddVertex({ -0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 1.0f });
+    builder.AddVertex({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 1.0f });
+    builder.AddVertex({ 0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 1.0f });
+    builder.AddVertex({ -0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 1.0f });
 
     // Back face
-    vb.push_back({ 0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f });
-    vb.push_back({ -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f });
-    vb.push_back({ -0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 1.0f });
-    vb.push_back({ 0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 1.0f });
+    builder.AddVertex({ 0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f });
+    builder.AddVertex({ -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f });
+    builder.AddVertex({ -0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 1.0f });
+    builder.AddVertex({ 0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 1.0f });
 
     // Left face
-    vb.push_back({ -0.5f, -0.5f, 0.5f, 1.0f, 1.0f, 0.0f });
-    vb.push_back({ -0.5f, -0.5f, -0.5f, 1.0f, 1.0f, 0.0f });
-    vb.push_back({ -0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.0f });
-    vb.push_back({ -0.5f, 0.5f, 0.5f, 1.0f, 1.0f, 0.0f });
+    builder.AddVertex({ -0.5f, -0.5f, 0.5f, 1.0f, 1.0f, 0.0f });
+    builder.AddVertex({ -0.5f, -0.5f, -0.5f, 1.0f, 1.0f, 0.0f });
+    builder.AddVertex({ -0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.0f });
+    builder.AddVertex({ -0.5f, 0.5f, 0.5f, 1.0f, 1.0f, 0.0f });
 
     // Right face
-    vb.push_back({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f });
-    vb.push_back({ 0.5f, -0.5f, 0.5f, 1.0f, 0.0f, 0.0f });
-    vb.push_back({ 0.5f, 0.5f, 0.5f, 1.0f, 0.0f, 0.0f });
-    vb.push_back({ 0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 0.0f });
+    builder.AddVertex({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f });
+    builder.AddVertex({ 0.5f, -0.5f, 0.5f, 1.0f, 0.0f, 0.0f });
+    builder.AddVertex({ 0.5f, 0.5f, 0.5f, 1.0f, 0.0f, 0.0f });
+    builder.AddVertex({ 0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 0.0f });
 
     // Fill in the index buffer
-    std::vector<GLuint> ib;
-    ib.reserve(30);
     for (int face = 0; face < 5; ++face) {
         GLuint baseIndex = 4 * face;
 
         //// One triangle
-        //ib.push_back(baseIndex);
-        //ib.push_back(baseIndex + 1);
-        //ib.push_back(baseIndex + 2);
+        //builder.AddIndex(baseIndex);
+        //builder.AddIndex(baseIndex + 1);
+        //builder.AddIndex(baseIndex + 2);
 
         // //Other triangle
-        //ib.push_back(baseIndex + 2);
-        //ib.push_back(baseIndex + 3);
-        //ib.push_back(baseIndex);
+        //builder.AddIndex(baseIndex + 2);
+        //builder.AddIndex(baseIndex + 3);
+        //builder.AddIndex(baseIndex);
 
         // One triangle
-        ib.push_back(baseIndex + 3);
-        ib.push_back(baseIndex + 2);
-        ib.push_back(baseIndex + 1);
+        builder.AddIndex(baseIndex + 3);
+        builder.AddIndex(baseIndex + 2);
+        builder.AddIndex(baseIndex + 1);
 
         // Other triangle
-        ib.push_back(baseIndex + 1);
-        ib.push_back(baseIndex);
-        ib.push_back(baseIndex + 3);
+        builder.AddIndex(baseIndex + 1);
+        builder.AddIndex(baseIndex);
+        builder.AddIndex(baseIndex + 3);
     }
 
-    // Create, initialize and return the mesh
-    Mesh<Vertex_Pos_Col>* mesh = new Mesh<Vertex_Pos_Col>();
-    mesh->Init(vb, ib);
-    return mesh;
+    // Upload and return the mesh
+    return builder.Finish();
 }
 
-Mesh<Vertex_Pos_Tex>* Geometry::CreateCubeTexInsideOut()
+template <class VertexType>
+Mesh<VertexType>* Geometry::CreateCubeTexInsideOut()
 {
     // Create the vertex buffer for a unit cube
-    std::vector<Vertex_Pos_Tex> vb;
-    vb.reserve(24);
+    MeshBuilder<VertexType> builder(24, 36, glm::vec3(-0.5f), glm::vec3(0.5f));
+    builder.OptimizePrimitives(3, "inside out cube");
+    builder.BuildMeshlets();
 
     // Top face
-    vb.push_back({ -0.5f, 0.5f, -0.5f, 1.0f, 0.0f });
-    vb.push_back({ 0.5f, 0.5f, -0.5f, 1.0f, 1.0f });
-    vb.push_back({ 0.5f, 0.5f, 0.5f, 0.0f, 1.0f });
-    vb.push_back({ -0.5f, 0.5f, 0.5f, 0.0f, 0.0f });
+    builder.AddVertex({ -0.5f, 0.5f, -0.5f, 1.0f, 0.0f });
+    builder.AddVertex({ 0.5f, 0.5f, -0.5f, 1.0f, 1.0f });
+    builder.AddVertex({ 0.5f, 0.5f, 0.5f, 0.0f, 1.0f });
+    builder.AddVertex({ -0.5f, 0.5f, 0.5f, 0.0f, 0.0f });
 
     // Bottom face
-    vb.push_back({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f });
-    vb.push_back({ -0.5f, -0.5f, -0.5f, 1.0f, 1.0f });
-    vb.push_back({ -0.5f, -0.5f, 0.5f, 0.0f, 1.0f });
-    vb.push_back({ 0.5f, -0.5f, 0.5f, 0.0f, 0.0f });
+    builder.AddVertex({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f });
+    builder.AddVertex({ -0.5f, -0.5f, -0.5f, 1.0f, 1.0f });
+    builder.AddVertex({ -0.5f, -0.5f, 0.5f, 0.0f, 1.0f });
+    builder.AddVertex({ 0.5f, -0.5f, 0.5f, 0.0f, 0.0f });
 
     // Front face
-    vb.push_back({ -0.5f, -0.5f, -0.5f, 0.0f, 0.0f });
-    vb.push_back({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f });
-    vb.push_back({ 0.5f, 0.5f, -0.5f, 1.0f, 1.0f });
-    vb.push_back({ -0.5f, 0.5f, -0.5f, 0.0f, 1.0f });
+    builder.AddVertex({ -0.5f, -0.5f, -0.5f, 0.0f, 0.0f });
+    builder.AddVertex({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f });
+    builder.AddVertex({ 0.5f, 0.5f, -0.5f, 1.0f, 1.0f });
+    builder.AddVertex({ -0.5f, 0.5f, -0.5f, 0.0f, 1.0f });
 
     // Back face
-    vb.push_back({ 0.5f, -0.5f, 0.5f, 0.0f, 0.0f });
-    vb.push_back({ -0.5f, -0.5f, 0.5f, 1.0f, 0.0f });
-    vb.push_back({ -0.5f, 0.5f, 0.5f, 1.0f, 1.0f });
-    vb.push_back({ 0.5f, 0.5f, 0.5f, 0.0f, 1.0f });
+    builder.AddVertex({ 0.5f, -0.5f, 0.5f, 0.0f, 0.0f });
+    builder.AddVertex({ -0.5f, -0.5f, 0.5f, 1.0f, 0.0f });
+    builder.AddVertex({ -0.5f, 0.5f, 0.5f, 1.0f, 1.0f });
+    builder.AddVertex({ 0.5f, 0.5f, 0.5f, 0.0f, 1.0f });
 
     // Left face
-    vb.push_back({ -0.5f, -0.5f, 0.5f, 0.0f, 0.0f });
-    vb.push_back({ -0.5f, -0.5f, -0.5f, 1.0f, 0.0f });
-    vb.push_back({ -0.5f, 0.5f, -0.5f, 1.0f, 1.0f });
-    vb.push_back({ -0.5f, 0.5f, 0.5f, 0.0f, 1.0f });
+    builder.AddVertex({ -0.5f, -0.5f, 0.5f, 0.0f, 0.0f });
+    builder.AddVertex({ -0.5f, -0.5f, -0.5f, 1.0f, 0.0f });
+    builder.AddVertex({ -0.5f, 0.5f, -0.5f, 1.0f, 1.0f });
+    builder.AddVertex({ -0.5f, 0.5f, 0.5f, 0.0f, 1.0f });
 
     // Right face
-    vb.push_back({ 0.5f, -0.5f, -0.5f, 0.0f, 0.0f });
-    vb.push_back({ 0.5f, -0.5f, 0.5f, 1.0f, 0.0f });
-    vb.push_back({ 0.5f, 0.5f, 0.5f, 1.0f, 1.0f });
-    vb.push_back({ 0.5f, 0.5f, -0.5f, 0.0f, 1.0f });
+    builder.AddVertex({ 0.5f, -0.5f, -0.5f, 0.0f, 0.0f });
+    builder.AddVertex({ 0.5f, -0.5f, 0.5f, 1.0f, 0.0f });
+    builder.AddVertex({ 0.5f, 0.5f, 0.5f, 1.0f, 1.0f });
+    builder.AddVertex({ 0.5f, 0.5f, -0.5f, 0.0f, 1.0f });
 
     // Fill in the index buffer
-    std::vector<GLuint> ib;
-    ib.reserve(36);
     for (int face = 0; face < 6; ++face) {
         GLuint baseIndex = 4 * face;
 
         // One triangle
-        ib.push_back(baseIndex + 3);
-        ib.push_back(baseIndex + 2);
-        ib.push_back(baseIndex + 1);
+        builder.AddIndex(baseIndex + 3);
+        builder.AddIndex(baseIndex + 2);
+        builder.AddIndex(baseIndex + 1);
 
         // Other triangle
-        ib.push_back(baseIndex + 1);
-        ib.push_back(baseIndex);
-        ib.push_back(baseIndex + 3);
+        builder.AddIndex(baseIndex + 1);
+        builder.AddIndex(baseIndex);
+        builder.AddIndex(baseIndex + 3);
     }
 
-    // Create, initialize and return the mesh
-    Mesh<Vertex_Pos_Tex>* mesh = new Mesh<Vertex_Pos_Tex>();
-    mesh->Init(vb, ib);
-    return mesh;
+    // Upload and return the mesh
+    return builder.Finish();
 }
 
 Mesh<Vertex_Pos_Col> *Geometry::CreateCubeColor()
 {
   // Create the vertex buffer for a unit cube
-  std::vector<Vertex_Pos_Col> vb;
-  vb.reserve(24);
+  MeshBuilder<Vertex_Pos_Col> builder(24, 36);
 
   // Top face
-  vb.push_back({-0.5f,  0.5f, -0.5f, 0.0f, 1.0f, 0.0f});
-  vb.push_back({ 0.5f,  0.5f, -0.5f, 0.0f, 1.0f, 0.0f});
-  vb.push_back({ 0.5f,  0.5f,  0.5f, 0.0f, 1.0f, 0.0f});
-  vb.push_back({-0.5f,  0.5f,  0.5f, 0.0f, 1.0f, 0.0f});
+  builder.AddVertex({-0.5f,  0.5f, -0.5f, 0.0f, 1.0f, 0.0f});
+  builder.AddVertex({ 0.5f,  0.5f, -0.5f, 0.0f, 1.0f, 0.0f});
+  builder.AddVertex({ 0.5f,  0.5f,  0.5f, 0.0f, 1.0f, 0.0f});
+  builder.AddVertex({-0.5f,  0.5f,  0.5f, 0.0f, 1.0f, 0.0f});
 
   // Bottom face
-  vb.push_back({ 0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 1.0f});
-  vb.push_back({-0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 1.0f});
-  vb.push_back({-0.5f, -0.5f,  0.5f, 0.0f, 1.0f, 1.0f});
-  vb.push_back({ 0.5f, -0.5f,  0.5f, 0.0f, 1.0f, 1.0f});
+  builder.AddVertex({ 0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 1.0f});
+  builder.AddVertex({-0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 1.0f});
+  builder.AddVertex({-0.5f, -0.5f,  0.5f, 0.0f, 1.0f, 1.0f});
+  builder.AddVertex({ 0.5f, -0.5f,  0.5f, 0.0f, 1.0f, 1.0f});
 
   // Front face
-  vb.push_back({-0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 1.0f});
-  vb.push_back({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 1.0f});
-  vb.push_back({ 0.5f,  0.5f, -0.5f, 1.0f, 0.0f, 1.0f});
-  vb.push_back({-0.5f,  0.5f, -0.5f, 1.0f, 0.0f, 1.0f});
+  builder.AddVertex({-0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 1.0f});
+  builder.AddVertex({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 1.0f});
+  builder.AddVertex({ 0.5f,  0.5f, -0.5f, 1.0f, 0.0f, 1.0f});
+  builder.AddVertex({-0.5f,  0.5f, -0.5f, 1.0f, 0.0f, 1.0f});
 
   // Back face
-  vb.push_back({ 0.5f, -0.5f,  0.5f, 0.0f, 0.0f, 1.0f});
-  vb.push_back({-0.5f, -0.5f,  0.5f, 0.0f, 0.0f, 1.0f});
-  vb.push_back({-0.5f,  0.5f,  0.5f, 0.0f, 0.0f, 1.0f});
-  vb.push_back({ 0.5f,  0.5f,  0.5f, 0.0f, 0.0f, 1.0f});
+  builder.AddVertex({ 0.5f, -0.5f,  0.5f, 0.0f, 0.0f, 1.0f});
+  builder.AddVertex({-0.5f, -0.5f,  0.5f, 0.0f, 0.0f, 1.0f});
+  builder.AddVertex({-0.5f,  0.5f,  0.5f, 0.0f, 0.0f, 1.0f});
+  builder.AddVertex({ 0.5f,  0.5f,  0.5f, 0.0f, 0.0f, 1.0f});
 
   // Left face
-  vb.push_back({-0.5f, -0.5f,  0.5f, 1.0f, 1.0f, 0.0f});
-  vb.push_back({-0.5f, -0.5f, -0.5f, 1.0f, 1.0f, 0.0f});
-  vb.push_back({-0.5f,  0.5f, -0.5f, 1.0f, 1.0f, 0.0f});
-  vb.push_back({-0.5f,  0.5f,  0.5f, 1.0f, 1.0f, 0.0f});
+  builder.AddVertex({-0.5f, -0.5f,  0.5f, 1.0f, 1.0f, 0.0f});
+  builder.AddVertex({-0.5f, -0.5f, -0.5f, 1.0f, 1.0f, 0.0f});
+  builder.AddVertex({-0.5f,  0.5f, -0.5f, 1.0f, 1.0f, 0.0f});
+  builder.AddVertex({-0.5f,  0.5f,  0.5f, 1.0f, 1.0f, 0.0f});
 
   // Right face
-  vb.push_back({0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f});
-  vb.push_back({0.5f, -0.5f,  0.5f, 1.0f, 0.0f, 0.0f});
-  vb.push_back({0.5f,  0.5f,  0.5f, 1.0f, 0.0f, 0.0f});
-  vb.push_back({0.5f,  0.5f, -0.5f, 1.0f, 0.0f, 0.0f});
+  builder.AddVertex({0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f});
+  builder.AddVertex({0.5f, -0.5f,  0.5f, 1.0f, 0.0f, 0.0f});
+  builder.AddVertex({0.5f,  0.5f,  0.5f, 1.0f, 0.0f, 0.0f});
+  builder.AddVertex({0.5f,  0.5f, -0.5f, 1.0f, 0.0f, 0.0f});
 
   // Fill in the index buffer
-  std::vector<GLuint> ib;
-  ib.reserve(36);
   for (int face = 0; face < 6; ++face)
   {
     GLuint baseIndex = 4 * face;
 
     // One triangle
-    ib.push_back(baseIndex);
-    ib.push_back(baseIndex + 1);
-    ib.push_back(baseIndex + 2);
+    builder.AddIndex(baseIndex);
+    builder.AddIndex(baseIndex + 1);
+    builder.AddIndex(baseIndex + 2);
 
     // Other triangle
-    ib.push_back(baseIndex + 2);
-    ib.push_back(baseIndex + 3);
-    ib.push_back(baseIndex);
+    builder.AddIndex(baseIndex + 2);
+    builder.AddIndex(baseIndex + 3);
+    builder.AddIndex(baseIndex);
   }
 
-  // Create, initialize and return the mesh
-  Mesh<Vertex_Pos_Col> *mesh = new Mesh<Vertex_Pos_Col>();
-  mesh->Init(vb, ib);
-  return mesh;
+  // Upload and return the mesh
+  return builder.Finish();
 }
 
 Mesh<Vertex_Pos_Col> *Geometry::CreateCubeColorShared()
 {
   // Create the vertex buffer for a unit cube
-  std::vector<Vertex_Pos_Col> vb;
-  vb.reserve(8);
+  MeshBuilder<Vertex_Pos_Col> builder(8, 36);
 
   // Top base
-  vb.push_back({-0.5f,  0.5f, -0.5f, 0.0f, 1.0f, 0.0f});
-  vb.push_back({ 0.5f,  0.5f, -0.5f, 1.0f, 1.0f, 0.0f});
-  vb.push_back({ 0.5f,  0.5f,  0.5f, 1.0f, 1.0f, 1.0f});
-  vb.push_back({-0.5f,  0.5f,  0.5f, 0.0f, 1.0f, 1.0f});
+  builder.AddVertex({-0.5f,  0.5f, -0.5f, 0.0f, 1.0f, 0.0f});
+  builder.AddVertex({ 0.5f,  0.5f, -0.5f, 1.0f, 1.0f, 0.0f});
+  builder.AddVertex({ 0.5f,  0.5f,  0.5f, 1.0f, 1.0f, 1.0f});
+  builder.AddVertex({-0.5f,  0.5f,  0.5f, 0.0f, 1.0f, 1.0f});
 
   // Bottom base
-  vb.push_back({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f});
-  vb.push_back({-0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.0f});
-  vb.push_back({-0.5f, -0.5f,  0.5f, 0.0f, 0.0f, 1.0f});
-  vb.push_back({ 0.5f, -0.5f,  0.5f, 1.0f, 0.0f, 1.0f});
-
-  // Fill in the index buffer
-  std::vector<GLuint> ib;
-  ib.reserve(36);
+  builder.AddVertex({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f});
+  builder.AddVertex({-0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.0f});
+  builder.AddVertex({-0.5f, -0.5f,  0.5f, 0.0f, 0.0f, 1.0f});
+  builder.AddVertex({ 0.5f, -0.5f,  0.5f, 1.0f, 0.0f, 1.0f});
 
   // Top face
-  ib.push_back(0);
-  ib.push_back(1);
-  ib.push_back(2);
-  ib.push_back(2);
-  ib.push_back(3);
-  ib.push_back(0);
+  builder.AddIndex(0);
+  builder.AddIndex(1);
+  builder.AddIndex(2);
+  builder.AddIndex(2);
+  builder.AddIndex(3);
+  builder.AddIndex(0);
 
   // Bottom face
-  ib.push_back(4);
-  ib.push_back(5);
-  ib.push_back(6);
-  ib.push_back(6);
-  ib.push_back(7);
-  ib.push_back(4);
+  builder.AddIndex(4);
+  builder.AddIndex(5);
+  builder.AddIndex(6);
+  builder.AddIndex(6);
+  builder.AddIndex(7);
+  builder.AddIndex(4);
 
   // Front face
-  ib.push_back(5);
-  ib.push_back(4);
-  ib.push_back(1);
-  ib.push_back(1);
-  ib.push_back(0);
-  ib.push_back(5);
+  builder.AddIndex(5);
+  builder.AddIndex(4);
+  builder.AddIndex(1);
+  builder.AddIndex(1);
+  builder.AddIndex(0);
+  builder.AddIndex(5);
 
   // Back face
-  ib.push_back(7);
-  ib.push_back(6);
-  ib.push_back(3);
-  ib.push_back(3);
-  ib.push_back(2);
-  ib.push_back(7);
+  builder.AddIndex(7);
+  builder.AddIndex(6);
+  builder.AddIndex(3);
+  builder.AddIndex(3);
+  builder.AddIndex(2);
+  builder.AddIndex(7);
 
   // Left face
-  ib.push_back(6);
-  ib.push_back(5);
-  ib.push_back(0);
-  ib.push_back(0);
-  ib.push_back(3);
-  ib.push_back(6);
+  builder.AddIndex(6);
+  builder.AddIndex(5);
+  builder.AddIndex(0);
+  builder.AddIndex(0);
+  builder.AddIndex(3);
+  builder.AddIndex(6);
 
   // Right face
-  ib.push_back(4);
-  ib.push_back(7);
-  ib.push_back(2);
-  ib.push_back(2);
-  ib.push_back(1);
-  ib.push_back(4);
-
-  // Create, initialize and return the mesh
-  Mesh<Vertex_Pos_Col> *mesh = new Mesh<Vertex_Pos_Col>();
-  mesh->Init(vb, ib);
-  return mesh;
+  builder.AddIndex(4);
+  builder.AddIndex(7);
+  builder.AddIndex(2);
+  builder.AddIndex(2);
+  builder.AddIndex(1);
+  builder.AddIndex(4);
+
+  // Upload and return the mesh
+  return builder.Finish();
 }
 
-Mesh<Vertex_Pos_Tex>* Geometry::CreatePoolTex()
+template <class VertexType>
+Mesh<VertexType>* Geometry::CreatePoolTex()
 {
     // Create the vertex buffer for a unit cube
-    std::vector<Vertex_Pos_Tex> vb;
-    vb.reserve(20);
+    MeshBuilder<VertexType> builder(20, 30, glm::vec3(-0.5f), glm::vec3(0.5f));
+    builder.OptimizePrimitives(3, "pool");
+    builder.BuildMeshlets();
 
     // Top face
-    //vb.push_back({ -0.5f, 0.5f, -0.5f, 1.0f, 0.0f });
-    //vb.push_back({ 0.5f, 0.5f, -0.5f, 1.0f, 1.0f });
-    //vb.push_back({ 0.5f, 0.5f, 0.5f, 0.0f, 1.0f });
-    //vb.push_back({ -0.5f, 0.5f, 0.5f, 0.0f, 0.0f });
+    //builder.AddVertex({ -0.5f, 0.5f, -0.5f, 1.0f, 0.0f });
+    //builder.AddVertex({ 0.5f, 0.5f, -0.5f, 1.0f, 1.0f });
+    //builder.AddVertex({ 0.5f, 0.5f, 0.5f, 0.0f, 1.0f });
+    //builder.AddVertex({ -0.5f, 0.5f, 0.5f, 0.0f, 0.0f });
 
     // Bottom face
-    vb.push_back({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f });
-    vb.push_back({ -0.5f, -0.5f, -0.5f, 1.0f, 1.0f });
-    vb.push_back({ -0.5f, -0.5f, 0.5f, 0.0f, 1.0f });
-    vb.push_back({ 0.5f, -0.5f, 0.5f, 0.0f, 0.0f });
+    builder.AddVertex({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f });
+    builder.AddVertex({ -0.5f, -0.5f, -0.5f, 1.0f, 1.0f });
+    builder.AddVertex({ -0.5f, -0.5f, 0.5f, 0.0f, 1.0f });
+    builder.AddVertex({ 0.5f, -0.5f, 0.5f, 0.0f, 0.0f });
 
     // Front face
-    vb.push_back({ -0.5f, -0.5f, -0.5f, 0.0f, 0.0f });
-    vb.push_back({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f });
-    vb.push_back({ 0.5f, 0.5f, -0.5f, 1.0f, 1.0f });
-    vb.push_back({ -0.5f, 0.5f, -0.5f, 0.0f, 1.0f });
+    builder.AddVertex({ -0.5f, -0.5f, -0.5f, 0.0f, 0.0f });
+    builder.AddVertex({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f });
+    builder.AddVertex({ 0.5f, 0.5f, -0.5f, 1.0f, 1.0f });
+    builder.AddVertex({ -0.5f, 0.5f, -0.5f, 0.0f, 1.0f });
 
     // Back face
-    vb.push_back({ 0.5f, -0.5f, 0.5f, 0.0f, 0.0f });
-    vb.push_back({ -0.5f, -0.5f, 0.5f, 1.0f, 0.0f });
-    vb.push_back({ -0.5f, 0.5f, 0.5f, 1.0f, 1.0f });
-    vb.push_back({ 0.5f, 0.5f, 0.5f, 0.0f, 1.0f });
+    builder.AddVertex({ 0.5f, -0.5f, 0.5f, 0.0f, 0.0f });
+    builder.AddVertex({ -0.5f, -0.5f, 0.5f, 1.0f, 0.0f });
+    builder.AddVertex({ -0.5f, 0.5f, 0.5f, 1.0f, 1.0f });
+    builder.AddVertex({ 0.5f, 0.5f, 0.5f, 0.0f, 1.0f });
 
     // Left face
-    vb.push_back({ -0.5f, -0.5f, 0.5f, 0.0f, 0.0f });
-    vb.push_back({ -0.5f, -0.5f, -0.5f, 1.0f, 0.0f });
-    vb.push_back({ -0.5f, 0.5f, -0.5f, 1.0f, 1.0f });
-    vb.push_back({ -0.5f, 0.5f, 0.5f, 0.0f, 1.0f });
+    builder.AddVertex({ -0.5f, -0.5f, 0.5f, 0.0f, 0.0f });
+    builder.AddVertex({ -0.5f, -0.5f, -0.5f, 1.0f, 0.0f });
+    builder.AddVertex({ -0.5f, 0.5f, -0.5f, 1.0f, 1.0f });
+    builder.AddVertex({ -0.5f, 0.5f, 0.5f, 0.0f, 1.0f });
 
     // Right face
-    vb.push_back({ 0.5f, -0.5f, -0.5f, 0.0f, 0.0f });
-    vb.push_back({ 0.5f, -0.5f, 0.5f, 1.0f, 0.0f });
-    vb.push_back({ 0.5f, 0.5f, 0.5f, 1.0f, 1.0f });
-    vb.push_back({ 0.5f, 0.5f, -0.5f, 0.0f, 1.0f });
+    builder.AddVertex({ 0.5f, -0.5f, -0.5f, 0.0f, 0.0f });
+    builder.AddVertex({ 0.5f, -0.5f, 0.5f, 1.0f, 0.0f });
+    builder.AddVertex({ 0.5f, 0.5f, 0.5f, 1.0f, 1.0f });
+    builder.AddVertex({ 0.5f, 0.5f, -0.5f, 0.0f, 1.0f });
 
     // Fill in the index buffer
-    std::vector<GLuint> ib;
-    ib.reserve(30);
     for (int face = 0; face < 5; ++face) {
         GLuint baseIndex = 4 * face;
 
         // One triangle
-        ib.push_back(baseIndex + 3);
-        ib.push_back(baseIndex + 2);
-        ib.push_back(baseIndex + 1);
+        builder.AddIndex(baseIndex + 3);
+        builder.AddIndex(baseIndex + 2);
+        builder.AddIndex(baseIndex + 1);
 
         // Other triangle
-        ib.push_back(baseIndex + 1);
-        ib.push_back(baseIndex);
-        ib.push_back(baseIndex + 3);
+        builder.AddIndex(baseIndex + 1);
+        builder.AddIndex(baseIndex);
+        builder.AddIndex(baseIndex + 3);
     }
 
-    // Create, initialize and return the mesh
-    Mesh<Vertex_Pos_Tex>* mesh = new Mesh<Vertex_Pos_Tex>();
-    mesh->Init(vb, ib);
-    return mesh;
+    // Upload and return the mesh
+    return builder.Finish();
 }
 
-Mesh<Vertex_Pos_Tex> *Geometry::CreateCubeTex()
+template <class VertexType>
+Mesh<VertexType> *Geometry::CreateCubeTex()
 {
   // Create the vertex buffer for a unit cube
-  std::vector<Vertex_Pos_Tex> vb;
-  vb.reserve(24);
+  MeshBuilder<VertexType> builder(24, 36, glm::vec3(-0.5f), glm::vec3(0.5f));
+  builder.OptimizePrimitives(3, "cube");
+  builder.BuildMeshlets();
 
   // Top face
-  vb.push_back({-0.5f,  0.5f, -0.5f, 1.0f, 0.0f});
-  vb.push_back({ 0.5f,  0.5f, -0.5f, 1.0f, 1.0f});
-  vb.push_back({ 0.5f,  0.5f,  0.5f, 0.0f, 1.0f});
-  vb.push_back({-0.5f,  0.5f,  0.5f, 0.0f, 0.0f});
+  builder.AddVertex({-0.5f,  0.5f, -0.5f, 1.0f, 0.0f});
+  builder.AddVertex({ 0.5f,  0.5f, -0.5f, 1.0f, 1.0f});
+  builder.AddVertex({ 0.5f,  0.5f,  0.5f, 0.0f, 1.0f});
+  builder.AddVertex({-0.5f,  0.5f,  0.5f, 0.0f, 0.0f});
 
   // Bottom face
-  vb.push_back({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f});
-  vb.push_back({-0.5f, -0.5f, -0.5f, 1.0f, 1.0f});
-  vb.push_back({-0.5f, -0.5f,  0.5f, 0.0f, 1.0f});
-  vb.push_back({ 0.5f, -0.5f,  0.5f, 0.0f, 0.0f});
+  builder.AddVertex({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f});
+  builder.AddVertex({-0.5f, -0.5f, -0.5f, 1.0f, 1.0f});
+  builder.AddVertex({-0.5f, -0.5f,  0.5f, 0.0f, 1.0f});
+  builder.AddVertex({ 0.5f, -0.5f,  0.5f, 0.0f, 0.0f});
 
   // Front face
-  vb.push_back({-0.5f, -0.5f, -0.5f, 0.0f, 0.0f});
-  vb.push_back({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f});
-  vb.push_back({ 0.5f,  0.5f, -0.5f, 1.0f, 1.0f});
-  vb.push_back({-0.5f,  0.5f, -0.5f, 0.0f, 1.0f});
+  builder.AddVertex({-0.5f, -0.5f, -0.5f, 0.0f, 0.0f});
+  builder.AddVertex({ 0.5f, -0.5f, -0.5f, 1.0f, 0.0f});
+  builder.AddVertex({ 0.5f,  0.5f, -0.5f, 1.0f, 1.0f});
+  builder.AddVertex({-0.5f,  0.5f, -0.5f, 0.0f, 1.0f});
 
   // Back face
-  vb.push_back({ 0.5f, -0.5f,  0.5f, 0.0f, 0.0f});
-  vb.push_back({-0.5f, -0.5f,  0.5f, 1.0f, 0.0f});
-  vb.push_back({-0.5f,  0.5f,  0.5f, 1.0f, 1.0f});
-  vb.push_back({ 0.5f,  0.5f,  0.5f, 0.0f, 1.0f});
+  builder.AddVertex({ 0.5f, -0.5f,  0.5f, 0.0f, 0.0f});
+  builder.AddVertex({-0.5f, -0.5f,  0.5f, 1.0f, 0.0f});
+  builder.AddVertex({-0.5f,  0.5f,  0.5f, 1.0f, 1.0f});
+  builder.AddVertex({ 0.5f,  0.5f,  0.5f, 0.0f, 1.0f});
 
   // Left face
-  vb.push_back({-0.5f, -0.5f,  0.5f, 0.0f, 0.0f});
-  vb.push_back({-0.5f, -0.5f, -0.5f, 1.0f, 0.0f});
-  vb.push_back({-0.5f,  0.5f, -0.5f, 1.0f, 1.0f});
-  vb.push_back({-0.5f,  0.5f,  0.5f, 0.0f, 1.0f});
+  builder.AddVertex({-0.5f, -0.5f,  0.5f, 0.0f, 0.0f});
+  builder.AddVertex({-0.5f, -0.5f, -0.5f, 1.0f, 0.0f});
+  builder.AddVertex({-0.5f,  0.5f, -0.5f, 1.0f, 1.0f});
+  builder.AddVertex({-0.5f,  0.5f,  0.5f, 0.0f, 1.0f});
 
   // Right face
-  vb.push_back({ 0.5f, -0.5f, -0.5f, 0.0f, 0.0f});
-  vb.push_back({ 0.5f, -0.5f,  0.5f, 1.0f, 0.0f});
-  vb.push_back({ 0.5f,  0.5f,  0.5f, 1.0f, 1.0f});
-  vb.push_back({ 0.5f,  0.5f, -0.5f, 0.0f, 1.0f});
+  builder.AddVertex({ 0.5f, -0.5f, -0.5f, 0.0f, 0.0f});
+  builder.AddVertex({ 0.5f, -0.5f,  0.5f, 1.0f, 0.0f});
+  builder.AddVertex({ 0.5f,  0.5f,  0.5f, 1.0f, 1.0f});
+  builder.AddVertex({ 0.5f,  0.5f, -0.5f, 0.0f, 1.0f});
 
   // Fill in the index buffer
-  std::vector<GLuint> ib;
-  ib.reserve(36);
   for (int face = 0; face < 6; ++face)
   {
     GLuint baseIndex = 4 * face;
 
     // One triangle
-    ib.push_back(baseIndex);
-    ib.push_back(baseIndex + 1);
-    ib.push_back(baseIndex + 2);
+    builder.AddIndex(baseIndex);
+    builder.AddIndex(baseIndex + 1);
+    builder.AddIndex(baseIndex + 2);
 
     // Other triangle
-    ib.push_back(baseIndex + 2);
-    ib.push_back(baseIndex + 3);
-    ib.push_back(baseIndex);
+    builder.AddIndex(baseIndex + 2);
+    builder.AddIndex(baseIndex + 3);
+    builder.AddIndex(baseIndex);
   }
 
-  // Create, initialize and return the mesh
-  Mesh<Vertex_Pos_Tex> *mesh = new Mesh<Vertex_Pos_Tex>();
-  mesh->Init(vb, ib);
-  return mesh;
+  // Upload and return the mesh
+  return builder.Finish();
 }
 
 Mesh<Vertex_Pos_Nrm_Tgt_Tex> *Geometry::CreateCubeNormalTangentTex(bool createAdjacencyInfo)
 {
   // Create the vertex buffer for a unit cube
-  std::vector<Vertex_Pos_Nrm_Tgt_Tex> vb;
-  vb.reserve(24);
+  MeshBuilder<Vertex_Pos_Nrm_Tgt_Tex> builder(24, createAdjacencyInfo ? 72 : 36);
 
   // Top face
-  vb.push_back({-0.5f,  0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f}); // 0
-  vb.push_back({ 0.5f,  0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f}); // 1
-  vb.push_back({ 0.5f,  0.5f,  0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f}); // 2
-  vb.push_back({-0.5f,  0.5f,  0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f}); // 3
+  builder.AddVertex({-0.5f,  0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f}); // 0
+  builder.AddVertex({ 0.5f,  0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f}); // 1
+  builder.AddVertex({ 0.5f,  0.5f,  0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f}); // 2
+  builder.AddVertex({-0.5f,  0.5f,  0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f}); // 3
 
   // Bottom face
-  vb.push_back({ 0.5f, -0.5f, -0.5f, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f}); // 4
-  vb.push_back({-0.5f, -0.5f, -0.5f, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f}); // 5
-  vb.push_back({-0.5f, -0.5f,  0.5f, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f}); // 6
-  vb.push_back({ 0.5f, -0.5f,  0.5f, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f}); // 7
+  builder.AddVertex({ 0.5f, -0.5f, -0.5f, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f}); // 4
+  builder.AddVertex({-0.5f, -0.5f, -0.5f, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f}); // 5
+  builder.AddVertex({-0.5f, -0.5f,  0.5f, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f}); // 6
+  builder.AddVertex({ 0.5f, -0.5f,  0.5f, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f}); // 7
 
   // Front face
-  vb.push_back({-0.5f, -0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f}); // 8
-  vb.push_back({ 0.5f, -0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f}); // 9
-  vb.push_back({ 0.5f,  0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f}); // 10
-  vb.push_back({-0.5f,  0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f}); // 11
+  builder.AddVertex({-0.5f, -0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f}); // 8
+  builder.AddVertex({ 0.5f, -0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f}); // 9
+  builder.AddVertex({ 0.5f,  0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f}); // 10
+  builder.AddVertex({-0.5f,  0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f}); // 11
 
   // Back face
-  vb.push_back({ 0.5f, -0.5f,  0.5f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f}); // 12
-  vb.push_back({-0.5f, -0.5f,  0.5f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f}); // 13
-  vb.push_back({-0.5f,  0.5f,  0.5f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f}); // 14
-  vb.push_back({ 0.5f,  0.5f,  0.5f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f}); // 15
+  builder.AddVertex({ 0.5f, -0.5f,  0.5f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f}); // 12
+  builder.AddVertex({-0.5f, -0.5f,  0.5f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f}); // 13
+  builder.AddVertex({-0.5f,  0.5f,  0.5f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f}); // 14
+  builder.AddVertex({ 0.5f,  0.5f,  0.5f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f}); // 15
 
   // Left face
-  vb.push_back({-0.5f, -0.5f,  0.5f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f}); // 16
-  vb.push_back({-0.5f, -0.5f, -0.5f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f}); // 17
-  vb.push_back({-0.5f,  0.5f, -0.5f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f}); // 18
-  vb.push_back({-0.5f,  0.5f,  0.5f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f}); // 19
+  builder.AddVertex({-0.5f, -0.5f,  0.5f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f}); // 16
+  builder.AddVertex({-0.5f, -0.5f, -0.5f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f}); // 17
+  builder.AddVertex({-0.5f,  0.5f, -0.5f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f}); // 18
+  builder.AddVertex({-0.5f,  0.5f,  0.5f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f}); // 19
 
   // Right face
-  vb.push_back({0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f}); // 20
-  vb.push_back({0.5f, -0.5f,  0.5f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f}); // 21
-  vb.push_back({0.5f,  0.5f,  0.5f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f}); // 22
-  vb.push_back({0.5f,  0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f}); // 23
+  builder.AddVertex({0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f}); // 20
+  builder.AddVertex({0.5f, -0.5f,  0.5f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f}); // 21
+  builder.AddVertex({0.5f,  0.5f,  0.5f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f}); // 22
+  builder.AddVertex({0.5f,  0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f}); // 23
 
   // Fill in the index buffer
-  std::vector<GLuint> ib;
   if (createAdjacencyInfo)
   {
     // Top face
-    ib.push_back(0);
-    ib.push_back(8); // Adjacent vertex
-    ib.push_back(1);
-    ib.push_back(20); // Adjacent vertex
-    ib.push_back(2);
-    ib.push_back(3); // Adjacent vertex
-
-    ib.push_back(2);
-    ib.push_back(12); // Adjacent vertex
-    ib.push_back(3);
-    ib.push_back(16); // Adjacent vertex
-    ib.push_back(0);
-    ib.push_back(1); // Adjacent vertex
+    builder.AddIndex(0);
+    builder.AddIndex(8); // Adjacent vertex
+    builder.AddIndex(1);
+    builder.AddIndex(20); // Adjacent vertex
+    builder.AddIndex(2);
+    builder.AddIndex(3); // Adjacent vertex
+
+    builder.AddIndex(2);
+    builder.AddIndex(12); // Adjacent vertex
+    builder.AddIndex(3);
+    builder.AddIndex(16); // Adjacent vertex
+    builder.AddIndex(0);
+    builder.AddIndex(1); // Adjacent vertex
 
     // Bottom face
-    ib.push_back(4);
-    ib.push_back(10); // Adjacent vertex
-    ib.push_back(5);
-    ib.push_back(18); // Adjacent vertex
-    ib.push_back(6);
-    ib.push_back(7); // Adjacent vertex
-
-    ib.push_back(6);
-    ib.push_back(14); // Adjacent vertex
-    ib.push_back(7);
-    ib.push_back(22); // Adjacent vertex
-    ib.push_back(4);
-    ib.push_back(5); // Adjacent vertex
+    builder.AddIndex(4);
+    builder.AddIndex(10); // Adjacent vertex
+    builder.AddIndex(5);
+    builder.AddIndex(18); // Adjacent vertex
+    builder.AddIndex(6);
+    builder.AddIndex(7); // Adjacent vertex
+
+    builder.AddIndex(6);
+    builder.AddIndex(14); // Adjacent vertex
+    builder.AddIndex(7);
+    builder.AddIndex(22); // Adjacent vertex
+    builder.AddIndex(4);
+    builder.AddIndex(5); // Adjacent vertex
 
     // Front face
-    ib.push_back(8);
-    ib.push_back(6); // Adjacent vertex
-    ib.push_back(9);
-    ib.push_back(22); // Adjacent vertex
-    ib.push_back(10);
-    ib.push_back(11); // Adjacent vertex
-
-    ib.push_back(10);
-    ib.push_back(2); // Adjacent vertex
-    ib.push_back(11);
-    ib.push_back(16); // Adjacent vertex
-    ib.push_back(8);
-    ib.push_back(9); // Adjacent vertex
+    builder.AddIndex(8);
+    builder.AddIndex(6); // Adjacent vertex
+    builder.AddIndex(9);
+    builder.AddIndex(22); // Adjacent vertex
+    builder.AddIndex(10);
+    builder.AddIndex(11); // Adjacent vertex
+
+    builder.AddIndex(10);
+    builder.AddIndex(2); // Adjacent vertex
+    builder.AddIndex(11);
+    builder.AddIndex(16); // Adjacent vertex
+    builder.AddIndex(8);
+    builder.AddIndex(9); // Adjacent vertex
 
     // Back face
-    ib.push_back(12);
-    ib.push_back(4); // Adjacent vertex
-    ib.push_back(13);
-    ib.push_back(18); // Adjacent vertex
-    ib.push_back(14);
-    ib.push_back(15); // Adjacent vertex
-
-    ib.push_back(14);
-    ib.push_back(0); // Adjacent vertex
-    ib.push_back(15);
-    ib.push_back(20); // Adjacent vertex
-    ib.push_back(12);
-    ib.push_back(13); // Adjacent vertex
+    builder.AddIndex(12);
+    builder.AddIndex(4); // Adjacent vertex
+    builder.AddIndex(13);
+    builder.AddIndex(18); // Adjacent vertex
+    builder.AddIndex(14);
+    builder.AddIndex(15); // Adjacent vertex
+
+    builder.AddIndex(14);
+    builder.AddIndex(0); // Adjacent vertex
+    builder.AddIndex(15);
+    builder.AddIndex(20); // Adjacent vertex
+    builder.AddIndex(12);
+    builder.AddIndex(13); // Adjacent vertex
 
     // Left face
-    ib.push_back(16);
-    ib.push_back(4); // Adjacent vertex
-    ib.push_back(17);
-    ib.push_back(10); // Adjacent vertex
-    ib.push_back(18);
-    ib.push_back(19); // Adjacent vertex
-
-    ib.push_back(18);
-    ib.push_back(2); // Adjacent vertex
-    ib.push_back(19);
-    ib.push_back(12); // Adjacent vertex
-    ib.push_back(16);
-    ib.push_back(17); // Adjacent vertex
+    builder.AddIndex(16);
+    builder.AddIndex(4); // Adjacent vertex
+    builder.AddIndex(17);
+    builder.AddIndex(10); // Adjacent vertex
+    builder.AddIndex(18);
+    builder.AddIndex(19); // Adjacent vertex
+
+    builder.AddIndex(18);
+    builder.AddIndex(2); // Adjacent vertex
+    builder.AddIndex(19);
+    builder.AddIndex(12); // Adjacent vertex
+    builder.AddIndex(16);
+    builder.AddIndex(17); // Adjacent vertex
 
     // Right face
-    ib.push_back(20);
-    ib.push_back(6); // Adjacent vertex
-    ib.push_back(21);
-    ib.push_back(14); // Adjacent vertex
-    ib.push_back(22);
-    ib.push_back(23); // Adjacent vertex
-
-    ib.push_back(22);
-    ib.push_back(0); // Adjacent vertex
-    ib.push_back(23);
-    ib.push_back(8); // Adjacent vertex
-    ib.push_back(20);
-    ib.push_back(21); // Adjacent vertex
+    builder.AddIndex(20);
+    builder.AddIndex(6); // Adjacent vertex
+    builder.AddIndex(21);
+    builder.AddIndex(14); // Adjacent vertex
+    builder.AddIndex(22);
+    builder.AddIndex(23); // Adjacent vertex
+
+    builder.AddIndex(22);
+    builder.AddIndex(0); // Adjacent vertex
+    builder.AddIndex(23);
+    builder.AddIndex(8); // Adjacent vertex
+    builder.AddIndex(20);
+    builder.AddIndex(21); // Adjacent vertex
   }
   else
   {
-    ib.reserve(36);
     for (int face = 0; face < 6; ++face)
     {
       GLuint baseIndex = 4 * face;
 
       // One triangle
-      ib.push_back(baseIndex);
-      ib.push_back(baseIndex + 1);
-      ib.push_back(baseIndex + 2);
+      builder.AddIndex(baseIndex);
+      builder.AddIndex(baseIndex + 1);
+      builder.AddIndex(baseIndex + 2);
 
       // Other triangle
-      ib.push_back(baseIndex + 2);
-      ib.push_back(baseIndex + 3);
-      ib.push_back(baseIndex);
+      builder.AddIndex(baseIndex + 2);
+      builder.AddIndex(baseIndex + 3);
+      builder.AddIndex(baseIndex);
     }
   }
 
-  // Create, initialize and return the mesh
-  Mesh<Vertex_Pos_Nrm_Tgt_Tex> *mesh = new Mesh<Vertex_Pos_Nrm_Tgt_Tex>();
-  mesh->Init(vb, ib);
-  return mesh;
+  // Upload and return the mesh
+  return builder.Finish();
 }
 
 Mesh<Vertex_Pos_Nrm> *Geometry::CreateTetrahedron()
 {
   // Create the vertex buffer for a tetrahedron
-  std::vector<Vertex_Pos_Nrm> vb;
-  vb.reserve(4);
+  MeshBuilder<Vertex_Pos_Nrm> builder(12, 12);
 
   // Define vertices
   glm::vec3 v0 = glm::vec3(-0.5f, -0.3f, -0.5f);
@@ -783,39 +733,49 @@ Mesh<Vertex_Pos_Nrm> *Geometry::CreateTetrahedron()
   glm::vec3 n3 = glm::normalize(glm::cross(e3, e4));
 
   // Bottom face
-  vb.push_back({v0.x, v0.y, v0.z, n0.x, n0.y, n0.z}); // 0
-  vb.push_back({v2.x, v2.y, v2.z, n0.x, n0.y, n0.z}); // 1
-  vb.push_back({v1.x, v1.y, v1.z, n0.x, n0.y, n0.z}); // 2
+  builder.AddVertex({v0.x, v0.y, v0.z, n0.x, n0.y, n0.z}); // 0
+  builder.AddVertex({v2.x, v2.y, v2.z, n0.x, n0.y, n0.z}); // 1
+  builder.AddVertex({v1.x, v1.y, v1.z, n0.x, n0.y, n0.z}); // 2
 
   // Left face
-  vb.push_back({v0.x, v0.y, v0.z, n1.x, n1.y, n1.z}); // 3
-  vb.push_back({v3.x, v3.y, v3.z, n1.x, n1.y, n1.z}); // 4
-  vb.push_back({v2.x, v2.y, v2.z, n1.x, n1.y, n1.z}); // 5
+  builder.AddVertex({v0.x, v0.y, v0.z, n1.x, n1.y, n1.z}); // 3
+  builder.AddVertex({v3.x, v3.y, v3.z, n1.x, n1.y, n1.z}); // 4
+  builder.AddVertex({v2.x, v2.y, v2.z, n1.x, n1.y, n1.z}); // 5
 
   // Back face
-  vb.push_back({v0.x, v0.y, v0.z, n2.x, n2.y, n2.z}); // 6
-  vb.push_back({v1.x, v1.y, v1.z, n2.x, n2.y, n2.z}); // 7
-  vb.push_back({v3.x, v3.y, v3.z, n2.x, n2.y, n2.z}); // 8
+  builder.AddVertex({v0.x, v0.y, v0.z, n2.x, n2.y, n2.z}); // 6
+  builder.AddVertex({v1.x, v1.y, v1.z, n2.x, n2.y, n2.z}); // 7
+  builder.AddVertex({v3.x, v3.y, v3.z, n2.x, n2.y, n2.z}); // 8
 
   // Right face
-  vb.push_back({v1.x, v1.y, v1.z, n3.x, n3.y, n3.z}); // 9
-  vb.push_back({v2.x, v2.y, v2.z, n3.x, n3.y, n3.z}); // 10
-  vb.push_back({v3.x, v3.y, v3.z, n3.x, n3.y, n3.z}); // 11
+  builder.AddVertex({v1.x, v1.y, v1.z, n3.x, n3.y, n3.z}); // 9
+  builder.AddVertex({v2.x, v2.y, v2.z, n3.x, n3.y, n3.z}); // 10
+  builder.AddVertex({v3.x, v3.y, v3.z, n3.x, n3.y, n3.z}); // 11
 
   // Fill in the index buffer
-  std::vector<GLuint> ib;
-  ib.reserve(12);
   for (int face = 0; face < 4; ++face)
   {
     GLuint baseIndex = 3 * face;
 
-    ib.push_back(baseIndex);
-    ib.push_back(baseIndex + 1);
-    ib.push_back(baseIndex + 2);
+    builder.AddIndex(baseIndex);
+    builder.AddIndex(baseIndex + 1);
+    builder.AddIndex(baseIndex + 2);
   }
 
-  // Create, initialize and return the mesh
-  Mesh<Vertex_Pos_Nrm> *mesh = new Mesh<Vertex_Pos_Nrm>();
-  mesh->Init(vb, ib);
-  return mesh;
+  // Upload and return the mesh
+  return builder.Finish();
 }
+
+// Texture coordinate meshes come in full precision and packed
+template Mesh<Vertex_Pos_Tex> *Geometry::CreateQuadTex2D<Vertex_Pos_Tex>();
+template Mesh<Vertex_Pos_Tex_Packed> *Geometry::CreateQuadTex2D<Vertex_Pos_Tex_Packed>();
+template Mesh<Vertex_Pos_Tex> *Geometry::CreateQuadGrid<Vertex_Pos_Tex>(int);
+template Mesh<Vertex_Pos_Tex_Packed> *Geometry::CreateQuadGrid<Vertex_Pos_Tex_Packed>(int);
+template Mesh<Vertex_Pos_Tex> *Geometry::CreateQuadTex<Vertex_Pos_Tex>();
+template Mesh<Vertex_Pos_Tex_Packed> *Geometry::CreateQuadTex<Vertex_Pos_Tex_Packed>();
+template Mesh<Vertex_Pos_Tex> *Geometry::CreatePoolTex<Vertex_Pos_Tex>();
+template Mesh<Vertex_Pos_Tex_Packed> *Geometry::CreatePoolTex<Vertex_Pos_Tex_Packed>();
+template Mesh<Vertex_Pos_Tex> *Geometry::CreateCubeTexInsideOut<Vertex_Pos_Tex>();
+template Mesh<Vertex_Pos_Tex_Packed> *Geometry::CreateCubeTexInsideOut<Vertex_Pos_Tex_Packed>();
+template Mesh<Vertex_Pos_Tex> *Geometry::CreateCubeTex<Vertex_Pos_Tex>();
+template Mesh<Vertex_Pos_Tex_Packed> *Geometry::CreateCubeTex<Vertex_Pos_Tex_Packed>();
@@ -0,0 +1,283 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <GpuProfiler.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+GpuProfiler::GpuProfiler() : _frames{}, _current(-1), _next(0), _stack{0}, _stackSize(0), _traceNext(0)
+{}
+
+GpuProfiler::~GpuProfiler()
+{
+  Release();
+}
+
+void GpuProfiler::Init()
+{
+  // Do nothing if we're already initialized
+  if (_frames[0].queries[0])
+    return;
+
+  for (int i = 0; i < LATENCY; ++i)
+  {
+    glGenQueries(MAX_ZONES * 2, _frames[i].queries);
+    _frames[i].count = 0;
+    _frames[i].last = 0;
+    _frames[i].pending = false;
+  }
+}
+
+void GpuProfiler::Release()
+{
+  // Release resources used by the driver
+  if (!_frames[0].queries[0])
+    return;
+
+  for (int i = 0; i < LATENCY; ++i)
+  {
+    glDeleteQueries(MAX_ZONES * 2, _frames[i].queries);
+    _frames[i].queries[0] = 0;
+    _frames[i].pending = false;
+  }
+  _current = -1;
+}
+
+void GpuProfiler::BeginFrame()
+{
+  // Not initialized
+  if (!_frames[0].queries[0])
+    return;
+
+  // Read back whatever has finished, oldest first
+  for (int i = 0; i < LATENCY; ++i)
+  {
+    FrameQueries& frame = _frames[(_next + i) % LATENCY];
+    if (frame.pending && !Resolve(frame))
+      break;
+  }
+
+  // Skip profiling of this frame rather than waiting for the GPU
+  FrameQueries& frame = _frames[_next];
+  if (frame.pending)
+  {
+    _current = -1;
+    return;
+  }
+
+  _current = _next;
+  _next = (_next + 1) % LATENCY;
+  frame.count = 0;
+  frame.last = 0;
+  _stackSize = 0;
+}
+
+void GpuProfiler::EndFrame()
+{
+  if (_current < 0)
+    return;
+
+  // Close zones left open by mistake so that every start has its end
+  while (_stackSize > 0)
+    PopZone();
+
+  _frames[_current].pending = _frames[_current].count > 0;
+  _current = -1;
+}
+
+void GpuProfiler::PushZone(const char* name)
+{
+  int instance = -1;
+  if (_current >= 0 && _stackSize < MAX_ZONES)
+  {
+    FrameQueries& frame = _frames[_current];
+    if (frame.count < MAX_ZONES)
+    {
+      // Parent zone is the zone of the innermost open instance
+      int parent = -1;
+      for (int i = _stackSize - 1; i >= 0 && parent < 0; --i)
+      {
+        if (_stack[i] >= 0)
+          parent = frame.zones[_stack[i]];
+      }
+
+      instance = frame.count++;
+      frame.zones[instance] = FindZone(name, parent);
+      frame.last = instance * 2;
+      glQueryCounter(frame.queries[frame.last], GL_TIMESTAMP);
+    }
+  }
+
+  // Push even the unmeasured zones to keep push/pop pairs balanced
+  if (_stackSize < MAX_ZONES)
+    _stack[_stackSize] = instance;
+  ++_stackSize;
+}
+
+void GpuProfiler::PopZone()
+{
+  if (_stackSize == 0)
+    return;
+
+  --_stackSize;
+  if (_current < 0 || _stackSize >= MAX_ZONES)
+    return;
+
+  const int instance = _stack[_stackSize];
+  if (instance >= 0)
+  {
+    FrameQueries& frame = _frames[_current];
+    frame.last = instance * 2 + 1;
+    glQueryCounter(frame.queries[frame.last], GL_TIMESTAMP);
+  }
+}
+
+int GpuProfiler::FindZone(const char* name, int parent)
+{
+  // Zone names are string literals, compare just the pointers
+  for (int i = 0; i < (int)_zones.size(); ++i)
+  {
+    if (_zones[i].name == name && _zones[i].parent == parent)
+      return i;
+  }
+
+  Zone zone;
+  zone.name = name;
+  zone.parent = parent;
+  zone.depth = parent < 0 ? 0 : _zones[parent].depth + 1;
+  zone.historyCount = 0;
+  zone.historyNext = 0;
+  _zones.push_back(zone);
+  return (int)_zones.size() - 1;
+}
+
+bool GpuProfiler::Resolve(FrameQueries& frame)
+{
+  // Queries finish in the order they were issued, once the last one is available all of them are
+  GLint available = GL_FALSE;
+  glGetQueryObjectiv(frame.queries[frame.last], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (available == GL_FALSE)
+    return false;
+
+  std::vector<TraceEvent>& trace = _trace[_traceNext];
+  _traceNext = (_traceNext + 1) % TRACE_FRAMES;
+  trace.clear();
+
+  for (int i = 0; i < frame.count; ++i)
+  {
+    GLuint64 start = 0, end = 0;
+    glGetQueryObjectui64v(frame.queries[i * 2], GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(frame.queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+    trace.push_back({frame.zones[i], start, end});
+
+    Zone& zone = _zones[frame.zones[i]];
+    zone.history[zone.historyNext] = (float)((double)(end - start) * 1e-6);
+    zone.historyNext = (zone.historyNext + 1) % HISTORY;
+    zone.historyCount = std::min(zone.historyCount + 1, HISTORY);
+  }
+
+  frame.pending = false;
+  return true;
+}
+
+float GpuProfiler::GetLastTime(const char* name) const
+{
+  for (const Zone& zone : _zones)
+  {
+    if (zone.parent < 0 && zone.historyCount > 0 && strcmp(zone.name, name) == 0)
+      return zone.history[(zone.historyNext + HISTORY - 1) % HISTORY];
+  }
+  return 0.0f;
+}
+
+void GpuProfiler::GetStats(std::vector<ZoneStats>& stats) const
+{
+  stats.clear();
+
+  // Depth first traversal so that children directly follow their parent
+  std::vector<int> stack;
+  for (int i = (int)_zones.size() - 1; i >= 0; --i)
+  {
+    if (_zones[i].parent < 0)
+      stack.push_back(i);
+  }
+
+  float sorted[HISTORY];
+  while (!stack.empty())
+  {
+    const int index = stack.back();
+    stack.pop_back();
+    for (int i = (int)_zones.size() - 1; i >= 0; --i)
+    {
+      if (_zones[i].parent == index)
+        stack.push_back(i);
+    }
+
+    const Zone& zone = _zones[index];
+    ZoneStats s = {zone.name, zone.depth, 0.0f, 0.0f, 0.0f, zone.historyCount};
+    if (zone.historyCount > 0)
+    {
+      std::copy(zone.history, zone.history + zone.historyCount, sorted);
+      std::sort(sorted, sorted + zone.historyCount);
+
+      float sum = 0.0f;
+      for (int i = 0; i < zone.historyCount; ++i)
+        sum += sorted[i];
+
+      s.minMs = sorted[0];
+      s.avgMs = sum / zone.historyCount;
+      s.p99Ms = sorted[(zone.historyCount * 99 + 99) / 100 - 1];
+    }
+    stats.push_back(s);
+  }
+}
+
+void GpuProfiler::PrintStats() const
+{
+  std::vector<ZoneStats> stats;
+  GetStats(stats);
+
+  printf("GPU zone                          min [ms]  avg [ms]  p99 [ms]\n");
+  for (const ZoneStats& s : stats)
+    printf("%*s%-*s %9.3f %9.3f %9.3f\n", s.depth * 2, "", 32 - s.depth * 2, s.name, s.minMs, s.avgMs, s.p99Ms);
+}
+
+bool GpuProfiler::WriteChromeTrace(const char* path) const
+{
+  FILE* file = fopen(path, "w");
+  if (!file)
+  {
+    printf("Failed to open trace file: %s\n", path);
+    return false;
+  }
+
+  // Timestamps are written relative to the oldest one
+  GLuint64 origin = ~(GLuint64)0;
+  for (int i = 0; i < TRACE_FRAMES; ++i)
+  {
+    for (const TraceEvent& e : _trace[i])
+      origin = std::min(origin, e.start);
+  }
+
+  fprintf(file, "{\"traceEvents\": [\n");
+  bool first = true;
+  for (int i = 0; i < TRACE_FRAMES; ++i)
+  {
+    // Oldest frame first
+    for (const TraceEvent& e : _trace[(_traceNext + i) % TRACE_FRAMES])
+    {
+      fprintf(file, "%s  {\"name\": \"%s\", \"cat\": \"gpu\", \"ph\": \"X\", \"pid\": 0, \"tid\": 0, \"ts\": %.3f, \"dur\": %.3f}",
+              first ? "" : ",\n", _zones[e.zone].name, (double)(e.start - origin) * 1e-3, (double)(e.end - e.start) * 1e-3);
+      first = false;
+    }
+  }
+  fprintf(file, "\n]}\n");
+
+  const bool result = ferror(file) == 0;
+  fclose(file);
+  return result;
+}
@@ -0,0 +1,375 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <MaterialLibrary.h>
+#include <GLStateCache.h>
+#include <TextureCache.h>
+#include <Textures.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// Texture coordinate limit of layers that repeat
+static const float NO_CLAMP = 1.0e30f;
+
+MaterialLibrary::MaterialLibrary() :
+  _table(0),
+  _format(BlockFormat::None),
+  _quality(BlockQuality::Normal),
+  _threadPool(nullptr),
+  _mipFilter(MipGenerator::DEFAULT_FILTER),
+  _useCache(true)
+{
+}
+
+MaterialLibrary::~MaterialLibrary()
+{
+  if (_table || !_arrays.empty())
+    printf("Material library destroyed while still holding textures!\n");
+}
+
+// Replicates the edge texels of the rectangle in level 0 of the layer into the padding
+// around it. Every copy doubles the replicated part, the columns go first and the rows
+// then span the padded width so that they fill the corners as well
+static void extendEdges(GLuint array, int layer, const glm::ivec4& rect, int padding)
+{
+  for (int done = 0; done < padding;)
+  {
+    const int n = std::min(done + 1, padding - done);
+    glCopyImageSubData(array, GL_TEXTURE_2D_ARRAY, 0, rect.x - done, rect.y, layer,
+                       array, GL_TEXTURE_2D_ARRAY, 0, rect.x - done - n, rect.y, layer, n, rect.w, 1);
+    glCopyImageSubData(array, GL_TEXTURE_2D_ARRAY, 0, rect.x + rect.z + done - n, rect.y, layer,
+                       array, GL_TEXTURE_2D_ARRAY, 0, rect.x + rect.z + done, rect.y, layer, n, rect.w, 1);
+    done += n;
+  }
+
+  const int x = rect.x - padding, width = rect.z + 2 * padding;
+  for (int done = 0; done < padding;)
+  {
+    const int n = std::min(done + 1, padding - done);
+    glCopyImageSubData(array, GL_TEXTURE_2D_ARRAY, 0, x, rect.y - done, layer,
+                       array, GL_TEXTURE_2D_ARRAY, 0, x, rect.y - done - n, layer, width, n, 1);
+    glCopyImageSubData(array, GL_TEXTURE_2D_ARRAY, 0, x, rect.y + rect.w + done - n, layer,
+                       array, GL_TEXTURE_2D_ARRAY, 0, x, rect.y + rect.w + done, layer, width, n, 1);
+    done += n;
+  }
+}
+
+// Returns the path of the baked array, there's no source file to put it next to
+static std::string getBakedPath(size_t index)
+{
+  return TextureCache::GetBakedPath(("material_array" + std::to_string(index)).c_str());
+}
+
+// Returns the coarsest level of the atlas rectangles not reaching past their padding.
+// Every reduction by the filter reaches its radius further out and the bilinear taps of
+// the level half of its texel
+static int getAtlasMaxLevel(MipFilter filter, int padding)
+{
+  const float radius = MipGenerator::GetRadius(filter);
+  int level = 0;
+  while (2.0f * radius * ((2 << level) - 1) + (1 << level) <= (float)padding)
+    ++level;
+  return level;
+}
+
+int MaterialLibrary::Add(GLuint texture)
+{
+  _sources.push_back(texture);
+  _materials.push_back(MaterialData());
+  return (int)_materials.size() - 1;
+}
+
+int MaterialLibrary::PackAtlas(int atlasSize, std::vector<glm::ivec4>& rects, std::vector<int>& layers) const
+{
+  // Shelf packing, the tallest textures go first so that the shelves are filled evenly
+  std::vector<int> order;
+  for (size_t i = 0; i < rects.size(); ++i)
+  {
+    if (layers[i] < 0)
+      order.push_back((int)i);
+  }
+  std::sort(order.begin(), order.end(), [&rects](int a, int b) { return rects[a].w > rects[b].w; });
+
+  int layer = 0, x = 0, y = 0, shelfHeight = 0;
+  for (int i : order)
+  {
+    const int width = rects[i].z + 2 * ATLAS_PADDING;
+    const int height = rects[i].w + 2 * ATLAS_PADDING;
+    if (x + width > atlasSize)
+    {
+      // Next shelf
+      x = 0;
+      y += shelfHeight;
+      shelfHeight = 0;
+    }
+    if (y + height > atlasSize)
+    {
+      // Next layer
+      ++layer;
+      x = y = 0;
+    }
+
+    rects[i].x = x + ATLAS_PADDING;
+    rects[i].y = y + ATLAS_PADDING;
+    layers[i] = layer;
+    x += width;
+    shelfHeight = std::max(shelfHeight, height);
+  }
+
+  return order.empty() ? 0 : layer + 1;
+}
+
+bool MaterialLibrary::Build(GLStateCache& state, int atlasSize)
+{
+  const size_t count = _sources.size();
+
+  // Texture rectangles (x, y, width, height) and the array and layer they go to
+  std::vector<glm::ivec4> rects(count);
+  std::vector<int> arrays(count, -1), layers(count, -1);
+  for (size_t i = 0; i < count; ++i)
+  {
+    GLint width = 0, height = 0;
+    glGetTextureLevelParameteriv(_sources[i], 0, GL_TEXTURE_WIDTH, &width);
+    glGetTextureLevelParameteriv(_sources[i], 0, GL_TEXTURE_HEIGHT, &height);
+    rects[i] = glm::ivec4(0, 0, width, height);
+
+    // Power of two textures share an array with the others of the same size, one array
+    // is always left for the atlas
+    const bool powerOfTwo = width > 0 && height > 0 && (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+    if (!powerOfTwo)
+      continue;
+
+    for (size_t j = 0; j < _arrays.size() && arrays[i] < 0; ++j)
+    {
+      if (_arrays[j].width == width && _arrays[j].height == height)
+        arrays[i] = (int)j;
+    }
+    if (arrays[i] < 0 && _arrays.size() < MAX_ARRAYS - 1)
+    {
+      _arrays.push_back({0, width, height, 0, 0, false, BlockFormat::None});
+      arrays[i] = (int)_arrays.size() - 1;
+    }
+    if (arrays[i] >= 0)
+      layers[i] = _arrays[arrays[i]].layers++;
+  }
+
+  // Everything else goes to the atlas
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (arrays[i] < 0 && (rects[i].z + 2 * ATLAS_PADDING > atlasSize || rects[i].w + 2 * ATLAS_PADDING > atlasSize))
+    {
+      printf("Texture %u of %dx%d doesn't fit into the material atlas!\n", _sources[i], rects[i].z, rects[i].w);
+      _arrays.clear();
+      return false;
+    }
+  }
+  const int atlasLayers = PackAtlas(atlasSize, rects, layers);
+  if (atlasLayers > 0)
+  {
+    _arrays.push_back({0, atlasSize, atlasSize, atlasLayers, 0, true, BlockFormat::None});
+    for (size_t i = 0; i < count; ++i)
+    {
+      if (arrays[i] < 0)
+        arrays[i] = (int)_arrays.size() - 1;
+    }
+  }
+
+  for (TextureArray& array : _arrays)
+  {
+    int levels = 1;
+    while ((std::max(array.width, array.height) >> levels) > 0)
+      ++levels;
+
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &array.texture);
+    glTextureStorage3D(array.texture, levels, GL_SRGB8_ALPHA8, array.width, array.height, array.layers);
+    array.levels = levels;
+
+    // The space left between the atlas rectangles is filtered into the mips as well
+    if (array.atlas)
+      glClearTexImage(array.texture, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  }
+
+  const int atlasMaxLevel = getAtlasMaxLevel(_mipFilter, ATLAS_PADDING);
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    const TextureArray& array = _arrays[arrays[i]];
+    const glm::ivec4& rect = rects[i];
+    Textures::CopyToLayer(state, _sources[i], array.texture, layers[i], rect.x, rect.y, rect.z, rect.w);
+
+    MaterialData& material = _materials[i];
+    material.texture = glm::ivec4(arrays[i], layers[i], array.levels - 1, 0);
+    if (array.atlas)
+    {
+      extendEdges(array.texture, layers[i], rect, ATLAS_PADDING);
+      material.texture.z = std::min(material.texture.z, atlasMaxLevel);
+      const glm::vec2 size((float)array.width, (float)array.height);
+      material.uvRect = glm::vec4(glm::vec2(rect.x, rect.y) / size, glm::vec2(rect.z, rect.w) / size);
+      material.uvClamp = glm::vec4((glm::vec2(rect.x, rect.y) + 0.5f) / size,
+                                   (glm::vec2(rect.x + rect.z, rect.y + rect.w) - 0.5f) / size);
+    }
+    else
+    {
+      material.uvRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+      material.uvClamp = glm::vec4(-NO_CLAMP, -NO_CLAMP, NO_CLAMP, NO_CLAMP);
+    }
+  }
+
+  for (size_t a = 0; a < _arrays.size(); ++a)
+  {
+    uint64_t hash = 0;
+    if (_useCache && LoadBaked(a, hash))
+      continue;
+
+    // The CPU filters read level 0 of all layers back, it's filtered in linear space
+    TextureArray& array = _arrays[a];
+    Textures::GenerateMipmaps(array.texture, _mipFilter, MipContent::SRGB, _threadPool);
+
+    // The blocks are encoded from the complete mip chain
+    if (_format != BlockFormat::None)
+      Compress(a, rects, arrays, layers);
+
+    // The next run loads the levels made now
+    if (_useCache)
+    {
+      const GLenum internalFormat = _format != BlockFormat::None ? BlockEncoder::GetInternalFormat(_format, true) : GL_SRGB8_ALPHA8;
+      TextureCache::Bake(array.texture, internalFormat, GL_RGBA, GL_UNSIGNED_BYTE, hash, getBakedPath(a).c_str());
+    }
+  }
+
+  glCreateBuffers(1, &_table);
+  glNamedBufferStorage(_table, std::max<size_t>(_materials.size(), 1) * sizeof(MaterialData), _materials.data(), 0);
+
+  _sources.clear();
+  return true;
+}
+
+void MaterialLibrary::SetCompression(BlockFormat format, BlockQuality quality, ThreadPool *threadPool)
+{
+  _format = format;
+  _quality = quality;
+  _threadPool = threadPool;
+}
+
+void MaterialLibrary::SetMipFilter(MipFilter filter, ThreadPool *threadPool)
+{
+  _mipFilter = filter;
+  _threadPool = threadPool;
+}
+
+bool MaterialLibrary::LoadBaked(size_t index, uint64_t& hash)
+{
+  // Level 0 holds everything the array is made of, baked with other settings is as stale
+  // as baked from other textures
+  TextureArray& array = _arrays[index];
+  std::vector<unsigned char> pixels((size_t)array.width * array.height * array.layers * 4);
+  glGetTextureImage(array.texture, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLsizei)pixels.size(), pixels.data());
+  const uint32_t settings[3] = {(uint32_t)_format, (uint32_t)_quality, (uint32_t)_mipFilter};
+  hash = TextureCache::Hash(reinterpret_cast<const unsigned char*>(settings), sizeof(settings),
+                            TextureCache::Hash(pixels.data(), pixels.size()));
+
+  const std::string path = getBakedPath(index);
+  MappedFile baked;
+  if (!TextureCache::Open(path.c_str(), hash, baked))
+    return false;
+
+  GLuint texture = 0;
+  glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+  TextureCache::Upload(baked, texture);
+  glDeleteTextures(1, &array.texture);
+  array.texture = texture;
+  array.format = _format;
+  printf("Loaded material array %u from %s\n", array.texture, path.c_str());
+  return true;
+}
+
+void MaterialLibrary::Compress(size_t index, const std::vector<glm::ivec4>& rects, const std::vector<int>& arrays, const std::vector<int>& layers)
+{
+  TextureArray& array = _arrays[index];
+  const auto start = std::chrono::high_resolution_clock::now();
+
+  GLuint compressed = 0;
+  glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &compressed);
+  std::vector<BlockStats> blockStats;
+  const BlockStats stats = Textures::Compress(array.texture, compressed, _format, _quality, _threadPool, &blockStats);
+  glDeleteTextures(1, &array.texture);
+  array.texture = compressed;
+  array.format = _format;
+
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+  printf("Compressed material array %u: %s %s, PSNR %.2f dB, %.1f ms\n", array.texture, BlockEncoder::GetName(_format),
+         BlockEncoder::GetName(_quality), stats.GetPSNR(), ms);
+
+  // Level 0 blocks covering the rectangle of each material
+  const int blocksX = (array.width + 3) / 4, blocksY = (array.height + 3) / 4;
+  for (size_t i = 0; i < rects.size(); ++i)
+  {
+    if (arrays[i] != (int)index)
+      continue;
+
+    const glm::ivec4& rect = rects[i];
+    BlockStats materialStats;
+    for (int y = rect.y / 4; y <= (rect.y + rect.w - 1) / 4; ++y)
+    {
+      for (int x = rect.x / 4; x <= (rect.x + rect.z - 1) / 4; ++x)
+        materialStats.Add(blockStats[((size_t)layers[i] * blocksY + y) * blocksX + x]);
+    }
+    printf("  material %d: %dx%d, PSNR %.2f dB\n", (int)i, rect.z, rect.w, materialStats.GetPSNR());
+  }
+}
+
+void MaterialLibrary::Release()
+{
+  for (const TextureArray& array : _arrays)
+    glDeleteTextures(1, &array.texture);
+  _arrays.clear();
+
+  glDeleteBuffers(1, &_table);
+  _table = 0;
+}
+
+void MaterialLibrary::Bind(GLStateCache& state, GLuint firstUnit, GLuint sampler, GLuint binding) const
+{
+  for (size_t i = 0; i < _arrays.size(); ++i)
+  {
+    state.BindTexture(firstUnit + (GLuint)i, _arrays[i].texture);
+    state.BindSampler(firstUnit + (GLuint)i, sampler);
+  }
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, _table);
+}
+
+size_t MaterialLibrary::GetMemoryUsage(const TextureArray& array)
+{
+  size_t bytes = 0;
+  for (int w = array.width, h = array.height; w > 0 || h > 0; w >>= 1, h >>= 1)
+  {
+    const int levelWidth = std::max(w, 1), levelHeight = std::max(h, 1);
+    bytes += (array.format == BlockFormat::None ? (size_t)levelWidth * levelHeight * 4 :
+              BlockEncoder::GetImageSize(array.format, levelWidth, levelHeight)) * array.layers;
+  }
+  return bytes;
+}
+
+size_t MaterialLibrary::GetMemoryUsage() const
+{
+  size_t total = 0;
+  for (const TextureArray& array : _arrays)
+    total += GetMemoryUsage(array);
+  return total;
+}
+
+void MaterialLibrary::PrintMemoryUsage() const
+{
+  for (const TextureArray& array : _arrays)
+  {
+    printf("Material array %u: %dx%dx%d%s, %s, %.2f MB\n", array.texture, array.width, array.height, array.layers,
+           array.atlas ? " (atlas)" : "", array.format == BlockFormat::None ? "SRGB8_ALPHA8" : BlockEncoder::GetName(array.format),
+           GetMemoryUsage(array) / (1024.0 * 1024.0));
+  }
+  printf("Materials total: %d materials, %.2f MB\n", GetCount(), GetMemoryUsage() / (1024.0 * 1024.0));
+}
@@ -0,0 +1,446 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <MeshArena.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// Smallest capacity of the buffers [vertices, indices]
+static const GLuint MIN_VERTICES = 16 * 1024;
+static const GLuint MIN_INDICES = 48 * 1024;
+// Smallest size of a region of the staging ring [bytes]
+static const size_t MIN_STAGING = 256 * 1024;
+// Alignment of the uploads in the staging ring [bytes]
+static const size_t STAGING_ALIGNMENT = 16;
+
+MeshArenaBase::MeshArenaBase(size_t vertexSize, void (*bindAttributes)()) :
+  _vertexSize(vertexSize),
+  _bindAttributes(bindAttributes),
+  _vbo(0),
+  _vertexCapacity(0),
+  _meshCount(0),
+  _reallocations(0),
+  _staging(0),
+  _stagingData(nullptr),
+  _stagingRegionSize(0),
+  _stagingRegion(0),
+  _stagingUsed(0),
+  _stagingFences{nullptr},
+  _pending(-1),
+  _pendingOffset(0)
+{
+  for (IndexBuffer& indexBuffer : _indexBuffers)
+  {
+    indexBuffer.vao = 0;
+    indexBuffer.ibo = 0;
+    indexBuffer.capacity = 0;
+  }
+  GetArenas().push_back(this);
+}
+
+MeshArenaBase::~MeshArenaBase()
+{
+  std::vector<MeshArenaBase*>& arenas = GetArenas();
+  arenas.erase(std::remove(arenas.begin(), arenas.end(), this), arenas.end());
+}
+
+std::vector<MeshArenaBase*>& MeshArenaBase::GetArenas()
+{
+  static std::vector<MeshArenaBase*> arenas;
+  return arenas;
+}
+
+GLint MeshArenaBase::TakeBlock(std::vector<FreeBlock>& freeList, GLuint count)
+{
+  // First fit keeps the used part at the start of the buffer
+  for (size_t i = 0; i < freeList.size(); ++i)
+  {
+    FreeBlock& block = freeList[i];
+    if (block.size < count)
+      continue;
+
+    const GLuint offset = block.offset;
+    block.offset += count;
+    block.size -= count;
+    if (block.size == 0)
+      freeList.erase(freeList.begin() + i);
+    return (GLint)offset;
+  }
+
+  return -1;
+}
+
+void MeshArenaBase::ReturnBlock(std::vector<FreeBlock>& freeList, GLuint offset, GLuint count)
+{
+  auto next = std::lower_bound(freeList.begin(), freeList.end(), offset,
+                               [](const FreeBlock& block, GLuint value) { return block.offset < value; });
+  next = freeList.insert(next, {offset, count});
+
+  // Merge with the following and the preceding block
+  if (next + 1 != freeList.end() && next->offset + next->size == (next + 1)->offset)
+  {
+    next->size += (next + 1)->size;
+    freeList.erase(next + 1);
+  }
+  if (next != freeList.begin() && (next - 1)->offset + (next - 1)->size == next->offset)
+  {
+    (next - 1)->size += next->size;
+    freeList.erase(next);
+  }
+}
+
+GLuint MeshArenaBase::GetFreeCount(const std::vector<FreeBlock>& freeList)
+{
+  GLuint count = 0;
+  for (const FreeBlock& block : freeList)
+    count += block.size;
+  return count;
+}
+
+int MeshArenaBase::AllocateRange(GLsizei vertexCount, GLsizei indexCount, GLenum indexType)
+{
+  IndexBuffer& indexBuffer = _indexBuffers[GetIndexBuffer(indexType)];
+  GLint baseVertex = TakeBlock(_freeVertices, (GLuint)vertexCount);
+  GLint firstIndex = TakeBlock(indexBuffer.freeList, (GLuint)indexCount);
+  if (baseVertex < 0 || firstIndex < 0)
+  {
+    if (baseVertex >= 0)
+      ReturnBlock(_freeVertices, (GLuint)baseVertex, (GLuint)vertexCount);
+    if (firstIndex >= 0)
+      ReturnBlock(indexBuffer.freeList, (GLuint)firstIndex, (GLuint)indexCount);
+
+    // Compact the arena, grow it when even the compacted free space isn't enough
+    const GLuint usedVertices = _vertexCapacity - GetFreeCount(_freeVertices);
+    const GLuint usedIndices = indexBuffer.capacity - GetFreeCount(indexBuffer.freeList);
+    GLuint vertexCapacity = std::max(_vertexCapacity, MIN_VERTICES);
+    GLuint indexCapacities[INDEX_TYPES];
+    for (int i = 0; i < INDEX_TYPES; ++i)
+      indexCapacities[i] = _indexBuffers[i].capacity;
+    GLuint& indexCapacity = indexCapacities[GetIndexBuffer(indexType)];
+    indexCapacity = std::max(indexCapacity, MIN_INDICES);
+    while (usedVertices + (GLuint)vertexCount > vertexCapacity)
+      vertexCapacity *= 2;
+    while (usedIndices + (GLuint)indexCount > indexCapacity)
+      indexCapacity *= 2;
+    Reallocate(vertexCapacity, indexCapacities);
+
+    baseVertex = TakeBlock(_freeVertices, (GLuint)vertexCount);
+    firstIndex = TakeBlock(indexBuffer.freeList, (GLuint)indexCount);
+  }
+
+  int handle;
+  if (!_freeHandles.empty())
+  {
+    handle = _freeHandles.back();
+    _freeHandles.pop_back();
+  }
+  else
+  {
+    handle = (int)_ranges.size();
+    _ranges.push_back(Range());
+  }
+  _ranges[handle] = {baseVertex, (GLuint)firstIndex, vertexCount, indexCount, indexType};
+  ++_meshCount;
+
+  return handle;
+}
+
+bool MeshArenaBase::PrepareStaging(size_t size, size_t& offset)
+{
+  if (size > _stagingRegionSize)
+  {
+    // The old buffer is only deleted once the GPU is done with it, no need to wait
+    size_t regionSize = std::max(_stagingRegionSize, MIN_STAGING);
+    while (regionSize < size)
+      regionSize *= 2;
+    ReleaseStaging();
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &_staging);
+    glNamedBufferStorage(_staging, (GLsizeiptr)(regionSize * STAGING_REGIONS), nullptr, flags);
+    _stagingData = static_cast<unsigned char*>(glMapNamedBufferRange(_staging, 0, (GLsizeiptr)(regionSize * STAGING_REGIONS), flags));
+    if (!_stagingData)
+    {
+      printf("Failed to map the mesh staging buffer!\n");
+      ReleaseStaging();
+      return false;
+    }
+    _stagingRegionSize = regionSize;
+  }
+
+  // Move on to the next region when the upload doesn't fit the rest of the current one,
+  // the copies issued from the current one so far are fenced
+  size_t start = (_stagingUsed + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+  if (start + size > _stagingRegionSize)
+  {
+    _stagingFences[_stagingRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _stagingRegion = (_stagingRegion + 1) % STAGING_REGIONS;
+    start = 0;
+
+    // The region was left a whole round ago, usually its copies have long been done
+    GLsync& fence = _stagingFences[_stagingRegion];
+    if (fence)
+    {
+      GLenum result = glClientWaitSync(fence, 0, 0);
+      while (result == GL_TIMEOUT_EXPIRED)
+        result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+
+  _stagingUsed = start + size;
+  offset = _stagingRegion * _stagingRegionSize + start;
+  return true;
+}
+
+void MeshArenaBase::ReleaseStaging()
+{
+  for (GLsync& fence : _stagingFences)
+  {
+    if (fence)
+      glDeleteSync(fence);
+    fence = nullptr;
+  }
+  glDeleteBuffers(1, &_staging);
+  _staging = 0;
+  _stagingData = nullptr;
+  _stagingRegionSize = 0;
+  _stagingRegion = 0;
+  _stagingUsed = 0;
+}
+
+int MeshArenaBase::Reserve(GLsizei vertexCount, GLsizei indexCount, void*& vertices, void*& indices, GLenum& indexType)
+{
+  if (vertexCount <= 0 || indexCount <= 0)
+    return -1;
+
+  if (_pending >= 0)
+  {
+    printf("Mesh arena range reserved while another one wasn't committed yet!\n");
+    return -1;
+  }
+
+  // Indices follow the vertices in the staging ring
+  indexType = SelectIndexType(vertexCount);
+  const size_t indexOffset = (vertexCount * _vertexSize + sizeof(GLuint) - 1) / sizeof(GLuint) * sizeof(GLuint);
+  size_t offset;
+  if (!PrepareStaging(indexOffset + indexCount * GetIndexSize(indexType), offset))
+    return -1;
+
+  _pending = AllocateRange(vertexCount, indexCount, indexType);
+  _pendingOffset = offset;
+  vertices = _stagingData + offset;
+  indices = _stagingData + offset + indexOffset;
+  return _pending;
+}
+
+void MeshArenaBase::Commit(int handle)
+{
+  if (handle < 0 || handle != _pending)
+    return;
+  _pending = -1;
+
+  // The range may have moved since Reserve() if another arena operation happened
+  const Range& range = _ranges[handle];
+  if (range.vertexCount == 0)
+    return;
+
+  // The mapping is coherent, the copies see everything written to it. They are fenced
+  // together with the rest of the region once the uploads move on
+  const size_t indexOffset = (range.vertexCount * _vertexSize + sizeof(GLuint) - 1) / sizeof(GLuint) * sizeof(GLuint);
+  const size_t indexSize = GetIndexSize(range.indexType);
+  glCopyNamedBufferSubData(_staging, _vbo, (GLintptr)_pendingOffset, (GLintptr)(range.baseVertex * _vertexSize),
+                           (GLsizeiptr)(range.vertexCount * _vertexSize));
+  glCopyNamedBufferSubData(_staging, _indexBuffers[GetIndexBuffer(range.indexType)].ibo, (GLintptr)(_pendingOffset + indexOffset),
+                           (GLintptr)(range.firstIndex * indexSize), (GLsizeiptr)(range.indexCount * indexSize));
+}
+
+int MeshArenaBase::Allocate(const void* vertices, GLsizei vertexCount, const GLuint* indices, GLsizei indexCount)
+{
+  void* vertexData;
+  void* indexData;
+  GLenum indexType;
+  const int handle = Reserve(vertexCount, indexCount, vertexData, indexData, indexType);
+  if (handle < 0)
+    return -1;
+
+  memcpy(vertexData, vertices, vertexCount * _vertexSize);
+  if (indexType == GL_UNSIGNED_SHORT)
+  {
+    GLushort* shortIndices = static_cast<GLushort*>(indexData);
+    for (GLsizei i = 0; i < indexCount; ++i)
+      shortIndices[i] = (GLushort)indices[i];
+  }
+  else
+    memcpy(indexData, indices, indexCount * sizeof(GLuint));
+  Commit(handle);
+
+  return handle;
+}
+
+void MeshArenaBase::Free(int handle)
+{
+  if (handle < 0 || handle >= (int)_ranges.size() || _ranges[handle].vertexCount == 0)
+    return;
+
+  Range& range = _ranges[handle];
+  // Nothing to return to the buffers that were already released
+  if (_vbo)
+  {
+    ReturnBlock(_freeVertices, (GLuint)range.baseVertex, (GLuint)range.vertexCount);
+    ReturnBlock(_indexBuffers[GetIndexBuffer(range.indexType)].freeList, range.firstIndex, (GLuint)range.indexCount);
+  }
+  range = {0, 0, 0, 0, GL_UNSIGNED_INT};
+  if (handle == _pending)
+    _pending = -1;
+  _freeHandles.push_back(handle);
+  --_meshCount;
+}
+
+void MeshArenaBase::Reallocate(GLuint vertexCapacity, const GLuint indexCapacities[INDEX_TYPES])
+{
+  GLuint vbo, ibos[INDEX_TYPES] = {};
+  glCreateBuffers(1, &vbo);
+  glNamedBufferStorage(vbo, (GLsizeiptr)(vertexCapacity * _vertexSize), nullptr, GL_DYNAMIC_STORAGE_BIT);
+  for (int i = 0; i < INDEX_TYPES; ++i)
+  {
+    if (indexCapacities[i] == 0)
+      continue;
+
+    const size_t indexSize = GetIndexSize(i == 0 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+    glCreateBuffers(1, &ibos[i]);
+    glNamedBufferStorage(ibos[i], (GLsizeiptr)(indexCapacities[i] * indexSize), nullptr, GL_DYNAMIC_STORAGE_BIT);
+  }
+
+  // Copy the live ranges one after another, on the GPU
+  GLuint vertexOffset = 0, indexOffsets[INDEX_TYPES] = {};
+  for (Range& range : _ranges)
+  {
+    if (range.vertexCount == 0)
+      continue;
+
+    const int buffer = GetIndexBuffer(range.indexType);
+    const size_t indexSize = GetIndexSize(range.indexType);
+    glCopyNamedBufferSubData(_vbo, vbo, (GLintptr)(range.baseVertex * _vertexSize), (GLintptr)(vertexOffset * _vertexSize),
+                             (GLsizeiptr)(range.vertexCount * _vertexSize));
+    glCopyNamedBufferSubData(_indexBuffers[buffer].ibo, ibos[buffer], (GLintptr)(range.firstIndex * indexSize),
+                             (GLintptr)(indexOffsets[buffer] * indexSize), (GLsizeiptr)(range.indexCount * indexSize));
+    range.baseVertex = (GLint)vertexOffset;
+    range.firstIndex = indexOffsets[buffer];
+    vertexOffset += (GLuint)range.vertexCount;
+    indexOffsets[buffer] += (GLuint)range.indexCount;
+  }
+
+  _freeVertices.clear();
+  if (vertexOffset < vertexCapacity)
+    _freeVertices.push_back({vertexOffset, vertexCapacity - vertexOffset});
+
+  // Point the VAOs to the new buffers, the attributes are described for the bound buffer
+  // so it has to be bound for a moment. The bindings are restored afterwards so that
+  // the state cache stays right
+  GLint previousVao = 0, previousBuffer = 0;
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVao);
+  glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &previousBuffer);
+  for (int i = 0; i < INDEX_TYPES; ++i)
+  {
+    IndexBuffer& indexBuffer = _indexBuffers[i];
+    indexBuffer.freeList.clear();
+    if (indexOffsets[i] < indexCapacities[i])
+      indexBuffer.freeList.push_back({indexOffsets[i], indexCapacities[i] - indexOffsets[i]});
+
+    if (!ibos[i])
+      continue;
+
+    if (!indexBuffer.vao)
+      glGenVertexArrays(1, &indexBuffer.vao);
+    glBindVertexArray(indexBuffer.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    _bindAttributes();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibos[i]);
+  }
+  glBindVertexArray((GLuint)previousVao);
+  glBindBuffer(GL_ARRAY_BUFFER, (GLuint)previousBuffer);
+
+  glDeleteBuffers(1, &_vbo);
+  _vbo = vbo;
+  _vertexCapacity = vertexCapacity;
+  for (int i = 0; i < INDEX_TYPES; ++i)
+  {
+    glDeleteBuffers(1, &_indexBuffers[i].ibo);
+    _indexBuffers[i].ibo = ibos[i];
+    _indexBuffers[i].capacity = indexCapacities[i];
+  }
+  ++_reallocations;
+}
+
+void MeshArenaBase::Defragment()
+{
+  bool fragmented = _freeVertices.size() > 1;
+  GLuint indexCapacities[INDEX_TYPES];
+  for (int i = 0; i < INDEX_TYPES; ++i)
+  {
+    fragmented |= _indexBuffers[i].freeList.size() > 1;
+    indexCapacities[i] = _indexBuffers[i].capacity;
+  }
+
+  if (fragmented)
+    Reallocate(_vertexCapacity, indexCapacities);
+}
+
+void MeshArenaBase::Release()
+{
+  glDeleteBuffers(1, &_vbo);
+  _vbo = 0;
+  _vertexCapacity = 0;
+  _freeVertices.clear();
+  for (IndexBuffer& indexBuffer : _indexBuffers)
+  {
+    glDeleteVertexArrays(1, &indexBuffer.vao);
+    glDeleteBuffers(1, &indexBuffer.ibo);
+    indexBuffer.vao = indexBuffer.ibo = 0;
+    indexBuffer.capacity = 0;
+    indexBuffer.freeList.clear();
+  }
+
+  ReleaseStaging();
+  _pending = -1;
+}
+
+void MeshArenaBase::PrintOccupancy() const
+{
+  const GLuint usedVertices = _vertexCapacity - GetFreeCount(_freeVertices);
+  const IndexBuffer& shortIndices = _indexBuffers[0];
+  const IndexBuffer& intIndices = _indexBuffers[1];
+  const GLuint usedShortIndices = shortIndices.capacity - GetFreeCount(shortIndices.freeList);
+  const GLuint usedIntIndices = intIndices.capacity - GetFreeCount(intIndices.freeList);
+  const double megabytes = (_vertexCapacity * _vertexSize + shortIndices.capacity * sizeof(GLushort) +
+                            intIndices.capacity * sizeof(GLuint)) / (1024.0 * 1024.0);
+  printf("Mesh arena (%u B vertices): %d meshes, %u/%u vertices, %u/%u 16 bit and %u/%u 32 bit indices, %d/%d/%d free runs, "
+         "%d reallocations, %.2f MB + %.2f MB staging\n",
+         (unsigned int)_vertexSize, _meshCount, usedVertices, _vertexCapacity, usedShortIndices, shortIndices.capacity,
+         usedIntIndices, intIndices.capacity, (int)_freeVertices.size(), (int)shortIndices.freeList.size(),
+         (int)intIndices.freeList.size(), _reallocations, megabytes, _stagingRegionSize * STAGING_REGIONS / (1024.0 * 1024.0));
+}
+
+void MeshArenaBase::DefragmentAll()
+{
+  for (MeshArenaBase* arena : GetArenas())
+    arena->Defragment();
+}
+
+void MeshArenaBase::ReleaseAll()
+{
+  for (MeshArenaBase* arena : GetArenas())
+    arena->Release();
+}
+
+void MeshArenaBase::PrintAllOccupancy()
+{
+  for (MeshArenaBase* arena : GetArenas())
+    arena->PrintOccupancy();
+}
@@ -0,0 +1,334 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <MeshOptimizer.h>
+
+#include <algorithm>
+#include <cmath>
+
+// Size of the LRU cache the vertex cache optimization plans for
+static const int CACHE_SIZE = 32;
+// Size of the FIFO cache the overdraw optimization looks for cluster boundaries with
+static const size_t CLUSTER_CACHE_SIZE = 16;
+
+// Vertex score of Forsyth's algorithm: vertices used recently and vertices with few
+// remaining primitives get higher scores, see "Linear-Speed Vertex Cache Optimisation"
+static float getVertexScore(int cachePosition, GLuint remaining, GLuint primitiveSize)
+{
+  if (remaining == 0)
+    return -1.0f;
+
+  float score = 0.0f;
+  if (cachePosition >= 0)
+  {
+    // The vertices of the last primitive get a fixed score so that its neighbours don't
+    // win just because they're its neighbours
+    if (cachePosition < (int)primitiveSize)
+      score = 0.75f;
+    else
+      score = std::pow(1.0f - (float)(cachePosition - (int)primitiveSize) / (CACHE_SIZE - (int)primitiveSize), 1.5f);
+  }
+
+  // Boost the vertices with few primitives left so that they're finished off
+  return score + 2.0f / std::sqrt((float)remaining);
+}
+
+// Simulation of a FIFO post-transform cache
+class VertexCacheSimulation
+{
+public:
+  VertexCacheSimulation(size_t vertexCount, size_t cacheSize) :
+    _loadedAt(vertexCount, 0), _loaded(vertexCount, false), _cacheSize(cacheSize), _time(0), _start(0) {}
+
+  // Returns the number of vertices of the primitive that missed the cache
+  GLuint Access(const GLuint *primitive, GLuint primitiveSize)
+  {
+    GLuint misses = 0;
+    for (GLuint k = 0; k < primitiveSize; ++k)
+    {
+      // A vertex is cached when less than cacheSize vertices were loaded since it and
+      // since the cache was cleared
+      const GLuint v = primitive[k];
+      if (_loaded[v] && _loadedAt[v] >= _start && _time - _loadedAt[v] < _cacheSize)
+        continue;
+
+      _loaded[v] = true;
+      _loadedAt[v] = _time++;
+      ++misses;
+    }
+    return misses;
+  }
+  // Empties the cache
+  void Clear() { _start = _time; }
+
+private:
+  std::vector<size_t> _loadedAt;
+  std::vector<bool> _loaded;
+  size_t _cacheSize;
+  // Number of vertices loaded so far and when the cache was last cleared
+  size_t _time;
+  size_t _start;
+};
+
+MeshOptimizer::CacheStatistics MeshOptimizer::AnalyzeVertexCache(const GLuint *indices, size_t indexCount, size_t vertexCount,
+                                                                 GLuint primitiveSize, size_t cacheSize)
+{
+  CacheStatistics statistics = {0.0f, 0.0f};
+  const size_t primitiveCount = indexCount / primitiveSize;
+  if (primitiveCount == 0 || vertexCount == 0)
+    return statistics;
+
+  VertexCacheSimulation cache(vertexCount, cacheSize);
+  size_t transformed = 0;
+  for (size_t p = 0; p < primitiveCount; ++p)
+    transformed += cache.Access(indices + p * primitiveSize, primitiveSize);
+
+  statistics.acmr = (float)transformed / primitiveCount;
+  statistics.atvr = (float)transformed / vertexCount;
+  return statistics;
+}
+
+void MeshOptimizer::OptimizeVertexCache(GLuint *indices, size_t indexCount, size_t vertexCount, GLuint primitiveSize)
+{
+  const size_t primitiveCount = indexCount / primitiveSize;
+  if (primitiveCount < 2)
+    return;
+
+  // Primitives of each vertex, the ones not emitted yet are kept at the start of its list
+  std::vector<GLuint> offsets(vertexCount + 1, 0);
+  for (size_t i = 0; i < primitiveCount * primitiveSize; ++i)
+    ++offsets[indices[i] + 1];
+  for (size_t v = 0; v < vertexCount; ++v)
+    offsets[v + 1] += offsets[v];
+
+  std::vector<GLuint> adjacency(primitiveCount * primitiveSize);
+  std::vector<GLuint> remaining(vertexCount, 0);
+  for (size_t p = 0; p < primitiveCount; ++p)
+  {
+    for (GLuint k = 0; k < primitiveSize; ++k)
+    {
+      const GLuint v = indices[p * primitiveSize + k];
+      adjacency[offsets[v] + remaining[v]++] = (GLuint)p;
+    }
+  }
+
+  std::vector<int> cachePositions(vertexCount, -1);
+  std::vector<float> vertexScores(vertexCount);
+  for (size_t v = 0; v < vertexCount; ++v)
+    vertexScores[v] = getVertexScore(-1, remaining[v], primitiveSize);
+
+  std::vector<float> primitiveScores(primitiveCount, 0.0f);
+  for (size_t p = 0; p < primitiveCount; ++p)
+  {
+    for (GLuint k = 0; k < primitiveSize; ++k)
+      primitiveScores[p] += vertexScores[indices[p * primitiveSize + k]];
+  }
+
+  std::vector<bool> emitted(primitiveCount, false);
+  std::vector<GLuint> output;
+  output.reserve(primitiveCount * primitiveSize);
+  std::vector<GLuint> cache, nextCache;
+  cache.reserve(CACHE_SIZE + primitiveSize);
+  nextCache.reserve(CACHE_SIZE + primitiveSize);
+
+  // Recomputes the score of the vertex and passes the change on to its remaining primitives
+  auto updateScore = [&](GLuint v)
+  {
+    const float score = getVertexScore(cachePositions[v], remaining[v], primitiveSize);
+    const float delta = score - vertexScores[v];
+    vertexScores[v] = score;
+    for (GLuint i = offsets[v]; i < offsets[v] + remaining[v]; ++i)
+      primitiveScores[adjacency[i]] += delta;
+  };
+
+  size_t scan = 0;
+  int best = 0;
+  for (size_t emittedCount = 0; emittedCount < primitiveCount; ++emittedCount)
+  {
+    if (best < 0)
+    {
+      // Nothing left around the cache, continue with the first primitive not emitted yet,
+      // looking for the best scoring one would make it quadratic
+      while (emitted[scan])
+        ++scan;
+      best = (int)scan;
+    }
+
+    emitted[best] = true;
+    const GLuint *primitive = indices + best * primitiveSize;
+    nextCache.clear();
+    for (GLuint k = 0; k < primitiveSize; ++k)
+    {
+      const GLuint v = primitive[k];
+      output.push_back(v);
+
+      // Take the primitive out of the remaining ones of the vertex
+      GLuint *first = &adjacency[offsets[v]];
+      GLuint *last = first + remaining[v];
+      GLuint *found = std::find(first, last, (GLuint)best);
+      if (found != last)
+      {
+        std::swap(*found, *(last - 1));
+        --remaining[v];
+      }
+
+      if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end())
+        nextCache.push_back(v);
+    }
+
+    // The primitive's vertices go to the front of the cache, the oldest ones fall out
+    for (GLuint v : cache)
+    {
+      if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end())
+        nextCache.push_back(v);
+    }
+    for (size_t i = CACHE_SIZE; i < nextCache.size(); ++i)
+    {
+      cachePositions[nextCache[i]] = -1;
+      updateScore(nextCache[i]);
+    }
+    if (nextCache.size() > (size_t)CACHE_SIZE)
+      nextCache.resize(CACHE_SIZE);
+    cache.swap(nextCache);
+
+    for (size_t i = 0; i < cache.size(); ++i)
+    {
+      cachePositions[cache[i]] = (int)i;
+      updateScore(cache[i]);
+    }
+
+    // The next primitive is the best one using the cached vertices
+    best = -1;
+    float bestScore = -1.0f;
+    for (GLuint v : cache)
+    {
+      for (GLuint i = offsets[v]; i < offsets[v] + remaining[v]; ++i)
+      {
+        const GLuint p = adjacency[i];
+        if (primitiveScores[p] > bestScore)
+        {
+          best = (int)p;
+          bestScore = primitiveScores[p];
+        }
+      }
+    }
+  }
+
+  std::copy(output.begin(), output.end(), indices);
+}
+
+void MeshOptimizer::OptimizeOverdraw(GLuint *indices, size_t indexCount, const std::vector<glm::vec3> &positions,
+                                     GLuint primitiveSize, float threshold)
+{
+  const size_t primitiveCount = indexCount / primitiveSize;
+  if (primitiveCount < 2)
+    return;
+
+  // Hard boundaries are where the cache starts over, i.e., all vertices of a primitive miss,
+  // reordering the clusters between them doesn't change the cache efficiency much
+  VertexCacheSimulation cache(positions.size(), CLUSTER_CACHE_SIZE);
+  std::vector<size_t> hardBoundaries;
+  for (size_t p = 0; p < primitiveCount; ++p)
+  {
+    if (cache.Access(indices + p * primitiveSize, primitiveSize) == primitiveSize)
+      hardBoundaries.push_back(p);
+  }
+  hardBoundaries.push_back(primitiveCount);
+
+  // Soft boundaries split the clusters further: with the cache emptied at the start of
+  // each piece, a piece ends once its miss ratio drops close to the one of the cluster
+  std::vector<size_t> clusters;
+  for (size_t c = 0; c + 1 < hardBoundaries.size(); ++c)
+  {
+    const size_t start = hardBoundaries[c], end = hardBoundaries[c + 1];
+    cache.Clear();
+    size_t total = 0;
+    for (size_t p = start; p < end; ++p)
+      total += cache.Access(indices + p * primitiveSize, primitiveSize);
+    const float clusterAcmr = (float)total / (end - start);
+
+    clusters.push_back(start);
+    cache.Clear();
+    size_t pieceMisses = 0, pieceStart = start;
+    for (size_t p = start; p + 1 < end; ++p)
+    {
+      pieceMisses += cache.Access(indices + p * primitiveSize, primitiveSize);
+      if (pieceMisses <= threshold * clusterAcmr * (p + 1 - pieceStart))
+      {
+        pieceStart = p + 1;
+        pieceMisses = 0;
+        clusters.push_back(pieceStart);
+        cache.Clear();
+      }
+    }
+  }
+  clusters.push_back(primitiveCount);
+
+  // Clusters on the outside facing away from the center occlude the rest, they go first
+  const size_t clusterCount = clusters.size() - 1;
+  std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f)), normals(clusterCount, glm::vec3(0.0f));
+  glm::vec3 meshCentroid(0.0f);
+  float meshArea = 0.0f;
+  for (size_t c = 0; c < clusterCount; ++c)
+  {
+    float clusterArea = 0.0f;
+    for (size_t p = clusters[c]; p < clusters[c + 1]; ++p)
+    {
+      // Newell's normal of the polygon, its length is twice the area
+      glm::vec3 normal(0.0f), center(0.0f);
+      for (GLuint k = 0; k < primitiveSize; ++k)
+      {
+        const glm::vec3 &a = positions[indices[p * primitiveSize + k]];
+        const glm::vec3 &b = positions[indices[p * primitiveSize + (k + 1) % primitiveSize]];
+        normal += glm::cross(a, b);
+        center += a;
+      }
+      const float area = 0.5f * glm::length(normal);
+      center /= (float)primitiveSize;
+
+      normals[c] += normal;
+      centroids[c] += center * area;
+      clusterArea += area;
+    }
+
+    meshCentroid += centroids[c];
+    meshArea += clusterArea;
+    centroids[c] = clusterArea > 0.0f ? centroids[c] / clusterArea : positions[indices[clusters[c] * primitiveSize]];
+  }
+  if (meshArea > 0.0f)
+    meshCentroid /= meshArea;
+
+  std::vector<float> sortKeys(clusterCount);
+  for (size_t c = 0; c < clusterCount; ++c)
+  {
+    const float length = glm::length(normals[c]);
+    sortKeys[c] = length > 0.0f ? glm::dot(centroids[c] - meshCentroid, normals[c] / length) : 0.0f;
+  }
+
+  std::vector<size_t> order(clusterCount);
+  for (size_t c = 0; c < clusterCount; ++c)
+    order[c] = c;
+  std::stable_sort(order.begin(), order.end(), [&sortKeys](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+  std::vector<GLuint> output;
+  output.reserve(primitiveCount * primitiveSize);
+  for (size_t c : order)
+    output.insert(output.end(), indices + clusters[c] * primitiveSize, indices + clusters[c + 1] * primitiveSize);
+  std::copy(output.begin(), output.end(), indices);
+}
+
+size_t MeshOptimizer::OptimizeVertexFetch(GLuint *indices, size_t indexCount, size_t vertexCount, std::vector<GLuint> &remap)
+{
+  remap.assign(vertexCount, ~0u);
+  GLuint next = 0;
+  for (size_t i = 0; i < indexCount; ++i)
+  {
+    GLuint &index = indices[i];
+    if (remap[index] == ~0u)
+      remap[index] = next++;
+    index = remap[index];
+  }
+  return next;
+}
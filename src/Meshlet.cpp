@@ -0,0 +1,238 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <Meshlet.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// Meshlets with triangles facing more than about 84 degrees away from the average
+// normal would hardly ever be culled by the cone, they don't get any
+static const float MIN_CONE_DOT = 0.1f;
+
+// Computes the bounds of the meshlet from its triangles
+static void computeBounds(Meshlet &meshlet, const GLuint *indices, const std::vector<glm::vec3> &positions,
+                          const std::vector<glm::vec3> &normals, const std::vector<GLuint> &triangles,
+                          const std::vector<GLuint> &vertices)
+{
+  // Ritter's bounding sphere: start from two far apart points and grow it by the ones outside
+  const glm::vec3 &first = positions[vertices[0]];
+  glm::vec3 a = first, b = first;
+  float maxDistance = -1.0f;
+  for (GLuint v : vertices)
+  {
+    const float distance = glm::dot(positions[v] - first, positions[v] - first);
+    if (distance > maxDistance)
+    {
+      maxDistance = distance;
+      a = positions[v];
+    }
+  }
+  maxDistance = -1.0f;
+  for (GLuint v : vertices)
+  {
+    const float distance = glm::dot(positions[v] - a, positions[v] - a);
+    if (distance > maxDistance)
+    {
+      maxDistance = distance;
+      b = positions[v];
+    }
+  }
+
+  glm::vec3 center = (a + b) * 0.5f;
+  float radius = glm::length(b - a) * 0.5f;
+  for (GLuint v : vertices)
+  {
+    const float distance = glm::length(positions[v] - center);
+    if (distance > radius)
+    {
+      // Move the center towards the point so that the old sphere stays inside
+      const float grownRadius = (radius + distance) * 0.5f;
+      center += (positions[v] - center) * ((grownRadius - radius) / distance);
+      radius = grownRadius;
+    }
+  }
+  meshlet.center = center;
+  meshlet.radius = radius;
+
+  // Degenerate cone unless the triangles face similar directions
+  meshlet.coneApex = center;
+  meshlet.coneAxis = glm::vec3(0.0f);
+  meshlet.coneCutoff = 1.0f;
+
+  glm::vec3 axis(0.0f);
+  for (GLuint t : triangles)
+    axis += normals[t];
+  const float axisLength = glm::length(axis);
+  if (axisLength <= 0.0f)
+    return;
+  axis /= axisLength;
+
+  // Zero normals of degenerate triangles don't restrict anything, they're never rasterized
+  float minDot = 1.0f;
+  for (GLuint t : triangles)
+  {
+    if (normals[t] != glm::vec3(0.0f))
+      minDot = glm::min(minDot, glm::dot(axis, normals[t]));
+  }
+  if (minDot <= MIN_CONE_DOT)
+    return;
+
+  // The apex is moved back along the axis until it's behind the planes of all triangles,
+  // every viewer looking at it from within the cone is then behind all of them as well
+  float maxT = -FLT_MAX;
+  for (GLuint t : triangles)
+  {
+    if (normals[t] == glm::vec3(0.0f))
+      continue;
+
+    const glm::vec3 &p = positions[indices[3 * t]];
+    maxT = glm::max(maxT, glm::dot(center - p, normals[t]) / glm::dot(axis, normals[t]));
+  }
+  meshlet.coneApex = center - axis * maxT;
+  meshlet.coneAxis = axis;
+  // The view direction must be within 90 degrees minus the spread of the normals from the axis
+  meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+void MeshletBuilder::Build(GLuint *indices, size_t indexCount, const std::vector<glm::vec3> &positions, std::vector<Meshlet> &meshlets,
+                           GLuint maxVertices, GLuint maxTriangles)
+{
+  meshlets.clear();
+  const size_t triangleCount = indexCount / 3;
+  const size_t vertexCount = positions.size();
+  if (triangleCount == 0)
+    return;
+
+  if (maxVertices < 3)
+    maxVertices = 3;
+  if (maxTriangles < 1)
+    maxTriangles = 1;
+
+  // Unit normals pointing out of the front faces: counter-clockwise front faces of the
+  // left handed world have cross(c - a, b - a) pointing towards the viewer
+  std::vector<glm::vec3> normals(triangleCount);
+  for (size_t t = 0; t < triangleCount; ++t)
+  {
+    const glm::vec3 &a = positions[indices[3 * t]];
+    const glm::vec3 &b = positions[indices[3 * t + 1]];
+    const glm::vec3 &c = positions[indices[3 * t + 2]];
+    const glm::vec3 normal = glm::cross(c - a, b - a);
+    const float length = glm::length(normal);
+    normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+  }
+
+  // Triangles of each vertex, compressed rows
+  std::vector<GLuint> adjacencyOffsets(vertexCount + 1, 0);
+  for (size_t i = 0; i < triangleCount * 3; ++i)
+    ++adjacencyOffsets[indices[i] + 1];
+  for (size_t v = 0; v < vertexCount; ++v)
+    adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+  std::vector<GLuint> adjacency(triangleCount * 3);
+  {
+    std::vector<GLuint> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+      adjacency[fill[indices[i]]++] = (GLuint)(i / 3);
+  }
+
+  // Triangles in the meshlet order, written back over the indices at the end
+  std::vector<GLuint> ordered;
+  ordered.reserve(triangleCount * 3);
+  std::vector<bool> emitted(triangleCount, false);
+  // Whether the vertex is in the current meshlet
+  std::vector<bool> inMeshlet(vertexCount, false);
+  std::vector<GLuint> meshletVertices, meshletTriangles;
+  meshletVertices.reserve(maxVertices);
+  meshletTriangles.reserve(maxTriangles);
+  glm::vec3 normalSum(0.0f);
+  // First triangle that may not have been emitted yet, new meshlets start from it
+  size_t seed = 0;
+
+  auto finishMeshlet = [&]()
+  {
+    Meshlet meshlet;
+    meshlet.firstIndex = (GLuint)ordered.size();
+    meshlet.indexCount = (GLuint)meshletTriangles.size() * 3;
+    computeBounds(meshlet, indices, positions, normals, meshletTriangles, meshletVertices);
+    meshlets.push_back(meshlet);
+
+    for (GLuint t : meshletTriangles)
+    {
+      for (int k = 0; k < 3; ++k)
+        ordered.push_back(indices[3 * t + k]);
+    }
+    for (GLuint v : meshletVertices)
+      inMeshlet[v] = false;
+    meshletVertices.clear();
+    meshletTriangles.clear();
+    normalSum = glm::vec3(0.0f);
+  };
+
+  for (;;)
+  {
+    // Neighbour of the meshlet adding the fewest vertices, ties go to the best aligned one
+    size_t best = triangleCount;
+    int bestNew = 4;
+    float bestAlignment = -FLT_MAX;
+    for (GLuint v : meshletVertices)
+    {
+      for (GLuint i = adjacencyOffsets[v]; i < adjacencyOffsets[v + 1]; ++i)
+      {
+        const GLuint t = adjacency[i];
+        if (emitted[t])
+          continue;
+
+        int added = 0;
+        for (int k = 0; k < 3; ++k)
+          added += inMeshlet[indices[3 * t + k]] ? 0 : 1;
+        const float alignment = glm::dot(normals[t], normalSum);
+        if (added < bestNew || (added == bestNew && alignment > bestAlignment))
+        {
+          best = t;
+          bestNew = added;
+          bestAlignment = alignment;
+        }
+      }
+    }
+
+    // Nothing connected left, continue with the next triangle in the original order, the
+    // cache optimized order keeps it close
+    if (best == triangleCount)
+    {
+      while (seed < triangleCount && emitted[seed])
+        ++seed;
+      if (seed == triangleCount)
+        break;
+
+      best = seed;
+      bestNew = 0;
+      for (int k = 0; k < 3; ++k)
+        bestNew += inMeshlet[indices[3 * best + k]] ? 0 : 1;
+    }
+
+    // Full, the triangle starts the next meshlet
+    if (meshletTriangles.size() + 1 > maxTriangles || meshletVertices.size() + bestNew > maxVertices)
+      finishMeshlet();
+
+    emitted[best] = true;
+    meshletTriangles.push_back((GLuint)best);
+    normalSum += normals[best];
+    for (int k = 0; k < 3; ++k)
+    {
+      const GLuint v = indices[3 * best + k];
+      if (!inMeshlet[v])
+      {
+        inMeshlet[v] = true;
+        meshletVertices.push_back(v);
+      }
+    }
+  }
+
+  if (!meshletTriangles.empty())
+    finishMeshlet();
+
+  std::copy(ordered.begin(), ordered.end(), indices);
+}
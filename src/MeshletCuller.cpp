@@ -0,0 +1,126 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <MeshletCuller.h>
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+MeshletCuller::MeshletCuller() : _viewCount(0), _tested(0), _passed(0)
+{
+}
+
+void MeshletCuller::SetViews(const Camera *cams, const glm::vec4 *clippingPlanes, int count)
+{
+  _viewCount = count < MAX_VIEWS ? count : MAX_VIEWS;
+  for (int i = 0; i < _viewCount; ++i)
+  {
+    _views[i].frustum.Update(cams[i].GetProjection() * cams[i].GetWorldToView());
+    // Unit normal, the plane equation gives the distance then
+    _views[i].clippingPlane = clippingPlanes[i] / glm::length(glm::vec3(clippingPlanes[i]));
+    _viewerPositions[i] = glm::vec3(cams[i].GetViewToWorld()[3]);
+  }
+}
+
+void MeshletCuller::Add(const DrawPacket &packet, const std::vector<Meshlet> &meshlets, const glm::mat4 &modelToWorld, bool coneCulling)
+{
+  Draw draw;
+  draw.packet = packet;
+  draw.meshlets = &meshlets;
+  draw.modelToWorld = modelToWorld;
+  draw.scale = std::sqrt(std::max(std::max(glm::dot(modelToWorld[0], modelToWorld[0]), glm::dot(modelToWorld[1], modelToWorld[1])),
+                                  glm::dot(modelToWorld[2], modelToWorld[2])));
+  // Mirroring turns the front faces into back faces, better not to bother with the cones then
+  draw.coneCulling = coneCulling && glm::determinant(glm::mat3(modelToWorld)) > 0.0f;
+  if (draw.coneCulling)
+  {
+    const glm::mat4 worldToModel = glm::inverse(modelToWorld);
+    for (int i = 0; i < _viewCount; ++i)
+      draw.viewers[i] = glm::vec3(worldToModel * glm::vec4(_viewerPositions[i], 1.0f));
+  }
+  draw.firstMeshlet = _visible.size();
+  _visible.resize(_visible.size() + meshlets.size());
+  _draws.push_back(draw);
+}
+
+void MeshletCuller::CullRange(size_t begin, size_t end)
+{
+  // The draw owning the first meshlet of the range, the rest follow in order
+  size_t drawIndex = std::upper_bound(_draws.begin(), _draws.end(), begin,
+                                      [](size_t meshlet, const Draw &draw) { return meshlet < draw.firstMeshlet; }) - _draws.begin() - 1;
+  for (size_t i = begin; i < end; ++i)
+  {
+    while (i >= _draws[drawIndex].firstMeshlet + _draws[drawIndex].meshlets->size())
+      ++drawIndex;
+
+    const Draw &draw = _draws[drawIndex];
+    const Meshlet &meshlet = (*draw.meshlets)[i - draw.firstMeshlet];
+    const glm::vec3 center = glm::vec3(draw.modelToWorld * glm::vec4(meshlet.center, 1.0f));
+    const float radius = meshlet.radius * draw.scale;
+
+    bool visible = false;
+    for (int v = 0; v < _viewCount && !visible; ++v)
+    {
+      const View &view = _views[v];
+      visible = glm::dot(glm::vec3(view.clippingPlane), center) + view.clippingPlane.w >= -radius &&
+                view.frustum.Intersects(center, radius) &&
+                (!draw.coneCulling || MeshletBuilder::IsFrontFacing(meshlet, draw.viewers[v]));
+    }
+    _visible[i] = visible ? 1 : 0;
+  }
+}
+
+void MeshletCuller::Flush(ThreadPool &threadPool, RenderQueue &queue)
+{
+  // The meshlets of all draws of the pass are split between the threads evenly
+  if (_viewCount > 0 && !_visible.empty())
+    threadPool.ParallelFor(_visible.size(), GRAIN, [this](size_t begin, size_t end) { CullRange(begin, end); });
+
+  for (const Draw &draw : _draws)
+  {
+    const std::vector<Meshlet> &meshlets = *draw.meshlets;
+    if (meshlets.empty() || _viewCount == 0)
+    {
+      queue.Add(draw.packet);
+      continue;
+    }
+
+    // Runs of visible meshlets are contiguous ranges of the mesh indices
+    _tested += meshlets.size();
+    for (size_t first = 0; first < meshlets.size();)
+    {
+      if (!_visible[draw.firstMeshlet + first])
+      {
+        ++first;
+        continue;
+      }
+
+      size_t last = first + 1;
+      while (last < meshlets.size() && _visible[draw.firstMeshlet + last] &&
+             meshlets[last].firstIndex == meshlets[last - 1].firstIndex + meshlets[last - 1].indexCount)
+        ++last;
+      _passed += last - first;
+
+      DrawPacket packet = draw.packet;
+      packet.firstIndex += meshlets[first].firstIndex;
+      packet.indexCount = (GLsizei)(meshlets[last - 1].firstIndex + meshlets[last - 1].indexCount - meshlets[first].firstIndex);
+      queue.Add(packet);
+      first = last;
+    }
+  }
+
+  _draws.clear();
+  _visible.clear();
+}
+
+void MeshletCuller::PrintCounters(int frames) const
+{
+  if (frames <= 0)
+    frames = 1;
+
+  printf("Meshlets per frame: %.1f tested, %.1f visible\n", (double)_tested / frames, (double)_passed / frames);
+}
@@ -0,0 +1,448 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <MipGenerator.h>
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// The AVX kernel doesn't depend on the compiler flags, it's used when the CPU supports it
+#if defined(__x86_64__) || defined(_M_X64)
+#define MIP_GENERATOR_AVX
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define MIP_GENERATOR_AVX_TARGET __attribute__((target("avx")))
+#else
+#include <intrin.h>
+#define MIP_GENERATOR_AVX_TARGET
+#endif
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_GENERATOR_SSE2
+#include <emmintrin.h>
+#endif
+
+static const float PI = 3.14159265358979f;
+// Kaiser window shape, higher values trade sharpness for less ringing
+static const float KAISER_ALPHA = 4.0f;
+// Points the kernel is evaluated at across a source texel
+static const int SUBSAMPLES = 8;
+// Buckets of the linear to sRGB look up, fine enough that the guess is off by one at most
+static const int SRGB_BUCKETS = 16384;
+
+// Conversions of 8 bit sRGB values
+struct SRGBTables
+{
+  // Linear value of every 8 bit value
+  float toLinear[256];
+  // Linear values halfway (in sRGB) between the neighbouring 8 bit values, the encoding
+  // rounds by comparing against them
+  float thresholds[256];
+  // Lowest 8 bit value of every bucket of linear values
+  unsigned char guesses[SRGB_BUCKETS + 1];
+};
+
+// Source texels and their weights for every destination texel along one axis
+struct AxisFilter
+{
+  int taps;
+  // taps source texel indices and weights per destination texel
+  std::vector<int> indices;
+  std::vector<float> weights;
+};
+
+static float srgbToLinear(float value)
+{
+  return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static const SRGBTables &getSRGBTables()
+{
+  static const SRGBTables tables = []()
+  {
+    SRGBTables result;
+    for (int i = 0; i < 256; ++i)
+      result.toLinear[i] = srgbToLinear(i / 255.0f);
+    for (int i = 0; i < 255; ++i)
+      result.thresholds[i] = srgbToLinear((i + 0.5f) / 255.0f);
+    result.thresholds[255] = 2.0f;
+    int value = 0;
+    for (int i = 0; i <= SRGB_BUCKETS; ++i)
+    {
+      while ((float)i / SRGB_BUCKETS >= result.thresholds[value])
+        ++value;
+      result.guesses[i] = (unsigned char)value;
+    }
+    return result;
+  }();
+  return tables;
+}
+
+static float sinc(float x)
+{
+  if (fabsf(x) < 1.0e-5f)
+    return 1.0f;
+  x *= PI;
+  return sinf(x) / x;
+}
+
+// Modified Bessel function of the first kind of order 0
+static float besselI0(float x)
+{
+  float sum = 1.0f, term = 1.0f;
+  for (int k = 1; k < 32 && term > 1.0e-7f * sum; ++k)
+  {
+    const float factor = 0.5f * x / k;
+    term *= factor * factor;
+    sum += term;
+  }
+  return sum;
+}
+
+// Returns the radius of the filter kernel [destination texels]
+static float getRadius(MipFilter filter)
+{
+  return filter == MipFilter::Box || filter == MipFilter::Driver ? 0.5f : 3.0f;
+}
+
+// Returns the filter kernel at x destination texels from the center
+static float evaluate(MipFilter filter, float x)
+{
+  const float radius = getRadius(filter);
+  x = fabsf(x);
+  if (x >= radius)
+    return 0.0f;
+
+  switch (filter) {
+      case MipFilter::Kaiser:
+      {
+        static const float norm = 1.0f / besselI0(KAISER_ALPHA);
+        const float t = x / radius;
+        return sinc(x) * besselI0(KAISER_ALPHA * sqrtf(1.0f - t * t)) * norm;
+      }
+      case MipFilter::Lanczos:
+          return sinc(x) * sinc(x / radius);
+      default:
+          return 1.0f;
+  }
+}
+
+// Mirrors a texel index outside [0, size) back in
+static int mirror(int i, int size)
+{
+  const int period = 2 * size;
+  i %= period;
+  if (i < 0)
+    i += period;
+  return i < size ? i : period - 1 - i;
+}
+
+// Computes the weights reducing srcSize texels to dstSize ones. The kernel is stretched by
+// the ratio of the sizes and integrated over every source texel it covers
+static void buildAxis(MipFilter filter, int srcSize, int dstSize, AxisFilter &axis)
+{
+  const float scale = (float)srcSize / dstSize;
+  const float radius = getRadius(filter) * scale;
+
+  axis.taps = 1;
+  for (int i = 0; i < dstSize; ++i)
+  {
+    const float center = (i + 0.5f) * scale;
+    axis.taps = std::max(axis.taps, (int)ceilf(center + radius) - (int)floorf(center - radius));
+  }
+  axis.indices.resize((size_t)dstSize * axis.taps);
+  axis.weights.resize((size_t)dstSize * axis.taps);
+
+  for (int i = 0; i < dstSize; ++i)
+  {
+    const float center = (i + 0.5f) * scale;
+    const int first = (int)floorf(center - radius);
+    int *indices = axis.indices.data() + (size_t)i * axis.taps;
+    float *weights = axis.weights.data() + (size_t)i * axis.taps;
+
+    float sum = 0.0f;
+    for (int k = 0; k < axis.taps; ++k)
+    {
+      float weight = 0.0f;
+      for (int s = 0; s < SUBSAMPLES; ++s)
+        weight += evaluate(filter, (first + k + (s + 0.5f) / SUBSAMPLES - center) / scale);
+      indices[k] = mirror(first + k, srcSize);
+      weights[k] = weight;
+      sum += weight;
+    }
+    for (int k = 0; k < axis.taps; ++k)
+      weights[k] /= sum;
+  }
+
+  // The taps at the ends may get nothing from the kernel for every texel, those are dropped
+  int lead = axis.taps, used = 0;
+  for (int i = 0; i < dstSize; ++i)
+  {
+    const float *weights = axis.weights.data() + (size_t)i * axis.taps;
+    for (int k = 0; k < axis.taps; ++k)
+    {
+      if (weights[k] != 0.0f)
+      {
+        lead = std::min(lead, k);
+        used = std::max(used, k + 1);
+      }
+    }
+  }
+  if (lead > 0 || used < axis.taps)
+  {
+    const int taps = used - lead;
+    for (int i = 0; i < dstSize; ++i)
+    {
+      for (int k = 0; k < taps; ++k)
+      {
+        axis.indices[(size_t)i * taps + k] = axis.indices[(size_t)i * axis.taps + lead + k];
+        axis.weights[(size_t)i * taps + k] = axis.weights[(size_t)i * axis.taps + lead + k];
+      }
+    }
+    axis.taps = taps;
+    axis.indices.resize((size_t)dstSize * taps);
+    axis.weights.resize((size_t)dstSize * taps);
+  }
+}
+
+#if defined(MIP_GENERATOR_AVX)
+// Returns whether the CPU and the OS support AVX
+static bool hasAVX()
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_cpu_supports("avx");
+#else
+  // The OS has to save the YMM registers as well
+  int info[4];
+  __cpuid(info, 1);
+  const bool cpu = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0;
+  return cpu && (_xgetbv(0) & 6) == 6;
+#endif
+}
+
+// row += weight * source over whole groups of 8, returns the number of values done
+MIP_GENERATOR_AVX_TARGET static size_t accumulateAVX(float *row, const float *source, float weight, size_t count)
+{
+  size_t i = 0;
+  const __m256 weight8 = _mm256_set1_ps(weight);
+  for (; i + 8 <= count; i += 8)
+    _mm256_storeu_ps(row + i, _mm256_add_ps(_mm256_loadu_ps(row + i), _mm256_mul_ps(_mm256_loadu_ps(source + i), weight8)));
+  return i;
+}
+#endif
+
+// row += weight * source, for the vertical pass over whole rows
+static void accumulate(float *row, const float *source, float weight, size_t count)
+{
+  size_t i = 0;
+#if defined(MIP_GENERATOR_AVX)
+  static const bool avx = hasAVX();
+  if (avx)
+    i = accumulateAVX(row, source, weight, count);
+#endif
+#if defined(MIP_GENERATOR_SSE2)
+  const __m128 weight4 = _mm_set1_ps(weight);
+  for (; i + 4 <= count; i += 4)
+    _mm_storeu_ps(row + i, _mm_add_ps(_mm_loadu_ps(row + i), _mm_mul_ps(_mm_loadu_ps(source + i), weight4)));
+#endif
+  for (; i < count; ++i)
+    row[i] += source[i] * weight;
+}
+
+// Filters a texel of the row horizontally, all four channels at once
+static void filterTexel(const float *row, const int *indices, const float *weights, int taps, float texel[4])
+{
+#if defined(MIP_GENERATOR_SSE2)
+  __m128 sum = _mm_setzero_ps();
+  for (int k = 0; k < taps; ++k)
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + (size_t)indices[k] * 4), _mm_set1_ps(weights[k])));
+  _mm_storeu_ps(texel, sum);
+#else
+  texel[0] = texel[1] = texel[2] = texel[3] = 0.0f;
+  for (int k = 0; k < taps; ++k)
+  {
+    for (int c = 0; c < 4; ++c)
+      texel[c] += row[(size_t)indices[k] * 4 + c] * weights[k];
+  }
+#endif
+}
+
+// Brings the filtered texel back into the range of its content, the sharper kernels over
+// and undershoot and averaged normals get shorter
+static void finishTexel(MipContent content, float texel[4])
+{
+  int c = 0;
+  if (content == MipContent::Normal)
+  {
+    const float length = sqrtf(texel[0] * texel[0] + texel[1] * texel[1] + texel[2] * texel[2]);
+    if (length > 1.0e-6f)
+    {
+      texel[0] /= length;
+      texel[1] /= length;
+      texel[2] /= length;
+    }
+    else
+    {
+      texel[0] = texel[1] = 0.0f;
+      texel[2] = 1.0f;
+    }
+    c = 3;
+  }
+  for (; c < 4; ++c)
+    texel[c] = std::min(std::max(texel[c], 0.0f), 1.0f);
+}
+
+static unsigned char encodeLinear(float value)
+{
+  return (unsigned char)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+// Rounds in sRGB space, the guess of the bucket is corrected by the threshold above it
+static unsigned char encodeSRGB(const SRGBTables &srgb, float value)
+{
+  value = std::min(std::max(value, 0.0f), 1.0f);
+  int result = srgb.guesses[(int)(value * SRGB_BUCKETS)];
+  if (value >= srgb.thresholds[result])
+    ++result;
+  return (unsigned char)result;
+}
+
+static unsigned char encodeChannel(MipContent content, const SRGBTables &srgb, float value, int channel)
+{
+  if (channel < 3 && content == MipContent::SRGB)
+    return encodeSRGB(srgb, value);
+  if (channel < 3 && content == MipContent::Normal)
+    return encodeLinear(value * 0.5f + 0.5f);
+  return encodeLinear(value);
+}
+
+// ----------------------------------------------------------------------------
+
+size_t MipGenerator::GetChainSize(int width, int height, int numChannels)
+{
+  size_t size = 0;
+  while (width > 1 || height > 1)
+  {
+    width = std::max(width >> 1, 1);
+    height = std::max(height >> 1, 1);
+    size += (size_t)width * height * numChannels;
+  }
+  return size;
+}
+
+const char *MipGenerator::GetName(MipFilter filter)
+{
+  static const char *names[] = {"driver", "box", "kaiser", "lanczos"};
+  return names[(int)filter];
+}
+
+float MipGenerator::GetRadius(MipFilter filter)
+{
+  return getRadius(filter);
+}
+
+bool MipGenerator::Generate(MipFilter filter, MipContent content, const unsigned char *pixels, int width, int height,
+                            int numChannels, unsigned char *levels, ThreadPool *threadPool)
+{
+  if (filter == MipFilter::Driver)
+    return false;
+
+  // Color and normals need all three channels, anything less is filtered as it is
+  if (numChannels < 3)
+    content = MipContent::Linear;
+  const SRGBTables &srgb = getSRGBTables();
+
+  // Rows of a level run in parallel, the small levels end up in a single task
+  const auto forRows = [threadPool](int rows, int rowWidth, const ThreadPool::RangeTask &task)
+  {
+    const size_t grain = (size_t)std::max(4096 / rowWidth, 1);
+    if (threadPool)
+      threadPool->ParallelFor((size_t)rows, grain, task);
+    else
+      task(0, (size_t)rows);
+  };
+
+  // Values of the 8 bit channels, the missing ones read as black and opaque
+  float decode[4][256];
+  for (int c = 0; c < 4; ++c)
+  {
+    for (int value = 0; value < 256; ++value)
+    {
+      if (c < 3 && content == MipContent::SRGB)
+        decode[c][value] = srgb.toLinear[value];
+      else if (c < 3 && content == MipContent::Normal)
+        decode[c][value] = value / 255.0f * 2.0f - 1.0f;
+      else
+        decode[c][value] = value / 255.0f;
+    }
+  }
+
+  // Every level is kept as four float channels per texel, so that a texel fills a SIMD
+  // register whatever the number of channels of the image
+  std::vector<float> source((size_t)width * height * 4), destination;
+  forRows(height, width, [&](size_t begin, size_t end)
+  {
+    for (size_t y = begin; y < end; ++y)
+    {
+      const unsigned char *pixel = pixels + y * width * numChannels;
+      float *texel = source.data() + y * width * 4;
+      for (int x = 0; x < width; ++x, pixel += numChannels, texel += 4)
+      {
+        texel[0] = texel[1] = texel[2] = 0.0f;
+        texel[3] = 1.0f;
+        for (int c = 0; c < numChannels; ++c)
+          texel[c] = decode[c][pixel[c]];
+      }
+    }
+  });
+
+  AxisFilter filterX, filterY;
+  unsigned char *level = levels;
+  int srcWidth = width, srcHeight = height;
+  while (srcWidth > 1 || srcHeight > 1)
+  {
+    const int dstWidth = std::max(srcWidth >> 1, 1), dstHeight = std::max(srcHeight >> 1, 1);
+    buildAxis(filter, srcWidth, dstWidth, filterX);
+    buildAxis(filter, srcHeight, dstHeight, filterY);
+    destination.resize((size_t)dstWidth * dstHeight * 4);
+
+    forRows(dstHeight, dstWidth, [&](size_t begin, size_t end)
+    {
+      // The source rows are filtered vertically first, the result horizontally
+      std::vector<float> row((size_t)srcWidth * 4);
+      for (size_t y = begin; y < end; ++y)
+      {
+        std::fill(row.begin(), row.end(), 0.0f);
+        for (int k = 0; k < filterY.taps; ++k)
+        {
+          const float weight = filterY.weights[y * filterY.taps + k];
+          if (weight != 0.0f)
+            accumulate(row.data(), source.data() + (size_t)filterY.indices[y * filterY.taps + k] * srcWidth * 4, weight,
+                       row.size());
+        }
+
+        float *texel = destination.data() + y * dstWidth * 4;
+        unsigned char *pixel = level + y * dstWidth * numChannels;
+        for (int x = 0; x < dstWidth; ++x, texel += 4, pixel += numChannels)
+        {
+          filterTexel(row.data(), filterX.indices.data() + (size_t)x * filterX.taps,
+                      filterX.weights.data() + (size_t)x * filterX.taps, filterX.taps, texel);
+          finishTexel(content, texel);
+          for (int c = 0; c < numChannels; ++c)
+            pixel[c] = encodeChannel(content, srgb, texel[c], c);
+        }
+      }
+    });
+
+    // The next level is reduced from this one
+    level += (size_t)dstWidth * dstHeight * numChannels;
+    source.swap(destination);
+    srcWidth = dstWidth;
+    srcHeight = dstHeight;
+  }
+  return true;
+}
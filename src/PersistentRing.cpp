@@ -0,0 +1,104 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <PersistentRing.h>
+
+#include <cstdio>
+
+PersistentRing::PersistentRing() :
+  _buffer(0),
+  _data(nullptr),
+  _frameSize(0),
+  _current(0),
+  _used(0),
+  _fences{nullptr}
+{
+}
+
+PersistentRing::~PersistentRing()
+{
+  // Release resources used by the driver
+  Release();
+}
+
+bool PersistentRing::Init(size_t frameSize)
+{
+  Release();
+
+  // Regions are bound as uniform and storage buffer ranges, keep their starts aligned
+  GLint uniformAlignment = 0, storageAlignment = 0;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+  glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+  const size_t alignment = (size_t)(uniformAlignment > storageAlignment ? uniformAlignment : storageAlignment);
+  _frameSize = (frameSize + alignment - 1) / alignment * alignment;
+
+  const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  glCreateBuffers(1, &_buffer);
+  glNamedBufferStorage(_buffer, _frameSize * FRAMES, nullptr, flags);
+  _data = static_cast<unsigned char*>(glMapNamedBufferRange(_buffer, 0, _frameSize * FRAMES, flags));
+  if (!_data)
+  {
+    printf("Failed to map the persistent buffer of %u bytes\n", (unsigned int)(_frameSize * FRAMES));
+    Release();
+    return false;
+  }
+
+  _current = 0;
+  _used = 0;
+  return true;
+}
+
+void PersistentRing::Release()
+{
+  for (GLsync& fence : _fences)
+  {
+    if (fence)
+      glDeleteSync(fence);
+    fence = nullptr;
+  }
+
+  if (_buffer)
+  {
+    if (_data)
+      glUnmapNamedBuffer(_buffer);
+    glDeleteBuffers(1, &_buffer);
+  }
+
+  _buffer = 0;
+  _data = nullptr;
+}
+
+void PersistentRing::BeginFrame()
+{
+  _current = (_current + 1) % FRAMES;
+  _used = 0;
+
+  // The GPU is at most FRAMES frames behind, usually the fence has long been signaled
+  GLsync& fence = _fences[_current];
+  if (fence)
+  {
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+      ;
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+}
+
+void PersistentRing::EndFrame()
+{
+  if (_buffer)
+    _fences[_current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void* PersistentRing::Allocate(size_t size, size_t alignment, GLintptr& offset)
+{
+  const size_t start = (_used + alignment - 1) / alignment * alignment;
+  if (!_data || start + size > _frameSize)
+    return nullptr;
+
+  _used = start + size;
+  offset = GetFrameOffset() + (GLintptr)start;
+  return _data + offset;
+}
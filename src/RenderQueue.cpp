@@ -0,0 +1,165 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <RenderQueue.h>
+#include <GLStateCache.h>
+#include <PersistentRing.h>
+
+#include <cstdio>
+#include <cstring>
+
+uint64_t RenderQueue::MakeKey(unsigned int stage, unsigned int program, unsigned int textureSet, float depth, bool backToFront)
+{
+  // Bits of a non-negative float compare the same way as the float itself
+  uint32_t depthBits = 0;
+  if (depth > 0.0f)
+    memcpy(&depthBits, &depth, sizeof(depthBits));
+  if (backToFront)
+    depthBits = ~depthBits;
+
+  return (uint64_t)(stage & 0xff) << 56 | (uint64_t)(program & 0xff) << 48 |
+         (uint64_t)(textureSet & 0xffff) << 32 | depthBits;
+}
+
+void RenderQueue::RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& order,
+                            std::vector<uint64_t>& scratchKeys, std::vector<uint32_t>& scratchOrder)
+{
+  const size_t count = keys.size();
+  scratchKeys.resize(count);
+  scratchOrder.resize(count);
+
+  for (int shift = 0; shift < 64; shift += 8)
+  {
+    size_t offsets[256] = {0};
+    for (size_t i = 0; i < count; ++i)
+      ++offsets[(keys[i] >> shift) & 0xff];
+
+    // All keys share the byte, this pass wouldn't move anything
+    if (offsets[(keys[0] >> shift) & 0xff] == count)
+      continue;
+
+    size_t sum = 0;
+    for (int i = 0; i < 256; ++i)
+    {
+      const size_t bucket = offsets[i];
+      offsets[i] = sum;
+      sum += bucket;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      const size_t dst = offsets[(keys[i] >> shift) & 0xff]++;
+      scratchKeys[dst] = keys[i];
+      scratchOrder[dst] = order[i];
+    }
+
+    keys.swap(scratchKeys);
+    order.swap(scratchOrder);
+  }
+}
+
+bool RenderQueue::SameState(const DrawPacket& a, const DrawPacket& b)
+{
+  return (a.key >> 56) == (b.key >> 56) && a.program == b.program && a.vao == b.vao && a.indexType == b.indexType &&
+         a.texture == b.texture && a.sampler == b.sampler;
+}
+
+void RenderQueue::Sort()
+{
+  const size_t count = _packets.size();
+  _keys.resize(count);
+  _order.resize(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    _keys[i] = _packets[i].key;
+    _order[i] = (uint32_t)i;
+  }
+
+  if (count > 1)
+    RadixSort(_keys, _order, _scratchKeys, _scratchOrder);
+}
+
+void RenderQueue::Submit(GLStateCache& state, PersistentRing& instances, PersistentRing& commands, StageCallback onStage)
+{
+  const size_t count = _order.size();
+  if (count == 0)
+    return;
+
+  // Instances are written in the sorted order so that the instances of a command follow each other
+  GLintptr instanceOffset = 0, commandOffset = 0;
+  InstanceData* instanceData = static_cast<InstanceData*>(instances.Allocate(count * sizeof(InstanceData), sizeof(InstanceData), instanceOffset));
+  DrawElementsIndirectCommand* commandData = static_cast<DrawElementsIndirectCommand*>(
+    commands.Allocate(count * sizeof(DrawElementsIndirectCommand), sizeof(GLuint), commandOffset));
+  if (!instanceData || !commandData)
+  {
+    printf("Too many draws in a frame!\n");
+    return;
+  }
+
+  _draws += count;
+  const GLuint firstInstance = (GLuint)((instanceOffset - instances.GetFrameOffset()) / sizeof(InstanceData));
+  unsigned int stage = ~0u;
+  size_t commandCount = 0;
+  for (size_t first = 0; first < count;)
+  {
+    const DrawPacket& packet = _packets[_order[first]];
+    const unsigned int packetStage = (unsigned int)(packet.key >> 56);
+    if (packetStage != stage)
+    {
+      stage = packetStage;
+      if (onStage)
+        onStage(stage);
+    }
+
+    // Gather the draws sharing the state, the same mesh drawn repeatedly becomes instances of
+    // one command. The mapping is write only, the command is finished locally first
+    const size_t firstCommand = commandCount;
+    DrawElementsIndirectCommand command = {};
+    size_t last = first;
+    for (; last < count && SameState(packet, _packets[_order[last]]); ++last)
+    {
+      const DrawPacket& draw = _packets[_order[last]];
+      instanceData[last] = draw.instance;
+
+      if (command.instanceCount > 0 && command.count == (GLuint)draw.indexCount && command.firstIndex == draw.firstIndex &&
+          command.baseVertex == draw.baseVertex)
+      {
+        ++command.instanceCount;
+        continue;
+      }
+
+      if (command.instanceCount > 0)
+        commandData[commandCount++] = command;
+      command.count = (GLuint)draw.indexCount;
+      command.instanceCount = 1;
+      command.firstIndex = draw.firstIndex;
+      command.baseVertex = draw.baseVertex;
+      command.baseInstance = firstInstance + (GLuint)last;
+    }
+    commandData[commandCount++] = command;
+
+    state.UseProgram(packet.program);
+    if (packet.texture)
+    {
+      state.BindTexture(0, packet.texture);
+      state.BindSampler(0, packet.sampler);
+    }
+    state.BindVertexArray(packet.vao);
+    const GLintptr offset = commandOffset + (GLintptr)(firstCommand * sizeof(DrawElementsIndirectCommand));
+    glMultiDrawElementsIndirect(GL_TRIANGLES, packet.indexType, reinterpret_cast<void*>(offset),
+                                (GLsizei)(commandCount - firstCommand), 0);
+    ++_drawCalls;
+
+    first = last;
+  }
+}
+
+void RenderQueue::PrintCounters(int frames) const
+{
+  if (frames <= 0)
+    frames = 1;
+
+  printf("Queued draws per frame: %.1f in %.1f draw calls\n", (double)_draws / frames, (double)_drawCalls / frames);
+}
@@ -0,0 +1,241 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <RenderTargetPool.h>
+
+#include <cstdio>
+
+RenderTargetPool::~RenderTargetPool()
+{
+  Clear();
+}
+
+void RenderTargetPool::BeginFrame()
+{
+  ++_frame;
+
+  // Free targets nobody asked for recently, e.g. the old size after a resize
+  for (size_t i = 0; i < _entries.size();)
+  {
+    const Entry& entry = _entries[i];
+    if (!entry.inUse && _frame - entry.lastUsed > MAX_UNUSED_FRAMES)
+    {
+      Free(entry);
+      _entries[i] = _entries.back();
+      _entries.pop_back();
+    }
+    else
+      ++i;
+  }
+}
+
+FrameBuffer RenderTargetPool::Acquire(const RenderTargetDesc& desc)
+{
+  // Reuse a free target with the same description
+  for (Entry& entry : _entries)
+  {
+    if (!entry.inUse && entry.desc == desc)
+    {
+      entry.inUse = true;
+      entry.lastUsed = _frame;
+      return entry.target;
+    }
+  }
+
+  Entry entry = {};
+  entry.desc = desc;
+  entry.target = Allocate(desc);
+  if (desc.layers > 0)
+    AllocateLayers(entry);
+  entry.bytes = (size_t)desc.width * desc.height * (desc.layers > 0 ? desc.layers : 1) *
+                (GetPixelSize(desc.colorFormat) + GetPixelSize(desc.depthFormat));
+  entry.lastUsed = _frame;
+  entry.inUse = true;
+  _entries.push_back(entry);
+
+  return entry.target;
+}
+
+void RenderTargetPool::Release(const FrameBuffer& target)
+{
+  for (Entry& entry : _entries)
+  {
+    if (entry.target.handle == target.handle)
+    {
+      entry.inUse = false;
+      return;
+    }
+  }
+}
+
+FrameBuffer RenderTargetPool::GetLayer(const FrameBuffer& target, int layer) const
+{
+  for (const Entry& entry : _entries)
+  {
+    if (entry.target.handle == target.handle && layer >= 0 && layer < entry.desc.layers)
+      return entry.layers[layer];
+  }
+  return {};
+}
+
+void RenderTargetPool::Clear()
+{
+  for (const Entry& entry : _entries)
+    Free(entry);
+  _entries.clear();
+}
+
+size_t RenderTargetPool::GetMemoryUsage() const
+{
+  size_t bytes = 0;
+  for (const Entry& entry : _entries)
+    bytes += entry.bytes;
+  return bytes;
+}
+
+void RenderTargetPool::PrintMemoryUsage() const
+{
+  for (const Entry& entry : _entries)
+  {
+    printf("Render target %u: %dx%dx%d, color 0x%04X, depth 0x%04X%s, %.2f MB\n", entry.target.handle,
+           entry.desc.width, entry.desc.height, entry.desc.layers > 0 ? entry.desc.layers : 1, entry.desc.colorFormat,
+           entry.desc.depthFormat, entry.desc.sampledDepth ? " (sampled)" : "", entry.bytes / (1024.0 * 1024.0));
+  }
+  printf("Render targets total: %.2f MB\n", GetMemoryUsage() / (1024.0 * 1024.0));
+}
+
+FrameBuffer RenderTargetPool::Allocate(const RenderTargetDesc& desc)
+{
+  // Objects are created with direct state access so that allocating a target in the
+  // middle of a frame doesn't disturb any bindings
+  GLuint handle = 0;
+  glCreateFramebuffers(1, &handle);
+
+  // --------------------------------------------------------------------------
+  // Render target texture:
+  // --------------------------------------------------------------------------
+
+  // layered targets are attached as a whole, the geometry shader selects the layer
+  const bool layered = desc.layers > 0;
+  const GLenum target = layered ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+
+  GLuint renderTarget = 0;
+  glCreateTextures(target, 1, &renderTarget);
+  if (layered)
+    glTextureStorage3D(renderTarget, 1, desc.colorFormat, desc.width, desc.height, desc.layers);
+  else
+    glTextureStorage2D(renderTarget, 1, desc.colorFormat, desc.width, desc.height);
+  glTextureParameteri(renderTarget, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTextureParameteri(renderTarget, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glNamedFramebufferTexture(handle, GL_COLOR_ATTACHMENT0, renderTarget, 0);
+
+  // --------------------------------------------------------------------------
+  // Depth (stencil) attachment:
+  // --------------------------------------------------------------------------
+
+  const bool hasStencil = desc.depthFormat == GL_DEPTH24_STENCIL8 || desc.depthFormat == GL_DEPTH32F_STENCIL8;
+  const GLenum attachment = hasStencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+
+  GLuint depthStencil = 0;
+  if (desc.sampledDepth || layered)
+  {
+    // we intend to sample the depth buffer -> it has to be a texture
+    glCreateTextures(target, 1, &depthStencil);
+    if (layered)
+      glTextureStorage3D(depthStencil, 1, desc.depthFormat, desc.width, desc.height, desc.layers);
+    else
+      glTextureStorage2D(depthStencil, 1, desc.depthFormat, desc.width, desc.height);
+    glTextureParameteri(depthStencil, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTextureParameteri(depthStencil, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glNamedFramebufferTexture(handle, attachment, depthStencil, 0);
+  }
+  else
+  {
+    glCreateRenderbuffers(1, &depthStencil);
+    glNamedRenderbufferStorage(depthStencil, desc.depthFormat, desc.width, desc.height);
+    glNamedFramebufferRenderbuffer(handle, attachment, GL_RENDERBUFFER, depthStencil);
+  }
+
+  // Set the list of draw buffers.
+  GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0 };
+  glNamedFramebufferDrawBuffers(handle, 1, drawBuffers);
+
+  // Check for completeness
+  GLenum status = glCheckNamedFramebufferStatus(handle, GL_FRAMEBUFFER);
+  if (status != GL_FRAMEBUFFER_COMPLETE)
+    printf("Failed to create framebuffer: 0x%04X\n", status);
+
+  return { handle, renderTarget, depthStencil };
+}
+
+void RenderTargetPool::AllocateLayers(Entry& entry)
+{
+  const RenderTargetDesc& desc = entry.desc;
+  const bool hasStencil = desc.depthFormat == GL_DEPTH24_STENCIL8 || desc.depthFormat == GL_DEPTH32F_STENCIL8;
+  const GLenum attachment = hasStencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+
+  for (int i = 0; i < desc.layers && i < MAX_RENDER_TARGET_LAYERS; ++i)
+  {
+    FrameBuffer& layer = entry.layers[i];
+
+    // Views share the storage of the arrays, they need no memory of their own
+    glGenTextures(1, &layer.color);
+    glTextureView(layer.color, GL_TEXTURE_2D, entry.target.color, desc.colorFormat, 0, 1, i, 1);
+    glGenTextures(1, &layer.depth_stencil);
+    glTextureView(layer.depth_stencil, GL_TEXTURE_2D, entry.target.depth_stencil, desc.depthFormat, 0, 1, i, 1);
+
+    glCreateFramebuffers(1, &layer.handle);
+    glNamedFramebufferTextureLayer(layer.handle, GL_COLOR_ATTACHMENT0, entry.target.color, 0, i);
+    glNamedFramebufferTextureLayer(layer.handle, attachment, entry.target.depth_stencil, 0, i);
+
+    GLenum status = glCheckNamedFramebufferStatus(layer.handle, GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+      printf("Failed to create framebuffer layer %d: 0x%04X\n", i, status);
+  }
+}
+
+void RenderTargetPool::Free(const Entry& entry)
+{
+  for (int i = 0; i < entry.desc.layers && i < MAX_RENDER_TARGET_LAYERS; ++i)
+  {
+    glDeleteFramebuffers(1, &entry.layers[i].handle);
+    glDeleteTextures(1, &entry.layers[i].color);
+    glDeleteTextures(1, &entry.layers[i].depth_stencil);
+  }
+
+  glDeleteFramebuffers(1, &entry.target.handle);
+  glDeleteTextures(1, &entry.target.color);
+  if (entry.desc.sampledDepth || entry.desc.layers > 0)
+    glDeleteTextures(1, &entry.target.depth_stencil);
+  else
+    glDeleteRenderbuffers(1, &entry.target.depth_stencil);
+}
+
+size_t RenderTargetPool::GetPixelSize(GLenum format)
+{
+  switch (format)
+  {
+  case GL_R8:                 return 1;
+  case GL_RG8:
+  case GL_R16F:
+  case GL_DEPTH_COMPONENT16:  return 2;
+  case GL_RGB8:
+  case GL_SRGB8:
+  case GL_DEPTH_COMPONENT24:  return 3;
+  case GL_RGBA8:
+  case GL_SRGB8_ALPHA8:
+  case GL_R11F_G11F_B10F:
+  case GL_RG16F:
+  case GL_R32F:
+  case GL_DEPTH_COMPONENT32F:
+  case GL_DEPTH24_STENCIL8:   return 4;
+  case GL_RGB16F:             return 6;
+  case GL_RGBA16F:
+  case GL_DEPTH32F_STENCIL8:  return 8;
+  case GL_RGB32F:             return 12;
+  case GL_RGBA32F:            return 16;
+  default:                    return 4;
+  }
+}
@@ -0,0 +1,304 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <TextureCache.h>
+#include <BlockCompression.h>
+#include <Textures.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Most layers of a baked texture array, the least GL_MAX_ARRAY_TEXTURE_LAYERS guaranteed
+static const uint32_t MAX_LAYERS = 2048;
+
+bool MappedFile::Open(const char path[])
+{
+  Close();
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  // The view keeps the file mapped after the handles are closed
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (!mapping)
+    return false;
+  void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (!data)
+    return false;
+
+  _data = static_cast<const unsigned char*>(data);
+  _size = (size_t)size.QuadPart;
+#else
+  const int file = open(path, O_RDONLY);
+  if (file < 0)
+    return false;
+
+  struct stat info;
+  if (fstat(file, &info) != 0 || info.st_size == 0)
+  {
+    close(file);
+    return false;
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  void *data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  if (data == MAP_FAILED)
+    return false;
+
+  _data = static_cast<const unsigned char*>(data);
+  _size = (size_t)info.st_size;
+#endif
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if (!_data)
+    return;
+
+#ifdef _WIN32
+  UnmapViewOfFile(_data);
+#else
+  munmap(const_cast<unsigned char*>(_data), _size);
+#endif
+  _data = nullptr;
+  _size = 0;
+}
+
+// ----------------------------------------------------------------------------
+
+uint64_t TextureCache::Hash(const unsigned char *data, size_t size, uint64_t hash)
+{
+  for (size_t i = 0; i < size; ++i)
+  {
+    hash ^= data[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+bool TextureCache::Open(const char path[], uint64_t sourceHash, MappedFile &file)
+{
+  if (!file.Open(path))
+    return false;
+
+  // Anything not matching exactly is just stale, it gets rebaked
+  const BakedTextureHeader *header = reinterpret_cast<const BakedTextureHeader*>(file.GetData());
+  const size_t tableEnd = sizeof(BakedTextureHeader) + (file.GetSize() >= sizeof(BakedTextureHeader) ? header->levels : 0) * sizeof(BakedTextureLevel);
+  bool valid = file.GetSize() >= sizeof(BakedTextureHeader) && memcmp(header->magic, "NPGT", 4) == 0 &&
+               header->version == VERSION && header->sourceHash == sourceHash && header->width > 0 &&
+               header->height > 0 && header->width <= INT_MAX && header->height <= INT_MAX &&
+               header->levels == (uint32_t)Textures::GetLevelCount((int)header->width, (int)header->height) &&
+               header->layers <= MAX_LAYERS && file.GetSize() >= tableEnd;
+  if (valid)
+  {
+    // The levels have to form the chain the storage is allocated for, with the sizes the
+    // uploads will read
+    const BakedTextureLevel *levels = reinterpret_cast<const BakedTextureLevel*>(file.GetData() + sizeof(BakedTextureHeader));
+    for (uint32_t i = 0; i < header->levels && valid; ++i)
+    {
+      const uint32_t width = header->width >> i > 0 ? header->width >> i : 1;
+      const uint32_t height = header->height >> i > 0 ? header->height >> i : 1;
+      valid = levels[i].width == width && levels[i].height == height &&
+              levels[i].size == GetLevelSize(*header, width, height) * std::max(header->layers, 1u) && levels[i].size > 0 &&
+              levels[i].offset >= tableEnd && levels[i].offset <= file.GetSize() &&
+              levels[i].size <= file.GetSize() - levels[i].offset;
+    }
+  }
+
+  if (!valid)
+    file.Close();
+  return valid;
+}
+
+uint64_t TextureCache::GetLevelSize(const BakedTextureHeader &header, uint32_t width, uint32_t height)
+{
+  // Compressed levels are made of whole blocks
+  if (header.format == GL_NONE)
+  {
+    const BlockFormat blockFormats[] = {BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC4, BlockFormat::BC5, BlockFormat::BC7};
+    for (BlockFormat blockFormat : blockFormats)
+    {
+      if (BlockEncoder::GetInternalFormat(blockFormat, false) == header.internalFormat ||
+          BlockEncoder::GetInternalFormat(blockFormat, true) == header.internalFormat)
+        return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * BlockEncoder::GetBlockSize(blockFormat);
+    }
+    return 0;
+  }
+
+  if (header.type != GL_UNSIGNED_BYTE && header.type != GL_FLOAT)
+    return 0;
+
+  uint64_t components = 0;
+  switch (header.format) {
+      case GL_RED:
+          components = 1;
+          break;
+      case GL_RG:
+          components = 2;
+          break;
+      case GL_RGB:
+          components = 3;
+          break;
+      case GL_RGBA:
+          components = 4;
+          break;
+  }
+  return (uint64_t)width * height * components * (header.type == GL_UNSIGNED_BYTE ? 1 : 4);
+}
+
+bool TextureCache::Upload(const MappedFile &file, GLuint texture)
+{
+  if (!file.IsOpen())
+    return false;
+
+  const BakedTextureHeader *header = reinterpret_cast<const BakedTextureHeader*>(file.GetData());
+  const BakedTextureLevel *levels = reinterpret_cast<const BakedTextureLevel*>(file.GetData() + sizeof(BakedTextureHeader));
+
+  // The storage is allocated once for all levels, no reallocation and no completeness checks
+  const GLsizei layers = (GLsizei)header->layers;
+  if (layers > 0)
+    glTextureStorage3D(texture, (GLsizei)header->levels, header->internalFormat, (GLsizei)header->width, (GLsizei)header->height, layers);
+  else
+    glTextureStorage2D(texture, (GLsizei)header->levels, header->internalFormat, (GLsizei)header->width, (GLsizei)header->height);
+  Textures::SetGreySwizzle(texture, header->internalFormat);
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (uint32_t i = 0; i < header->levels; ++i)
+  {
+    const void *data = file.GetData() + levels[i].offset;
+    const GLsizei width = (GLsizei)levels[i].width, height = (GLsizei)levels[i].height;
+    if (header->format == GL_NONE && layers > 0)
+      glCompressedTextureSubImage3D(texture, (GLint)i, 0, 0, 0, width, height, layers, header->internalFormat,
+                                    (GLsizei)levels[i].size, data);
+    else if (header->format == GL_NONE)
+      glCompressedTextureSubImage2D(texture, (GLint)i, 0, 0, width, height, header->internalFormat, (GLsizei)levels[i].size, data);
+    else if (layers > 0)
+      glTextureSubImage3D(texture, (GLint)i, 0, 0, 0, width, height, layers, header->format, header->type, data);
+    else
+      glTextureSubImage2D(texture, (GLint)i, 0, 0, width, height, header->format, header->type, data);
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  return true;
+}
+
+bool TextureCache::Bake(GLuint texture, GLenum internalFormat, GLenum format, GLenum type, uint64_t sourceHash, const char path[])
+{
+  GLint target = GL_TEXTURE_2D, width = 0, height = 0, layers = 0, compressed = GL_FALSE;
+  glGetTextureParameteriv(texture, GL_TEXTURE_TARGET, &target);
+  glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_WIDTH, &width);
+  glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_HEIGHT, &height);
+  glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_COMPRESSED, &compressed);
+  if (target == GL_TEXTURE_2D_ARRAY)
+    glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_DEPTH, &layers);
+  if (width <= 0 || height <= 0 || (target == GL_TEXTURE_2D_ARRAY && (layers <= 0 || (uint32_t)layers > MAX_LAYERS)))
+    return false;
+
+  // Full chain down to 1x1
+  uint32_t levelCount = 1;
+  while ((width >> levelCount) > 0 || (height >> levelCount) > 0)
+    ++levelCount;
+
+  BakedTextureHeader header;
+  memcpy(header.magic, "NPGT", 4);
+  header.version = VERSION;
+  header.sourceHash = sourceHash;
+  header.width = (uint32_t)width;
+  header.height = (uint32_t)height;
+  header.levels = levelCount;
+  header.layers = (uint32_t)layers;
+  header.internalFormat = internalFormat;
+  header.format = compressed ? GL_NONE : format;
+  header.type = compressed ? GL_NONE : type;
+
+  // Read the levels back one after another into a single image of the file contents
+  std::vector<BakedTextureLevel> levels(levelCount);
+  std::vector<unsigned char> data;
+  size_t offset = sizeof(BakedTextureHeader) + levelCount * sizeof(BakedTextureLevel);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  for (uint32_t i = 0; i < levelCount; ++i)
+  {
+    GLint levelWidth = 0, levelHeight = 0, size = 0;
+    glGetTextureLevelParameteriv(texture, (GLint)i, GL_TEXTURE_WIDTH, &levelWidth);
+    glGetTextureLevelParameteriv(texture, (GLint)i, GL_TEXTURE_HEIGHT, &levelHeight);
+    if (compressed)
+      glGetTextureLevelParameteriv(texture, (GLint)i, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+    else
+      size = (GLint)(GetLevelSize(header, (uint32_t)levelWidth, (uint32_t)levelHeight) * std::max(layers, 1));
+    if (size <= 0)
+    {
+      glPixelStorei(GL_PACK_ALIGNMENT, 4);
+      printf("Unsupported format of the baked texture: %s\n", path);
+      return false;
+    }
+
+    levels[i].offset = offset;
+    levels[i].size = (uint64_t)size;
+    levels[i].width = (uint32_t)levelWidth;
+    levels[i].height = (uint32_t)levelHeight;
+
+    data.resize(data.size() + size);
+    unsigned char *levelData = data.data() + data.size() - size;
+    if (compressed)
+      glGetCompressedTextureImage(texture, (GLint)i, size, levelData);
+    else
+      glGetTextureImage(texture, (GLint)i, format, type, size, levelData);
+    offset += (size_t)size;
+  }
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+  // Written under a temporary name first so that a crash never leaves a broken file behind
+  const std::string tempPath = std::string(path) + ".tmp";
+  FILE *file = fopen(tempPath.c_str(), "wb");
+  if (!file)
+  {
+    printf("Failed to write the baked texture: %s\n", path);
+    return false;
+  }
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(levels.data(), sizeof(BakedTextureLevel), levels.size(), file) == levels.size() &&
+                 fwrite(data.data(), 1, data.size(), file) == data.size();
+  written = fclose(file) == 0 && written;
+
+  remove(path);
+  if (!written || rename(tempPath.c_str(), path) != 0)
+  {
+    printf("Failed to write the baked texture: %s\n", path);
+    remove(tempPath.c_str());
+    return false;
+  }
+
+  if (layers > 0)
+    printf("Baked %s: %dx%d, %d layers, %u levels, %u KB\n", path, width, height, layers, levelCount, (unsigned int)((offset + 1023) / 1024));
+  else
+    printf("Baked %s: %dx%d, %u levels, %u KB\n", path, width, height, levelCount, (unsigned int)((offset + 1023) / 1024));
+  return true;
+}
@@ -0,0 +1,332 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <TextureLoader.h>
+#include <Textures.h>
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <stb/stb_image.h>
+
+// Reads the whole file, returns false if it can't be read
+static bool readFile(const char path[], std::vector<unsigned char> &data)
+{
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return false;
+
+  fseek(file, 0, SEEK_END);
+  const long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  data.resize(size > 0 ? (size_t)size : 0);
+  const bool read = size > 0 && fread(data.data(), 1, data.size(), file) == data.size();
+  fclose(file);
+  return read;
+}
+
+TextureLoader::TextureLoader() :
+  _threadPool(nullptr),
+  _state(nullptr),
+  _useCache(true),
+  _quality(BlockQuality::Normal),
+  _mipFilter(MipGenerator::DEFAULT_FILTER),
+  _staging(0),
+  _stagingData(nullptr),
+  _stagingSize(0),
+  _stagingUsed(0)
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+  // The staging buffer has to be freed by Release() while the context exists
+}
+
+void TextureLoader::Release()
+{
+  // The workers write into the requests, they have to be done before they're freed
+  while (!_pending.empty())
+  {
+    std::vector<Request*> decoded;
+    {
+      std::lock_guard<std::mutex> lock(_decodedMutex);
+      decoded.swap(_decoded);
+    }
+    for (Request *request : decoded)
+    {
+      _pending.erase(std::find(_pending.begin(), _pending.end(), request));
+      stbi_image_free(request->data);
+      // The mapping of the baked file is closed with the request
+      delete request;
+    }
+
+    if (!_pending.empty() && !(_threadPool && _threadPool->RunPending()))
+      std::this_thread::yield();
+  }
+
+  glDeleteBuffers(1, &_staging);
+  _staging = 0;
+  _stagingData = nullptr;
+  _stagingSize = 0;
+  _stagingUsed = 0;
+}
+
+GLuint TextureLoader::Load(const char name[], bool sRGB, const glm::vec3 &placeholder, BlockFormat compression, bool normalMap)
+{
+  const GLuint texture = Textures::CreateSingleColorTexture(*_state, (unsigned char)(placeholder.x * 255.0f + 0.5f),
+                                                            (unsigned char)(placeholder.y * 255.0f + 0.5f),
+                                                            (unsigned char)(placeholder.z * 255.0f + 0.5f));
+
+  Request *request = new Request();
+  request->texture = texture;
+  request->name = name;
+  request->sRGB = sRGB;
+  request->useCache = _useCache;
+  request->compression = compression;
+  request->quality = _quality;
+  request->mipFilter = _mipFilter;
+  request->mipContent = normalMap ? MipContent::Normal : sRGB ? MipContent::SRGB : MipContent::Linear;
+  request->data = nullptr;
+  request->width = request->height = request->numChannels = 0;
+  request->sourceHash = 0;
+  _pending.push_back(request);
+
+  // Without a pool the image is decoded right here
+  if (_threadPool)
+    _threadPool->Enqueue([this, request]() { Decode(request); });
+  else
+    Decode(request);
+
+  return texture;
+}
+
+void TextureLoader::Decode(Request *request)
+{
+  // stb_image keeps no state between the calls, the images can be decoded concurrently.
+  // The source is read first to find out whether the baked file is up to date
+  std::vector<unsigned char> source;
+  if (readFile(request->name.c_str(), source))
+  {
+    if (request->useCache)
+    {
+      // Baked with other settings is as stale as baked from another image
+      const uint32_t settings[4] = {(uint32_t)request->compression, (uint32_t)request->quality,
+                                    (uint32_t)request->mipFilter, (uint32_t)request->mipContent};
+      request->sourceHash = TextureCache::Hash(reinterpret_cast<const unsigned char*>(settings), sizeof(settings),
+                                               TextureCache::Hash(source.data(), source.size()));
+      TextureCache::Open(TextureCache::GetBakedPath(request->name.c_str()).c_str(), request->sourceHash, request->baked);
+    }
+
+    if (!request->baked.IsOpen())
+    {
+      // sRGB grey images get expanded
+      int fileChannels = 0;
+      stbi_info_from_memory(source.data(), (int)source.size(), &request->width, &request->height, &fileChannels);
+      const int channels = Textures::GetDecodedChannels(fileChannels, request->sRGB);
+      request->data = stbi_load_from_memory(source.data(), (int)source.size(), &request->width, &request->height,
+                                            &request->numChannels, channels);
+      if (channels > 0)
+        request->numChannels = channels;
+
+      // The mips are filtered right here too, the rows of the levels on the other workers
+      if (request->data && request->mipFilter != MipFilter::Driver)
+      {
+        request->mips.resize(MipGenerator::GetChainSize(request->width, request->height, request->numChannels));
+        MipGenerator::Generate(request->mipFilter, request->mipContent, request->data, request->width, request->height,
+                               request->numChannels, request->mips.data(), _threadPool);
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(_decodedMutex);
+  _decoded.push_back(request);
+}
+
+int TextureLoader::Update()
+{
+  std::vector<Request*> decoded;
+  {
+    std::lock_guard<std::mutex> lock(_decodedMutex);
+    decoded.swap(_decoded);
+  }
+
+  for (Request *request : decoded)
+  {
+    _pending.erase(std::find(_pending.begin(), _pending.end(), request));
+    Upload(request);
+  }
+  return (int)decoded.size();
+}
+
+void TextureLoader::Wait(GLuint texture)
+{
+  // The image may still be queued behind others, help the workers instead of just waiting
+  while (IsPending(texture))
+  {
+    if (Update() == 0 && !(_threadPool && _threadPool->RunPending()))
+      std::this_thread::yield();
+  }
+}
+
+void TextureLoader::Finish()
+{
+  while (!_pending.empty())
+  {
+    if (Update() == 0 && !(_threadPool && _threadPool->RunPending()))
+      std::this_thread::yield();
+  }
+}
+
+bool TextureLoader::IsPending(GLuint texture) const
+{
+  for (const Request *request : _pending)
+  {
+    if (request->texture == texture)
+      return true;
+  }
+  return false;
+}
+
+void TextureLoader::Upload(Request *request)
+{
+  // Baked levels go straight from the mapping, the mapping is closed with the request
+  if (request->baked.IsOpen())
+  {
+    TextureCache::Upload(request->baked, request->texture);
+    Textures::PrintMemoryUsage(request->name.c_str(), request->texture);
+    delete request;
+    return;
+  }
+
+  // The texture keeps its placeholder when the file couldn't be read
+  if (!request->data)
+  {
+    printf("Failed to load texture: %s\n", request->name.c_str());
+    delete request;
+    return;
+  }
+
+  // The driver reads the image and its mips from the staging buffer, the copy returns right away
+  const size_t size = (size_t)request->width * request->height * request->numChannels;
+  size_t offset = 0;
+  if (!PrepareStaging(size + request->mips.size(), offset))
+  {
+    stbi_image_free(request->data);
+    delete request;
+    return;
+  }
+  memcpy(_stagingData + offset, request->data, size);
+  if (!request->mips.empty())
+    memcpy(_stagingData + offset + size, request->mips.data(), request->mips.size());
+  stbi_image_free(request->data);
+
+  // The placeholder is mutable and gets immutable storage of the format matching the
+  // channels for the whole mip chain. Compressed textures are encoded from a temporary
+  // one, so the placeholder only gets the storage of the blocks
+  const GLenum format = Textures::GetPixelFormat(request->numChannels);
+  const GLenum internalFormat = Textures::GetInternalFormat(request->numChannels, request->sRGB);
+  GLuint texture = request->texture;
+  if (request->compression != BlockFormat::None)
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+  glTextureStorage2D(texture, Textures::GetLevelCount(request->width, request->height), internalFormat, request->width,
+                     request->height);
+  Textures::SetGreySwizzle(texture, internalFormat);
+
+  // Upload texture data: mip level 0, offset, width, height, input format, type, offset in the buffer. Rows of the
+  // decoded images are tightly packed
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _staging);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTextureSubImage2D(texture, 0, 0, 0, request->width, request->height, format, GL_UNSIGNED_BYTE,
+                      reinterpret_cast<void*>(offset));
+
+  // The mips filtered by the worker follow level 0 in the staging buffer
+  size_t levelOffset = offset + size;
+  int levelWidth = request->width, levelHeight = request->height;
+  for (int level = 1; !request->mips.empty() && (levelWidth > 1 || levelHeight > 1); ++level)
+  {
+    levelWidth = std::max(levelWidth >> 1, 1);
+    levelHeight = std::max(levelHeight >> 1, 1);
+    glTextureSubImage2D(texture, level, 0, 0, levelWidth, levelHeight, format, GL_UNSIGNED_BYTE,
+                        reinterpret_cast<void*>(levelOffset));
+    levelOffset += (size_t)levelWidth * levelHeight * request->numChannels;
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  if (request->mips.empty())
+    glGenerateTextureMipmap(texture);
+
+  if (request->compression != BlockFormat::None)
+  {
+    const auto start = std::chrono::high_resolution_clock::now();
+    const BlockStats stats = Textures::Compress(texture, request->texture, request->compression, request->quality,
+                                                _threadPool);
+    glDeleteTextures(1, &texture);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    printf("Compressed %s: %s %s, PSNR %.2f dB, %.1f ms\n", request->name.c_str(), BlockEncoder::GetName(request->compression),
+           BlockEncoder::GetName(request->quality), stats.GetPSNR(), ms);
+  }
+  Textures::PrintMemoryUsage(request->name.c_str(), request->texture);
+
+  // The next run loads the levels generated now
+  if (request->useCache)
+  {
+    TextureCache::Bake(request->texture,
+                       request->compression != BlockFormat::None ? BlockEncoder::GetInternalFormat(request->compression, request->sRGB) : internalFormat,
+                       format, GL_UNSIGNED_BYTE, request->sourceHash, TextureCache::GetBakedPath(request->name.c_str()).c_str());
+  }
+
+  delete request;
+}
+
+bool TextureLoader::PrepareStaging(size_t size, size_t &offset)
+{
+  if (_stagingUsed + size > _stagingSize)
+  {
+    // The whole buffer is reused from the start, the uploads from it have to be done
+    if (_stagingUsed > 0)
+    {
+      GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+      while (result == GL_TIMEOUT_EXPIRED)
+        result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+      glDeleteSync(fence);
+      _stagingUsed = 0;
+    }
+
+    if (size > _stagingSize)
+    {
+      // The old buffer is only deleted once the GPU is done with it
+      size_t stagingSize = std::max(_stagingSize, MIN_STAGING);
+      while (stagingSize < size)
+        stagingSize *= 2;
+
+      glDeleteBuffers(1, &_staging);
+
+      const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glCreateBuffers(1, &_staging);
+      glNamedBufferStorage(_staging, (GLsizeiptr)stagingSize, nullptr, flags);
+      _stagingData = static_cast<unsigned char*>(glMapNamedBufferRange(_staging, 0, (GLsizeiptr)stagingSize, flags));
+      if (!_stagingData)
+      {
+        printf("Failed to map the texture staging buffer!\n");
+        glDeleteBuffers(1, &_staging);
+        _staging = 0;
+        _stagingSize = 0;
+        return false;
+      }
+      _stagingSize = stagingSize;
+    }
+  }
+
+  offset = _stagingUsed;
+  // Keep the next image aligned for fast copies
+  _stagingUsed += (size + 15) / 16 * 16;
+  return true;
+}
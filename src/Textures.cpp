@@ -4,10 +4,19 @@
  */
 
 #include <Textures.h>
+#include <GLStateCache.h>
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
+// Runs of every path of the mip benchmark, the fastest one counts
+static const int MIP_BENCHMARK_RUNS = 5;
+
 Textures::Textures() : _samplers{0}
 {
   stbi_set_flip_vertically_on_load(true);
@@ -19,20 +28,22 @@ Textures::~Textures()
   glDeleteSamplers((GLsizei)Sampler::NumSamplers, _samplers);
 }
 
+const glm::vec3 Textures::CHECKER_ODD_COLOR(0.15f, 0.15f, 0.6f);
+const glm::vec3 Textures::CHECKER_EVEN_COLOR(0.85f, 0.75f, 0.3f);
+
 Textures& Textures::GetInstance()
 {
   static Textures instance;
   return instance;
 }
 
-GLuint Textures::CreateCheckerBoardTexture(unsigned int textureSize, unsigned int checkerSize, glm::vec3 oddColor, glm::vec3 evenColor, bool sRGB)
+GLuint Textures::CreateCheckerBoardTexture(unsigned int textureSize, unsigned int checkerSize, glm::vec3 oddColor, glm::vec3 evenColor, bool sRGB,
+                                           MipFilter mipFilter, ThreadPool *threadPool)
 {
-  // Generate the texture name
+  // Create the texture object with immutable storage for the whole mip chain
   GLuint tex;
-  glGenTextures(1, &tex);
-
-  // Create the texture object (first bind call for this name)
-  glBindTexture(GL_TEXTURE_2D, tex);
+  glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+  glTextureStorage2D(tex, GetLevelCount(textureSize, textureSize), sRGB ? GL_SRGB8 : GL_RGB8, textureSize, textureSize);
 
   // Generate texture RGB data
   const int stride = 3;
@@ -53,12 +64,11 @@ GLuint Textures::CreateCheckerBoardTexture(unsigned int textureSize, unsigned in
     }
   }
 
-  // Upload texture data: 2D texture, mip level 0, internal format RGB, width, height, border, input format RGB, type, data
-  glTexImage2D(GL_TEXTURE_2D, 0, sRGB ? GL_SRGB : GL_RGB, textureSize, textureSize, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-  glGenerateMipmap(GL_TEXTURE_2D);
-
-  // Unbind the texture
-  glBindTexture(GL_TEXTURE_2D, 0);
+  // Upload texture data: 2D texture, mip level 0, offset, width, height, input format RGB, type, data
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTextureSubImage2D(tex, 0, 0, 0, textureSize, textureSize, GL_RGB, GL_UNSIGNED_BYTE, data);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  GenerateMipmaps(tex, mipFilter, sRGB ? MipContent::SRGB : MipContent::Linear, threadPool, data, stride);
 
   // Delete the temporary buffer
   delete[] data;
@@ -67,31 +77,31 @@ GLuint Textures::CreateCheckerBoardTexture(unsigned int textureSize, unsigned in
   return tex;
 }
 
-GLuint Textures::CreateSingleColorTexture(unsigned char r, unsigned char g, unsigned char b)
+GLuint Textures::CreateSingleColorTexture(GLStateCache &state, unsigned char r, unsigned char g, unsigned char b)
 {
-  // Generate the texture name
+  // Create the texture object
   GLuint tex;
-  glGenTextures(1, &tex);
+  glCreateTextures(GL_TEXTURE_2D, 1, &tex);
 
-  // Create the texture object (first bind call for this name)
-  glBindTexture(GL_TEXTURE_2D, tex);
+  // Mutable images can only be specified through a binding, the one of the active unit (0).
+  // It's bound through the cache, which keeps track of it
+  state.BindTexture(0, tex);
 
   unsigned char data[] = {r, g, b};
 
   // Upload texture data: 2D texture, mip level 0, internal format RGB, width, height, border, input format RGB, type, data
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
 
-  // Unbind the texture
-  glBindTexture(GL_TEXTURE_2D, 0);
-
   return tex;
 }
 
-GLuint Textures::LoadTexture(const char name[], bool sRGB)
+GLuint Textures::LoadTexture(const char name[], bool sRGB, MipFilter mipFilter, ThreadPool *threadPool)
 {
-  // Load stored texture on the disk
-  int width, height, numChannels;
-  unsigned char *data = stbi_load(name, &width, &height, &numChannels, 0);
+  // Load stored texture on the disk, sRGB grey images get expanded
+  int width, height, numChannels = 0;
+  stbi_info(name, &width, &height, &numChannels);
+  const int channels = GetDecodedChannels(numChannels, sRGB);
+  unsigned char *data = stbi_load(name, &width, &height, &numChannels, channels);
 
   // Early return when we failed to load the texture
   if (!data)
@@ -99,38 +109,423 @@ GLuint Textures::LoadTexture(const char name[], bool sRGB)
     printf("Failed to load texture: %s\n", name);
     return 0;
   }
+  if (channels > 0)
+    numChannels = channels;
+
+  // Immutable storage of the format matching the channels, for the whole mip chain
+  const GLenum internalFormat = GetInternalFormat(numChannels, sRGB);
+  GLuint tex;
+  glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+  glTextureStorage2D(tex, GetLevelCount(width, height), internalFormat, width, height);
+  SetGreySwizzle(tex, internalFormat);
+
+  // Upload texture data: 2D texture, mip level 0, offset, width, height, input format, type, data. Rows of the
+  // decoded images are tightly packed
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTextureSubImage2D(tex, 0, 0, 0, width, height, GetPixelFormat(numChannels), GL_UNSIGNED_BYTE, data);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  GenerateMipmaps(tex, mipFilter, sRGB ? MipContent::SRGB : MipContent::Linear, threadPool, data, numChannels);
+
+  // Free the image data, we don't need them anymore
+  stbi_image_free(data);
+
+  PrintMemoryUsage(name, tex);
+  return tex;
+}
+
+GLenum Textures::GetInternalFormat(int numChannels, bool sRGB)
+{
+  switch (numChannels) {
+      case 1:
+          return GL_R8;
+      case 2:
+          return GL_RG8;
+      case 4:
+          return sRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+      default:
+          return sRGB ? GL_SRGB8 : GL_RGB8;
+  }
+}
 
-  GLenum format;
+GLenum Textures::GetPixelFormat(int numChannels)
+{
   switch (numChannels) {
       case 1:
-          format = GL_RED;
-          break;
+          return GL_RED;
+      case 2:
+          return GL_RG;
       case 4:
-          format = GL_RGBA;
-          break;
+          return GL_RGBA;
       default:
-          format = GL_RGB;
-          break;
+          return GL_RGB;
   }
+}
 
-  // Generate the texture name
-  GLuint tex;
-  glGenTextures(1, &tex);
+int Textures::GetDecodedChannels(int fileChannels, bool sRGB)
+{
+  return sRGB && fileChannels > 0 && fileChannels < 3 ? fileChannels + 2 : 0;
+}
 
-  // Create the texture object (first bind call for this name)
-  glBindTexture(GL_TEXTURE_2D, tex);
+void Textures::SetGreySwizzle(GLuint texture, GLenum internalFormat)
+{
+  if (internalFormat != GL_R8 && internalFormat != GL_RG8)
+    return;
 
-  // Upload texture data: 2D texture, mip level 0, internal format RGB, width, height, border, input format RGB, type, data
-  glTexImage2D(GL_TEXTURE_2D, 0, sRGB ? GL_SRGB : GL_RGB, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-  glGenerateMipmap(GL_TEXTURE_2D);
+  const GLint swizzle[] = {GL_RED, GL_RED, GL_RED, internalFormat == GL_R8 ? GL_ONE : GL_GREEN};
+  glTextureParameteriv(texture, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+}
+
+int Textures::GetLevelCount(int width, int height)
+{
+  int levels = 1;
+  while ((std::max(width, height) >> levels) > 0)
+    ++levels;
+  return levels;
+}
+
+// Returns the number of levels the texture has storage for
+static int getTextureLevels(GLuint texture)
+{
+  GLint immutable = GL_FALSE, levels = 0;
+  glGetTextureParameteriv(texture, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
+  if (immutable)
+  {
+    glGetTextureParameteriv(texture, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+    return levels;
+  }
+
+  // Mutable textures have as many levels as were specified, up to the full chain
+  GLint width = 0, height = 0;
+  glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_WIDTH, &width);
+  glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_HEIGHT, &height);
+  const int maxLevels = width > 0 ? Textures::GetLevelCount(width, height) : 0;
+  while (levels < maxLevels)
+  {
+    glGetTextureLevelParameteriv(texture, levels, GL_TEXTURE_WIDTH, &width);
+    if (width == 0)
+      break;
+    ++levels;
+  }
+  return levels;
+}
+
+// Returns a printable name of the internal format
+static const char *getFormatName(GLenum internalFormat)
+{
+  switch (internalFormat) {
+      case GL_R8:
+          return "R8";
+      case GL_RG8:
+          return "RG8";
+      case GL_RGB8:
+          return "RGB8";
+      case GL_SRGB8:
+          return "SRGB8";
+      case GL_RGBA8:
+          return "RGBA8";
+      case GL_SRGB8_ALPHA8:
+          return "SRGB8_ALPHA8";
+      case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+          return "BC1";
+      case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+          return "BC3";
+      case GL_COMPRESSED_RED_RGTC1:
+          return "BC4";
+      case GL_COMPRESSED_RG_RGTC2:
+          return "BC5";
+      case GL_COMPRESSED_RGBA_BPTC_UNORM:
+          return "BC7";
+      case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+          return "BC1_SRGB";
+      case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+          return "BC3_SRGB";
+      case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+          return "BC7_SRGB";
+      default:
+          return "other";
+  }
+}
+
+size_t Textures::GetMemoryUsage(GLuint texture)
+{
+  if (!texture)
+    return 0;
+
+  size_t bytes = 0;
+  const int levels = getTextureLevels(texture);
+  for (int level = 0; level < levels; ++level)
+  {
+    GLint width = 0, height = 0, depth = 0, compressed = GL_FALSE;
+    glGetTextureLevelParameteriv(texture, level, GL_TEXTURE_WIDTH, &width);
+    glGetTextureLevelParameteriv(texture, level, GL_TEXTURE_HEIGHT, &height);
+    glGetTextureLevelParameteriv(texture, level, GL_TEXTURE_DEPTH, &depth);
+    glGetTextureLevelParameteriv(texture, level, GL_TEXTURE_COMPRESSED, &compressed);
+    if (compressed)
+    {
+      GLint size = 0;
+      glGetTextureLevelParameteriv(texture, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+      bytes += (size_t)size;
+      continue;
+    }
+
+    // Sum of the component sizes of the internal format
+    const GLenum sizes[] = {GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE, GL_TEXTURE_ALPHA_SIZE,
+                            GL_TEXTURE_DEPTH_SIZE, GL_TEXTURE_STENCIL_SIZE};
+    GLint bits = 0;
+    for (GLenum size : sizes)
+    {
+      GLint componentBits = 0;
+      glGetTextureLevelParameteriv(texture, level, size, &componentBits);
+      bits += componentBits;
+    }
+    bytes += (size_t)width * height * std::max(depth, 1) * bits / 8;
+  }
+  return bytes;
+}
+
+void Textures::PrintMemoryUsage(const char name[], GLuint texture)
+{
+  GLint width = 0, height = 0, internalFormat = 0;
+  glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_WIDTH, &width);
+  glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_HEIGHT, &height);
+  glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+  printf("Texture %s: %dx%d %s, %d levels, %.2f MB\n", name, width, height, getFormatName((GLenum)internalFormat),
+         getTextureLevels(texture), GetMemoryUsage(texture) / (1024.0 * 1024.0));
+}
+
+void Textures::GenerateMipmaps(GLuint texture, MipFilter filter, MipContent content, ThreadPool *threadPool,
+                               const unsigned char *pixels, int numChannels)
+{
+  if (filter == MipFilter::Driver)
+  {
+    glGenerateTextureMipmap(texture);
+    return;
+  }
+
+  GLint target = GL_TEXTURE_2D, width = 0, height = 0, layers = 1;
+  glGetTextureParameteriv(texture, GL_TEXTURE_TARGET, &target);
+  glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_WIDTH, &width);
+  glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_HEIGHT, &height);
+  if (target == GL_TEXTURE_2D_ARRAY)
+    glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_DEPTH, &layers);
+
+  // Without the pixels level 0 comes back from the GPU, as RGBA whatever the format is
+  const size_t layerSize = (size_t)width * height * numChannels;
+  std::vector<unsigned char> readBack;
+  if (!pixels)
+  {
+    numChannels = 4;
+    readBack.resize((size_t)width * height * 4 * layers);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTextureImage(texture, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLsizei)readBack.size(), readBack.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    pixels = readBack.data();
+  }
+
+  // Chains of the layers one after another
+  const size_t chainSize = MipGenerator::GetChainSize(width, height, numChannels);
+  std::vector<unsigned char> levels(chainSize * layers);
+  for (int layer = 0; layer < layers; ++layer)
+  {
+    MipGenerator::Generate(filter, content, pixels + layer * layerSize, width, height, numChannels,
+                           levels.data() + layer * chainSize, threadPool);
+  }
+
+  const GLenum format = GetPixelFormat(numChannels);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (int layer = 0; layer < layers; ++layer)
+  {
+    const unsigned char *data = levels.data() + layer * chainSize;
+    for (int level = 1, levelWidth = width, levelHeight = height; levelWidth > 1 || levelHeight > 1; ++level)
+    {
+      levelWidth = std::max(levelWidth >> 1, 1);
+      levelHeight = std::max(levelHeight >> 1, 1);
+      if (target == GL_TEXTURE_2D_ARRAY)
+        glTextureSubImage3D(texture, level, 0, 0, layer, levelWidth, levelHeight, 1, format, GL_UNSIGNED_BYTE, data);
+      else
+        glTextureSubImage2D(texture, level, 0, 0, levelWidth, levelHeight, format, GL_UNSIGNED_BYTE, data);
+      data += (size_t)levelWidth * levelHeight * numChannels;
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+bool Textures::BenchmarkMipmaps(const char name[], MipContent content, ThreadPool &threadPool)
+{
+  int width, height, numChannels = 0;
+  stbi_info(name, &width, &height, &numChannels);
+  const int channels = GetDecodedChannels(numChannels, content == MipContent::SRGB);
+  unsigned char *data = stbi_load(name, &width, &height, &numChannels, channels);
+  if (!data)
+  {
+    printf("Failed to load texture: %s\n", name);
+    return false;
+  }
+  if (channels > 0)
+    numChannels = channels;
+
+  const GLenum internalFormat = GetInternalFormat(numChannels, content == MipContent::SRGB);
+  const int levels = GetLevelCount(width, height);
+  printf("Mipmaps of %s: %dx%d %s, %d levels, best of %d runs\n", name, width, height, getFormatName(internalFormat),
+         levels, MIP_BENCHMARK_RUNS);
+
+  typedef std::chrono::high_resolution_clock Clock;
+  const auto elapsed = [](Clock::time_point start) { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); };
+
+  // The driver is timed from the call until the GPU is done, level 0 is uploaded and
+  // finished before
+  double driverMs = 1.0e30;
+  for (int run = 0; run < MIP_BENCHMARK_RUNS; ++run)
+  {
+    GLuint tex;
+    glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+    glTextureStorage2D(tex, levels, internalFormat, width, height);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTextureSubImage2D(tex, 0, 0, 0, width, height, GetPixelFormat(numChannels), GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glFinish();
+
+    const Clock::time_point start = Clock::now();
+    glGenerateTextureMipmap(tex);
+    glFinish();
+    driverMs = std::min(driverMs, elapsed(start));
+    glDeleteTextures(1, &tex);
+  }
+  printf("  %-8s %8.2f ms on the GPU\n", MipGenerator::GetName(MipFilter::Driver), driverMs);
+
+  // The CPU filters on one thread and on the whole pool, and the upload of their levels
+  std::vector<unsigned char> chain(MipGenerator::GetChainSize(width, height, numChannels));
+  for (int filter = (int)MipFilter::Box; filter <= (int)MipFilter::Lanczos; ++filter)
+  {
+    double singleMs = 1.0e30, poolMs = 1.0e30, uploadMs = 1.0e30;
+    for (int run = 0; run < MIP_BENCHMARK_RUNS; ++run)
+    {
+      Clock::time_point start = Clock::now();
+      MipGenerator::Generate((MipFilter)filter, content, data, width, height, numChannels, chain.data(), nullptr);
+      singleMs = std::min(singleMs, elapsed(start));
+
+      start = Clock::now();
+      MipGenerator::Generate((MipFilter)filter, content, data, width, height, numChannels, chain.data(), &threadPool);
+      poolMs = std::min(poolMs, elapsed(start));
+
+      GLuint tex;
+      glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+      glTextureStorage2D(tex, levels, internalFormat, width, height);
+      glFinish();
+      start = Clock::now();
+      const unsigned char *level = chain.data();
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      for (int i = 1; i < levels; ++i)
+      {
+        const int levelWidth = std::max(width >> i, 1), levelHeight = std::max(height >> i, 1);
+        glTextureSubImage2D(tex, i, 0, 0, levelWidth, levelHeight, GetPixelFormat(numChannels), GL_UNSIGNED_BYTE, level);
+        level += (size_t)levelWidth * levelHeight * numChannels;
+      }
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      glFinish();
+      uploadMs = std::min(uploadMs, elapsed(start));
+      glDeleteTextures(1, &tex);
+    }
+    printf("  %-8s %8.2f ms on %u threads, %.2f ms on one, upload %.2f ms\n", MipGenerator::GetName((MipFilter)filter),
+           poolMs, threadPool.GetWorkerCount() + 1, singleMs, uploadMs);
+  }
 
-  // Free the image data, we don't need them anymore
   stbi_image_free(data);
+  return true;
+}
+
+void Textures::CopyToLayer(GLStateCache &state, GLuint texture, GLuint array, int layer, int x, int y, int width, int height)
+{
+  GLint srcWidth = 0, srcHeight = 0;
+  glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_WIDTH, &srcWidth);
+  glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_HEIGHT, &srcHeight);
+
+  // Copy through a framebuffer blit, it rescales and converts the format on the way. With
+  // sRGB framebuffer enabled sRGB textures are decoded and sRGB arrays encoded again, any
+  // texture keeps the values it's sampled as
+  GLuint fbos[2];
+  glCreateFramebuffers(2, fbos);
+  glNamedFramebufferTexture(fbos[0], GL_COLOR_ATTACHMENT0, texture, 0);
+  glNamedFramebufferTextureLayer(fbos[1], GL_COLOR_ATTACHMENT0, array, 0, layer);
+
+  const bool framebufferSRGB = state.IsEnabled(GL_FRAMEBUFFER_SRGB);
+  state.Enable(GL_FRAMEBUFFER_SRGB);
+  // Whole multiples are magnified by pixel replication so that sharp textures stay sharp
+  const bool replicate = width % srcWidth == 0 && height % srcHeight == 0;
+  glBlitNamedFramebuffer(fbos[0], fbos[1], 0, 0, srcWidth, srcHeight, x, y, x + width, y + height, GL_COLOR_BUFFER_BIT,
+                         replicate ? GL_NEAREST : GL_LINEAR);
+  if (!framebufferSRGB)
+    state.Disable(GL_FRAMEBUFFER_SRGB);
+
+  glDeleteFramebuffers(2, fbos);
+}
 
-  // Unbind the texture
-  glBindTexture(GL_TEXTURE_2D, 0);
+BlockStats Textures::Compress(GLuint source, GLuint destination, BlockFormat format, BlockQuality quality,
+                              ThreadPool *threadPool, std::vector<BlockStats> *blockStats)
+{
+  GLint target = GL_TEXTURE_2D, width = 0, height = 0, layers = 1, sourceFormat = GL_RGBA8;
+  glGetTextureParameteriv(source, GL_TEXTURE_TARGET, &target);
+  glGetTextureLevelParameteriv(source, 0, GL_TEXTURE_WIDTH, &width);
+  glGetTextureLevelParameteriv(source, 0, GL_TEXTURE_HEIGHT, &height);
+  glGetTextureLevelParameteriv(source, 0, GL_TEXTURE_INTERNAL_FORMAT, &sourceFormat);
+  const bool sRGB = sourceFormat == GL_SRGB8 || sourceFormat == GL_SRGB8_ALPHA8;
+  // The read back ignores the swizzle, the grey the texture is sampled as is rebuilt
+  const bool expandGrey = BlockEncoder::IsColor(format) && (sourceFormat == GL_R8 || sourceFormat == GL_RG8);
+  if (target == GL_TEXTURE_2D_ARRAY)
+    glGetTextureLevelParameteriv(source, 0, GL_TEXTURE_DEPTH, &layers);
+
+  const int levels = GetLevelCount(width, height);
+
+  // All levels are encoded before the destination storage replaces them, the source
+  // may be the destination
+  BlockStats stats;
+  std::vector<std::vector<unsigned char>> blocks(levels);
+  std::vector<unsigned char> pixels;
+  for (int level = 0; level < levels; ++level)
+  {
+    const int levelWidth = std::max(width >> level, 1), levelHeight = std::max(height >> level, 1);
+    const size_t layerSize = (size_t)levelWidth * levelHeight * 4;
+    const size_t layerBlocks = BlockEncoder::GetImageSize(format, levelWidth, levelHeight);
+    pixels.resize(layerSize * layers);
+    blocks[level].resize(layerBlocks * layers);
+    glGetTextureImage(source, level, GL_RGBA, GL_UNSIGNED_BYTE, (GLsizei)pixels.size(), pixels.data());
+    if (expandGrey)
+    {
+      for (size_t i = 0; i < pixels.size(); i += 4)
+      {
+        pixels[i + 3] = sourceFormat == GL_RG8 ? pixels[i + 1] : 255;
+        pixels[i + 1] = pixels[i + 2] = pixels[i];
+      }
+    }
 
-  return tex;
+    const size_t blockCount = layerBlocks / BlockEncoder::GetBlockSize(format);
+    if (level == 0 && blockStats)
+      blockStats->resize(blockCount * layers);
+    for (int layer = 0; layer < layers; ++layer)
+    {
+      BlockStats *layerStats = level == 0 && blockStats ? blockStats->data() + layer * blockCount : nullptr;
+      stats.Add(BlockEncoder::Encode(format, quality, pixels.data() + layer * layerSize, levelWidth, levelHeight,
+                                     blocks[level].data() + layer * layerBlocks, threadPool, layerStats));
+    }
+  }
+
+  const GLenum internalFormat = BlockEncoder::GetInternalFormat(format, sRGB);
+  if (target == GL_TEXTURE_2D_ARRAY)
+    glTextureStorage3D(destination, levels, internalFormat, width, height, layers);
+  else
+    glTextureStorage2D(destination, levels, internalFormat, width, height);
+  for (int level = 0; level < levels; ++level)
+  {
+    const int levelWidth = std::max(width >> level, 1), levelHeight = std::max(height >> level, 1);
+    if (target == GL_TEXTURE_2D_ARRAY)
+      glCompressedTextureSubImage3D(destination, level, 0, 0, 0, levelWidth, levelHeight, layers, internalFormat,
+                                    (GLsizei)blocks[level].size(), blocks[level].data());
+    else
+      glCompressedTextureSubImage2D(destination, level, 0, 0, levelWidth, levelHeight, internalFormat,
+                                    (GLsizei)blocks[level].size(), blocks[level].data());
+  }
+
+  return stats;
 }
 
 void Textures::CreateSamplers()
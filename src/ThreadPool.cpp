@@ -0,0 +1,154 @@
+/*
+ * Source code for the NPGR019 lab practices. Copyright Martin Kahoun 2021.
+ * Licensed under the zlib license, see LICENSE.txt in the root directory.
+ */
+
+#include <ThreadPool.h>
+
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool() : _stop(false)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+  Release();
+}
+
+void ThreadPool::Init(unsigned int workers)
+{
+  Release();
+
+  if (workers == 0)
+  {
+    const unsigned int hardware = std::thread::hardware_concurrency();
+    workers = hardware > 1 ? hardware - 1 : 0;
+  }
+
+  _stop = false;
+  _workers.reserve(workers);
+  for (unsigned int i = 0; i < workers; ++i)
+    _workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+void ThreadPool::Release()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _wake.notify_all();
+
+  for (std::thread &worker : _workers)
+    worker.join();
+  _workers.clear();
+
+  // Nobody would run them anymore
+  while (RunPending())
+    ;
+}
+
+void ThreadPool::Enqueue(std::function<void()> task)
+{
+  if (_workers.empty())
+  {
+    task();
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _tasks.push_back(std::move(task));
+  }
+  _wake.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t grain, const RangeTask &task)
+{
+  if (count == 0)
+    return;
+
+  // A few ranges per thread even out the differing costs of the items
+  if (grain == 0)
+    grain = 1;
+  const size_t maxRanges = ((size_t)_workers.size() + 1) * 4;
+  size_t ranges = (count + grain - 1) / grain;
+  if (ranges > maxRanges)
+    ranges = maxRanges;
+  if (ranges <= 1)
+  {
+    task(0, count);
+    return;
+  }
+
+  // The ranges are handed out from a counter, whoever gets to it first takes the next one.
+  // Helpers starting late find all the ranges taken and finish right away, they share the
+  // state so that the loop may return without waiting for them
+  struct Loop
+  {
+    const RangeTask *task;
+    size_t count;
+    size_t ranges;
+    std::atomic<size_t> nextRange;
+    std::atomic<size_t> doneRanges;
+  };
+  std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+  loop->task = &task;
+  loop->count = count;
+  loop->ranges = ranges;
+  loop->nextRange = 0;
+  loop->doneRanges = 0;
+  auto runRanges = [](Loop &loop)
+  {
+    for (size_t range = loop.nextRange++; range < loop.ranges; range = loop.nextRange++)
+    {
+      (*loop.task)(loop.count * range / loop.ranges, loop.count * (range + 1) / loop.ranges);
+      ++loop.doneRanges;
+    }
+  };
+
+  const size_t helpers = ranges - 1 < _workers.size() ? ranges - 1 : _workers.size();
+  for (size_t i = 0; i < helpers; ++i)
+    Enqueue([loop, runRanges]() { runRanges(*loop); });
+  runRanges(*loop);
+
+  // Only the ranges already taken by the workers are left, other queued tasks aren't run
+  // here as they may take much longer than the loop itself
+  while (loop->doneRanges.load() < ranges)
+    std::this_thread::yield();
+}
+
+void ThreadPool::WorkerLoop()
+{
+  for (;;)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _wake.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+      if (_tasks.empty())
+        return;
+
+      task = std::move(_tasks.front());
+      _tasks.pop_front();
+    }
+    task();
+  }
+}
+
+bool ThreadPool::RunPending()
+{
+  std::function<void()> task;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_tasks.empty())
+      return false;
+
+    task = std::move(_tasks.front());
+    _tasks.pop_front();
+  }
+  task();
+  return true;
+}